@@ -2,12 +2,21 @@
 entry point for the ESP32-S3. 
 in setup(), sets up WiFi, hardware peripherals, ESP32-S3 web server.
 in loop(), handle PIR interrupts and corresponding FD/FR actions.
+face detection/recognition itself runs in the vision task (vision_task.cpp).
 */
 
 #include "esp_camera.h"
 #include <WiFi.h>
 #include "hardware_control.h"
 #include "intruder_task.h"
+#include "vision_task.h"
+#include "capture_profile.h"
+#include "telemetry.h"
+#include "db_client.h"
+#include "alert_client.h"
+#include "outbox.h"
+#include "snapshot.h"
+#include "session.h"
 // Camera module
 #define CAMERA_MODEL_ESP32S3_EYE
 #include "camera_pins.h"
@@ -77,6 +86,8 @@ void setup() {
   s->set_vflip(s, 0);                      // flip it back
   s->set_brightness(s, 1);                 // up the brightness just a bit
   s->set_saturation(s, 0);                 // lower the saturation
+  // remember the config so detection can flip the sensor to raw pixels and back
+  capture_profile_init(&config);
 
   // Start Wi-Fi
   WiFi.mode(WIFI_STA);
@@ -98,6 +109,22 @@ void setup() {
     Serial.print("IP address: ");
     Serial.println(WiFi.localIP().toString()); 
   }
+  // wall clock for outbox records, SNTP keeps retrying in the background if Wi-Fi is not up yet
+  configTime(0, 0, "pool.ntp.org");
+
+  // initialize hardware, the intruder FreeRTOS task, the flash outbox, the database and snapshot uploaders, the alert connection and session recording,
+  // all before the vision pipeline and the web server can call into them
+  hardware_init();
+  intruder_task_init(); 
+  outbox_init();
+  db_client_init();
+  telemetry_init();
+  snapshot_init();
+  alert_client_init();
+  session_init();
+
+  // load enrolled faces and start the always-on detection/recognition pipeline
+  vision_task_init();
 
   // start ESP32-S3 camera web server
   startCameraServer();
@@ -112,10 +139,6 @@ void setup() {
   } else {
     Serial.println("Camera server started but no WiFi IP assigned.");
   }
-
-  // initialize hardware and the intruder FreeRTOS task
-  hardware_init();
-  intruder_task_init(); 
 }
 
 
@@ -0,0 +1,150 @@
+/*
+alert_client.cpp
+CallMeBot transport for intruder alerts. A low priority task resolves the host ahead of time
+and keeps a TLS connection open (HTTP/1.1 keep-alive), re-opening it in the background
+whenever the server drops it, so an alert is a single GET on a warm socket instead of a DNS
+lookup plus a full handshake inside intruder_task.
+*/
+
+#include "alert_client.h"
+#include "http_response.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#define TAG "alert: "
+
+#define ALERT_TASK_STACK 8192            // mbedTLS handshake runs on this stack
+#define ALERT_TASK_PRIORITY 3
+#define ALERT_TASK_CORE 0
+#define ALERT_TIMEOUT_S 10
+#define ALERT_REQUEST_LEN 384
+
+static WiFiClientSecure client;
+static SemaphoreHandle_t alert_lock = NULL;
+static TaskHandle_t alert_task_handle = NULL;
+static IPAddress host_ip;
+static int64_t resolved_at_us = 0;
+static int64_t retry_at_us = 0;
+static uint32_t backoff_ms = 0;
+static alert_client_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+/* cached DNS answer, refreshed after ALERT_DNS_TTL_MS */
+static bool alert_client_resolve(int64_t now)
+{
+    if (resolved_at_us && now - resolved_at_us < (int64_t)ALERT_DNS_TTL_MS * 1000) return true;
+    IPAddress ip;
+    stats.dns_lookups++;
+    if (!WiFi.hostByName(ALERT_HOST, ip)) {
+        ESP_LOGW(TAG, "cannot resolve %s", ALERT_HOST);
+        return resolved_at_us != 0;   // keep using the old address
+    }
+    host_ip = ip;
+    resolved_at_us = now;
+    return true;
+}
+
+
+/* TLS handshake to the pre-resolved address (SNI still carries the host name). Call with alert_lock held. */
+static bool alert_client_connect(void)
+{
+    if (client.connected()) return true;
+    int64_t now = esp_timer_get_time();
+    if (WiFi.status() != WL_CONNECTED || now < retry_at_us || !alert_client_resolve(now)) return false;
+    client.stop();
+    int64_t t0 = esp_timer_get_time();
+    if (!client.connect(host_ip, ALERT_PORT, ALERT_HOST, NULL, NULL, NULL)) {
+        stats.handshake_failures++;
+        backoff_ms = backoff_ms ? backoff_ms * 2 : ALERT_BACKOFF_MIN_MS;
+        if (backoff_ms > ALERT_BACKOFF_MAX_MS) backoff_ms = ALERT_BACKOFF_MAX_MS;
+        retry_at_us = esp_timer_get_time() + (int64_t)backoff_ms * 1000;
+        resolved_at_us = 0;           // the address may have moved
+        ESP_LOGW(TAG, "TLS connect to %s failed, retry in %ums", ALERT_HOST, backoff_ms);
+        return false;
+    }
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    backoff_ms = 0;
+    stats.handshakes++;
+    stats.last_handshake_ms = ms;
+    stats.avg_handshake_ms = (stats.handshakes == 1) ? ms : stats.avg_handshake_ms + ((float)ms - stats.avg_handshake_ms) * 0.2f;
+    ESP_LOGI(TAG, "TLS connection to %s ready in %ums", ALERT_HOST, ms);
+    return true;
+}
+
+
+/* keep the connection warm: re-open it in the background whenever it is gone */
+static void alert_client_task(void *arg)
+{
+    while (true) {
+        xSemaphoreTake(alert_lock, portMAX_DELAY);
+        alert_client_connect();
+        stats.connected = client.connected();
+        xSemaphoreGive(alert_lock);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ALERT_KEEPALIVE_CHECK_MS));
+    }
+}
+
+
+void alert_client_init(void)
+{
+    if (alert_lock) return;
+    alert_lock = xSemaphoreCreateMutex();
+    client.setInsecure();             // skip certificate check, as before
+    client.setTimeout(ALERT_TIMEOUT_S);
+    xTaskCreatePinnedToCore(alert_client_task, "alert_task", ALERT_TASK_STACK, NULL,
+                            ALERT_TASK_PRIORITY, &alert_task_handle, ALERT_TASK_CORE);
+}
+
+
+int alert_client_get(const char *path_and_query, uint32_t detected_ms)
+{
+    if (!alert_lock) return -1;
+    char request[ALERT_REQUEST_LEN];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: esp32-intruder\r\nConnection: keep-alive\r\n\r\n",
+                       path_and_query, ALERT_HOST);
+    if (len <= 0 || len >= (int)sizeof(request)) return -1;
+    xSemaphoreTake(alert_lock, portMAX_DELAY);
+    stats.alerts++;
+    int code = -1;
+    for (int attempt = 0; attempt < 2 && code < 0; attempt++) {
+        bool warm = client.connected();
+        if (!warm) {
+            retry_at_us = 0;          // an alert is worth a handshake even while backing off
+            if (!alert_client_connect()) break;
+        }
+        if (client.write((const uint8_t *)request, len) == (size_t)len) {
+            code = http_read_response(client);
+        }
+        if (code < 0) {
+            client.stop();            // stale keep-alive socket, try once more on a fresh one
+        } else if (warm) {
+            stats.warm_sends++;
+        } else {
+            stats.cold_sends++;
+        }
+    }
+    if (code < 0) {
+        stats.failures++;
+    } else {
+        uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000) - detected_ms;
+        stats.last_latency_ms = ms;
+        stats.avg_latency_ms = (stats.avg_latency_ms == 0) ? ms : stats.avg_latency_ms + ((float)ms - stats.avg_latency_ms) * 0.2f;
+    }
+    stats.connected = client.connected();
+    xSemaphoreGive(alert_lock);
+    // the background task re-opens the connection if the server closed it
+    if (!stats.connected && alert_task_handle) xTaskNotifyGive(alert_task_handle);
+    return code;
+}
+
+
+void alert_client_get_stats(alert_client_stats_t *out)
+{
+    *out = stats;
+}
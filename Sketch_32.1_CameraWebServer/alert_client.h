@@ -0,0 +1,56 @@
+#ifndef ALERT_CLIENT_H
+#define ALERT_CLIENT_H
+
+#include <stdint.h>
+
+#ifndef ALERT_HOST
+#define ALERT_HOST "api.callmebot.com"
+#endif
+
+#ifndef ALERT_PORT
+#define ALERT_PORT 443
+#endif
+
+// how often the background task checks the warm connection
+#ifndef ALERT_KEEPALIVE_CHECK_MS
+#define ALERT_KEEPALIVE_CHECK_MS 5000
+#endif
+
+// re-resolve the host this often, the address is reused in between
+#ifndef ALERT_DNS_TTL_MS
+#define ALERT_DNS_TTL_MS 600000
+#endif
+
+// reconnect backoff after a failed handshake, doubles up to the max
+#ifndef ALERT_BACKOFF_MIN_MS
+#define ALERT_BACKOFF_MIN_MS 2000
+#endif
+#ifndef ALERT_BACKOFF_MAX_MS
+#define ALERT_BACKOFF_MAX_MS 60000
+#endif
+
+typedef struct {
+    uint32_t alerts;
+    uint32_t failures;
+    uint32_t warm_sends;           // alert went out on the pre-established connection
+    uint32_t cold_sends;           // handshake had to happen inside the alert
+    uint32_t handshakes;
+    uint32_t handshake_failures;
+    uint32_t dns_lookups;
+    uint32_t last_handshake_ms;
+    float avg_handshake_ms;
+    uint32_t last_latency_ms;      // intruder detected -> CallMeBot response
+    float avg_latency_ms;
+    bool connected;
+} alert_client_stats_t;
+
+/* Start the task that keeps a TLS connection to ALERT_HOST open */
+void alert_client_init(void);
+
+/* GET path_and_query on the warm connection. detected_ms is when the intruder was seen
+   (esp_timer ms), used for the latency stats. Returns the HTTP status or -1. */
+int alert_client_get(const char *path_and_query, uint32_t detected_ms);
+
+void alert_client_get_stats(alert_client_stats_t *stats);
+
+#endif
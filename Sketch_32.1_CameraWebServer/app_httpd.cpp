@@ -5,14 +5,34 @@ Web app for ESP32-S3 showing camera stream.
 #include "esp_http_server.h"
 #include "esp_timer.h"
 #include "esp_camera.h"
-#include "img_converters.h"
-#include "fb_gfx.h"
 #include "driver/ledc.h"
 #include "sdkconfig.h"
 #include "camera_index.h"
 #include "hardware_control.h"
 #include "intruder_task.h"
 #include "face_state.h"
+#include "vision_task.h"
+#include "stream_broadcast.h"
+#include "face_models.h"
+#include "frame_pool.h"
+#include "capture_profile.h"
+#include "face_crop.h"
+#include "jpeg_decoder.h"
+#include "face_tracker.h"
+#include "motion_gate.h"
+#include "telemetry.h"
+#include "db_client.h"
+#include "alert_client.h"
+#include "outbox.h"
+#include "intruder_episode.h"
+#include "snapshot.h"
+#include "clip_recorder.h"
+#include "metrics.h"
+#include "trace.h"
+#include "bench.h"
+#include "session.h"
+#include "gallery.h"
+#include <cstdarg>
 #include "FS.h"
 #include "SPIFFS.h"
 #include <WiFi.h>
@@ -20,440 +40,432 @@ Web app for ESP32-S3 showing camera stream.
 #include <HTTPClient.h>
 #define TAG "app: "
 
-/* all part of face detection and recogition */
-#include <vector>
-#include <list>
-#include <cstdarg> 
-
-// First Stage Detector - Multi State Regression 1 - Run lightweight model to find potential face candidate regions
-// Outputs a bounding box
-// (score_threshold, nms_threshold, top_k, center_variance)
-#include "human_face_detect_msr01.hpp" 
-// Second Stage Detector - Multi Network Pipeline - Takes bounding boxes and improves location and add facial landmarks
-// Needed for proper landmark alignment -- two stage recognition
-#include "human_face_detect_mnp01.hpp"
-
-#define TWO_STAGE 1                         // 1: detect by two-stage, uses keypoints, needed for facial recognition
-#include "face_recognition_tool.hpp"
-// Espressif face recognition models
-#include "face_recognition_112_v1_s8.hpp"   // less accurate but runs faster - what we're using!
-
-// Max number of enrolled faces
-#define FACE_ID_SAVE_NUMBER 7
-
-// stream resolution variables
-#define FACE_COLOR_WHITE 0x00FFFFFF
-#define FACE_COLOR_BLACK 0x00000000
-#define FACE_COLOR_RED 0x000000FF
-#define FACE_COLOR_GREEN 0x0000FF00
-#define FACE_COLOR_BLUE 0x00FF0000
-#define FACE_COLOR_YELLOW (FACE_COLOR_RED | FACE_COLOR_GREEN)
-#define FACE_COLOR_CYAN (FACE_COLOR_BLUE | FACE_COLOR_GREEN)
-#define FACE_COLOR_PURPLE (FACE_COLOR_BLUE | FACE_COLOR_RED)
-#define ENROLL_INTERVAL_MS 5000          // 5 seconds between enroll captures (tune if you like)
-
-// Enables live streaming over HTTP by mix of JPEG to MJPEG though mixed
-#define PART_BOUNDARY "123456789000000000000987654321"
-static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
-static const char *_STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
-
 /* Two httpd instances (servers) with different ports: one for control/capture (port X) and one for streaming (port X+1).  */
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
 
-/* face detection and recognition variables */
-volatile bool detection_via_gui = false;
-volatile bool recognition_via_gui = false;
-volatile bool detection_via_pir = false;
-volatile bool recognition_via_pir = false;
-
-volatile int8_t is_enrolling = 0;
-volatile int8_t detection_enabled = 0;
-volatile int8_t recognition_enabled = 0;
-
-// Delay showing the enrollment messages on screen
-static bool show_enroll_msg = false;
-static char enroll_msg_text[64];
-static int64_t enroll_msg_until_us = 0;
-#define ENROLL_MSG_DURATION_MS 3000
+// size of the /stats JSON response buffer
+#define STATS_JSON_LEN 12288
 
-/* 
-    face recognition model (neural network) 
-    extracts face embeddings and compares to IDs
-    enrolls new IDs
-    loads/saves IDs to flash
-    (112x112) aligned face images with 8 bit signed weights and activations
-*/
-FaceRecognition112V1S8 recognizer;
+// size of the /metrics text response buffer
+#define METRICS_TEXT_LEN 8192
+// size of the /bench report buffer
+#define BENCH_REPORT_LEN 8192
+// /session download and upload transfer size
+#define SESSION_CHUNK_LEN 4096
 
 // ----- FUNCTIONS --------------------------------
 
-/* Prints out text at top of frame buffer (intruder, id, confidence, etc)*/
-static void rgb_print(fb_data_t *fb, uint32_t color, const char *str)
+/* Live MJPEG stream - hands the viewer to the broadcaster, which serves it from its own task */
+static esp_err_t stream_handler(httpd_req_t *req)
 {
-    fb_gfx_print(fb, (fb->width - (strlen(str) * 14)) / 2, 10, color, str);
+    return stream_broadcast_add_client(req);
 }
 
 
-/* Prints out ID and confidence values onto screen */
-static int rgb_printf(fb_data_t *fb, uint32_t color, const char *format, ...)
+/* append formatted text to the stats buffer, stops quietly when full */
+static void stats_append(char *buf, size_t cap, size_t *len, const char *format, ...)
 {
-    char loc_buf[64];
-    char *temp = loc_buf;
-    int len;
+    if (*len >= cap) return;
     va_list arg;
-    va_list copy;
     va_start(arg, format);
-    va_copy(copy, arg);
-    len = vsnprintf(NULL, 0, format, copy);
-    va_end(copy);
-    if (len < 0) {
-        va_end(arg);
-        return 0;
-    }
-    if (len >= (int)sizeof(loc_buf)) {
-        temp = (char *)malloc(len + 1);
-        if (temp == NULL) {
-            va_end(arg);
-            return 0;
-        }
-    }
-    vsnprintf(temp, (size_t)len + 1, format, arg);
+    int n = vsnprintf(buf + *len, cap - *len, format, arg);
     va_end(arg);
-    rgb_print(fb, color, temp);
-    if (temp != loc_buf) {
-        free(temp);
+    if (n > 0) {
+        *len += ((size_t)n < cap - *len) ? (size_t)n : cap - *len - 1;
     }
-    return len;
 }
 
 
-/*Draw rectangles and 5 landmark indicators for detected face*/
-static void draw_face_boxes(fb_data_t *fb, std::list<dl::detect::result_t> *results, int face_id)
+/* JSON snapshot of pipeline statistics */
+static esp_err_t stats_handler(httpd_req_t *req)
 {
-    int x, y, w, h;
-    uint32_t color = FACE_COLOR_YELLOW;
-    if (face_id < 0)
-    {
-        color = FACE_COLOR_RED;
+    char *json = (char *)malloc(STATS_JSON_LEN);
+    if (!json) {
+        return httpd_resp_send_500(req);
     }
-    else if (face_id > 0)
-    {
-        color = FACE_COLOR_GREEN;
+    size_t len = 0;
+    stream_producer_stats_t producer;
+    stream_client_stats_t clients[STREAM_MAX_CLIENTS];
+    stream_broadcast_get_stats(&producer, clients);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 "{\"stream\":{\"clients\":%d,\"published\":%u,\"publish_failed\":%u,"
+                 "\"encode_us\":%u,\"avg_encode_us\":%.0f,\"viewers\":[",
+                 producer.clients, producer.frames_published, producer.publish_failed,
+                 producer.last_encode_us, producer.avg_encode_us);
+    bool first = true;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (!clients[i].active) continue;
+        stats_append(json, STATS_JSON_LEN, &len,
+                     "%s{\"id\":%u,\"fps\":%.1f,\"sent\":%u,\"dropped\":%u,\"bytes\":%llu,\"age_s\":%u}",
+                     first ? "" : ",", clients[i].id, clients[i].fps, clients[i].frames_sent,
+                     clients[i].frames_dropped, clients[i].bytes_sent,
+                     (uint32_t)((esp_timer_get_time() - clients[i].connected_us) / 1000000));
+        first = false;
     }
-    if(fb->bytes_per_pixel == 2){
-        color = ((color >> 16) & 0x001F) | ((color >> 3) & 0x07E0) | ((color << 8) & 0xF800);
+    stats_append(json, STATS_JSON_LEN, &len, "]}");
+    face_models_stats_t models;
+    face_models_get_stats(&models);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"models\":{\"ready\":%s,\"build_us\":%u,\"load_ids_us\":%u,"
+                 "\"cold_detect_us\":%u,\"warm_detect_us\":%u,\"cold_recognize_us\":%u,\"warm_recognize_us\":%u}",
+                 models.ready ? "true" : "false", models.build_us, models.load_ids_us,
+                 models.cold_detect_us, models.warm_detect_us, models.cold_recognize_us, models.warm_recognize_us);
+    const char *pool_names[FRAME_POOL_KINDS] = { "rgb", "jpeg", "crop" };
+    stats_append(json, STATS_JSON_LEN, &len, ",\"pools\":{");
+    for (int k = 0; k < FRAME_POOL_KINDS; k++) {
+        frame_pool_stats_t pool;
+        frame_pool_get_stats((frame_pool_kind_t)k, &pool);
+        stats_append(json, STATS_JSON_LEN, &len,
+                     "%s\"%s\":{\"capacity\":%d,\"buf_size\":%u,\"in_use\":%d,\"high_water\":%d,"
+                     "\"borrows\":%u,\"alloc_failures\":%u,\"overflows\":%u}",
+                     k ? "," : "", pool_names[k], pool.capacity, (uint32_t)pool.buf_size, pool.in_use,
+                     pool.high_water, pool.borrows, pool.alloc_failures, pool.overflows);
     }
-    int i = 0;
-    for (std::list<dl::detect::result_t>::iterator prediction = results->begin(); prediction != results->end(); prediction++, i++)
-    {
-        // rectangle box
-        x = (int)prediction->box[0];
-        y = (int)prediction->box[1];
-        w = (int)prediction->box[2] - x + 1;
-        h = (int)prediction->box[3] - y + 1;
-        if((x + w) > fb->width){
-            w = fb->width - x;
-        }
-        if((y + h) > fb->height){
-            h = fb->height - y;
-        }
-        fb_gfx_drawFastHLine(fb, x, y, w, color);
-        fb_gfx_drawFastHLine(fb, x, y + h - 1, w, color);
-        fb_gfx_drawFastVLine(fb, x, y, h, color);
-        fb_gfx_drawFastVLine(fb, x + w - 1, y, h, color);
-        // landmarks (left eye, mouth left, nose, right eye, mouth right)
-        int x0, y0, j;
-        for (j = 0; j < 10; j+=2) {
-            x0 = (int)prediction->keypoint[j];
-            y0 = (int)prediction->keypoint[j+1];
-            fb_gfx_fillRect(fb, x0, y0, 3, 3, color);
-        }
+    stats_append(json, STATS_JSON_LEN, &len, "}");
+    capture_profile_stats_t profile;
+    capture_profile_get_stats(&profile);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"capture\":{\"profile\":\"%s\",\"switches\":%u,\"switch_failures\":%u,"
+                 "\"last_switch_us\":%u,\"avg_switch_us\":%.0f,\"jpeg_decode_us\":%.0f,"
+                 "\"raw_convert_us\":%.0f,\"decodes_skipped\":%u,\"scaled_decodes\":%u,"
+                 "\"scale\":%d,\"scaled_decode_us\":%.0f,\"raw_unusable\":%s}",
+                 profile.active == CAPTURE_PROFILE_ANALYSE ? "raw" : "jpeg", profile.switches,
+                 profile.switch_failures, profile.last_switch_us, profile.avg_switch_us,
+                 profile.jpeg_decode_us, profile.raw_convert_us, profile.decodes_skipped,
+                 profile.scaled_decodes, profile.scale, profile.scaled_decode_us,
+                 profile.raw_unusable ? "true" : "false");
+    face_crop_stats_t crop;
+    face_crop_get_stats(&crop);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"crop\":{\"crops\":%u,\"failures\":%u,\"avg_us\":%.0f,\"peak_bytes\":%u,\"full_frame_bytes\":%u}",
+                 crop.crops, crop.failures, crop.avg_us, (uint32_t)crop.peak_bytes, (uint32_t)crop.full_frame_bytes);
+    jpeg_decoder_stats_t decoder;
+    jpeg_decoder_get_stats(&decoder);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"jpeg_decoder\":{\"decodes\":%u,\"contended\":%u,\"max_wait_us\":%u,\"avg_wait_us\":%.0f}",
+                 decoder.decodes, decoder.contended, decoder.max_wait_us, decoder.avg_wait_us);
+    face_tracker_stats_t tracker;
+    face_tracker_get_stats(&tracker);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"tracker\":{\"frames\":%u,\"detect_frames\":%u,\"tracked_frames\":%u,\"tracks_started\":%u,"
+                 "\"tracks_lost\":%u,\"active_tracks\":%d,\"interval\":%d,\"avg_detect_us\":%.0f,"
+                 "\"avg_track_us\":%.0f,\"avg_box_age_ms\":%.1f,\"motion\":%.3f,"
+                 "\"recognitions\":%u,\"identity_hits\":%u,\"identity_episodes\":%u}",
+                 tracker.frames, tracker.detect_frames, tracker.tracked_frames, tracker.tracks_started,
+                 tracker.tracks_lost, tracker.active_tracks, tracker.interval, tracker.avg_detect_us,
+                 tracker.avg_track_us, tracker.avg_box_age_ms, tracker.motion,
+                 tracker.recognitions, tracker.identity_hits, tracker.identity_episodes);
+    motion_gate_stats_t motion;
+    motion_gate_get_stats(&motion);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"motion\":{\"frames\":%u,\"motion_frames\":%u,\"skipped\":%u,\"skipped_pct\":%.1f,"
+                 "\"roi_frames\":%u,\"avg_roi_pct\":%.1f,\"last_motion_pct\":%.1f,\"avg_motion_pct\":%.1f,"
+                 "\"avg_gate_us\":%.0f,\"threshold_pct\":%d}",
+                 motion.frames, motion.motion_frames, motion.skipped,
+                 motion.frames ? motion.skipped * 100.0f / motion.frames : 0.0f,
+                 motion.roi_frames, motion.avg_roi_pct, motion.last_motion_pct, motion.avg_motion_pct,
+                 motion.avg_gate_us, motion.threshold_pct);
+    telemetry_stats_t telemetry;
+    telemetry_get_stats(&telemetry);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"telemetry\":{\"queued\":%u,\"dropped\":%u,\"sent\":%u,\"batches\":%u,\"failures\":%u,\"spilled\":%u,"
+                 "\"depth\":%u,\"max_depth\":%u,\"last_upload_us\":%u,\"avg_upload_us\":%.0f,\"avg_event_age_ms\":%.0f,"
+                 "\"format\":\"%s\",\"bytes_sent\":%u,\"json_bytes_per_event\":%.1f,\"json_encode_us\":%.1f,"
+                 "\"binary_bytes_per_event\":%.1f,\"binary_encode_us\":%.1f}",
+                 telemetry.queued, telemetry.dropped, telemetry.sent, telemetry.batches, telemetry.failures, telemetry.spilled,
+                 telemetry.depth, telemetry.max_depth, telemetry.last_upload_us, telemetry.avg_upload_us,
+                 telemetry.avg_event_age_ms, TELEMETRY_BINARY ? "binary" : "json", telemetry.bytes_sent,
+                 telemetry.json_bytes_per_event, telemetry.json_encode_us, telemetry.binary_bytes_per_event,
+                 telemetry.binary_encode_us);
+    db_client_stats_t db;
+    db_client_get_stats(&db);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"db\":{\"requests\":%u,\"binary_requests\":%u,\"failures\":%u,\"connects\":%u,\"reuses\":%u,\"stale_retries\":%u,"
+                 "\"connect_failures\":%u,\"backoff_skips\":%u,\"backoff_ms\":%u,\"last_rtt_us\":%u,"
+                 "\"avg_rtt_us\":%.0f,\"avg_connect_us\":%.0f}",
+                 db.requests, db.binary_requests, db.failures, db.connects, db.reuses, db.stale_retries, db.connect_failures,
+                 db.backoff_skips, db.backoff_ms, db.last_rtt_us, db.avg_rtt_us, db.avg_connect_us);
+    alert_client_stats_t alert;
+    alert_client_get_stats(&alert);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"alert\":{\"alerts\":%u,\"failures\":%u,\"warm_sends\":%u,\"cold_sends\":%u,\"handshakes\":%u,"
+                 "\"handshake_failures\":%u,\"dns_lookups\":%u,\"last_handshake_ms\":%u,\"avg_handshake_ms\":%.0f,"
+                 "\"last_latency_ms\":%u,\"avg_latency_ms\":%.0f,\"connected\":%s}",
+                 alert.alerts, alert.failures, alert.warm_sends, alert.cold_sends, alert.handshakes,
+                 alert.handshake_failures, alert.dns_lookups, alert.last_handshake_ms, alert.avg_handshake_ms,
+                 alert.last_latency_ms, alert.avg_latency_ms, alert.connected ? "true" : "false");
+    outbox_stats_t outbox;
+    outbox_get_stats(&outbox);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"outbox\":{\"mounted\":%s,\"appended\":%u,\"staged\":%u,\"pending\":%u,\"log_bytes\":%u,"
+                 "\"record_bytes\":%u,\"flash_bytes\":%u,\"write_amplification\":%.2f,\"flushes\":%u,"
+                 "\"compactions\":%u,\"replayed\":%u,\"replay_failures\":%u,\"alerts_dropped\":%u,\"replay_rate\":%.1f,"
+                 "\"crc_errors\":%u,\"dropped\":%u,\"acked_seq\":%u,\"next_seq\":%u}",
+                 outbox.mounted ? "true" : "false", outbox.appended, outbox.staged, outbox.pending, outbox.log_bytes,
+                 outbox.record_bytes, outbox.flash_bytes,
+                 outbox.record_bytes ? (float)outbox.flash_bytes / outbox.record_bytes : 0.0f, outbox.flushes,
+                 outbox.compactions, outbox.replayed, outbox.replay_failures, outbox.alerts_dropped, outbox.replay_rate,
+                 outbox.crc_errors, outbox.dropped, outbox.acked_seq, outbox.next_seq);
+    intruder_episode_stats_t episode;
+    intruder_episode_get_stats(&episode);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"episodes\":{\"episodes\":%u,\"frames\":%u,\"messages\":%u,\"queue_drops\":%u,\"active\":%s,"
+                 "\"last_frames\":%u,\"last_duration_ms\":%u,\"avg_frames_per_episode\":%.1f}",
+                 episode.episodes, episode.frames, episode.messages, episode.queue_drops,
+                 episode.active ? "true" : "false", episode.last_frames, episode.last_duration_ms,
+                 episode.avg_frames_per_episode);
+    snapshot_stats_t snapshot;
+    snapshot_get_stats(&snapshot);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"snapshot\":{\"held\":%u,\"replaced\":%u,\"no_slot\":%u,\"extra_encodes\":%u,\"uploaded\":%u,"
+                 "\"upload_failures\":%u,\"given_up\":%u,\"bytes\":%u,\"last_hold_us\":%u,\"avg_hold_us\":%.1f,"
+                 "\"avg_upload_us\":%.0f}",
+                 snapshot.held, snapshot.replaced, snapshot.no_slot, snapshot.extra_encodes, snapshot.uploaded,
+                 snapshot.upload_failures, snapshot.given_up, snapshot.bytes, snapshot.last_hold_us,
+                 snapshot.avg_hold_us, snapshot.avg_upload_us);
+    clip_recorder_stats_t clip;
+    clip_recorder_get_stats(&clip);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"clip\":{\"enabled\":%s,\"frames\":%u,\"skipped\":%u,\"evicted\":%u,\"ring_frames\":%u,"
+                 "\"ring_bytes\":%u,\"last_insert_us\":%u,\"max_insert_us\":%u,\"avg_insert_us\":%.1f,\"clips\":%u,"
+                 "\"truncated\":%u,\"last_clip_episode\":%u,\"last_clip_frames\":%u,\"last_clip_bytes\":%u,"
+                 "\"last_export_us\":%u,\"export_mb_s\":%.2f}",
+                 clip_recorder_enabled() ? "true" : "false", clip.frames, clip.skipped, clip.evicted, clip.ring_frames,
+                 clip.ring_bytes, clip.last_insert_us, clip.max_insert_us, clip.avg_insert_us, clip.clips,
+                 clip.truncated, clip.last_clip_episode, clip.last_clip_frames, clip.last_clip_bytes,
+                 clip.last_export_us, clip.export_mb_s);
+    session_stats_t session;
+    session_get_stats(&session);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"session\":{\"state\":%d,\"recorded_frames\":%u,\"recorded_events\":%u,\"record_drops\":%u,"
+                 "\"bytes\":%u,\"avg_record_us\":%.0f,\"replayed_frames\":%u,\"replayed_events\":%u,"
+                 "\"replay_skipped\":%u,\"replay_wall_ms\":%u,\"replay_fps\":%.2f,\"results_bytes\":%u,"
+                 "\"results_truncated\":%u}",
+                 session.state, session.recorded_frames, session.recorded_events, session.record_drops,
+                 session.bytes, session.avg_record_us, session.replayed_frames, session.replayed_events,
+                 session.replay_skipped, session.replay_wall_ms, session.replay_fps, session.results_bytes,
+                 session.results_truncated);
+    gallery_stats_t gallery;
+    gallery_get_stats(&gallery);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"gallery\":{\"persons\":%u,\"templates\":%u,\"migrated\":%u,\"in_flash\":%s,\"boot_ready_us\":%u,"
+                 "\"enroll_bytes\":%u,\"generation\":%u,\"records\":%u,\"capacity\":%u,\"dead\":%u,\"corrupt\":%u,"
+                 "\"appends\":%u,\"bytes_written\":%u,\"erases\":%u,\"compactions\":%u,"
+                 "\"searches\":%u,\"last_search_us\":%u,\"avg_search_us\":%.1f,\"avg_pruned\":%.2f,\"pie\":%s}",
+                 gallery.persons, gallery.templates, gallery.migrated, gallery.in_flash ? "true" : "false",
+                 gallery.boot_ready_us, gallery.enroll_bytes, gallery.store.generation, gallery.store.records,
+                 gallery.store.capacity, gallery.store.dead, gallery.store.corrupt, gallery.store.appends,
+                 gallery.store.bytes_written, gallery.store.erases, gallery.store.compactions,
+                 gallery.searches, gallery.last_search_us, gallery.avg_search_us, gallery.avg_pruned,
+                 gallery.pie ? "true" : "false");
+    vision_pipeline_stats_t pipeline;
+    vision_get_pipeline_stats(&pipeline);
+    stats_append(json, STATS_JSON_LEN, &len,
+                 ",\"pipeline\":{\"frames\":%u,\"drops\":%u,\"fps\":%.2f,\"infer_queue_high_water\":%u,"
+                 "\"encode_queue_high_water\":%u,\"backpressure_waits\":%u,\"stages\":[",
+                 pipeline.frames, pipeline.drops, pipeline.fps, pipeline.infer_queue_high_water,
+                 pipeline.encode_queue_high_water, pipeline.backpressure_waits);
+    static const char *stage_names[VISION_STAGE_COUNT] = { "capture", "infer", "encode" };
+    for (int i = 0; i < VISION_STAGE_COUNT; i++) {
+        vision_stage_stats_t *st = &pipeline.stage[i];
+        stats_append(json, STATS_JSON_LEN, &len,
+                     "%s{\"name\":\"%s\",\"core\":%d,\"frames\":%u,\"avg_us\":%.0f,\"occupancy\":%.2f,"
+                     "\"wait_in_ms\":%u,\"wait_out_ms\":%u}",
+                     i ? "," : "", stage_names[i], st->core, st->frames, st->avg_us, st->occupancy,
+                     (uint32_t)(st->wait_in_us / 1000), (uint32_t)(st->wait_out_us / 1000));
     }
+    stats_append(json, STATS_JSON_LEN, &len, "]}");
+    stats_append(json, STATS_JSON_LEN, &len, "}");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    esp_err_t res = httpd_resp_send(req, json, len);
+    free(json);
+    return res;
 }
 
 
-/*
-    Runs facial recognition
-    Takes detected face and keypoints - converts into tensor to put into the NN    
-*/
-static int run_face_recognition(fb_data_t *fb, std::list<dl::detect::result_t> *results)
+/* latency histograms and counters in Prometheus text format */
+static esp_err_t metrics_handler(httpd_req_t *req)
 {
-    std::vector<int> landmarks = results->front().keypoint;
-    int id = -1;
-    // Turns framebuffer into a Tensor object to put into the NN
-    Tensor<uint8_t> tensor;
-    tensor.set_element((uint8_t *)fb->data).set_shape({fb->height, fb->width, 3}).set_auto_free(false);
-    // If enrolling, a face, check how many faces can be enrolled
-    int enrolled_count = recognizer.get_enrolled_id_num();
-    bool did_enroll = false;
-    if (enrolled_count < FACE_ID_SAVE_NUMBER && is_enrolling) {
-        // timestamp of last enroll, 5 second intervals for enrolling
-        static int64_t last_enroll_time_us = 0;
-        int64_t now_us = esp_timer_get_time();
-        if (now_us - last_enroll_time_us >= (int64_t)ENROLL_INTERVAL_MS * 1000) {
-            id = recognizer.enroll_id(tensor, landmarks, "", true);
-            last_enroll_time_us = now_us;
-            did_enroll = true;
-            ESP_LOGI(TAG, "Enrolled ID: %d", id);
-            // delay a little to slow down enrolling and verify that identity has been enrolled
-            sprintf(enroll_msg_text, "ID[%u] enrolled", id);
-            show_enroll_msg = true;
-            enroll_msg_until_us = esp_timer_get_time() + (int64_t)ENROLL_MSG_DURATION_MS * 1000;
-            rgb_printf(fb, FACE_COLOR_CYAN, enroll_msg_text);
-            return id;
-        }
+    char *text = (char *)malloc(METRICS_TEXT_LEN);
+    if (!text) {
+        return httpd_resp_send_500(req);
     }
+    size_t len = metrics_render(text, METRICS_TEXT_LEN);
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t res = httpd_resp_send(req, text, len);
+    free(text);
+    return res;
+}
 
-    face_info_t recognize = recognizer.recognize(tensor, landmarks);
-    if(!is_enrolling) {
-        if (recognize.id >= 0) {
-            // recognized owner — print single green line
-            rgb_printf(fb, FACE_COLOR_GREEN, "ID[%u]: %.2f", recognize.id, recognize.similarity);
-            // log data
-            send_to_database(false, recognize.id, recognize.similarity);
-        } else {
-            // intruder — single red message
-            rgb_print(fb, FACE_COLOR_RED, "Intruder Alert!");
-            intruder_queue_send(1);
-            // Serial.println("INTRUDER");
-            // log data
-            send_to_database(true, -1, recognize.similarity);
-        }
+
+/* binary dump of the trace rings, trace_to_chrome.py turns it into a Chrome trace */
+static esp_err_t trace_handler(httpd_req_t *req)
+{
+    size_t cap = trace_dump_size();
+    uint8_t *buf = (uint8_t *)malloc(cap);
+    if (!buf) {
+        return httpd_resp_send_500(req);
     }
-    return recognize.id;
+    size_t len = trace_dump(buf, cap);
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=trace.bin");
+    esp_err_t res = httpd_resp_send(req, (const char *)buf, len);
+    free(buf);
+    return res;
 }
 
 
-/* Used to check either flag and determine if recognition or detection has been triggered by gui or pir */
-void recompute_face_state() {
-    // recognition depends on detection
-    // If no face has been enrolled yet, ignore PIR-sourced requests to enable detection/recognition.
-    int enrolled_count = recognizer.get_enrolled_id_num();
-    if (enrolled_count == 0) {
-        if (detection_via_pir || recognition_via_pir) {
-            ESP_LOGI("face_state", "PIR requested detection/recognition but no enrolled faces - ignoring PIR");
-        }
-        // Prevent PIR from enabling detection/recognition when there are no enrolled faces.
-        detection_via_pir = false;
-        recognition_via_pir = false;
-    }
-    // recognition depends on detection
-    recognition_enabled = (recognition_via_gui || recognition_via_pir) ? 1 : 0;
-    detection_enabled = (detection_via_gui || detection_via_pir || is_enrolling) ? 1 : 0;
-    if (recognition_enabled) detection_enabled = 1;
-    Serial.println("recomputing");
-    ESP_LOGI("face_state", "recompute: d_gui=%d d_pir=%d enroll=%d => detect=%d | r_gui=%d r_pir=%d => recog=%d",
-             detection_via_gui, detection_via_pir, is_enrolling,
-             detection_enabled, recognition_via_gui, recognition_via_pir, recognition_enabled);
+/* kernel micro-benchmarks, /bench?iterations=N&format=json|text; takes seconds, runs on the stream server */
+static esp_err_t bench_handler(httpd_req_t *req)
+{
+    char query[64] = "";
+    char value[16];
+    int iterations = BENCH_ITERATIONS;
+    bench_format_t format = BENCH_FORMAT_JSON;
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "iterations", value, sizeof(value)) == ESP_OK) {
+        iterations = atoi(value);
+    }
+    if (httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK && !strcmp(value, "text")) {
+        format = BENCH_FORMAT_TEXT;
+    }
+    char *report = (char *)malloc(BENCH_REPORT_LEN);
+    if (!report) {
+        return httpd_resp_send_500(req);
+    }
+    size_t len = bench_run(iterations, format, report, BENCH_REPORT_LEN);
+    if (len == 0) {
+        free(report);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "benchmark busy or out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, format == BENCH_FORMAT_JSON ? "application/json" : "text/plain");
+    esp_err_t res = httpd_resp_send(req, report, len);
+    free(report);
+    return res;
 }
 
 
-/* Live MJPEG Face Detection and Recognition */
-static esp_err_t stream_handler(httpd_req_t *req)
+/* session record/replay: /session?action=status|record|replay[&pace=max]|stop|results|download */
+static esp_err_t session_handler(httpd_req_t *req)
 {
-    camera_fb_t *fb = NULL;
-    struct timeval _timestamp;
-    esp_err_t res = ESP_OK;
-    size_t _jpg_buf_len = 0;
-    uint8_t *_jpg_buf = NULL;
-    char part_buf[128];
-        bool detected = false;
-        int64_t fr_ready = 0;
-        int64_t fr_recognize = 0;
-        int64_t fr_encode = 0;
-        int64_t fr_face = 0;
-        int64_t fr_start = 0;
-    int face_id = 0;
-    size_t out_len = 0, out_width = 0, out_height = 0;
-    uint8_t *out_buf = NULL;
-    bool s = false;
-    // MSR01 params: (score/confidence threshold; nms threshold (IoU); top_K (candidates to return); post filter threshold)
-    HumanFaceDetectMSR01 s1(0.2F, 0.1F, 10, 0.2F);
-    // MNP01 params: (score/confidence threshold; nms threshold (IoU); top_K (candidates to return))
-    HumanFaceDetectMNP01 s2(0.2F, 0.1F, 5);
-    static int64_t last_frame = 0;
-    if (!last_frame)
-    {
-        last_frame = esp_timer_get_time();
-    }
-    res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-    if (res != ESP_OK)
-    {
+    char query[64] = "";
+    char action[16] = "status";
+    char pace[8] = "";
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "action", action, sizeof(action));
+    httpd_query_key_value(query, "pace", pace, sizeof(pace));
+    bool ok = true;
+    if (!strcmp(action, "record")) {
+        ok = session_record_start();
+    } else if (!strcmp(action, "replay")) {
+        ok = session_replay_start(!strcmp(pace, "max") ? SESSION_PACE_MAX : SESSION_PACE_REALTIME);
+    } else if (!strcmp(action, "stop")) {
+        session_stop();
+    } else if (!strcmp(action, "results")) {
+        size_t len = 0;
+        char *lines = session_results_copy(&len);
+        if (!lines) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no replay results");
+            return ESP_FAIL;
+        }
+        httpd_resp_set_type(req, "application/x-ndjson");
+        esp_err_t res = httpd_resp_send(req, lines, len);
+        free(lines);
         return res;
-    }
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "X-Framerate", "60");
-    // loop to contiuously send frames until disconnect
-    while (true)
-    {
-        detected = false;
-        face_id = 0;
-        fb = esp_camera_fb_get();
-        if (!fb)
-        {
-            ESP_LOGE(TAG, "Camera capture failed");
-            res = ESP_FAIL;
+    } else if (!strcmp(action, "download")) {
+        if (!session_file_acquire()) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "session busy");
+            return ESP_FAIL;
         }
-        else
-        {
-            _timestamp.tv_sec = fb->timestamp.tv_sec;
-            _timestamp.tv_usec = fb->timestamp.tv_usec;
-            fr_start = esp_timer_get_time();
-            fr_ready = fr_start;
-            fr_encode = fr_start;
-            fr_recognize = fr_start;
-            fr_face = fr_start;
-            // when not detecting or enrolling, faster camera stream
-            if ((!detection_enabled && !is_enrolling) || fb->width > 400)
-            {
-                if (fb->format != PIXFORMAT_JPEG)
-                {
-                    bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-                    esp_camera_fb_return(fb);
-                    fb = NULL;
-                    if (!jpeg_converted)
-                    {
-                        ESP_LOGE(TAG, "JPEG compression failed");
-                        res = ESP_FAIL;
-                    }
-                }
-                else
-                {
-                    _jpg_buf_len = fb->len;
-                    _jpg_buf = fb->buf;
-                }
-            }
-            else //if only doing detection, runs on RGB565 path
-            {
-                if (fb->format == PIXFORMAT_RGB565 && !recognition_enabled && !is_enrolling)
-                {
-                    fr_ready = esp_timer_get_time();
-                    // running detection on the output buffer
-                    std::list<dl::detect::result_t> &candidates = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-                    std::list<dl::detect::result_t> &results = s2.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3}, candidates);
-                    fr_face = esp_timer_get_time();
-                    fr_recognize = fr_face;
-                    if (results.size() > 0) {
-                        fb_data_t rfb;
-                        rfb.width = fb->width;
-                        rfb.height = fb->height;
-                        rfb.data = fb->buf;
-                        rfb.bytes_per_pixel = 2;
-                        rfb.format = FB_RGB565;
-                        detected = true;
-                        draw_face_boxes(&rfb, &results, face_id);
-                    }
-                    s = fmt2jpg(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, 80, &_jpg_buf, &_jpg_buf_len);
-                    esp_camera_fb_return(fb);
-                    fb = NULL;
-                    if (!s) {
-                        ESP_LOGE(TAG, "fmt2jpg failed");
-                        res = ESP_FAIL;
-                    }
-                    fr_encode = esp_timer_get_time();
-                } else // full frame stream - needed for facial recognition
-                {
-                    out_len = fb->width * fb->height * 3;
-                    out_width = fb->width;
-                    out_height = fb->height;
-                    out_buf = (uint8_t*)malloc(out_len);
-                    if (!out_buf) {
-                        ESP_LOGE(TAG, "out_buf malloc failed");
-                        res = ESP_FAIL;
-                    } else {
-                        s = fmt2rgb888(fb->buf, fb->len, fb->format, out_buf);
-                        esp_camera_fb_return(fb);
-                        fb = NULL;
-                        if (!s) {
-                            free(out_buf);
-                            ESP_LOGE(TAG, "to rgb888 failed");
-                            res = ESP_FAIL;
-                        } else {
-                            fr_ready = esp_timer_get_time();
-                            fb_data_t rfb;
-                            rfb.width = out_width;
-                            rfb.height = out_height;
-                            rfb.data = out_buf;
-                            rfb.bytes_per_pixel = 3;
-                            rfb.format = FB_BGR888;
-                            std::list<dl::detect::result_t> &candidates = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-                            std::list<dl::detect::result_t> &results = s2.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3}, candidates);
-                            fr_face = esp_timer_get_time();
-                            fr_recognize = fr_face;
-                            if (results.size() > 0) {
-                                detected = true;
-                                if (recognition_enabled || is_enrolling) {
-                                    face_id = run_face_recognition(&rfb, &results);
-                                    fr_recognize = esp_timer_get_time();
-                                }
-                                draw_face_boxes(&rfb, &results, face_id);
-                            }
-                            // Keep enrollment message on screen for N ms
-                            if (show_enroll_msg) {
-                                if (esp_timer_get_time() < enroll_msg_until_us) {
-                                    // redisplay enrolled message
-                                    rgb_print(&rfb, FACE_COLOR_CYAN, enroll_msg_text);
-                                } else {
-                                    show_enroll_msg = false; // stop displaying
-                                }
-                            }
-                            s = fmt2jpg(out_buf, out_len, out_width, out_height, PIXFORMAT_RGB888, 90, &_jpg_buf, &_jpg_buf_len);
-                            free(out_buf);
-                            if (!s) {
-                                ESP_LOGE(TAG, "fmt2jpg failed");
-                                res = ESP_FAIL;
-                            }
-                            fr_encode = esp_timer_get_time();
-                        }
-                    }
-                }
+        File f = SPIFFS.open(SESSION_PATH, FILE_READ);
+        char *chunk = (char *)malloc(SESSION_CHUNK_LEN);
+        esp_err_t res = ESP_FAIL;
+        if (f && chunk) {
+            httpd_resp_set_type(req, "application/octet-stream");
+            httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=session.bin");
+            res = ESP_OK;
+            size_t n;
+            while (res == ESP_OK && (n = f.read((uint8_t *)chunk, SESSION_CHUNK_LEN)) > 0) {
+                res = httpd_resp_send_chunk(req, chunk, n);
             }
+            if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+        } else {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no recording");
         }
-        if (res == ESP_OK)
-        {
-            res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-        }
-        if (res == ESP_OK)
-        {
-            size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-            res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
-        }
-        if (res == ESP_OK)
-        {
-            res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-        }
-        if (fb)
-        {
-            esp_camera_fb_return(fb);
-            fb = NULL;
-            _jpg_buf = NULL;
-        }
-        else if (_jpg_buf)
-        {
-            free(_jpg_buf);
-            _jpg_buf = NULL;
-        }
-        if (res != ESP_OK)
-        {
-            ESP_LOGE(TAG, "send frame failed failed");
-            break;
-        }
-        int64_t fr_end = esp_timer_get_time();
-        int64_t ready_time = (fr_ready - fr_start) / 1000;
-        int64_t face_time = (fr_face - fr_ready) / 1000;
-        int64_t recognize_time = (fr_recognize - fr_face) / 1000;
-        int64_t encode_time = (fr_encode - fr_recognize) / 1000;
-        int64_t process_time = (fr_encode - fr_start) / 1000;
-        int64_t frame_time = fr_end - last_frame;
-        frame_time /= 1000;
-        ESP_LOGI(TAG, "MJPG: %uB %ums (%.1ffps)"
-                      ", %u+%u+%u+%u=%u %s%d", (uint32_t)(_jpg_buf_len),
-                 (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time,
-                 (uint32_t)ready_time, (uint32_t)face_time, (uint32_t)recognize_time, (uint32_t)encode_time, (uint32_t)process_time,
-                 (detected) ? "DETECTED " : "", face_id);
+        free(chunk);
+        if (f) f.close();
+        session_file_release();
+        return res;
+    } else if (strcmp(action, "status")) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    if (!ok) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "session busy, no recording or no storage");
+        return ESP_FAIL;
+    }
+    session_stats_t session;
+    session_get_stats(&session);
+    char json[128];
+    static const char *states[] = { "idle", "recording", "replaying" };
+    int len = snprintf(json, sizeof(json), "{\"state\":\"%s\",\"recorded_frames\":%u,\"bytes\":%u,\"replayed_frames\":%u}",
+                       states[session.state], session.recorded_frames, session.bytes, session.replayed_frames);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+
+/* POST /session: store a recording taken on another device, for replay here */
+static esp_err_t session_upload_handler(httpd_req_t *req)
+{
+    if (req->content_len == 0 || req->content_len > SESSION_MAX_BYTES) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "empty or larger than SESSION_MAX_BYTES");
+        return ESP_FAIL;
+    }
+    if (!session_file_acquire()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "session busy");
+        return ESP_FAIL;
     }
+    File f = SPIFFS.open(SESSION_PATH, FILE_WRITE);
+    char *chunk = (char *)malloc(SESSION_CHUNK_LEN);
+    size_t remaining = req->content_len;
+    while (f && chunk && remaining > 0) {
+        int n = httpd_req_recv(req, chunk, remaining < SESSION_CHUNK_LEN ? remaining : SESSION_CHUNK_LEN);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0 || f.write((const uint8_t *)chunk, n) != (size_t)n) break;
+        remaining -= n;
+    }
+    free(chunk);
+    if (f) f.close();
+    session_file_release();
+    if (remaining > 0) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    return httpd_resp_send(req, NULL, 0);
+}
+
+
+/* last intruder clip as an MJPEG AVI, sent straight from the export buffer */
+static esp_err_t clip_handler(httpd_req_t *req)
+{
+    const uint8_t *data = NULL;
+    size_t len = 0;
+    uint32_t episode = 0;
+    if (!clip_recorder_borrow(&data, &len, &episode)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no clip recorded yet");
+        return ESP_FAIL;
+    }
+    char disposition[64];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=intruder_%u.avi", episode);
+    httpd_resp_set_type(req, "video/x-msvideo");
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    esp_err_t res = httpd_resp_send(req, (const char *)data, len);
+    clip_recorder_return();
     return res;
 }
 
@@ -481,29 +493,20 @@ static esp_err_t parse_get(httpd_req_t *req, char **obuf)
 }
 
 
-/* handles UI controls */
-static esp_err_t cmd_handler(httpd_req_t *req)
+/* apply one /control variable, also called when a recorded session is replayed */
+int control_apply(const char *variable, const char *value)
 {
-    char *buf = NULL;
-    char variable[32];
-    char value[32];
-    if (parse_get(req, &buf) != ESP_OK) {
-        return ESP_FAIL;
-    }
-    if (httpd_query_key_value(buf, "var", variable, sizeof(variable)) != ESP_OK) {
-        free(buf);
-        httpd_resp_send_404(req);
-        return ESP_FAIL;
-    }
-    if (httpd_query_key_value(buf, "val", value, sizeof(value)) != ESP_OK) {
-        value[0] = '\0';
-    }
-    free(buf);
     int val = atoi(value);
     ESP_LOGI(TAG, "%s = %d", variable, val);
-    sensor_t *s = esp_camera_sensor_get();
+    sensor_t *s = capture_profile_sensor_acquire();
     int res = 0;
-    if (!strcmp(variable, "quality"))
+    bool sensor_var = !strcmp(variable, "quality") || !strcmp(variable, "contrast") ||
+                      !strcmp(variable, "brightness") || !strcmp(variable, "saturation");
+    if (sensor_var && !s) {
+        ESP_LOGE(TAG, "no camera sensor for %s", variable);
+        res = -1;
+    }
+    else if (!strcmp(variable, "quality"))
         res = s->set_quality(s, val);
     else if (!strcmp(variable, "contrast"))
         res = s->set_contrast(s, val);
@@ -527,6 +530,10 @@ static esp_err_t cmd_handler(httpd_req_t *req)
         }
         recompute_face_state();
     }
+    else if (!strcmp(variable, "face_delete")) {
+        res = gallery_delete(val) ? 0 : -1;
+        recompute_face_state();
+    }
     else if (!strcmp(variable, "face_recognize")) {
         recognition_via_gui = (val != 0);
         if (recognition_via_gui) {
@@ -534,13 +541,43 @@ static esp_err_t cmd_handler(httpd_req_t *req)
         }
         recompute_face_state();
     }
+    else if (!strcmp(variable, "motion_threshold")) {
+        motion_gate_set_threshold(val);
+    }
+    else if (!strcmp(variable, "clip_record")) {
+        clip_recorder_set_enabled(val != 0);
+    }
     else {
         ESP_LOGI(TAG, "Unknown command: %s", variable);
         res = -1;
     }
-    if (res < 0) {
+    capture_profile_sensor_release();
+    return res;
+}
+
+
+/* handles UI controls */
+static esp_err_t cmd_handler(httpd_req_t *req)
+{
+    char *buf = NULL;
+    char variable[32];
+    char value[32];
+    if (parse_get(req, &buf) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (httpd_query_key_value(buf, "var", variable, sizeof(variable)) != ESP_OK) {
+        free(buf);
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    if (httpd_query_key_value(buf, "val", value, sizeof(value)) != ESP_OK) {
+        value[0] = '\0';
+    }
+    free(buf);
+    if (control_apply(variable, value) < 0) {
         return httpd_resp_send_500(req);
     }
+    session_record_control(variable, value);
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     return httpd_resp_send(req, NULL, 0);
 }
@@ -551,9 +588,11 @@ static esp_err_t index_handler(httpd_req_t *req)
 {
     httpd_resp_set_type(req, "text/html");
     httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-    sensor_t *s = esp_camera_sensor_get();
+    sensor_t *s = capture_profile_sensor_acquire();
+    uint16_t pid = s ? s->id.PID : 0;
+    capture_profile_sensor_release();
     if (s != NULL) {
-        if (s->id.PID == OV2640_PID){
+        if (pid == OV2640_PID){
             return httpd_resp_send(req, (const char *)index_ov2640_html_gz, index_ov2640_html_gz_len);
         }
     } else {
@@ -580,20 +619,62 @@ void startCameraServer()
         .handler = cmd_handler,
         .user_ctx = NULL
     };
+    httpd_uri_t stats_uri = {
+        .uri = "/stats",
+        .method = HTTP_GET,
+        .handler = stats_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t trace_uri = {
+        .uri = "/trace",
+        .method = HTTP_GET,
+        .handler = trace_handler,
+        .user_ctx = NULL
+    };
     httpd_uri_t stream_uri = {
         .uri = "/stream",
         .method = HTTP_GET,
         .handler = stream_handler,
         .user_ctx = NULL
     };
-    // face recognizer
-    recognizer.set_partition(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "fr");
-    recognizer.set_ids_from_flash();     // load ids from flash partition
+    httpd_uri_t clip_uri = {
+        .uri = "/clip",
+        .method = HTTP_GET,
+        .handler = clip_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t bench_uri = {
+        .uri = "/bench",
+        .method = HTTP_GET,
+        .handler = bench_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t session_uri = {
+        .uri = "/session",
+        .method = HTTP_GET,
+        .handler = session_handler,
+        .user_ctx = NULL
+    };
+    httpd_uri_t session_upload_uri = {
+        .uri = "/session",
+        .method = HTTP_POST,
+        .handler = session_upload_handler,
+        .user_ctx = NULL
+    };
     ESP_LOGI(TAG, "Starting web server on port: '%d'", config.server_port);
     if (httpd_start(&camera_httpd, &config) == ESP_OK)
     {
         httpd_register_uri_handler(camera_httpd, &index_uri);
         httpd_register_uri_handler(camera_httpd, &cmd_uri);
+        httpd_register_uri_handler(camera_httpd, &stats_uri);
+        httpd_register_uri_handler(camera_httpd, &metrics_uri);
+        httpd_register_uri_handler(camera_httpd, &trace_uri);
     }
     config.server_port += 1;
     config.ctrl_port += 1;
@@ -601,6 +682,11 @@ void startCameraServer()
     if (httpd_start(&stream_httpd, &config) == ESP_OK)
     {
         httpd_register_uri_handler(stream_httpd, &stream_uri);
+        // long downloads go to the stream server so they do not hold up /control
+        httpd_register_uri_handler(stream_httpd, &clip_uri);
+        httpd_register_uri_handler(stream_httpd, &bench_uri);
+        httpd_register_uri_handler(stream_httpd, &session_uri);
+        httpd_register_uri_handler(stream_httpd, &session_upload_uri);
     }
 }
 
@@ -0,0 +1,346 @@
+/*
+bench.cpp
+on-device micro-benchmarks for the frame-processing kernels: RGB565 -> RGB888 conversion,
+JPEG decode, JPEG encode from both pixel formats, face box and text annotation, and
+recompute_face_state, plus gallery search at 7, 100 and 500 enrolled ids with the PIE and the
+scalar dot product (most templates are abandoned after their first slice, so 500 ids stay
+well under a millisecond). Each frame kernel runs over a fixed corpus of generated QVGA and VGA frames
+(a smooth gradient and a noisy scene, so JPEG cost covers both ends), timed with the cycle
+counter. Frames are deterministic, so two /bench?format=json reports taken before and after a
+change compare like for like. The vision task keeps running, so pause detection for clean numbers.
+The portable kernels (conversions from the sketch's own code, annotation, face state, scalar
+gallery search) also run in host/bench_host.cpp on Linux; this one adds what only the device has:
+the JPEG codec, PIE, PSRAM timings and heap allocations.
+*/
+
+#include "bench.h"
+#include "frame_annotate.h"
+#include "face_state.h"
+#include "gallery.h"
+#include "jpeg_decoder.h"
+#include "img_converters.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#define TAG "bench: "
+
+// the JPEG encoder needs the same stack as the vision task
+#define BENCH_TASK_STACK 16384
+#define BENCH_TASK_PRIORITY 3
+#define BENCH_TASK_CORE 0
+#define BENCH_FACES 3
+#define BENCH_GALLERY_QUERIES 20       // gallery searches per iteration
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    bool noisy;
+    uint8_t *rgb565;
+    uint8_t *rgb888;
+    uint8_t *jpg;                  // encoded once from rgb565, input of the decode kernel
+    size_t jpg_len;
+    std::list<dl::detect::result_t> faces;
+} bench_frame_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(bench_frame_t *f);
+} bench_kernel_t;
+
+typedef struct {
+    int iterations;
+    bench_format_t format;
+    char *buf;
+    size_t cap;
+    size_t len;
+    int results;                   // rows written, for the JSON separators
+    TaskHandle_t caller;
+} bench_job_t;
+
+static std::atomic<bool> running(false);
+
+// ----- FUNCTIONS --------------------------------
+
+static void bench_append(bench_job_t *job, const char *format, ...)
+{
+    if (job->len + 1 >= job->cap) return;
+    va_list arg;
+    va_start(arg, format);
+    int n = vsnprintf(job->buf + job->len, job->cap - job->len, format, arg);
+    va_end(arg);
+    if (n > 0) {
+        job->len += ((size_t)n < job->cap - job->len) ? (size_t)n : job->cap - job->len - 1;
+    }
+}
+
+
+/* encoder output that only counts, the kernels measure the encoder and not a copy */
+static size_t bench_jpeg_discard(void *arg, size_t index, const void *data, size_t len)
+{
+    *(size_t *)arg = index + len;
+    return len;
+}
+
+
+static void kernel_rgb565_to_rgb888(bench_frame_t *f)
+{
+    fmt2rgb888(f->rgb565, f->width * f->height * 2, PIXFORMAT_RGB565, f->rgb888);
+}
+
+
+static void kernel_encode_rgb565(bench_frame_t *f)
+{
+    size_t len = 0;
+    fmt2jpg_cb(f->rgb565, f->width * f->height * 2, f->width, f->height, PIXFORMAT_RGB565, 80, bench_jpeg_discard, &len);
+}
+
+
+static void kernel_encode_rgb888(bench_frame_t *f)
+{
+    size_t len = 0;
+    fmt2jpg_cb(f->rgb888, f->width * f->height * 3, f->width, f->height, PIXFORMAT_RGB888, 90, bench_jpeg_discard, &len);
+}
+
+
+static void bench_fb(bench_frame_t *f, fb_data_t *fb)
+{
+    fb->width = f->width;
+    fb->height = f->height;
+    fb->data = f->rgb888;
+    fb->bytes_per_pixel = 3;
+    fb->format = FB_BGR888;
+}
+
+
+static void kernel_draw_face_boxes(bench_frame_t *f)
+{
+    fb_data_t fb;
+    bench_fb(f, &fb);
+    draw_face_boxes(&fb, &f->faces, -1);
+}
+
+
+static void kernel_rgb_printf(bench_frame_t *f)
+{
+    fb_data_t fb;
+    bench_fb(f, &fb);
+    rgb_printf(&fb, FACE_COLOR_GREEN, "ID[%u]: %.2f", 3, 0.87f);
+}
+
+
+/* the decoder is shared with the pipeline, so a busy pipeline shows up here as wait time */
+static void kernel_jpeg_decode(bench_frame_t *f)
+{
+    jpeg_decoder_take();
+    fmt2rgb888(f->jpg, f->jpg_len, PIXFORMAT_JPEG, f->rgb888);
+    jpeg_decoder_give();
+}
+
+
+// run order matters: the RGB888 kernels work on what the conversion produced, decode goes last
+static const bench_kernel_t kernels[] = {
+    { "rgb565_to_rgb888", kernel_rgb565_to_rgb888 },
+    { "jpeg_encode_rgb565", kernel_encode_rgb565 },
+    { "jpeg_encode_rgb888", kernel_encode_rgb888 },
+    { "draw_face_boxes", kernel_draw_face_boxes },
+    { "rgb_printf", kernel_rgb_printf },
+    { "jpeg_decode", kernel_jpeg_decode },
+};
+
+
+/* gradient or fixed-seed noise over a gradient, RGB565 big endian like the sensor */
+static void bench_fill(bench_frame_t *f)
+{
+    uint32_t seed = 0x2545F491;
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) {
+            int r = x * 31 / f->width, g = y * 63 / f->height, b = ((x + y) >> 3) & 31;
+            if (f->noisy) {
+                seed = seed * 1664525u + 1013904223u;
+                r = (r + (seed >> 28)) & 31;
+                g = (g + ((seed >> 22) & 31)) & 63;
+                b = (b + ((seed >> 16) & 15)) & 31;
+            }
+            uint16_t px = (r << 11) | (g << 5) | b;
+            uint8_t *p = f->rgb565 + (y * f->width + x) * 2;
+            p[0] = px >> 8;
+            p[1] = px & 0xFF;
+        }
+    }
+    // three faces spread over the frame, boxes + 5 landmarks like the detector returns
+    for (int i = 0; i < BENCH_FACES; i++) {
+        dl::detect::result_t r;
+        int w = f->width / 5, x = f->width / 10 + i * f->width * 3 / 10, y = f->height / 4;
+        r.category = 0;
+        r.score = 0.9f;
+        r.box = { x, y, x + w, y + w };
+        r.keypoint = { x + w / 3, y + w / 3, x + w / 3, y + w * 3 / 4, x + w / 2, y + w / 2,
+                       x + w * 2 / 3, y + w / 3, x + w * 2 / 3, y + w * 3 / 4 };
+        f->faces.push_back(r);
+    }
+}
+
+
+static bool bench_frame_alloc(bench_frame_t *f)
+{
+    f->rgb565 = (uint8_t *)heap_caps_malloc(f->width * f->height * 2, MALLOC_CAP_SPIRAM);
+    f->rgb888 = (uint8_t *)heap_caps_malloc(f->width * f->height * 3, MALLOC_CAP_SPIRAM);
+    if (!f->rgb565 || !f->rgb888) return false;
+    bench_fill(f);
+    return fmt2jpg(f->rgb565, f->width * f->height * 2, f->width, f->height, PIXFORMAT_RGB565, 80, &f->jpg, &f->jpg_len);
+}
+
+
+static void bench_frame_free(bench_frame_t *f)
+{
+    heap_caps_free(f->rgb565);
+    heap_caps_free(f->rgb888);
+    free(f->jpg);
+    f->rgb565 = f->rgb888 = f->jpg = NULL;
+    f->faces.clear();
+}
+
+
+/* allocated blocks and bytes across internal RAM and PSRAM */
+static void bench_heap(uint32_t *blocks, uint32_t *bytes)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+    *blocks = info.allocated_blocks;
+    *bytes = info.total_allocated_bytes;
+}
+
+
+/* time one kernel, mean and fastest pass in ns, net heap change per pass */
+static void bench_measure(bench_job_t *job, const char *kernel, const char *frame, void (*run)(bench_frame_t *), bench_frame_t *f)
+{
+    uint32_t mhz = esp_rom_get_cpu_ticks_per_us();
+    uint64_t total = 0;
+    uint32_t fastest = UINT32_MAX;
+    uint32_t blocks0, bytes0, blocks1, bytes1;
+    run(f);                        // warm caches and lazily allocated encoder state
+    bench_heap(&blocks0, &bytes0);
+    for (int i = 0; i < job->iterations; i++) {
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        run(f);
+        uint32_t cycles = esp_cpu_get_cycle_count() - c0;
+        total += cycles;
+        if (cycles < fastest) fastest = cycles;
+    }
+    bench_heap(&blocks1, &bytes1);
+    float ns = (float)total * 1000.0f / mhz / job->iterations;
+    float min_ns = (float)fastest * 1000.0f / mhz;
+    float allocs = ((float)blocks1 - blocks0) / job->iterations;
+    float bytes = ((float)bytes1 - bytes0) / job->iterations;
+    if (job->format == BENCH_FORMAT_JSON) {
+        bench_append(job, "%s{\"kernel\":\"%s\",\"frame\":\"%s\",\"ns_per_frame\":%.0f,\"min_ns\":%.0f,"
+                          "\"allocs_per_frame\":%.2f,\"bytes_per_frame\":%.0f}",
+                     job->results ? "," : "", kernel, frame, ns, min_ns, allocs, bytes);
+    } else {
+        bench_append(job, "%-20s %-12s %12.0f %12.0f %8.2f %10.0f\n", kernel, frame, ns, min_ns, allocs, bytes);
+    }
+    job->results++;
+}
+
+
+/* face_state logic alone, its log line muted while timed */
+static void kernel_face_state(bench_frame_t *f)
+{
+    recompute_face_state();
+}
+
+
+/* gallery search over a scratch gallery of random persons, enrolled ids stay untouched */
+static void bench_gallery(bench_job_t *job, int persons, bool pie)
+{
+    gallery_bench_t result;
+    if (pie && !GALLERY_USE_PIE) return;
+    if (!gallery_bench(persons, job->iterations * BENCH_GALLERY_QUERIES, pie, &result)) {
+        ESP_LOGE(TAG, "no memory for a gallery of %d", persons);
+        return;
+    }
+    char frame[16];
+    snprintf(frame, sizeof(frame), "ids_%d", persons);
+    const char *kernel = pie ? "gallery_match_pie" : "gallery_match_scalar";
+    if (job->format == BENCH_FORMAT_JSON) {
+        bench_append(job, "%s{\"kernel\":\"%s\",\"frame\":\"%s\",\"ns_per_frame\":%u,\"pruned\":%.2f}",
+                     job->results ? "," : "", kernel, frame, result.search_ns, result.pruned);
+    } else {
+        bench_append(job, "%-20s %-12s %12u %12s %8s %10s pruned %.2f\n", kernel, frame, result.search_ns, "-", "-", "-", result.pruned);
+    }
+    job->results++;
+}
+
+
+static void bench_task(void *arg)
+{
+    bench_job_t *job = (bench_job_t *)arg;
+    static bench_frame_t frames[] = {
+        { "qvga_smooth", 320, 240, false },
+        { "qvga_noisy", 320, 240, true },
+        { "vga_smooth", 640, 480, false },
+        { "vga_noisy", 640, 480, true },
+    };
+    if (job->format == BENCH_FORMAT_JSON) {
+        bench_append(job, "{\"iterations\":%d,\"cpu_mhz\":%u,\"results\":[", job->iterations, esp_rom_get_cpu_ticks_per_us());
+    } else {
+        bench_append(job, "%d iterations at %u MHz\n%-20s %-12s %12s %12s %8s %10s\n", job->iterations,
+                     esp_rom_get_cpu_ticks_per_us(), "kernel", "frame", "ns/frame", "min ns", "allocs", "bytes");
+    }
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]) && ok; i++) {
+        bench_frame_t *f = &frames[i];
+        ok = bench_frame_alloc(f);
+        if (ok) {
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+                bench_measure(job, kernels[k].name, f->name, kernels[k].run, f);
+            }
+        } else {
+            ESP_LOGE(TAG, "no memory for %s", f->name);
+        }
+        bench_frame_free(f);
+        vTaskDelay(1);
+    }
+    esp_log_level_t level = esp_log_level_get("face_state");
+    esp_log_level_set("face_state", ESP_LOG_WARN);
+    bench_measure(job, "recompute_face_state", "none", kernel_face_state, NULL);
+    esp_log_level_set("face_state", level);
+    static const int gallery_sizes[] = { 7, 100, 500 };
+    for (size_t i = 0; i < sizeof(gallery_sizes) / sizeof(gallery_sizes[0]) && ok; i++) {
+        bench_gallery(job, gallery_sizes[i], true);
+        bench_gallery(job, gallery_sizes[i], false);
+    }
+    if (!ok) {
+        job->len = 0;
+    } else if (job->format == BENCH_FORMAT_JSON) {
+        bench_append(job, "]}");
+    }
+    xTaskNotifyGive(job->caller);
+    vTaskDelete(NULL);
+}
+
+
+size_t bench_run(int iterations, bench_format_t format, char *buf, size_t cap)
+{
+    bool idle = false;
+    if (!running.compare_exchange_strong(idle, true)) return 0;
+    bench_job_t job = { iterations, format, buf, cap, 0, 0, xTaskGetCurrentTaskHandle() };
+    if (job.iterations < 1) job.iterations = 1;
+    if (job.iterations > BENCH_MAX_ITERATIONS) job.iterations = BENCH_MAX_ITERATIONS;
+    buf[0] = '\0';
+    if (xTaskCreatePinnedToCore(bench_task, "bench", BENCH_TASK_STACK, &job, BENCH_TASK_PRIORITY, NULL, BENCH_TASK_CORE) != pdPASS) {
+        running = false;
+        return 0;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    running = false;
+    return job.len;
+}
@@ -0,0 +1,23 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// passes per kernel and test frame when /bench does not say
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 10
+#endif
+#define BENCH_MAX_ITERATIONS 100
+
+typedef enum {
+    BENCH_FORMAT_JSON = 0,         // baseline file for regression checks
+    BENCH_FORMAT_TEXT              // one aligned line per kernel and frame
+} bench_format_t;
+
+/* Time every frame-processing kernel over the synthetic test frames on a dedicated task and
+   write the report into buf. Blocks until done (seconds at VGA). Returns the length written,
+   0 when another run is in progress or the test frames could not be allocated. */
+size_t bench_run(int iterations, bench_format_t format, char *buf, size_t cap);
+
+#endif
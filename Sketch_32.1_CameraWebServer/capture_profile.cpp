@@ -0,0 +1,174 @@
+/*
+capture_profile.cpp
+switches the camera between a JPEG streaming profile and a raw (RGB565) analysis profile.
+While detection/recognition is on, frames come out of the sensor as raw pixels and skip the
+JPEG -> RGB888 decode; plain streaming goes back to sensor JPEG. Frame sizes above
+CAPTURE_RAW_MAX_WIDTH stay JPEG while analysing: the vision task detects on a scaled decode.
+
+esp32-camera fixes JPEG mode and the DMA frame size when the driver is initialised, so a
+format change re-initialises the capture driver with the cached camera_config_t and then
+restores the cached sensor settings (quality, brightness, flips, ...) instead of going
+back through setup().
+*/
+
+#include "capture_profile.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#define TAG "profile: "
+
+static camera_config_t cached_config;
+static SemaphoreHandle_t sensor_lock = NULL;
+static capture_profile_stats_t stats;
+static int64_t analyse_seen_us = 0;
+static bool decode_sampled = false;
+
+// ----- FUNCTIONS --------------------------------
+
+/* push the cached sensor settings back after the driver came up again */
+static void capture_profile_apply(sensor_t *s, const camera_status_t *st)
+{
+    s->set_quality(s, st->quality);
+    s->set_brightness(s, st->brightness);
+    s->set_contrast(s, st->contrast);
+    s->set_saturation(s, st->saturation);
+    s->set_special_effect(s, st->special_effect);
+    s->set_whitebal(s, st->awb);
+    s->set_awb_gain(s, st->awb_gain);
+    s->set_wb_mode(s, st->wb_mode);
+    s->set_exposure_ctrl(s, st->aec);
+    s->set_aec2(s, st->aec2);
+    s->set_ae_level(s, st->ae_level);
+    s->set_aec_value(s, st->aec_value);
+    s->set_gain_ctrl(s, st->agc);
+    s->set_agc_gain(s, st->agc_gain);
+    s->set_gainceiling(s, (gainceiling_t)st->gainceiling);
+    s->set_bpc(s, st->bpc);
+    s->set_wpc(s, st->wpc);
+    s->set_raw_gma(s, st->raw_gma);
+    s->set_lenc(s, st->lenc);
+    s->set_hmirror(s, st->hmirror);
+    s->set_vflip(s, st->vflip);
+    s->set_dcw(s, st->dcw);
+}
+
+
+/* re-init the capture driver in the given format, keeping every sensor setting */
+static bool capture_profile_switch(capture_profile_t profile)
+{
+    pixformat_t format = (profile == CAPTURE_PROFILE_ANALYSE) ? CAPTURE_RAW_FORMAT : PIXFORMAT_JPEG;
+    xSemaphoreTake(sensor_lock, portMAX_DELAY);
+    int64_t t0 = esp_timer_get_time();
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s) {
+        xSemaphoreGive(sensor_lock);
+        return false;
+    }
+    camera_status_t status = s->status;
+    pixformat_t previous = cached_config.pixel_format;
+    cached_config.frame_size = status.framesize;
+    cached_config.pixel_format = format;
+    esp_camera_deinit();
+    esp_err_t err = esp_camera_init(&cached_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "switch to format %d failed (0x%x), restoring %d", format, err, previous);
+        cached_config.pixel_format = previous;
+        err = esp_camera_init(&cached_config);
+        stats.switch_failures++;
+        // re-initialising on every frame would stall the camera, stay on JPEG from now on
+        if (profile == CAPTURE_PROFILE_ANALYSE) stats.raw_unusable = true;
+    } else {
+        stats.active = profile;
+    }
+    if (err == ESP_OK) {
+        capture_profile_apply(esp_camera_sensor_get(), &status);
+        // first frame after a re-init is taken before the settings land, throw it away
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (fb) esp_camera_fb_return(fb);
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    xSemaphoreGive(sensor_lock);
+    if (cached_config.pixel_format != format) return false;
+    stats.switches++;
+    stats.last_switch_us = us;
+    stats.avg_switch_us = (stats.switches == 1) ? us : stats.avg_switch_us + ((float)us - stats.avg_switch_us) * 0.2f;
+    ESP_LOGI(TAG, "capture profile -> %s in %ums", profile == CAPTURE_PROFILE_ANALYSE ? "raw" : "jpeg", us / 1000);
+    return true;
+}
+
+
+void capture_profile_init(const camera_config_t *config)
+{
+    if (sensor_lock) return;
+    sensor_lock = xSemaphoreCreateMutex();
+    cached_config = *config;
+    memset(&stats, 0, sizeof(stats));
+    stats.active = (config->pixel_format == PIXFORMAT_JPEG) ? CAPTURE_PROFILE_STREAM : CAPTURE_PROFILE_ANALYSE;
+}
+
+
+void capture_profile_update(bool analyse)
+{
+    if (!sensor_lock) return;
+    int64_t now = esp_timer_get_time();
+    if (analyse) analyse_seen_us = now;
+    capture_profile_t want = CAPTURE_PROFILE_STREAM;
+    // wide frames stay JPEG, the vision cascade decodes them at 1/2..1/8
+    sensor_t *s = esp_camera_sensor_get();
+    bool raw_fits = s && resolution[s->status.framesize].width <= CAPTURE_RAW_MAX_WIDTH;
+    if (raw_fits && !stats.raw_unusable && (analyse || (stats.active == CAPTURE_PROFILE_ANALYSE && now - analyse_seen_us < (int64_t)CAPTURE_PROFILE_HOLD_MS * 1000))) {
+        want = CAPTURE_PROFILE_ANALYSE;
+    }
+    // the first analysed frame is still decoded from sensor JPEG by the vision task, which keeps
+    // the cost the raw profile saves measured without grabbing a frame under the sensor lock
+    if (want == CAPTURE_PROFILE_ANALYSE && stats.active == CAPTURE_PROFILE_STREAM && !decode_sampled) {
+        decode_sampled = true;
+        return;
+    }
+    if (want != stats.active) {
+        decode_sampled = false;
+        capture_profile_switch(want);
+    }
+}
+
+
+void capture_profile_note_convert(pixformat_t src, uint32_t us)
+{
+    float *avg = (src == PIXFORMAT_JPEG) ? &stats.jpeg_decode_us : &stats.raw_convert_us;
+    *avg = (*avg == 0) ? us : *avg + ((float)us - *avg) * 0.05f;
+}
+
+
+void capture_profile_note_skipped(void)
+{
+    stats.decodes_skipped++;
+}
+
+
+void capture_profile_note_scaled(int scale, uint32_t us)
+{
+    stats.scaled_decodes++;
+    stats.scale = scale;
+    stats.scaled_decode_us = (stats.scaled_decodes == 1) ? us : stats.scaled_decode_us + ((float)us - stats.scaled_decode_us) * 0.05f;
+}
+
+
+sensor_t *capture_profile_sensor_acquire(void)
+{
+    if (sensor_lock) xSemaphoreTake(sensor_lock, portMAX_DELAY);
+    return esp_camera_sensor_get();
+}
+
+
+void capture_profile_sensor_release(void)
+{
+    if (sensor_lock) xSemaphoreGive(sensor_lock);
+}
+
+
+void capture_profile_get_stats(capture_profile_stats_t *out)
+{
+    *out = stats;
+}
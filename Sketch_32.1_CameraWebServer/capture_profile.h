@@ -0,0 +1,62 @@
+#ifndef CAPTURE_PROFILE_H
+#define CAPTURE_PROFILE_H
+
+#include <stdint.h>
+#include "esp_camera.h"
+
+// raw format used while detection/recognition runs, detectors take RGB565 directly
+#ifndef CAPTURE_RAW_FORMAT
+#define CAPTURE_RAW_FORMAT PIXFORMAT_RGB565
+#endif
+
+// widest frame size that switches to the raw profile; wider frames stay sensor JPEG and are
+// detected on a scaled decode (VISION_CASCADE), with the face crop taken from the full frame
+#ifndef CAPTURE_RAW_MAX_WIDTH
+#define CAPTURE_RAW_MAX_WIDTH 400
+#endif
+
+// stay in the raw profile this long after analysis stops, so PIR/GUI toggles do not thrash the sensor
+#ifndef CAPTURE_PROFILE_HOLD_MS
+#define CAPTURE_PROFILE_HOLD_MS 5000
+#endif
+
+typedef enum {
+    CAPTURE_PROFILE_STREAM = 0,    // sensor JPEG, passed straight to viewers
+    CAPTURE_PROFILE_ANALYSE        // raw pixels, no JPEG decode before inference
+} capture_profile_t;
+
+typedef struct {
+    capture_profile_t active;
+    uint32_t switches;
+    uint32_t switch_failures;
+    uint32_t last_switch_us;
+    float avg_switch_us;
+    float jpeg_decode_us;          // moving average of JPEG -> RGB888 per frame
+    float raw_convert_us;          // moving average of raw -> RGB888 per frame (0 if never needed)
+    uint32_t decodes_skipped;      // frames analysed straight from raw pixels
+    uint32_t scaled_decodes;       // wide JPEG frames decoded at 1/scale for detection
+    int scale;                     // of the last scaled decode
+    float scaled_decode_us;        // moving average of one scaled decode
+    bool raw_unusable;             // a switch to raw failed, analysis stays on JPEG
+} capture_profile_stats_t;
+
+/* Cache the camera configuration used by setup(), call right after esp_camera_init succeeds */
+void capture_profile_init(const camera_config_t *config);
+
+/* Called by the vision task before each capture; switches format when analysis starts or has been off for the hold time.
+   Frame sizes wider than CAPTURE_RAW_MAX_WIDTH stay JPEG while analysing. */
+void capture_profile_update(bool analyse);
+
+/* Record how long a frame took to become RGB888 (or that the conversion was skipped) */
+void capture_profile_note_convert(pixformat_t src, uint32_t us);
+void capture_profile_note_skipped(void);
+void capture_profile_note_scaled(int scale, uint32_t us);
+
+/* Serialize sensor access against a format switch; release must follow every acquire. The sensor
+   is NULL when a failed switch could not bring the driver back. */
+sensor_t *capture_profile_sensor_acquire(void);
+void capture_profile_sensor_release(void);
+
+void capture_profile_get_stats(capture_profile_stats_t *stats);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+clip_recorder.cpp
+a few seconds of video around every intruder episode. The vision task copies each encoded
+frame it produces (the same JPEG it publishes to /stream) into a fixed PSRAM byte ring with a
+frame index; the oldest frames are overwritten, nothing is allocated after boot. When an
+episode ends a low priority task on core 0 waits for the post-roll, then writes the frames of
+[start - pre-roll, end + post-roll] as an MJPEG AVI (RIFF, avih/strh/strf, movi, idx1) into a
+preallocated export buffer served at /clip. The export locks the ring one frame at a time, so
+the frame loop never waits longer than a single frame copy.
+*/
+
+#include "clip_recorder.h"
+#include "intruder_episode.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#define TAG "clip: "
+
+#define CLIP_TASK_STACK 4096
+#define CLIP_TASK_PRIORITY 1
+#define CLIP_TASK_CORE 0
+
+// RIFF 12 + LIST hdrl 12 + avih 64 + LIST strl 12 + strh 64 + strf 48 + LIST movi 12
+#define CLIP_AVI_HEADER_LEN 224
+#define CLIP_AVI_MOVI_OFFSET 220         // idx1 offsets count from the 'movi' fourcc
+#define CLIP_AVI_INDEX_ENTRY 16
+
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+    int64_t timestamp_us;
+    uint16_t width;
+    uint16_t height;
+} clip_frame_t;
+
+// ring and index, guarded by ring_lock
+static uint8_t *ring = NULL;
+static clip_frame_t frames[CLIP_MAX_FRAMES];
+static uint32_t head_seq = 0;          // next frame
+static uint32_t tail_seq = 0;          // oldest frame still in the ring
+static uint32_t write_pos = 0;
+static SemaphoreHandle_t ring_lock = NULL;
+
+// exported AVI, guarded by export_lock (held while /clip sends it)
+static uint8_t *export_buf = NULL;
+static uint8_t *index_buf = NULL;
+static size_t export_len = 0;
+static uint32_t export_episode = 0;
+static SemaphoreHandle_t export_lock = NULL;
+
+// episode waiting to be exported, guarded by pending_mux
+static struct {
+    uint32_t episode;
+    int64_t from_us;
+    int64_t until_us;
+} pending;
+static portMUX_TYPE pending_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t clip_task_handle = NULL;
+static clip_recorder_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+
+/* fourcc + little endian size */
+static inline uint8_t *put_chunk(uint8_t *p, const char *fourcc, uint32_t size)
+{
+    memcpy(p, fourcc, 4);
+    put_u32(p + 4, size);
+    return p + 8;
+}
+
+
+/* drop the oldest frame. Call with ring_lock held. */
+static void clip_evict(void)
+{
+    stats.ring_bytes -= frames[tail_seq % CLIP_MAX_FRAMES].len;
+    tail_seq++;
+    stats.evicted++;
+}
+
+
+bool clip_recorder_enabled(void)
+{
+    return stats.ready && stats.enabled;
+}
+
+
+void clip_recorder_set_enabled(bool enabled)
+{
+    stats.enabled = enabled;
+}
+
+
+void clip_recorder_push(const uint8_t *jpg, size_t len, int width, int height, int64_t timestamp_us)
+{
+    if (!clip_recorder_enabled()) return;
+    if (len > CLIP_RING_BYTES / 4) {
+        stats.skipped++;
+        return;
+    }
+    int64_t t0 = esp_timer_get_time();
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+    if (write_pos + len > CLIP_RING_BYTES) {
+        // whatever sits between here and the end of the ring is the oldest, then start over at 0
+        while (tail_seq != head_seq && frames[tail_seq % CLIP_MAX_FRAMES].offset >= write_pos) {
+            clip_evict();
+        }
+        write_pos = 0;
+    }
+    while (tail_seq != head_seq) {
+        const clip_frame_t *f = &frames[tail_seq % CLIP_MAX_FRAMES];
+        bool overlaps = f->offset < write_pos + len && f->offset + f->len > write_pos;
+        if (!overlaps && head_seq - tail_seq < CLIP_MAX_FRAMES) break;
+        clip_evict();
+    }
+    memcpy(ring + write_pos, jpg, len);
+    clip_frame_t *f = &frames[head_seq % CLIP_MAX_FRAMES];
+    f->offset = write_pos;
+    f->len = len;
+    f->timestamp_us = timestamp_us;
+    f->width = width;
+    f->height = height;
+    head_seq++;
+    write_pos = (write_pos + len + 3) & ~3u;
+    stats.ring_bytes += len;
+    stats.ring_frames = head_seq - tail_seq;
+    xSemaphoreGive(ring_lock);
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.frames++;
+    stats.last_insert_us = us;
+    if (us > stats.max_insert_us) stats.max_insert_us = us;
+    stats.avg_insert_us = (stats.frames == 1) ? us : stats.avg_insert_us + ((float)us - stats.avg_insert_us) * 0.05f;
+}
+
+
+void clip_recorder_episode_closed(const intruder_episode_t *episode)
+{
+    if (!clip_recorder_enabled() || !clip_task_handle) return;
+    taskENTER_CRITICAL(&pending_mux);
+    pending.episode = episode->id;
+    pending.from_us = (int64_t)episode->start_ms * 1000 - (int64_t)CLIP_PREROLL_MS * 1000;
+    pending.until_us = (int64_t)episode->end_ms * 1000 + (int64_t)CLIP_POSTROLL_MS * 1000;
+    taskEXIT_CRITICAL(&pending_mux);
+    xTaskNotifyGive(clip_task_handle);
+}
+
+
+/* hdrl for n frames of width x height. Fills the first CLIP_AVI_HEADER_LEN bytes of out. */
+static void clip_avi_header(uint8_t *out, size_t riff_len, size_t movi_len, uint32_t n, int width, int height,
+                            uint32_t us_per_frame, uint32_t max_frame)
+{
+    uint8_t *p = out;
+    memset(out, 0, CLIP_AVI_HEADER_LEN);
+    p = put_chunk(p, "RIFF", riff_len - 8);
+    memcpy(p, "AVI ", 4);
+    p = put_chunk(p + 4, "LIST", 4 + 64 + 12 + 64 + 48);
+    memcpy(p, "hdrl", 4);
+    p = put_chunk(p + 4, "avih", 56);
+    put_u32(p, us_per_frame);
+    put_u32(p + 4, us_per_frame ? (uint32_t)((uint64_t)max_frame * 1000000 / us_per_frame) : 0);
+    put_u32(p + 12, 0x10);                       // AVIF_HASINDEX
+    put_u32(p + 16, n);
+    put_u32(p + 24, 1);                          // streams
+    put_u32(p + 28, max_frame);
+    put_u32(p + 32, width);
+    put_u32(p + 36, height);
+    p = put_chunk(p + 56, "LIST", 4 + 64 + 48);
+    memcpy(p, "strl", 4);
+    p = put_chunk(p + 4, "strh", 56);
+    memcpy(p, "vids", 4);
+    memcpy(p + 4, "MJPG", 4);
+    put_u32(p + 20, us_per_frame);               // scale
+    put_u32(p + 24, 1000000);                    // rate, fps = rate / scale
+    put_u32(p + 32, n);
+    put_u32(p + 36, max_frame);
+    put_u32(p + 40, 0xFFFFFFFF);                 // quality: default
+    put_u16(p + 52, width);
+    put_u16(p + 54, height);
+    p = put_chunk(p + 56, "strf", 40);
+    put_u32(p, 40);                              // BITMAPINFOHEADER
+    put_u32(p + 4, width);
+    put_u32(p + 8, height);
+    put_u16(p + 12, 1);
+    put_u16(p + 14, 24);
+    memcpy(p + 16, "MJPG", 4);
+    put_u32(p + 20, (uint32_t)width * height * 3);
+    p = put_chunk(p + 40, "LIST", movi_len);
+    memcpy(p, "movi", 4);
+}
+
+
+/* write the frames taken in [from_us, until_us] as an AVI into the export buffer */
+static void clip_export(uint32_t episode, int64_t from_us, int64_t until_us)
+{
+    int64_t t0 = esp_timer_get_time();
+    xSemaphoreTake(ring_lock, portMAX_DELAY);
+    uint32_t first = head_seq, last = head_seq;
+    for (uint32_t seq = tail_seq; seq != head_seq; seq++) {
+        int64_t ts = frames[seq % CLIP_MAX_FRAMES].timestamp_us;
+        if (ts < from_us) continue;
+        if (ts > until_us) break;
+        if (first == head_seq) first = seq;
+        last = seq + 1;
+    }
+    bool truncated = first == tail_seq && stats.evicted > 0;   // pre-roll already overwritten
+    xSemaphoreGive(ring_lock);
+    if (first == head_seq) {
+        ESP_LOGW(TAG, "episode %u: no frames left in the ring", episode);
+        return;
+    }
+
+    xSemaphoreTake(export_lock, portMAX_DELAY);
+    size_t pos = CLIP_AVI_HEADER_LEN;
+    uint32_t n = 0, max_frame = 0;
+    int width = 0, height = 0;
+    int64_t first_ts = 0, last_ts = 0;
+    for (uint32_t seq = first; seq != last; seq++) {
+        xSemaphoreTake(ring_lock, portMAX_DELAY);
+        if ((int32_t)(seq - tail_seq) < 0) {
+            // overwritten while we were exporting
+            xSemaphoreGive(ring_lock);
+            truncated = true;
+            continue;
+        }
+        const clip_frame_t *f = &frames[seq % CLIP_MAX_FRAMES];
+        size_t chunk = 8 + ((f->len + 1) & ~(size_t)1);
+        if (pos + chunk + 8 + (n + 1) * CLIP_AVI_INDEX_ENTRY > CLIP_EXPORT_BYTES) {
+            xSemaphoreGive(ring_lock);
+            truncated = true;
+            break;
+        }
+        uint8_t *p = put_chunk(export_buf + pos, "00dc", f->len);
+        memcpy(p, ring + f->offset, f->len);
+        if (f->len & 1) p[f->len] = 0;
+        uint8_t *idx = index_buf + n * CLIP_AVI_INDEX_ENTRY;
+        memcpy(idx, "00dc", 4);
+        put_u32(idx + 4, 0x10);                  // AVIIF_KEYFRAME
+        put_u32(idx + 8, pos - CLIP_AVI_MOVI_OFFSET);
+        put_u32(idx + 12, f->len);
+        if (f->len > max_frame) max_frame = f->len;
+        if (n == 0) first_ts = f->timestamp_us;
+        last_ts = f->timestamp_us;
+        width = f->width;
+        height = f->height;
+        xSemaphoreGive(ring_lock);
+        pos += chunk;
+        n++;
+    }
+    if (n > 0) {
+        size_t movi_len = pos - CLIP_AVI_MOVI_OFFSET;
+        uint8_t *p = put_chunk(export_buf + pos, "idx1", n * CLIP_AVI_INDEX_ENTRY);
+        memcpy(p, index_buf, n * CLIP_AVI_INDEX_ENTRY);
+        pos += 8 + n * CLIP_AVI_INDEX_ENTRY;
+        uint32_t us_per_frame = (n > 1) ? (uint32_t)((last_ts - first_ts) / (n - 1)) : 100000;
+        clip_avi_header(export_buf, pos, movi_len, n, width, height, us_per_frame, max_frame);
+        export_len = pos;
+        export_episode = episode;
+    }
+    xSemaphoreGive(export_lock);
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.clips++;
+    if (truncated) stats.truncated++;
+    stats.last_clip_frames = n;
+    stats.last_clip_bytes = pos;
+    stats.last_clip_episode = episode;
+    stats.last_export_us = us;
+    stats.export_mb_s = us ? (float)pos / us : 0;
+    ESP_LOGI(TAG, "episode %u: %u frames, %u bytes in %ums%s", episode, n, (uint32_t)pos, us / 1000,
+             truncated ? " (truncated)" : "");
+}
+
+
+/* waits for an episode end, then for its post-roll, then exports */
+static void clip_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        taskENTER_CRITICAL(&pending_mux);
+        uint32_t episode = pending.episode;
+        int64_t from_us = pending.from_us;
+        int64_t until_us = pending.until_us;
+        taskEXIT_CRITICAL(&pending_mux);
+        int64_t wait_us = until_us - esp_timer_get_time();
+        if (wait_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS(wait_us / 1000 + 1));
+        }
+        clip_export(episode, from_us, until_us);
+    }
+}
+
+
+bool clip_recorder_init(void)
+{
+    if (stats.ready) return true;
+    ring = (uint8_t *)heap_caps_malloc(CLIP_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    export_buf = (uint8_t *)heap_caps_malloc(CLIP_EXPORT_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    index_buf = (uint8_t *)heap_caps_malloc(CLIP_MAX_FRAMES * CLIP_AVI_INDEX_ENTRY, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ring || !export_buf || !index_buf) {
+        ESP_LOGE(TAG, "no PSRAM for the clip ring (%u + %u bytes)", CLIP_RING_BYTES, CLIP_EXPORT_BYTES);
+        heap_caps_free(ring);
+        heap_caps_free(export_buf);
+        heap_caps_free(index_buf);
+        ring = export_buf = index_buf = NULL;
+        return false;
+    }
+    ring_lock = xSemaphoreCreateMutex();
+    export_lock = xSemaphoreCreateMutex();
+    stats.ready = true;
+    stats.enabled = true;
+    xTaskCreatePinnedToCore(clip_task, "clip", CLIP_TASK_STACK, NULL, CLIP_TASK_PRIORITY, &clip_task_handle, CLIP_TASK_CORE);
+    return true;
+}
+
+
+bool clip_recorder_borrow(const uint8_t **data, size_t *len, uint32_t *episode)
+{
+    if (!stats.ready) return false;
+    xSemaphoreTake(export_lock, portMAX_DELAY);
+    if (export_len == 0) {
+        xSemaphoreGive(export_lock);
+        return false;
+    }
+    *data = export_buf;
+    *len = export_len;
+    *episode = export_episode;
+    return true;
+}
+
+
+void clip_recorder_return(void)
+{
+    xSemaphoreGive(export_lock);
+}
+
+
+void clip_recorder_get_stats(clip_recorder_stats_t *out)
+{
+    *out = stats;
+}
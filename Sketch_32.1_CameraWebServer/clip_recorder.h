@@ -0,0 +1,72 @@
+#ifndef CLIP_RECORDER_H
+#define CLIP_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct intruder_episode;    // intruder_episode.h
+
+// PSRAM ring of the most recent encoded frames
+#ifndef CLIP_RING_BYTES
+#define CLIP_RING_BYTES (1536 * 1024)
+#endif
+#ifndef CLIP_MAX_FRAMES
+#define CLIP_MAX_FRAMES 256
+#endif
+
+// the finished AVI of the last episode, served at /clip
+#ifndef CLIP_EXPORT_BYTES
+#define CLIP_EXPORT_BYTES (1024 * 1024)
+#endif
+
+// video kept before the first and after the last intruder frame of an episode
+#ifndef CLIP_PREROLL_MS
+#define CLIP_PREROLL_MS 3000
+#endif
+#ifndef CLIP_POSTROLL_MS
+#define CLIP_POSTROLL_MS 3000
+#endif
+
+typedef struct {
+    bool ready;                    // buffers allocated
+    bool enabled;
+    uint32_t frames;               // inserted into the ring
+    uint32_t skipped;              // frame larger than a quarter of the ring
+    uint32_t evicted;              // overwritten by newer frames
+    uint32_t ring_frames;          // in the ring right now
+    uint32_t ring_bytes;
+    uint32_t last_insert_us;
+    uint32_t max_insert_us;
+    float avg_insert_us;
+    uint32_t clips;
+    uint32_t truncated;            // clip did not fit CLIP_EXPORT_BYTES / lost frames to the ring
+    uint32_t last_clip_frames;
+    uint32_t last_clip_bytes;
+    uint32_t last_clip_episode;
+    uint32_t last_export_us;
+    float export_mb_s;             // ring -> AVI throughput of the last export
+} clip_recorder_stats_t;
+
+/* Preallocate the ring and the export buffer and start the export task */
+bool clip_recorder_init(void);
+
+/* Frames are wanted (recorder enabled), the vision task encodes for the ring even without viewers */
+bool clip_recorder_enabled(void);
+
+void clip_recorder_set_enabled(bool enabled);
+
+/* Copy one encoded frame into the ring, called from the vision task */
+void clip_recorder_push(const uint8_t *jpg, size_t len, int width, int height, int64_t timestamp_us);
+
+/* The episode is over: export [start - pre-roll, end + post-roll] once the post-roll is recorded */
+void clip_recorder_episode_closed(const struct intruder_episode *episode);
+
+/* Lend the last exported AVI, false if there is none. Must be followed by clip_recorder_return. */
+bool clip_recorder_borrow(const uint8_t **data, size_t *len, uint32_t *episode);
+
+void clip_recorder_return(void);
+
+void clip_recorder_get_stats(clip_recorder_stats_t *stats);
+
+#endif
@@ -0,0 +1,157 @@
+/*
+db_client.cpp
+one long-lived HTTP/1.1 keep-alive connection to the EC2 Flask server, shared by the telemetry
+uploader (/create), the heartbeat (/status_create) and intruder snapshots (/snapshot). Request
+headers are built once at init, only Content-Length and the body change per request. A
+connection the server dropped is re-opened once per request; failed connects back off exponentially.
+*/
+
+#include "db_client.h"
+#include "http_response.h"
+#include "event_codec.h"
+#include "trace.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <WiFi.h>
+#include <string.h>
+#define TAG "db: "
+
+#define DB_HEADER_LEN 192
+
+static const char *endpoint_paths[DB_ENDPOINT_COUNT] = { "/create", "/status_create", "/snapshot" };
+static const char *format_types[DB_FORMAT_COUNT] = { "application/json", EVENT_CODEC_CONTENT_TYPE,
+                                                     EVENT_CODEC_SNAPSHOT_CONTENT_TYPE };
+static char headers[DB_ENDPOINT_COUNT][DB_FORMAT_COUNT][DB_HEADER_LEN];
+static size_t header_lens[DB_ENDPOINT_COUNT][DB_FORMAT_COUNT];
+static WiFiClient client;
+static SemaphoreHandle_t db_lock = NULL;
+static int64_t retry_at_us = 0;
+static db_client_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+/* open the connection unless it is still up, honouring the backoff */
+static bool db_client_connect(bool *reused)
+{
+    *reused = false;
+    if (client.connected()) {
+        *reused = true;
+        return true;
+    }
+    int64_t now = esp_timer_get_time();
+    if (now < retry_at_us) {
+        stats.backoff_skips++;
+        return false;
+    }
+    client.stop();
+    if (WiFi.status() != WL_CONNECTED || !client.connect(DB_HOST, DB_PORT, DB_CLIENT_TIMEOUT_S * 1000)) {
+        stats.connect_failures++;
+        stats.backoff_ms = stats.backoff_ms ? stats.backoff_ms * 2 : DB_CLIENT_BACKOFF_MIN_MS;
+        if (stats.backoff_ms > DB_CLIENT_BACKOFF_MAX_MS) stats.backoff_ms = DB_CLIENT_BACKOFF_MAX_MS;
+        retry_at_us = now + (int64_t)stats.backoff_ms * 1000;
+        ESP_LOGW(TAG, "connect to %s:%d failed, retry in %ums", DB_HOST, DB_PORT, stats.backoff_ms);
+        return false;
+    }
+    client.setNoDelay(true);
+    client.setTimeout(DB_CLIENT_TIMEOUT_S);
+    uint32_t us = (uint32_t)(esp_timer_get_time() - now);
+    stats.connects++;
+    stats.backoff_ms = 0;
+    stats.avg_connect_us = (stats.connects == 1) ? us : stats.avg_connect_us + ((float)us - stats.avg_connect_us) * 0.2f;
+    return true;
+}
+
+
+/* one request on the current connection */
+static int db_client_send(db_endpoint_t endpoint, db_format_t format, const uint8_t *prefix, size_t prefix_len,
+                          const uint8_t *body, size_t len)
+{
+    char length[16];
+    int length_len = snprintf(length, sizeof(length), "%u\r\n\r\n", (uint32_t)(prefix_len + len));
+    size_t header_len = header_lens[endpoint][format];
+    if (client.write((const uint8_t *)headers[endpoint][format], header_len) != header_len ||
+        client.write((const uint8_t *)length, length_len) != (size_t)length_len ||
+        (prefix_len && client.write(prefix, prefix_len) != prefix_len) ||
+        client.write(body, len) != len) {
+        client.stop();
+        return -1;
+    }
+    int code = http_read_response(client);
+    if (code < 0) client.stop();
+    return code;
+}
+
+
+void db_client_init(void)
+{
+    if (db_lock) return;
+    db_lock = xSemaphoreCreateMutex();
+    for (int i = 0; i < DB_ENDPOINT_COUNT; i++) {
+        for (int f = 0; f < DB_FORMAT_COUNT; f++) {
+            int n = snprintf(headers[i][f], DB_HEADER_LEN,
+                             "POST %s HTTP/1.1\r\n"
+                             "Host: %s:%d\r\n"
+                             "User-Agent: esp32-intruder\r\n"
+                             "Content-Type: %s\r\n"
+                             "Connection: keep-alive\r\n"
+                             "Content-Length: ", endpoint_paths[i], DB_HOST, DB_PORT, format_types[f]);
+            header_lens[i][f] = (n > 0 && n < DB_HEADER_LEN) ? n : 0;
+        }
+    }
+}
+
+
+int db_client_post(db_endpoint_t endpoint, const char *body, size_t len)
+{
+    return db_client_post_format(endpoint, DB_FORMAT_JSON, (const uint8_t *)body, len);
+}
+
+
+int db_client_post_format(db_endpoint_t endpoint, db_format_t format, const uint8_t *body, size_t len)
+{
+    return db_client_post_parts(endpoint, format, NULL, 0, body, len);
+}
+
+
+int db_client_post_parts(db_endpoint_t endpoint, db_format_t format, const uint8_t *prefix, size_t prefix_len,
+                         const uint8_t *body, size_t len)
+{
+    if (!db_lock || endpoint >= DB_ENDPOINT_COUNT || format >= DB_FORMAT_COUNT) return -1;
+    xSemaphoreTake(db_lock, portMAX_DELAY);
+    trace_begin(TRACE_DB_POST);
+    stats.requests++;
+    if (format != DB_FORMAT_JSON) stats.binary_requests++;
+    int code = -1;
+    bool reused = false;
+    if (db_client_connect(&reused)) {
+        int64_t t0 = esp_timer_get_time();
+        code = db_client_send(endpoint, format, prefix, prefix_len, body, len);
+        if (code < 0 && reused) {
+            // server timed the idle connection out, open a fresh one and send again
+            stats.stale_retries++;
+            if (db_client_connect(&reused)) {
+                t0 = esp_timer_get_time();
+                code = db_client_send(endpoint, format, prefix, prefix_len, body, len);
+            }
+        } else if (reused) {
+            stats.reuses++;
+        }
+        if (code >= 0) {
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+            stats.last_rtt_us = us;
+            stats.avg_rtt_us = (stats.avg_rtt_us == 0) ? us : stats.avg_rtt_us + ((float)us - stats.avg_rtt_us) * 0.2f;
+        }
+    }
+    if (code < 0) stats.failures++;
+    trace_end(TRACE_DB_POST);
+    xSemaphoreGive(db_lock);
+    return code;
+}
+
+
+void db_client_get_stats(db_client_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,74 @@
+#ifndef DB_CLIENT_H
+#define DB_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// EC2 Flask server (app_intruder_detector.py)
+#ifndef DB_HOST
+#define DB_HOST "54.167.124.79"
+#endif
+
+#ifndef DB_PORT
+#define DB_PORT 5000
+#endif
+
+// socket connect / response timeout
+#ifndef DB_CLIENT_TIMEOUT_S
+#define DB_CLIENT_TIMEOUT_S 5
+#endif
+
+// reconnect backoff after a failed connect, doubles up to the max
+#ifndef DB_CLIENT_BACKOFF_MIN_MS
+#define DB_CLIENT_BACKOFF_MIN_MS 1000
+#endif
+#ifndef DB_CLIENT_BACKOFF_MAX_MS
+#define DB_CLIENT_BACKOFF_MAX_MS 30000
+#endif
+
+typedef enum {
+    DB_ENDPOINT_CREATE = 0,        // /create, recognizer events
+    DB_ENDPOINT_STATUS,            // /status_create, heartbeat
+    DB_ENDPOINT_SNAPSHOT,          // /snapshot, intruder episode JPEG
+    DB_ENDPOINT_COUNT
+} db_endpoint_t;
+
+typedef enum {
+    DB_FORMAT_JSON = 0,            // application/json
+    DB_FORMAT_BINARY,              // event_codec.h records
+    DB_FORMAT_SNAPSHOT,            // one event_codec.h record + JPEG
+    DB_FORMAT_COUNT
+} db_format_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t binary_requests;
+    uint32_t failures;             // no usable response
+    uint32_t connects;             // TCP handshakes
+    uint32_t reuses;               // requests sent on an already open connection
+    uint32_t stale_retries;        // reused connection was closed by the server, re-sent once
+    uint32_t connect_failures;
+    uint32_t backoff_skips;        // requests refused while backing off
+    uint32_t backoff_ms;           // current backoff, 0 when connected
+    uint32_t last_rtt_us;
+    float avg_rtt_us;              // request written -> response read
+    float avg_connect_us;
+} db_client_stats_t;
+
+/* Build the request headers and the lock, call once before any post */
+void db_client_init(void);
+
+/* POST a JSON body over the shared keep-alive connection.
+   Returns the HTTP status code, or -1 when no response could be obtained. Thread safe. */
+int db_client_post(db_endpoint_t endpoint, const char *body, size_t len);
+
+/* Same, with the body in the given format */
+int db_client_post_format(db_endpoint_t endpoint, db_format_t format, const uint8_t *body, size_t len);
+
+/* Same, the body being prefix followed by data, written as is (no copy to join them) */
+int db_client_post_parts(db_endpoint_t endpoint, db_format_t format, const uint8_t *prefix, size_t prefix_len,
+                         const uint8_t *body, size_t len);
+
+void db_client_get_stats(db_client_stats_t *stats);
+
+#endif
@@ -0,0 +1,71 @@
+/*
+event_codec.cpp
+zero-allocation encoder for the fixed-layout binary event records (see event_codec.h),
+14 bytes per event instead of ~70 bytes of JSON text.
+*/
+
+#include "event_codec.h"
+
+// ----- FUNCTIONS --------------------------------
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+
+bool event_codec_begin(event_encoder_t *enc, uint8_t *buf, size_t cap)
+{
+    enc->buf = buf;
+    enc->cap = cap;
+    enc->len = 0;
+    enc->count = 0;
+    if (cap < EVENT_CODEC_HEADER_LEN) return false;
+    buf[0] = 'E';
+    buf[1] = 'V';
+    buf[2] = EVENT_CODEC_VERSION;
+    buf[3] = 0;
+    enc->len = EVENT_CODEC_HEADER_LEN;
+    return true;
+}
+
+
+bool event_codec_put(event_encoder_t *enc, const event_record_t *r)
+{
+    if (enc->len < EVENT_CODEC_HEADER_LEN || enc->count >= EVENT_CODEC_MAX_COUNT ||
+        enc->len + EVENT_CODEC_RECORD_LEN > enc->cap) {
+        return false;
+    }
+    uint8_t *p = enc->buf + enc->len;
+    // saturated; NaN (c != c) would be undefined behaviour in the cast and encodes as 0
+    float c = r->confidence * 10000.0f;
+    int16_t confidence_e4 = (c != c) ? 0 : (int16_t)((c > 32767.0f) ? 32767.0f : (c < -32768.0f) ? -32768.0f : c);
+    p[0] = r->type;
+    p[1] = r->flags;
+    put_u16(p + 2, (uint16_t)r->face_id);
+    put_u16(p + 4, (uint16_t)confidence_e4);
+    put_u32(p + 6, r->seq);
+    put_u32(p + 10, r->time);
+    enc->len += EVENT_CODEC_RECORD_LEN;
+    enc->count++;
+    return true;
+}
+
+
+size_t event_codec_finish(event_encoder_t *enc)
+{
+    if (enc->len >= EVENT_CODEC_HEADER_LEN) {
+        enc->buf[3] = (uint8_t)enc->count;
+    }
+    return enc->len;
+}
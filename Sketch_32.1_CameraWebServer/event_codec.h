@@ -0,0 +1,63 @@
+#ifndef EVENT_CODEC_H
+#define EVENT_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+Binary wire format for /create and /status_create (Content-Type EVENT_CODEC_CONTENT_TYPE),
+little endian, decoded by decode_events() in app_intruder_detector.py:
+
+  header  4 bytes   'E' 'V' version(1) count(1)
+  record 14 bytes   type(1) flags(1) face_id(int16) confidence_e4(int16) seq(uint32) time(uint32)
+
+time is epoch seconds with EVENT_FLAG_TS, milliseconds ago with EVENT_FLAG_AGE, unused otherwise.
+/snapshot bodies (EVENT_CODEC_SNAPSHOT_CONTENT_TYPE) are a one-record batch of type
+EVENT_TYPE_SNAPSHOT (seq = episode, time = episode start) directly followed by the JPEG.
+*/
+
+#define EVENT_CODEC_CONTENT_TYPE "application/x-intruder-events"
+#define EVENT_CODEC_SNAPSHOT_CONTENT_TYPE "application/x-intruder-snapshot"
+#define EVENT_CODEC_VERSION 1
+#define EVENT_CODEC_HEADER_LEN 4
+#define EVENT_CODEC_RECORD_LEN 14
+#define EVENT_CODEC_MAX_COUNT 255
+
+// record types
+#define EVENT_TYPE_RECOGNITION 1
+#define EVENT_TYPE_HEARTBEAT 2
+#define EVENT_TYPE_SNAPSHOT 3
+
+// record flags
+#define EVENT_FLAG_INTRUDER 0x01
+#define EVENT_FLAG_TS 0x02
+#define EVENT_FLAG_AGE 0x04
+#define EVENT_FLAG_SEQ 0x08
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    int16_t face_id;
+    float confidence;
+    uint32_t seq;
+    uint32_t time;
+} event_record_t;
+
+// encoder state over a caller-owned buffer, nothing is allocated
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    int count;
+} event_encoder_t;
+
+/* Start a batch in buf; false if cap cannot even hold the header */
+bool event_codec_begin(event_encoder_t *enc, uint8_t *buf, size_t cap);
+
+/* Append one record; false when the buffer or the count is full */
+bool event_codec_put(event_encoder_t *enc, const event_record_t *record);
+
+/* Patch the record count into the header, returns the encoded length */
+size_t event_codec_finish(event_encoder_t *enc);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+face_crop.cpp
+region-of-interest extraction for recognition. FaceRecognition112V1S8 only needs the aligned
+112x112 face, so instead of turning the whole frame into RGB888 we produce just the padded
+face box: RGB565 frames are converted pixel by pixel inside the box, JPEG frames are decoded
+only up to the last MCU row of the box and only the MCUs overlapping it are written out.
+*/
+
+#include "face_crop.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_jpg_decode.h"
+#include "jpeg_decoder.h"
+#include <string.h>
+#define TAG "crop: "
+
+// JPEG decode cursor
+typedef struct {
+    const uint8_t *src;
+    const face_crop_t *crop;
+    uint8_t *out;
+    int x0;                       // crop origin in (scaled) decoder coordinates
+    int y0;
+    bool done;                    // reached the row below the crop
+} crop_decoder_t;
+
+static face_crop_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+bool face_crop_region(const std::vector<int> &box, int frame_width, int frame_height, face_crop_t *crop)
+{
+    if (box.size() < 4 || frame_width < 1 || frame_height < 1) return false;
+    face_crop_t c;
+    int x0 = box[0], y0 = box[1], x1 = box[2], y1 = box[3];
+    int pad_x = (x1 - x0 + 1) * FACE_CROP_PAD_PCT / 100;
+    int pad_y = (y1 - y0 + 1) * FACE_CROP_PAD_PCT / 100;
+    x0 -= pad_x;
+    y0 -= pad_y;
+    x1 += pad_x;
+    y1 += pad_y;
+    // a box from a track predicted past the border can lie partly or wholly outside the frame
+    if (x0 >= frame_width || y0 >= frame_height || x1 < 0 || y1 < 0 || x1 < x0 || y1 < y0) return false;
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 >= frame_width) ? frame_width - 1 : x1;
+    y1 = (y1 >= frame_height) ? frame_height - 1 : y1;
+    int w = x1 - x0 + 1, h = y1 - y0 + 1;
+    // decimate large faces by a power of two (the JPEG decoder can scale by 2/4/8 for free)
+    c.step = 1;
+    while ((w / c.step > FACE_CROP_MAX_SIDE || h / c.step > FACE_CROP_MAX_SIDE) && c.step < 8) {
+        c.step *= 2;
+    }
+    c.x = x0 / c.step * c.step;
+    c.y = y0 / c.step * c.step;
+    c.out_width = w / c.step;
+    c.out_height = h / c.step;
+    if (c.out_width > FACE_CROP_MAX_SIDE) c.out_width = FACE_CROP_MAX_SIDE;
+    if (c.out_height > FACE_CROP_MAX_SIDE) c.out_height = FACE_CROP_MAX_SIDE;
+    if (c.out_width < 1 || c.out_height < 1) return false;
+    c.width = c.out_width * c.step;
+    c.height = c.out_height * c.step;
+    *crop = c;
+    return true;
+}
+
+
+/* RGB565 (camera byte order) -> BGR888, same bit layout as fmt2rgb888 */
+static bool face_crop_from_rgb565(const uint8_t *src, size_t src_len, int frame_width, int frame_height,
+                                  const face_crop_t *c, uint8_t *out)
+{
+    if (src_len < (size_t)frame_width * frame_height * 2) return false;
+    for (int oy = 0; oy < c->out_height; oy++) {
+        const uint8_t *p = src + ((size_t)(c->y + oy * c->step) * frame_width + c->x) * 2;
+        for (int ox = 0; ox < c->out_width; ox++, p += c->step * 2) {
+            uint8_t hb = p[0], lb = p[1];
+            *out++ = (lb & 0x1F) << 3;
+            *out++ = (hb & 0x07) << 5 | (lb & 0xE0) >> 3;
+            *out++ = hb & 0xF8;
+        }
+    }
+    return true;
+}
+
+
+/* crop rows out of an already decoded BGR888 frame */
+static bool face_crop_from_rgb888(const uint8_t *src, size_t src_len, int frame_width, int frame_height,
+                                  const face_crop_t *c, uint8_t *out)
+{
+    if (src_len < (size_t)frame_width * frame_height * 3) return false;
+    for (int oy = 0; oy < c->out_height; oy++) {
+        const uint8_t *p = src + ((size_t)(c->y + oy * c->step) * frame_width + c->x) * 3;
+        if (c->step == 1) {
+            memcpy(out, p, c->out_width * 3);
+            out += c->out_width * 3;
+            continue;
+        }
+        for (int ox = 0; ox < c->out_width; ox++, p += c->step * 3) {
+            *out++ = p[0];
+            *out++ = p[1];
+            *out++ = p[2];
+        }
+    }
+    return true;
+}
+
+
+/* jpg_reader_cb: the whole JPEG is already in memory */
+static size_t face_crop_jpg_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    crop_decoder_t *d = (crop_decoder_t *)arg;
+    if (buf) {
+        memcpy(buf, d->src + index, len);
+    }
+    return len;
+}
+
+
+/* jpg_writer_cb: copy the part of each decoded MCU that overlaps the crop, stop below it */
+static bool face_crop_jpg_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    crop_decoder_t *d = (crop_decoder_t *)arg;
+    if (!data) {
+        return true;              // start / end notifications
+    }
+    int cx1 = d->x0 + d->crop->out_width;
+    int cy1 = d->y0 + d->crop->out_height;
+    if (y >= cy1) {
+        d->done = true;
+        return false;             // aborts the decoder, nothing below the face is needed
+    }
+    int ix0 = (x > d->x0) ? x : d->x0;
+    int ix1 = (x + w < cx1) ? x + w : cx1;
+    int iy0 = (y > d->y0) ? y : d->y0;
+    int iy1 = (y + h < cy1) ? y + h : cy1;
+    if (ix0 >= ix1 || iy0 >= iy1) {
+        return true;
+    }
+    for (int yy = iy0; yy < iy1; yy++) {
+        const uint8_t *s = data + ((yy - y) * w + (ix0 - x)) * 3;
+        uint8_t *o = d->out + ((yy - d->y0) * d->crop->out_width + (ix0 - d->x0)) * 3;
+        for (int xx = ix0; xx < ix1; xx++, s += 3, o += 3) {
+            o[0] = s[2];
+            o[1] = s[1];
+            o[2] = s[0];
+        }
+    }
+    return true;
+}
+
+
+/* decode the crop's MCUs, using the decoder's DCT scaling for the decimation step. Runs on the
+   recognition core while the capture stage decodes the next frame, hence the decoder lock. */
+static bool face_crop_from_jpeg(const uint8_t *src, size_t src_len, const face_crop_t *c, uint8_t *out)
+{
+    jpg_scale_t scale = JPG_SCALE_NONE;
+    if (c->step == 2) scale = JPG_SCALE_2X;
+    else if (c->step == 4) scale = JPG_SCALE_4X;
+    else if (c->step >= 8) scale = JPG_SCALE_8X;
+    crop_decoder_t d = { src, c, out, c->x / c->step, c->y / c->step, false };
+    jpeg_decoder_take();
+    esp_err_t err = esp_jpg_decode(src_len, scale, face_crop_jpg_read, face_crop_jpg_write, &d);
+    jpeg_decoder_give();
+    return err == ESP_OK || d.done;
+}
+
+
+bool face_crop_extract(const uint8_t *src, size_t src_len, pixformat_t format,
+                       int frame_width, int frame_height, const face_crop_t *crop, uint8_t *out)
+{
+    int64_t t0 = esp_timer_get_time();
+    bool ok = false;
+    if (format == PIXFORMAT_RGB565) {
+        ok = face_crop_from_rgb565(src, src_len, frame_width, frame_height, crop, out);
+    } else if (format == PIXFORMAT_RGB888) {
+        ok = face_crop_from_rgb888(src, src_len, frame_width, frame_height, crop, out);
+    } else if (format == PIXFORMAT_JPEG) {
+        ok = face_crop_from_jpeg(src, src_len, crop, out);
+    }
+    if (!ok) {
+        stats.failures++;
+        ESP_LOGE(TAG, "crop %dx%d from format %d failed", crop->out_width, crop->out_height, format);
+        return false;
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    size_t bytes = (size_t)crop->out_width * crop->out_height * 3;
+    stats.crops++;
+    stats.avg_us = (stats.crops == 1) ? us : stats.avg_us + ((float)us - stats.avg_us) * 0.05f;
+    if (bytes > stats.peak_bytes) stats.peak_bytes = bytes;
+    stats.full_frame_bytes = (size_t)frame_width * frame_height * 3;
+    return true;
+}
+
+
+bool face_crop_decode_scaled(const uint8_t *src, size_t src_len, int frame_width, int frame_height, int step, uint8_t *out)
+{
+    // the whole frame as one crop sampled every step pixels
+    face_crop_t c = { 0, 0, 0, 0, step, frame_width / step, frame_height / step };
+    c.width = c.out_width * step;
+    c.height = c.out_height * step;
+    return face_crop_from_jpeg(src, src_len, &c, out);
+}
+
+
+std::vector<int> face_crop_landmarks(const std::vector<int> &keypoints, const face_crop_t *crop)
+{
+    std::vector<int> out(keypoints.size());
+    for (size_t i = 0; i + 1 < keypoints.size(); i += 2) {
+        out[i] = (keypoints[i] - crop->x) / crop->step;
+        out[i + 1] = (keypoints[i + 1] - crop->y) / crop->step;
+    }
+    return out;
+}
+
+
+void face_crop_get_stats(face_crop_stats_t *out)
+{
+    *out = stats;
+}
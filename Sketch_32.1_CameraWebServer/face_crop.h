@@ -0,0 +1,58 @@
+#ifndef FACE_CROP_H
+#define FACE_CROP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "esp_camera.h"
+
+// padding added around the detected box on every side, the 112x112 alignment warp reaches past the box
+#ifndef FACE_CROP_PAD_PCT
+#define FACE_CROP_PAD_PCT 30
+#endif
+
+// largest crop side handed to the recognizer, bigger faces are decimated by a power of two
+#ifndef FACE_CROP_MAX_SIDE
+#define FACE_CROP_MAX_SIDE 224
+#endif
+
+#define FACE_CROP_MAX_BYTES (FACE_CROP_MAX_SIDE * FACE_CROP_MAX_SIDE * 3)
+
+// padded face region in full-frame coordinates, sampled every `step` pixels
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+    int step;
+    int out_width;                // width / step
+    int out_height;               // height / step
+} face_crop_t;
+
+typedef struct {
+    uint32_t crops;
+    uint32_t failures;
+    float avg_us;                 // moving average time to produce a crop
+    size_t peak_bytes;            // largest crop produced
+    size_t full_frame_bytes;      // what a full RGB888 decode of the same frame needs
+} face_crop_stats_t;
+
+/* Padded crop around a detection box, clamped to the frame and aligned to the decimation step.
+   False when nothing of the box is left inside the frame. */
+bool face_crop_region(const std::vector<int> &box, int frame_width, int frame_height, face_crop_t *crop);
+
+/* Decode / convert only the crop into out as BGR888 (out_width * out_height * 3 bytes).
+   JPEG input stops decoding after the last MCU row of the crop; RGB565 input is converted in place. */
+bool face_crop_extract(const uint8_t *src, size_t src_len, pixformat_t format,
+                       int frame_width, int frame_height, const face_crop_t *crop, uint8_t *out);
+
+/* Whole JPEG frame decoded at 1/step (2, 4 or 8) into out as BGR888 ((frame_width / step) x (frame_height / step)),
+   scaled in the DCT domain by the decoder. Not counted as a crop. */
+bool face_crop_decode_scaled(const uint8_t *src, size_t src_len, int frame_width, int frame_height, int step, uint8_t *out);
+
+/* Keypoints moved into crop coordinates */
+std::vector<int> face_crop_landmarks(const std::vector<int> &keypoints, const face_crop_t *crop);
+
+void face_crop_get_stats(face_crop_stats_t *stats);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+face_models.cpp
+owns the face detection and recognition models for the lifetime of the device.
+Everything is built once at boot and warmed up with a synthetic frame so the first
+PIR-triggered frame or stream connection runs at steady-state speed.
+*/
+
+#include "face_models.h"
+#include "gallery.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <vector>
+#include <list>
+#define TAG "models: "
+
+// MSR01 params: (score/confidence threshold; nms threshold (IoU); top_K (candidates to return); post filter threshold)
+static HumanFaceDetectMSR01 *msr01 = NULL;
+// MNP01 params: (score/confidence threshold; nms threshold (IoU); top_K (candidates to return))
+static HumanFaceDetectMNP01 *mnp01 = NULL;
+/*
+    face recognition model (neural network)
+    extracts face embeddings and compares to IDs
+    only its embeddings are used, enrolled IDs live in gallery.cpp
+    (112x112) aligned face images with 8 bit signed weights and activations
+*/
+static FaceRecognition112V1S8 *recognizer = NULL;
+
+static face_models_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+/* fill a synthetic frame: soft gradient with a brighter oval where a face would be */
+static void face_models_fill_warmup(uint8_t *img, int width, int height)
+{
+    int cx = width / 2, cy = height / 2;
+    int rx = width / 6, ry = height / 4;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int dx = (x - cx) * 100 / rx, dy = (y - cy) * 100 / ry;
+            uint8_t v = (uint8_t)(40 + (x + y) * 60 / (width + height));
+            if (dx * dx + dy * dy < 100 * 100) v = 170;
+            uint8_t *p = img + (y * width + x) * 3;
+            p[0] = v; p[1] = v; p[2] = v;
+        }
+    }
+}
+
+
+/* run detection + recognition on the synthetic frame, returns (detect_us, recognize_us) */
+static void face_models_warmup_pass(uint8_t *img, int width, int height, uint32_t *detect_us, uint32_t *recognize_us)
+{
+    int64_t t0 = esp_timer_get_time();
+    std::list<dl::detect::result_t> &candidates = msr01->infer(img, {height, width, 3});
+    mnp01->infer(img, {height, width, 3}, candidates);
+    int64_t t1 = esp_timer_get_time();
+    // landmarks of a frontal face around the oval (left eye, mouth left, nose, right eye, mouth right)
+    int cx = width / 2, cy = height / 2, s = height / 10;
+    std::vector<int> landmarks = {cx - s, cy - s, cx - s, cy + s, cx, cy, cx + s, cy - s, cx + s, cy + s};
+    Tensor<uint8_t> tensor;
+    tensor.set_element(img).set_shape({height, width, 3}).set_auto_free(false);
+    gallery_match_t match;
+    gallery_match(recognizer->get_face_emb(tensor, landmarks).get_element_ptr(), &match);
+    int64_t t2 = esp_timer_get_time();
+    *detect_us = (uint32_t)(t1 - t0);
+    *recognize_us = (uint32_t)(t2 - t1);
+}
+
+
+void face_models_init(int width, int height)
+{
+    if (stats.ready) return;
+    memset(&stats, 0, sizeof(stats));
+    int64_t t0 = esp_timer_get_time();
+    msr01 = new HumanFaceDetectMSR01(0.2F, 0.1F, 10, 0.2F);
+    mnp01 = new HumanFaceDetectMNP01(0.2F, 0.1F, 5);
+    recognizer = new FaceRecognition112V1S8();
+    int64_t t1 = esp_timer_get_time();
+    if (gallery_needs_recognizer_ids()) {
+        // ids saved by the recognizer's own enroll, imported by gallery_init
+        recognizer->set_partition(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, GALLERY_LEGACY_PARTITION);
+        recognizer->set_ids_from_flash();
+    }
+    gallery_init(*recognizer);            // map the gallery in the fr partition
+    int64_t t2 = esp_timer_get_time();
+    stats.build_us = (uint32_t)(t1 - t0);
+    stats.load_ids_us = (uint32_t)(t2 - t1);
+    stats.warmup_width = width;
+    stats.warmup_height = height;
+
+    uint8_t *img = (uint8_t *)heap_caps_malloc(width * height * 3, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!img) {
+        ESP_LOGE(TAG, "warm-up frame alloc failed, first real frame will pay the cold cost");
+    } else {
+        face_models_fill_warmup(img, width, height);
+        face_models_warmup_pass(img, width, height, &stats.cold_detect_us, &stats.cold_recognize_us);
+        face_models_warmup_pass(img, width, height, &stats.warm_detect_us, &stats.warm_recognize_us);
+        free(img);
+    }
+    stats.ready = true;
+    ESP_LOGI(TAG, "models ready: build %ums, ids %ums, detect cold/warm %u/%ums, recognize cold/warm %u/%ums (%dx%d)",
+             stats.build_us / 1000, stats.load_ids_us / 1000,
+             stats.cold_detect_us / 1000, stats.warm_detect_us / 1000,
+             stats.cold_recognize_us / 1000, stats.warm_recognize_us / 1000, width, height);
+}
+
+
+HumanFaceDetectMSR01 &face_models_msr01(void)
+{
+    return *msr01;
+}
+
+
+HumanFaceDetectMNP01 &face_models_mnp01(void)
+{
+    return *mnp01;
+}
+
+
+FaceRecognition112V1S8 &face_models_recognizer(void)
+{
+    return *recognizer;
+}
+
+
+void face_models_get_stats(face_models_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,43 @@
+#ifndef FACE_MODELS_H
+#define FACE_MODELS_H
+
+#include <stdint.h>
+
+// First Stage Detector - Multi State Regression 1 - Run lightweight model to find potential face candidate regions
+// Outputs a bounding box
+// (score_threshold, nms_threshold, top_k, center_variance)
+#include "human_face_detect_msr01.hpp"
+// Second Stage Detector - Multi Network Pipeline - Takes bounding boxes and improves location and add facial landmarks
+// Needed for proper landmark alignment -- two stage recognition
+#include "human_face_detect_mnp01.hpp"
+
+#define TWO_STAGE 1                         // 1: detect by two-stage, uses keypoints, needed for facial recognition
+#include "face_recognition_tool.hpp"
+// Espressif face recognition models
+#include "face_recognition_112_v1_s8.hpp"   // less accurate but runs faster - what we're using!
+
+// model lifecycle timings, all in microseconds
+typedef struct {
+    bool ready;
+    uint32_t build_us;             // constructing detectors + recognizer
+    uint32_t load_ids_us;          // reading enrolled ids from the fr partition
+    uint32_t cold_detect_us;       // first MSR01+MNP01 pass (allocates internal buffers)
+    uint32_t warm_detect_us;       // second pass, what a real frame costs
+    uint32_t cold_recognize_us;
+    uint32_t warm_recognize_us;
+    int warmup_width;
+    int warmup_height;
+} face_models_stats_t;
+
+/* Build detectors and recognizer once, load enrolled ids and run a synthetic warm-up at width x height */
+void face_models_init(int width, int height);
+
+/* Long-lived model instances, valid after face_models_init */
+HumanFaceDetectMSR01 &face_models_msr01(void);
+HumanFaceDetectMNP01 &face_models_mnp01(void);
+FaceRecognition112V1S8 &face_models_recognizer(void);
+
+/* Copy of the boot timings */
+void face_models_get_stats(face_models_stats_t *stats);
+
+#endif
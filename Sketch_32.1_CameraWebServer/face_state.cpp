@@ -0,0 +1,46 @@
+/*
+face_state.cpp
+detection / recognition switches: the GUI and the PIR each request detection and recognition,
+recompute_face_state folds the requests into the flags the vision task reads. Kept apart from
+the web server so host/bench_host.cpp can time it.
+*/
+
+#include "face_state.h"
+#include "vision_task.h"
+#include "trace.h"
+#include "esp_log.h"
+
+/* face detection and recognition variables */
+volatile bool detection_via_gui = false;
+volatile bool recognition_via_gui = false;
+volatile bool detection_via_pir = false;
+volatile bool recognition_via_pir = false;
+
+volatile int8_t is_enrolling = 0;
+volatile int8_t detection_enabled = 0;
+volatile int8_t recognition_enabled = 0;
+
+// ----- FUNCTIONS --------------------------------
+
+/* Used to check either flag and determine if recognition or detection has been triggered by gui or pir */
+void recompute_face_state() {
+    // recognition depends on detection
+    // If no face has been enrolled yet, ignore PIR-sourced requests to enable detection/recognition.
+    int enrolled_count = vision_enrolled_count();
+    if (enrolled_count == 0) {
+        if (detection_via_pir || recognition_via_pir) {
+            ESP_LOGI("face_state", "PIR requested detection/recognition but no enrolled faces - ignoring PIR");
+        }
+        // Prevent PIR from enabling detection/recognition when there are no enrolled faces.
+        detection_via_pir = false;
+        recognition_via_pir = false;
+    }
+    // recognition depends on detection
+    recognition_enabled = (recognition_via_gui || recognition_via_pir) ? 1 : 0;
+    detection_enabled = (detection_via_gui || detection_via_pir || is_enrolling) ? 1 : 0;
+    if (recognition_enabled) detection_enabled = 1;
+    trace_instant(TRACE_FACE_STATE, detection_enabled | (recognition_enabled << 1));
+    ESP_LOGI("face_state", "recompute: d_gui=%d d_pir=%d enroll=%d => detect=%d | r_gui=%d r_pir=%d => recog=%d",
+             detection_via_gui, detection_via_pir, is_enrolling,
+             detection_enabled, recognition_via_gui, recognition_via_pir, recognition_enabled);
+}
@@ -16,4 +16,7 @@ extern volatile int8_t recognition_enabled;
 /* recompute facial detection and recognition state on pir and gui flags */
 void recompute_face_state();
 
+/* apply one /control variable (GUI or session replay), <0 if unknown or rejected */
+int control_apply(const char *variable, const char *value);
+
 #endif
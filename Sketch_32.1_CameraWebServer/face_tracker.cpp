@@ -0,0 +1,299 @@
+/*
+face_tracker.cpp
+detect-then-track scheduler. The two-stage detector runs every N frames (or as soon as a
+track is lost); in between, boxes and keypoints are carried forward with a constant-velocity
+IoU tracker. N adapts to how fast the tracked faces move and to how expensive detection is.
+*/
+
+#include "face_tracker.h"
+#include "session.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <string.h>
+#include <math.h>
+#define TAG "tracker: "
+
+#define TRACKER_MATCH_IOU 0.3f           // min IoU to continue a track on a detection frame
+#define TRACKER_MAX_MISSES 1             // detection frames a track may go unmatched
+#define TRACKER_MAX_DRIFT 0.25f          // predicted drift (box widths) allowed before re-detecting
+#define TRACKER_VELOCITY_ALPHA 0.5f      // smoothing of the per-frame velocity estimate
+
+typedef struct {
+    bool active;
+    uint32_t id;
+    float box[4];                 // x0, y0, x1, y1
+    float keypoint[10];
+    float vx, vy;                 // px per frame
+    float score;
+    int category;
+    int misses;
+    int face_id;
+    int64_t detected_us;
+    bool identified;
+    track_identity_t identity;
+    int64_t identified_us;
+} face_track_t;
+
+static face_track_t tracks[TRACKER_MAX_TRACKS];
+static std::list<dl::detect::result_t> predicted;
+static face_tracker_stats_t stats = { .interval = 1 };
+static uint32_t next_track_id = 1;
+static int frames_since_detect = 0;
+static bool force_detect = true;
+static int front_track = -1;
+
+// ----- FUNCTIONS --------------------------------
+
+static float tracker_iou(const float *a, const std::vector<int> &b)
+{
+    float ix0 = fmaxf(a[0], b[0]), iy0 = fmaxf(a[1], b[1]);
+    float ix1 = fminf(a[2], b[2]), iy1 = fminf(a[3], b[3]);
+    float iw = ix1 - ix0 + 1, ih = iy1 - iy0 + 1;
+    if (iw <= 0 || ih <= 0) return 0;
+    float inter = iw * ih;
+    float area_a = (a[2] - a[0] + 1) * (a[3] - a[1] + 1);
+    float area_b = (float)(b[2] - b[0] + 1) * (b[3] - b[1] + 1);
+    return inter / (area_a + area_b - inter);
+}
+
+
+/* copy a detection into a track, estimating velocity from the centre shift since the last detection */
+static void tracker_assign(face_track_t *t, const dl::detect::result_t &r, int frames, int64_t now)
+{
+    if (t->active && frames > 0) {
+        float cx_old = (t->box[0] + t->box[2]) * 0.5f, cy_old = (t->box[1] + t->box[3]) * 0.5f;
+        float cx_new = (r.box[0] + r.box[2]) * 0.5f, cy_new = (r.box[1] + r.box[3]) * 0.5f;
+        // t->box was already advanced by the prediction, the residual corrects the velocity
+        float vx = t->vx + (cx_new - cx_old) / frames;
+        float vy = t->vy + (cy_new - cy_old) / frames;
+        t->vx += (vx - t->vx) * TRACKER_VELOCITY_ALPHA;
+        t->vy += (vy - t->vy) * TRACKER_VELOCITY_ALPHA;
+    }
+    for (int i = 0; i < 4; i++) t->box[i] = r.box[i];
+    for (int i = 0; i < 10 && i < (int)r.keypoint.size(); i++) t->keypoint[i] = r.keypoint[i];
+    t->score = r.score;
+    t->category = r.category;
+    t->misses = 0;
+    t->detected_us = now;
+    t->active = true;
+}
+
+
+/* pick the next N from track motion and detector cost */
+static void tracker_adapt_interval(void)
+{
+    float motion = 0;
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        if (!tracks[i].active) continue;
+        float w = tracks[i].box[2] - tracks[i].box[0] + 1;
+        float speed = sqrtf(tracks[i].vx * tracks[i].vx + tracks[i].vy * tracks[i].vy) / (w > 1 ? w : 1);
+        if (speed > motion) motion = speed;
+    }
+    stats.motion = motion;
+    int n_motion = (motion > 0.001f) ? (int)(TRACKER_MAX_DRIFT / motion) : TRACKER_MAX_INTERVAL;
+    int n_cpu = (int)ceilf(stats.avg_detect_us / TRACKER_DETECT_BUDGET_US);
+    int n = (n_motion < TRACKER_MAX_INTERVAL) ? n_motion : TRACKER_MAX_INTERVAL;
+    if (n < n_cpu) n = n_cpu;          // no headroom: detect less often even if faces move
+    if (n < 1) n = 1;
+    if (n > TRACKER_MAX_INTERVAL) n = TRACKER_MAX_INTERVAL;
+    stats.interval = n;
+}
+
+
+void face_tracker_reset(void)
+{
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) tracks[i].active = false;
+    stats.active_tracks = 0;
+    front_track = -1;
+    force_detect = true;
+}
+
+
+bool face_tracker_should_detect(void)
+{
+    stats.frames++;
+    if (force_detect || stats.active_tracks == 0 || frames_since_detect + 1 >= stats.interval) {
+        return true;
+    }
+    return false;
+}
+
+
+void face_tracker_update(std::list<dl::detect::result_t> &results, uint32_t detect_us, int frame_width, int frame_height)
+{
+    int64_t now = session_clock_us();
+    bool matched[TRACKER_MAX_TRACKS] = { false };
+    int frames = frames_since_detect + 1;
+    stats.detect_frames++;
+    stats.avg_detect_us = (stats.detect_frames == 1) ? detect_us : stats.avg_detect_us + ((float)detect_us - stats.avg_detect_us) * 0.1f;
+    force_detect = false;
+    front_track = -1;
+    int r_index = 0;
+    for (std::list<dl::detect::result_t>::iterator r = results.begin(); r != results.end(); r++, r_index++) {
+        // greedy: best unmatched track by IoU
+        int best = -1;
+        float best_iou = TRACKER_MATCH_IOU;
+        for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+            if (!tracks[i].active || matched[i]) continue;
+            float iou = tracker_iou(tracks[i].box, r->box);
+            if (iou >= best_iou) {
+                best_iou = iou;
+                best = i;
+            }
+        }
+        if (best < 0) {
+            for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+                if (!tracks[i].active && !matched[i]) {
+                    best = i;
+                    memset(&tracks[i], 0, sizeof(tracks[i]));
+                    tracks[i].id = next_track_id++;
+                    stats.tracks_started++;
+                    break;
+                }
+            }
+        }
+        if (best < 0) continue;       // more faces than track slots
+        tracker_assign(&tracks[best], *r, frames, now);
+        matched[best] = true;
+        if (r_index == 0) front_track = best;
+    }
+    int active = 0;
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        if (!tracks[i].active) continue;
+        if (!matched[i] && ++tracks[i].misses > TRACKER_MAX_MISSES) {
+            tracks[i].active = false;
+            stats.tracks_lost++;
+            continue;
+        }
+        active++;
+    }
+    stats.active_tracks = active;
+    frames_since_detect = 0;
+    tracker_adapt_interval();
+}
+
+
+std::list<dl::detect::result_t> &face_tracker_predict(int frame_width, int frame_height)
+{
+    int64_t t0 = esp_timer_get_time();
+    int64_t now = session_clock_us();
+    frames_since_detect++;
+    stats.tracked_frames++;
+    int active = 0;
+    float age_ms = 0;
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        face_track_t *t = &tracks[i];
+        if (!t->active) continue;
+        t->box[0] += t->vx; t->box[2] += t->vx;
+        t->box[1] += t->vy; t->box[3] += t->vy;
+        for (int k = 0; k < 10; k += 2) {
+            t->keypoint[k] += t->vx;
+            t->keypoint[k + 1] += t->vy;
+        }
+        // drifted out of the frame: the track is lost, detect on the next frame
+        if (t->box[2] < 0 || t->box[3] < 0 || t->box[0] >= frame_width || t->box[1] >= frame_height) {
+            t->active = false;
+            stats.tracks_lost++;
+            force_detect = true;
+            continue;
+        }
+        age_ms += (now - t->detected_us) / 1000.0f;
+        active++;
+    }
+    stats.active_tracks = active;
+    if (active == 0) force_detect = true;
+    // reuse list nodes so steady-state tracking does not allocate
+    while ((int)predicted.size() < active) {
+        dl::detect::result_t r = {};
+        r.box.assign(4, 0);
+        r.keypoint.assign(10, 0);
+        predicted.push_back(r);
+    }
+    while ((int)predicted.size() > active) predicted.pop_back();
+    std::list<dl::detect::result_t>::iterator out = predicted.begin();
+    for (int i = 0; i < TRACKER_MAX_TRACKS && out != predicted.end(); i++) {
+        face_track_t *t = &tracks[i];
+        if (!t->active) continue;
+        for (int k = 0; k < 4; k++) out->box[k] = (int)t->box[k];
+        for (int k = 0; k < 10; k++) out->keypoint[k] = (int)t->keypoint[k];
+        out->score = t->score;
+        out->category = t->category;
+        out++;
+    }
+    if (active) {
+        age_ms /= active;
+        stats.avg_box_age_ms += (age_ms - stats.avg_box_age_ms) * 0.1f;
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.avg_track_us = (stats.tracked_frames == 1) ? us : stats.avg_track_us + ((float)us - stats.avg_track_us) * 0.1f;
+    return predicted;
+}
+
+
+bool face_tracker_front_identity(track_identity_t *identity)
+{
+    if (front_track < 0 || !tracks[front_track].active || !tracks[front_track].identified) {
+        return false;
+    }
+    *identity = tracks[front_track].identity;
+    return true;
+}
+
+
+bool face_tracker_front_needs_recognition(void)
+{
+    face_track_t *t = (front_track >= 0) ? &tracks[front_track] : NULL;
+    bool needed = !t || !t->active || !t->identified ||
+                  (t->identity.id >= 0 && t->identity.similarity < TRACKER_IDENTITY_MIN_SIMILARITY) ||
+                  session_clock_us() - t->identified_us >= (int64_t)TRACKER_IDENTITY_REVERIFY_MS * 1000;
+    if (needed) {
+        stats.recognitions++;
+    } else {
+        stats.identity_hits++;
+    }
+    return needed;
+}
+
+
+bool face_tracker_set_front_identity(const track_identity_t *identity)
+{
+    if (front_track < 0 || !tracks[front_track].active) {
+        stats.identity_episodes++;
+        return true;                  // untracked face, nothing to deduplicate against
+    }
+    face_track_t *t = &tracks[front_track];
+    bool episode = !t->identified || t->identity.id != identity->id;
+    t->identified = true;
+    t->identity = *identity;
+    t->identified_us = session_clock_us();
+    t->face_id = identity->id;
+    if (episode) {
+        stats.identity_episodes++;
+        ESP_LOGI(TAG, "track %u -> id %d (%.2f)", t->id, identity->id, identity->similarity);
+    }
+    return episode;
+}
+
+
+int face_tracker_active_tracks(void)
+{
+    return stats.active_tracks;
+}
+
+
+int face_tracker_front_label(void)
+{
+    if (front_track >= 0 && tracks[front_track].active) {
+        return tracks[front_track].face_id;
+    }
+    for (int i = 0; i < TRACKER_MAX_TRACKS; i++) {
+        if (tracks[i].active) return tracks[i].face_id;
+    }
+    return 0;
+}
+
+
+void face_tracker_get_stats(face_tracker_stats_t *out)
+{
+    *out = stats;
+}
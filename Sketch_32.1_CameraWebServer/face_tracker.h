@@ -0,0 +1,86 @@
+#ifndef FACE_TRACKER_H
+#define FACE_TRACKER_H
+
+#include <stdint.h>
+#include <list>
+#include "dl_detect_define.hpp"
+
+// faces tracked at once
+#ifndef TRACKER_MAX_TRACKS
+#define TRACKER_MAX_TRACKS 4
+#endif
+
+// never go longer than this many frames without a full detection
+#ifndef TRACKER_MAX_INTERVAL
+#define TRACKER_MAX_INTERVAL 8
+#endif
+
+// average detector time per frame we are willing to spend, sets the lower bound on the interval
+#ifndef TRACKER_DETECT_BUDGET_US
+#define TRACKER_DETECT_BUDGET_US 40000
+#endif
+
+// cached owner verdicts below this similarity are re-checked on the next detection frame
+#ifndef TRACKER_IDENTITY_MIN_SIMILARITY
+#define TRACKER_IDENTITY_MIN_SIMILARITY 0.55f
+#endif
+
+// re-run the recognizer on a tracked face this often even when its identity is cached
+#ifndef TRACKER_IDENTITY_REVERIFY_MS
+#define TRACKER_IDENTITY_REVERIFY_MS 10000
+#endif
+
+// recognition verdict cached on a track
+typedef struct {
+    int id;                       // enrolled id, -1 = intruder
+    float similarity;
+} track_identity_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t detect_frames;
+    uint32_t tracked_frames;
+    uint32_t tracks_started;
+    uint32_t tracks_lost;
+    int active_tracks;
+    int interval;                 // current N
+    float avg_detect_us;          // full MSR01+MNP01 pass
+    float avg_track_us;           // prediction step
+    float avg_box_age_ms;         // how old the detection behind a drawn box is (detection latency)
+    float motion;                 // fastest track speed, box widths per frame
+    uint32_t recognitions;        // recognizer passes on tracked faces
+    uint32_t identity_hits;       // detection frames served from the identity cache
+    uint32_t identity_episodes;   // verdicts reported (one per track, or per identity change)
+} face_tracker_stats_t;
+
+/* Forget every track, e.g. when detection is switched off */
+void face_tracker_reset(void);
+
+/* True when this frame needs the full two-stage detector */
+bool face_tracker_should_detect(void);
+
+/* Feed a detection frame: match boxes to tracks by IoU, start/drop tracks, update velocities and N */
+void face_tracker_update(std::list<dl::detect::result_t> &results, uint32_t detect_us, int frame_width, int frame_height);
+
+/* Tracked frame: move every track by its velocity and return the predicted boxes/keypoints */
+std::list<dl::detect::result_t> &face_tracker_predict(int frame_width, int frame_height);
+
+/* Cached verdict of the track behind results.front() of the last update, false if there is none */
+bool face_tracker_front_identity(track_identity_t *identity);
+
+/* True when that track has no trusted verdict yet or it is due for re-verification */
+bool face_tracker_front_needs_recognition(void);
+
+/* Store a fresh recognition on that track. True when it starts a new episode (first verdict
+   for the track or a different id) and should be logged / alerted. */
+bool face_tracker_set_front_identity(const track_identity_t *identity);
+
+/* Faces currently tracked */
+int face_tracker_active_tracks(void);
+
+/* Recognition label of the front track (0 = unknown) */
+int face_tracker_front_label(void);
+
+void face_tracker_get_stats(face_tracker_stats_t *stats);
+
+#endif
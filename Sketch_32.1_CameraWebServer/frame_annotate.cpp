@@ -0,0 +1,105 @@
+/*
+frame_annotate.cpp
+drawing helpers for the annotated stream: face boxes, landmarks and the identity / enrollment
+text line. Shared by the vision task and the /bench kernels.
+*/
+
+#include "frame_annotate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstdarg>
+
+// ----- FUNCTIONS --------------------------------
+
+/* FACE_COLOR_* is 0x00BBGGRR, RGB565 frames need it packed */
+uint32_t fb_color(fb_data_t *fb, uint32_t color)
+{
+    if(fb->bytes_per_pixel == 2){
+        color = ((color >> 16) & 0x001F) | ((color >> 3) & 0x07E0) | ((color << 8) & 0xF800);
+    }
+    return color;
+}
+
+
+/* Prints out text at top of frame buffer (intruder, id, confidence, etc)*/
+void rgb_print(fb_data_t *fb, uint32_t color, const char *str)
+{
+    fb_gfx_print(fb, (fb->width - (strlen(str) * 14)) / 2, 10, fb_color(fb, color), str);
+}
+
+
+/* Prints out ID and confidence values onto screen */
+int rgb_printf(fb_data_t *fb, uint32_t color, const char *format, ...)
+{
+    char loc_buf[64];
+    char *temp = loc_buf;
+    int len;
+    va_list arg;
+    va_list copy;
+    va_start(arg, format);
+    va_copy(copy, arg);
+    len = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (len < 0) {
+        va_end(arg);
+        return 0;
+    }
+    if (len >= (int)sizeof(loc_buf)) {
+        temp = (char *)malloc(len + 1);
+        if (temp == NULL) {
+            va_end(arg);
+            return 0;
+        }
+    }
+    vsnprintf(temp, (size_t)len + 1, format, arg);
+    va_end(arg);
+    rgb_print(fb, color, temp);
+    if (temp != loc_buf) {
+        free(temp);
+    }
+    return len;
+}
+
+
+/*Draw rectangles and 5 landmark indicators for detected face*/
+void draw_face_boxes(fb_data_t *fb, std::list<dl::detect::result_t> *results, int face_id)
+{
+    int x, y, w, h;
+    uint32_t color = FACE_COLOR_YELLOW;
+    if (face_id < 0)
+    {
+        color = FACE_COLOR_RED;
+    }
+    else if (face_id > 0)
+    {
+        color = FACE_COLOR_GREEN;
+    }
+    color = fb_color(fb, color);
+    int i = 0;
+    for (std::list<dl::detect::result_t>::iterator prediction = results->begin(); prediction != results->end(); prediction++, i++)
+    {
+        // rectangle box
+        x = (int)prediction->box[0];
+        y = (int)prediction->box[1];
+        w = (int)prediction->box[2] - x + 1;
+        h = (int)prediction->box[3] - y + 1;
+        if((x + w) > fb->width){
+            w = fb->width - x;
+        }
+        if((y + h) > fb->height){
+            h = fb->height - y;
+        }
+        fb_gfx_drawFastHLine(fb, x, y, w, color);
+        fb_gfx_drawFastHLine(fb, x, y + h - 1, w, color);
+        fb_gfx_drawFastVLine(fb, x, y, h, color);
+        fb_gfx_drawFastVLine(fb, x + w - 1, y, h, color);
+        // landmarks (left eye, mouth left, nose, right eye, mouth right)
+        int x0, y0, j;
+        for (j = 0; j < 10; j+=2) {
+            x0 = (int)prediction->keypoint[j];
+            y0 = (int)prediction->keypoint[j+1];
+            fb_gfx_fillRect(fb, x0, y0, 3, 3, color);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef FRAME_ANNOTATE_H
+#define FRAME_ANNOTATE_H
+
+#include <stdint.h>
+#include <list>
+#include "fb_gfx.h"
+#include "dl_detect_define.hpp"
+
+// frame annotation colors, 0x00BBGGRR
+#define FACE_COLOR_WHITE 0x00FFFFFF
+#define FACE_COLOR_BLACK 0x00000000
+#define FACE_COLOR_RED 0x000000FF
+#define FACE_COLOR_GREEN 0x0000FF00
+#define FACE_COLOR_BLUE 0x00FF0000
+#define FACE_COLOR_YELLOW (FACE_COLOR_RED | FACE_COLOR_GREEN)
+#define FACE_COLOR_CYAN (FACE_COLOR_BLUE | FACE_COLOR_GREEN)
+#define FACE_COLOR_PURPLE (FACE_COLOR_BLUE | FACE_COLOR_RED)
+
+/* FACE_COLOR_* in the pixel format of fb */
+uint32_t fb_color(fb_data_t *fb, uint32_t color);
+
+/* Centered text line at the top of the frame */
+void rgb_print(fb_data_t *fb, uint32_t color, const char *str);
+
+/* printf flavour of rgb_print, returns the formatted length */
+int rgb_printf(fb_data_t *fb, uint32_t color, const char *format, ...);
+
+/* Boxes and the 5 landmarks of every result; yellow unknown, red intruder (face_id < 0), green owner */
+void draw_face_boxes(fb_data_t *fb, std::list<dl::detect::result_t> *results, int face_id);
+
+#endif
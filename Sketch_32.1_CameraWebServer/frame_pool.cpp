@@ -0,0 +1,169 @@
+/*
+frame_pool.cpp
+fixed-capacity pools of PSRAM frame buffers, sized once from the configured frame_size.
+The RGB888 conversion and the JPEG encode stages borrow from here instead of doing a
+malloc/free per frame, so long uptimes do not fragment PSRAM. Buffers are reference counted so
+a published JPEG can also be kept as an intruder snapshot without a copy.
+*/
+
+#include "frame_pool.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "img_converters.h"
+#include "face_crop.h"
+#include "trace.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+#define TAG "pool: "
+
+// smallest JPEG buffer, tiny frame sizes still produce headers + tables
+#define FRAME_POOL_JPEG_MIN 16384
+
+typedef struct {
+    pool_buf_t *bufs;
+    pool_buf_t **free_list;
+    int free_count;
+    frame_pool_stats_t stats;
+} frame_pool_t;
+
+static frame_pool_t pools[FRAME_POOL_KINDS];
+static portMUX_TYPE pool_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool pool_ready = false;
+
+// ----- FUNCTIONS --------------------------------
+
+/* allocate count buffers of size bytes for one pool */
+static bool frame_pool_fill(frame_pool_kind_t kind, int count, size_t size)
+{
+    frame_pool_t *p = &pools[kind];
+    p->bufs = (pool_buf_t *)heap_caps_calloc(count, sizeof(pool_buf_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    p->free_list = (pool_buf_t **)heap_caps_calloc(count, sizeof(pool_buf_t *), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!p->bufs || !p->free_list) {
+        ESP_LOGE(TAG, "pool %d: no room for %d buffer descriptors", kind, count);
+        return false;
+    }
+    p->stats.capacity = count;
+    p->stats.buf_size = size;
+    for (int i = 0; i < count; i++) {
+        uint8_t *data = (uint8_t *)heap_caps_aligned_alloc(16, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!data) {
+            ESP_LOGE(TAG, "pool %d: buffer %d of %u bytes failed", kind, i, (uint32_t)size);
+            return false;
+        }
+        p->bufs[i].data = data;
+        p->bufs[i].cap = size;
+        p->bufs[i].len = 0;
+        p->bufs[i].kind = kind;
+        p->free_list[p->free_count++] = &p->bufs[i];
+    }
+    return true;
+}
+
+
+bool frame_pool_init(int jpeg_count, int width, int height)
+{
+    if (pool_ready) return true;
+    memset(pools, 0, sizeof(pools));
+    size_t rgb_size = (size_t)width * height * 3;
+    size_t jpeg_size = (size_t)width * height / 2;
+    if (jpeg_size < FRAME_POOL_JPEG_MIN) jpeg_size = FRAME_POOL_JPEG_MIN;
+    size_t crop_size = (rgb_size < FACE_CROP_MAX_BYTES) ? rgb_size : FACE_CROP_MAX_BYTES;
+    bool ok = frame_pool_fill(FRAME_POOL_RGB, FRAME_POOL_RGB_COUNT, rgb_size) &&
+              frame_pool_fill(FRAME_POOL_JPEG, jpeg_count, jpeg_size) &&
+              frame_pool_fill(FRAME_POOL_CROP, FRAME_POOL_CROP_COUNT, crop_size);
+    pool_ready = true;
+    ESP_LOGI(TAG, "frame pool %dx%d: %d x %uB rgb, %d x %uB jpeg, %d x %uB crop%s", width, height,
+             FRAME_POOL_RGB_COUNT, (uint32_t)rgb_size, jpeg_count, (uint32_t)jpeg_size,
+             FRAME_POOL_CROP_COUNT, (uint32_t)crop_size, ok ? "" : " (incomplete)");
+    return ok;
+}
+
+
+pool_buf_t *frame_pool_get(frame_pool_kind_t kind)
+{
+    frame_pool_t *p = &pools[kind];
+    pool_buf_t *buf = NULL;
+    taskENTER_CRITICAL(&pool_mux);
+    if (p->free_count > 0) {
+        buf = p->free_list[--p->free_count];
+        buf->refs = 1;
+        p->stats.in_use++;
+        p->stats.borrows++;
+        if (p->stats.in_use > p->stats.high_water) p->stats.high_water = p->stats.in_use;
+    } else {
+        p->stats.alloc_failures++;
+    }
+    taskEXIT_CRITICAL(&pool_mux);
+    if (buf) buf->len = 0;
+    return buf;
+}
+
+
+void frame_pool_ref(pool_buf_t *buf)
+{
+    if (!buf) return;
+    taskENTER_CRITICAL(&pool_mux);
+    buf->refs++;
+    taskEXIT_CRITICAL(&pool_mux);
+}
+
+
+void frame_pool_put(pool_buf_t *buf)
+{
+    if (!buf) return;
+    frame_pool_t *p = &pools[buf->kind];
+    taskENTER_CRITICAL(&pool_mux);
+    if (--buf->refs == 0) {
+        p->free_list[p->free_count++] = buf;
+        p->stats.in_use--;
+    }
+    taskEXIT_CRITICAL(&pool_mux);
+}
+
+
+// encoder output cursor
+typedef struct {
+    pool_buf_t *out;
+    bool overflow;
+} jpeg_sink_t;
+
+/* jpg_out_cb: append encoder output to the pooled buffer, returning 0 aborts the encode */
+static size_t frame_pool_jpeg_out(void *arg, size_t index, const void *data, size_t len)
+{
+    jpeg_sink_t *sink = (jpeg_sink_t *)arg;
+    if (index + len > sink->out->cap) {
+        sink->overflow = true;
+        return 0;
+    }
+    memcpy(sink->out->data + index, data, len);
+    sink->out->len = index + len;
+    return len;
+}
+
+
+bool frame_pool_encode_jpeg(const uint8_t *src, size_t src_len, int width, int height,
+                            pixformat_t format, uint8_t quality, pool_buf_t *out)
+{
+    jpeg_sink_t sink = { out, false };
+    out->len = 0;
+    trace_begin(TRACE_ENCODE);
+    bool ok = fmt2jpg_cb((uint8_t *)src, src_len, width, height, format, quality, frame_pool_jpeg_out, &sink);
+    trace_end(TRACE_ENCODE);
+    if (!ok || sink.overflow) {
+        if (sink.overflow) {
+            taskENTER_CRITICAL(&pool_mux);
+            pools[out->kind].stats.overflows++;
+            taskEXIT_CRITICAL(&pool_mux);
+        }
+        return false;
+    }
+    return true;
+}
+
+
+void frame_pool_get_stats(frame_pool_kind_t kind, frame_pool_stats_t *stats)
+{
+    taskENTER_CRITICAL(&pool_mux);
+    *stats = pools[kind].stats;
+    taskEXIT_CRITICAL(&pool_mux);
+}
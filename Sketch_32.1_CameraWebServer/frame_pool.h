@@ -0,0 +1,64 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_camera.h"
+
+// decoded RGB888 frames in flight: one per vision pipeline stage plus a detector region copy
+#ifndef FRAME_POOL_RGB_COUNT
+#define FRAME_POOL_RGB_COUNT 4
+#endif
+
+// recognition face crops (face_crop.h), FACE_CROP_MAX_BYTES each
+#ifndef FRAME_POOL_CROP_COUNT
+#define FRAME_POOL_CROP_COUNT 1
+#endif
+
+typedef enum {
+    FRAME_POOL_RGB = 0,
+    FRAME_POOL_JPEG,
+    FRAME_POOL_CROP,
+    FRAME_POOL_KINDS
+} frame_pool_kind_t;
+
+// a fixed-capacity PSRAM buffer borrowed from the pool
+typedef struct pool_buf {
+    uint8_t *data;
+    size_t cap;
+    size_t len;
+    frame_pool_kind_t kind;
+    int refs;                    // owners, the buffer goes back to the pool when the last one puts it
+} pool_buf_t;
+
+typedef struct {
+    int capacity;
+    int in_use;
+    int high_water;
+    uint32_t borrows;
+    uint32_t alloc_failures;     // borrow with the pool exhausted
+    uint32_t overflows;          // data did not fit in a pooled buffer (e.g. a very large JPEG)
+    size_t buf_size;
+} frame_pool_stats_t;
+
+/* Preallocate every buffer for frames of width x height, jpeg_count encoded frames (the owners
+   of JPEGs are sized by the vision task), call once at boot */
+bool frame_pool_init(int jpeg_count, int width, int height);
+
+/* Borrow a buffer, NULL when the pool is exhausted */
+pool_buf_t *frame_pool_get(frame_pool_kind_t kind);
+
+/* Add an owner to a borrowed buffer (e.g. a snapshot keeping a published frame) */
+void frame_pool_ref(pool_buf_t *buf);
+
+/* Drop one owner, the last one returns the buffer to its pool */
+void frame_pool_put(pool_buf_t *buf);
+
+/* JPEG-encode src straight into a pooled buffer (no fmt2jpg output malloc) */
+bool frame_pool_encode_jpeg(const uint8_t *src, size_t src_len, int width, int height,
+                            pixformat_t format, uint8_t quality, pool_buf_t *out);
+
+/* Copy of one pool's statistics */
+void frame_pool_get_stats(frame_pool_kind_t kind, frame_pool_stats_t *stats);
+
+#endif
@@ -0,0 +1,384 @@
+/*
+gallery.cpp
+enrolled identities for recognition, sized for hundreds of people instead of the recognizer's
+built-in 7. Each template is the recognizer embedding scaled to int8, stored as one record of
+the gallery log in the fr partition (gallery_store.cpp) with its norm and the norms of its four
+128-wide slices. The partition is memory-mapped and searched in place through an index of
+record pointers, so boot walks the log instead of loading it. A search (gallery_search.cpp)
+quantizes the query once and takes int8 dot products slice by slice, abandoning a template as
+soon as the Cauchy-Schwarz bound of its remaining slices cannot beat the best match so far; the
+best starts at the match threshold, so most strangers cost one slice per template. Deletes
+append tombstones, a background task compacts the log.
+*/
+
+#include "gallery.h"
+#include "face_models.h"
+#include "esp_partition.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <vector>
+#define TAG "gallery: "
+
+// compaction: erases and rewrites up to half the partition, low priority next to the telemetry task
+#define GALLERY_TASK_STACK 4096
+#define GALLERY_TASK_PRIORITY 1
+#define GALLERY_TASK_CORE 0
+
+// record layout an older build wrote to GALLERY_LEGACY_PARTITION, imported once
+#define GALLERY_V1_MAGIC "GAL1"
+#define GALLERY_V1_HEADER 16
+#define GALLERY_V1_VALID 0xA55A
+
+typedef struct {
+    uint16_t person;
+    uint16_t valid;
+    int8_t emb[GALLERY_DIM];
+} gallery_v1_record_t;
+
+static gallery_set_t gallery;
+static gallery_store_t store;
+static SemaphoreHandle_t gallery_lock = NULL;
+static TaskHandle_t gallery_task_handle = NULL;
+static const esp_partition_t *partition = NULL;
+static uint8_t *ram_store = NULL;
+static int next_person = 1;
+static gallery_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+static bool gallery_flash_write(void *ctx, size_t offset, const void *data, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, data, len) == ESP_OK;
+}
+
+
+static bool gallery_flash_erase(void *ctx, size_t offset, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, len) == ESP_OK;
+}
+
+
+static bool gallery_ram_write(void *ctx, size_t offset, const void *data, size_t len)
+{
+    // NOR semantics: writing can only clear bits
+    uint8_t *dst = (uint8_t *)ctx + offset;
+    const uint8_t *src = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) dst[i] &= src[i];
+    return true;
+}
+
+
+static bool gallery_ram_erase(void *ctx, size_t offset, size_t len)
+{
+    memset((uint8_t *)ctx + offset, 0xFF, len);
+    return true;
+}
+
+
+/* GAL2 header at the start of either half */
+static bool gallery_store_present(const esp_partition_t *p)
+{
+    size_t half = (p->size / 2) & ~(size_t)(GALLERY_STORE_SECTOR - 1);
+    char magic[4];
+    for (int i = 0; i < 2; i++) {
+        if (esp_partition_read(p, i * half, magic, sizeof(magic)) == ESP_OK && !memcmp(magic, "GAL2", 4)) return true;
+    }
+    return false;
+}
+
+
+bool gallery_needs_recognizer_ids(void)
+{
+    const esp_partition_t *p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, GALLERY_PARTITION);
+    const esp_partition_t *legacy = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, GALLERY_LEGACY_PARTITION);
+    char magic[4];
+    if (!legacy || (p && gallery_store_present(p))) return false;
+    return esp_partition_read(legacy, 0, magic, sizeof(magic)) != ESP_OK || memcmp(magic, GALLERY_V1_MAGIC, 4);
+}
+
+
+/* map the fr partition, or fall back to a PSRAM stand-in */
+static bool gallery_store_attach(bool *formatted)
+{
+    gallery_store_flash_t flash = { 0 };
+    const void *map = NULL;
+    esp_partition_mmap_handle_t handle;
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, GALLERY_PARTITION);
+    if (partition && esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &map, &handle) == ESP_OK) {
+        flash.ctx = (void *)partition;
+        flash.size = partition->size;
+        flash.map = (const uint8_t *)map;
+        flash.write = gallery_flash_write;
+        flash.erase = gallery_flash_erase;
+        if (gallery_store_open(&store, &flash, formatted)) {
+            stats.in_flash = true;
+            return true;
+        }
+    }
+    ESP_LOGE(TAG, "no usable %s partition, enrolled faces will not survive a reboot", GALLERY_PARTITION);
+    ram_store = (uint8_t *)heap_caps_malloc(GALLERY_RAM_STORE_BYTES, MALLOC_CAP_SPIRAM);
+    if (!ram_store) return false;
+    memset(ram_store, 0, GALLERY_RAM_STORE_BYTES);         // no valid header: open formats it
+    flash.ctx = ram_store;
+    flash.size = GALLERY_RAM_STORE_BYTES;
+    flash.map = ram_store;
+    flash.write = gallery_ram_write;
+    flash.erase = gallery_ram_erase;
+    return gallery_store_open(&store, &flash, formatted);
+}
+
+
+/* first boot: ids an older build stored, either as GAL1 records or in the recognizer's format */
+static void gallery_import(FaceRecognition112V1S8 &recognizer)
+{
+    static gallery_record_t rec __attribute__((aligned(16)));
+    const esp_partition_t *legacy = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, GALLERY_LEGACY_PARTITION);
+    char magic[4];
+    memset(&rec, 0, sizeof(rec));
+    rec.type = GALLERY_RECORD_ENROLL;
+    if (legacy && esp_partition_read(legacy, 0, magic, sizeof(magic)) == ESP_OK && !memcmp(magic, GALLERY_V1_MAGIC, 4)) {
+        gallery_v1_record_t v1;
+        for (uint32_t off = GALLERY_V1_HEADER; off + sizeof(v1) <= legacy->size; off += sizeof(v1)) {
+            if (esp_partition_read(legacy, off, &v1, sizeof(v1)) != ESP_OK || v1.valid != GALLERY_V1_VALID) break;
+            rec.person = v1.person;
+            memcpy(rec.emb, v1.emb, GALLERY_DIM);
+            gallery_norms(&rec);
+            if (!gallery_store_append(&store, &rec)) break;
+            stats.migrated++;
+        }
+    } else if (legacy) {
+        std::vector<face_info_t> ids = recognizer.get_enrolled_ids();
+        for (size_t i = 0; i < ids.size(); i++) {
+            Tensor<float> &e = recognizer.get_face_emb(ids[i].id);
+            if (e.get_size() != GALLERY_DIM) continue;
+            rec.person = ids[i].id;
+            gallery_quantize(e.get_element_ptr(), rec.emb);
+            gallery_norms(&rec);
+            if (!gallery_store_append(&store, &rec)) break;
+            stats.migrated++;
+        }
+    }
+    ESP_LOGI(TAG, "gallery created, %u templates imported from %s", stats.migrated, GALLERY_LEGACY_PARTITION);
+}
+
+
+static void gallery_count_persons(void)
+{
+    uint32_t persons = 0;
+    for (int i = 0; i < gallery.count; i++) {
+        bool seen = false;
+        for (int j = 0; j < i && !seen; j++) seen = gallery.tpl[j]->person == gallery.tpl[i]->person;
+        if (!seen) persons++;
+    }
+    stats.persons = persons;
+    stats.templates = gallery.count;
+}
+
+
+static void gallery_index_remove(int person)
+{
+    int kept = 0;
+    for (int i = 0; i < gallery.count; i++) {
+        if (gallery.tpl[i]->person != person) gallery.tpl[kept++] = gallery.tpl[i];
+    }
+    gallery.count = kept;
+}
+
+
+/* under gallery_lock: point the index at the live templates of the active half */
+static void gallery_index_rebuild(void)
+{
+    gallery.count = 0;
+    for (uint32_t i = 0; i < store.stats.records; i++) {
+        const gallery_record_t *rec = gallery_store_record(&store, i);
+        if (!rec) continue;
+        if (rec->person >= next_person) next_person = rec->person + 1;
+        if (rec->type == GALLERY_RECORD_TOMBSTONE) {
+            gallery_index_remove(rec->person);
+        } else if (gallery.count < gallery.cap) {
+            gallery.tpl[gallery.count++] = rec;
+        }
+    }
+    gallery_count_persons();
+}
+
+
+/* compact the log when asked; searches keep running on the old half until the switch */
+static void gallery_task(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!gallery_store_wants_compaction(&store)) continue;
+        int64_t t0 = esp_timer_get_time();
+        if (!gallery_store_compact_start(&store)) {
+            ESP_LOGE(TAG, "compaction: erase failed");
+            continue;
+        }
+        // records written so far are immutable, copy them without holding up the vision task
+        xSemaphoreTake(gallery_lock, portMAX_DELAY);
+        uint32_t upto = store.stats.records;
+        xSemaphoreGive(gallery_lock);
+        bool ok = gallery_store_compact_copy(&store, upto);
+        xSemaphoreTake(gallery_lock, portMAX_DELAY);
+        ok = ok && gallery_store_compact_finish(&store);
+        gallery_index_rebuild();
+        xSemaphoreGive(gallery_lock);
+        if (ok) {
+            ESP_LOGI(TAG, "compacted to generation %u, %u records, %ums", store.stats.generation, store.stats.records,
+                     (uint32_t)((esp_timer_get_time() - t0) / 1000));
+        } else {
+            ESP_LOGE(TAG, "compaction failed, staying on generation %u", store.stats.generation);
+        }
+    }
+}
+
+
+static void gallery_maybe_compact(void)
+{
+    if (gallery_task_handle && gallery_store_wants_compaction(&store)) xTaskNotifyGive(gallery_task_handle);
+}
+
+
+void gallery_init(FaceRecognition112V1S8 &recognizer)
+{
+    if (gallery_lock) return;
+    int64_t t0 = esp_timer_get_time();
+    stats.pie = GALLERY_USE_PIE;
+    gallery.tpl = (const gallery_record_t **)heap_caps_malloc(GALLERY_MAX_TEMPLATES * sizeof(gallery.tpl[0]), MALLOC_CAP_SPIRAM);
+    bool formatted = false;
+    if (!gallery.tpl || !gallery_store_attach(&formatted)) {
+        ESP_LOGE(TAG, "no memory for the gallery");
+        return;
+    }
+    gallery.cap = GALLERY_MAX_TEMPLATES;
+    gallery_lock = xSemaphoreCreateMutex();
+    if (formatted) gallery_import(recognizer);
+    gallery_index_rebuild();
+    stats.boot_ready_us = (uint32_t)(esp_timer_get_time() - t0);
+    xTaskCreatePinnedToCore(gallery_task, "gallery", GALLERY_TASK_STACK, NULL, GALLERY_TASK_PRIORITY, &gallery_task_handle, GALLERY_TASK_CORE);
+    gallery_maybe_compact();
+    ESP_LOGI(TAG, "%u persons, %u templates, %u/%u records in generation %u, ready in %uus, %s kernel",
+             stats.persons, stats.templates, store.stats.records, store.stats.capacity, store.stats.generation,
+             stats.boot_ready_us, stats.pie ? "PIE" : "scalar");
+}
+
+
+void gallery_match(const float *embedding, gallery_match_t *match)
+{
+    static gallery_record_t query __attribute__((aligned(16)));
+    match->id = -1;
+    match->similarity = 0;
+    match->template_index = -1;
+    if (!gallery_lock) return;
+    int64_t t0 = esp_timer_get_time();
+    gallery_quantize(embedding, query.emb);
+    gallery_norms(&query);
+    xSemaphoreTake(gallery_lock, portMAX_DELAY);
+    int pruned = gallery_search(&gallery, &query, gallery_dot_kernel(GALLERY_USE_PIE), match);
+    int count = gallery.count;
+    xSemaphoreGive(gallery_lock);
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    float share = count ? (float)pruned / count : 0;
+    stats.searches++;
+    stats.last_search_us = us;
+    stats.avg_search_us = (stats.searches == 1) ? us : stats.avg_search_us + ((float)us - stats.avg_search_us) * 0.2f;
+    stats.avg_pruned = (stats.searches == 1) ? share : stats.avg_pruned + (share - stats.avg_pruned) * 0.2f;
+}
+
+
+int gallery_enroll(const float *embedding, int person)
+{
+    static gallery_record_t rec __attribute__((aligned(16)));
+    if (!gallery_lock) return -1;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = GALLERY_RECORD_ENROLL;
+    gallery_quantize(embedding, rec.emb);
+    gallery_norms(&rec);
+    xSemaphoreTake(gallery_lock, portMAX_DELAY);
+    if (person < 0) person = next_person;
+    rec.person = person;
+    uint32_t written = store.stats.bytes_written;
+    const gallery_record_t *stored = (gallery.count < gallery.cap) ? gallery_store_append(&store, &rec) : NULL;
+    if (stored) {
+        gallery.tpl[gallery.count++] = stored;
+        if (person >= next_person) next_person = person + 1;
+        stats.enroll_bytes = store.stats.bytes_written - written;
+        gallery_count_persons();
+    } else {
+        ESP_LOGW(TAG, "gallery full (%u templates, %u/%u records)", gallery.count, store.stats.records, store.stats.capacity);
+        person = -1;
+    }
+    xSemaphoreGive(gallery_lock);
+    gallery_maybe_compact();
+    return person;
+}
+
+
+int gallery_templates_of(int person)
+{
+    int n = 0;
+    if (!gallery_lock) return 0;
+    xSemaphoreTake(gallery_lock, portMAX_DELAY);
+    for (int i = 0; i < gallery.count; i++) {
+        if (gallery.tpl[i]->person == person) n++;
+    }
+    xSemaphoreGive(gallery_lock);
+    return n;
+}
+
+
+bool gallery_delete(int person)
+{
+    static gallery_record_t tombstone;
+    if (!gallery_lock) return false;
+    xSemaphoreTake(gallery_lock, portMAX_DELAY);
+    int count = gallery.count;
+    gallery_index_remove(person);
+    bool found = gallery.count != count;
+    if (found) {
+        memset(&tombstone, 0, sizeof(tombstone));
+        tombstone.type = GALLERY_RECORD_TOMBSTONE;
+        tombstone.person = person;
+        if (!gallery_store_append(&store, &tombstone)) {
+            ESP_LOGE(TAG, "log full, person %d comes back after a reboot", person);
+        }
+        gallery_count_persons();
+        ESP_LOGI(TAG, "person %d deleted, %u persons left", person, stats.persons);
+    }
+    xSemaphoreGive(gallery_lock);
+    gallery_maybe_compact();
+    return found;
+}
+
+
+int gallery_person_count(void)
+{
+    return stats.persons;
+}
+
+
+bool gallery_bench(int persons, int iterations, bool pie, gallery_bench_t *out)
+{
+    if (persons < 1) return false;
+    gallery_record_t *records = (gallery_record_t *)heap_caps_aligned_alloc(16, persons * sizeof(gallery_record_t), MALLOC_CAP_SPIRAM);
+    gallery_record_t *queries = (gallery_record_t *)heap_caps_aligned_alloc(16, GALLERY_BENCH_QUERIES * sizeof(gallery_record_t), MALLOC_CAP_SPIRAM);
+    gallery_set_t set = { (const gallery_record_t **)heap_caps_malloc(persons * sizeof(set.tpl[0]), MALLOC_CAP_SPIRAM), 0, persons };
+    bool ok = records && queries && set.tpl;
+    if (ok) gallery_search_bench(&set, records, queries, iterations, pie, out);
+    heap_caps_free(records);
+    heap_caps_free(queries);
+    heap_caps_free(set.tpl);
+    return ok;
+}
+
+
+void gallery_get_stats(gallery_stats_t *out)
+{
+    *out = stats;
+    gallery_store_get_stats(&store, &out->store);
+}
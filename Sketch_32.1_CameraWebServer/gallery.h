@@ -0,0 +1,74 @@
+#ifndef GALLERY_H
+#define GALLERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gallery_store.h"
+#include "gallery_search.h"
+
+// gallery log (two halves, see gallery_store.h), and the partition an older build kept ids in
+#define GALLERY_PARTITION "fr"
+#define GALLERY_LEGACY_PARTITION "fr_v1"
+
+// live templates indexed for search; one half of the fr partition bounds how many can be stored
+#ifndef GALLERY_MAX_TEMPLATES
+#define GALLERY_MAX_TEMPLATES 1024
+#endif
+
+// stand-in for the fr partition when it is missing or cannot be mapped (PSRAM, lost on reboot)
+#ifndef GALLERY_RAM_STORE_BYTES
+#define GALLERY_RAM_STORE_BYTES (256 * 1024)
+#endif
+
+// templates captured per person in one enroll session, ENROLL_INTERVAL_MS apart
+#ifndef GALLERY_TEMPLATES_PER_ID
+#define GALLERY_TEMPLATES_PER_ID 3
+#endif
+
+typedef struct {
+    uint32_t persons;
+    uint32_t templates;
+    uint32_t migrated;             // ids imported from GALLERY_LEGACY_PARTITION at first boot
+    bool in_flash;                 // false when running on the PSRAM stand-in
+    uint32_t boot_ready_us;        // gallery_init: map the partition, walk the log, build the index
+    uint32_t enroll_bytes;         // flash bytes written by the last enrollment
+    gallery_store_stats_t store;
+    uint32_t searches;
+    uint32_t last_search_us;
+    float avg_search_us;
+    float avg_pruned;              // share of templates abandoned early by the norm bound
+    bool pie;
+} gallery_stats_t;
+
+class FaceRecognition112V1S8;
+
+/* True when the gallery has not been created yet and GALLERY_LEGACY_PARTITION may hold ids in the
+   recognizer's own format: load them into the recognizer first and gallery_init imports them */
+bool gallery_needs_recognizer_ids(void);
+
+/* Map the fr partition and index the templates in it, importing older ids on first boot.
+   Starts the background compaction task. */
+void gallery_init(FaceRecognition112V1S8 &recognizer);
+
+/* Best template for a float embedding */
+void gallery_match(const float *embedding, gallery_match_t *match);
+
+/* Add a template. person < 0 starts a new person; returns the person id, -1 if the gallery is full */
+int gallery_enroll(const float *embedding, int person);
+
+/* Templates stored for a person */
+int gallery_templates_of(int person);
+
+/* Remove a person (one tombstone record), false if unknown */
+bool gallery_delete(int person);
+
+/* Number of enrolled persons */
+int gallery_person_count(void);
+
+/* Time searches over a scratch gallery of random persons (one template each), pie selects the kernel.
+   False if the scratch gallery could not be allocated. */
+bool gallery_bench(int persons, int iterations, bool pie, gallery_bench_t *out);
+
+void gallery_get_stats(gallery_stats_t *stats);
+
+#endif
@@ -0,0 +1,174 @@
+/*
+gallery_search.cpp
+template search for the gallery: the query is quantized to int8 once and compared slice by slice
+(ESP32-S3 PIE vector MACs, or a scalar loop), abandoning a template as soon as the
+Cauchy-Schwarz bound of its remaining slices cannot beat the best match so far. Only plain C,
+so the search and its benchmark also run on a Linux host (host/bench_host.cpp).
+*/
+
+#include "gallery_search.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <string.h>
+
+#define GALLERY_CHUNKS GALLERY_STORE_CHUNKS
+#define GALLERY_CHUNK (GALLERY_DIM / GALLERY_CHUNKS)
+
+// ----- FUNCTIONS --------------------------------
+
+/* int8 dot product, len a multiple of 16 */
+static int32_t gallery_dot_scalar(const int8_t *a, const int8_t *b, int len)
+{
+    int32_t sum = 0;
+    for (int i = 0; i < len; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+
+#if GALLERY_USE_PIE
+/* same on the S3 vector unit: 16 MACs per instruction into the 40 bit ACCX accumulator.
+   a and b 16 byte aligned, len a multiple of 16. Not inlined so it never nests in a compiler loop. */
+static __attribute__((noinline)) int32_t gallery_dot_pie(const int8_t *a, const int8_t *b, int len)
+{
+    int32_t sum;
+    int n = len / 16;
+    asm volatile (
+        "ee.zero.accx\n"
+        "beqz %[n], 2f\n"
+        "1:\n"
+        "ee.vld.128.ip q0, %[a], 16\n"
+        "ee.vld.128.ip q1, %[b], 16\n"
+        "addi %[n], %[n], -1\n"
+        "ee.vmulas.s8.accx q0, q1\n"
+        "bnez %[n], 1b\n"
+        "2:\n"
+        "rur.accx_0 %[sum]\n"
+        : [sum] "=r"(sum), [a] "+r"(a), [b] "+r"(b), [n] "+r"(n)
+        :
+        : "memory");
+    return sum;
+}
+#endif
+
+
+gallery_dot_fn gallery_dot_kernel(bool pie)
+{
+#if GALLERY_USE_PIE
+    if (pie) return gallery_dot_pie;
+#endif
+    return gallery_dot_scalar;
+}
+
+
+void gallery_quantize(const float *embedding, int8_t *out)
+{
+    float peak = 0;
+    for (int i = 0; i < GALLERY_DIM; i++) {
+        float v = fabsf(embedding[i]);
+        if (v > peak) peak = v;
+    }
+    float scale = (peak > 0) ? 127.0f / peak : 0;
+    for (int i = 0; i < GALLERY_DIM; i++) {
+        out[i] = (int8_t)lrintf(embedding[i] * scale);
+    }
+}
+
+
+void gallery_norms(gallery_record_t *rec)
+{
+    float total = 0;
+    for (int c = 0; c < GALLERY_CHUNKS; c++) {
+        int32_t sq = gallery_dot_scalar(rec->emb + c * GALLERY_CHUNK, rec->emb + c * GALLERY_CHUNK, GALLERY_CHUNK);
+        rec->chunk_norm[c] = sqrtf((float)sq);
+        total += sq;
+    }
+    rec->norm = sqrtf(total);
+}
+
+
+int gallery_search(const gallery_set_t *set, const gallery_record_t *query, gallery_dot_fn dot, gallery_match_t *match)
+{
+    float best = GALLERY_MATCH_THRESHOLD;
+    int pruned = 0;
+    match->id = -1;
+    match->similarity = 0;
+    match->template_index = -1;
+    if (query->norm == 0) return 0;
+    for (int i = 0; i < set->count; i++) {
+        const gallery_record_t *t = set->tpl[i];
+        float scale = query->norm * t->norm;
+        if (scale == 0) continue;
+        float needed = best * scale;              // dot product that would beat the best
+        float rest = 0;
+        for (int c = 0; c < GALLERY_CHUNKS; c++) rest += query->chunk_norm[c] * t->chunk_norm[c];
+        int32_t sum = 0;
+        bool abandoned = false;
+        for (int c = 0; c < GALLERY_CHUNKS; c++) {
+            sum += dot(query->emb + c * GALLERY_CHUNK, t->emb + c * GALLERY_CHUNK, GALLERY_CHUNK);
+            rest -= query->chunk_norm[c] * t->chunk_norm[c];
+            if (sum + rest < needed) {
+                abandoned = true;
+                break;
+            }
+        }
+        if (abandoned) {
+            pruned++;
+            continue;
+        }
+        float similarity = sum / scale;
+        if (similarity > match->similarity) match->similarity = similarity;
+        if (similarity >= best) {
+            best = similarity;
+            match->id = t->person;
+            match->template_index = i;
+        }
+    }
+    if (match->id >= 0) match->similarity = best;
+    return pruned;
+}
+
+
+static uint32_t bench_rand(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed;
+}
+
+
+void gallery_search_bench(gallery_set_t *set, gallery_record_t *records, gallery_record_t *queries,
+                          int iterations, bool pie, gallery_bench_t *out)
+{
+    int persons = set->cap;
+    uint32_t seed = 0x9E3779B9;
+    set->count = 0;
+    for (int p = 0; p < persons; p++) {
+        for (int i = 0; i < GALLERY_DIM; i++) {
+            records[p].emb[i] = (int8_t)(bench_rand(&seed) >> 24);
+        }
+        records[p].person = p + 1;
+        gallery_norms(&records[p]);
+        set->tpl[set->count++] = &records[p];
+    }
+    // built up front, so the timed loop is the search alone
+    for (int q = 0; q < GALLERY_BENCH_QUERIES; q++) {
+        const int8_t *base = records[bench_rand(&seed) % persons].emb;
+        for (int i = 0; i < GALLERY_DIM; i++) {
+            int noise = (int)(bench_rand(&seed) >> 16) % 41 - 20;
+            int v = (q & 1) ? (int)(int8_t)(bench_rand(&seed) >> 24) : base[i] + noise;
+            queries[q].emb[i] = (int8_t)(v > 127 ? 127 : (v < -127 ? -127 : v));
+        }
+        gallery_norms(&queries[q]);
+    }
+    gallery_dot_fn dot = gallery_dot_kernel(pie);
+    gallery_match_t match;
+    uint32_t pruned = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (int it = 0; it < iterations; it++) {
+        pruned += gallery_search(set, &queries[it % GALLERY_BENCH_QUERIES], dot, &match);
+    }
+    int64_t us = esp_timer_get_time() - t0;
+    out->search_ns = iterations ? (uint32_t)(us * 1000 / iterations) : 0;
+    out->pruned = iterations ? (float)pruned / ((float)iterations * persons) : 0;
+}
@@ -0,0 +1,67 @@
+#ifndef GALLERY_SEARCH_H
+#define GALLERY_SEARCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "gallery_store.h"
+
+// embedding length of FaceRecognition112V1S8
+#define GALLERY_DIM GALLERY_STORE_DIM
+
+// cosine similarity needed for a match
+#ifndef GALLERY_MATCH_THRESHOLD
+#define GALLERY_MATCH_THRESHOLD 0.5f
+#endif
+
+// ESP32-S3 PIE int8 dot product, scalar loop elsewhere
+#ifndef GALLERY_USE_PIE
+#if CONFIG_IDF_TARGET_ESP32S3
+#define GALLERY_USE_PIE 1
+#else
+#define GALLERY_USE_PIE 0
+#endif
+#endif
+
+// distinct queries the benchmark cycles through
+#define GALLERY_BENCH_QUERIES 16
+
+typedef struct {
+    int id;                        // person, -1 when nobody reaches the threshold
+    float similarity;              // best cosine similarity found
+    int template_index;
+} gallery_match_t;
+
+// templates searched together: the live index, or a scratch set for the benchmark
+typedef struct {
+    const gallery_record_t **tpl;
+    int count;
+    int cap;
+} gallery_set_t;
+
+typedef struct {
+    uint32_t search_ns;            // one search, mean over the iterations
+    float pruned;                  // share of templates abandoned early
+} gallery_bench_t;
+
+typedef int32_t (*gallery_dot_fn)(const int8_t *a, const int8_t *b, int len);
+
+/* int8 dot product: the PIE kernel if pie and GALLERY_USE_PIE, the scalar loop otherwise */
+gallery_dot_fn gallery_dot_kernel(bool pie);
+
+/* Scale to int8 by the largest component, cosine does not care about the scale */
+void gallery_quantize(const float *embedding, int8_t *out);
+
+/* Fill in the norm and the slice norms of rec->emb */
+void gallery_norms(gallery_record_t *rec);
+
+/* Exact top-1 above GALLERY_MATCH_THRESHOLD; returns how many templates were abandoned early */
+int gallery_search(const gallery_set_t *set, const gallery_record_t *query, gallery_dot_fn dot, gallery_match_t *match);
+
+/* Time searches over set->cap generated persons (one template each, records 16 byte aligned) with
+   GALLERY_BENCH_QUERIES queries that alternate between a noisy view of an enrolled person and a
+   stranger. Deterministic, so two runs compare like for like. */
+void gallery_search_bench(gallery_set_t *set, gallery_record_t *records, gallery_record_t *queries,
+                          int iterations, bool pie, gallery_bench_t *out);
+
+#endif
@@ -0,0 +1,281 @@
+/*
+gallery_store.cpp
+on-flash format of the enrolled face gallery. The partition is split into two halves; the active
+one starts with a versioned header and continues with an append-only log of fixed-size records,
+each carrying its own CRC. Enrolling appends one record, deleting appends a tombstone, and the
+gallery reads templates straight out of the memory-mapped partition, so boot only walks the
+record headers. Compaction copies the live records into the other half and switches to it by
+writing the newer header last. Only plain C and the flash callbacks are used here, so the
+format runs unchanged against a file on a Linux host.
+*/
+
+#include "gallery_store.h"
+#include <string.h>
+
+#define GALLERY_STORE_MAGIC "GAL2"
+#define GALLERY_STORE_RECORD_MAGIC 0x4752
+#define GALLERY_STORE_RESERVE 8         // free records that trigger compaction
+#define GALLERY_STORE_MIN_DEAD 16       // dead records worth a compaction on their own
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t dim;
+    uint32_t generation;
+    uint32_t record_size;
+    uint32_t reserved[3];
+    uint32_t crc;                  // CRC-32 of the header with crc = 0
+} gallery_store_header_t;
+
+#define GALLERY_STORE_HEADER_CRC_LEN (sizeof(gallery_store_header_t) - sizeof(uint32_t))
+#define GALLERY_RECORD_HEADER_LEN (sizeof(gallery_record_t) - GALLERY_STORE_DIM)
+
+static uint32_t crc_table[256];
+
+// ----- FUNCTIONS --------------------------------
+
+static uint32_t store_crc32(uint32_t crc, const void *data, size_t len)
+{
+    if (!crc_table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+/* bytes of a record that are written and covered by its CRC */
+static size_t store_record_len(const gallery_record_t *rec)
+{
+    return (rec->type == GALLERY_RECORD_TOMBSTONE) ? GALLERY_RECORD_HEADER_LEN : sizeof(gallery_record_t);
+}
+
+
+static uint32_t store_record_crc(const gallery_record_t *rec)
+{
+    static const uint32_t zero = 0;
+    size_t crc_at = offsetof(gallery_record_t, crc);
+    uint32_t crc = store_crc32(0, rec, crc_at);
+    crc = store_crc32(crc, &zero, sizeof(zero));
+    return store_crc32(crc, (const uint8_t *)rec + crc_at + sizeof(zero), store_record_len(rec) - crc_at - sizeof(zero));
+}
+
+
+static size_t store_half_offset(const gallery_store_t *store, int half)
+{
+    return half ? store->half : 0;
+}
+
+
+static size_t store_record_offset(const gallery_store_t *store, int half, uint32_t index)
+{
+    return store_half_offset(store, half) + sizeof(gallery_store_header_t) + (size_t)index * sizeof(gallery_record_t);
+}
+
+
+static const gallery_record_t *store_map_record(const gallery_store_t *store, int half, uint32_t index)
+{
+    return (const gallery_record_t *)(store->flash.map + store_record_offset(store, half, index));
+}
+
+
+/* generation of a half, 0 when its header is missing or damaged */
+static uint32_t store_header_generation(const gallery_store_t *store, int half)
+{
+    const gallery_store_header_t *h = (const gallery_store_header_t *)(store->flash.map + store_half_offset(store, half));
+    if (memcmp(h->magic, GALLERY_STORE_MAGIC, 4) || h->version != GALLERY_STORE_VERSION || h->dim != GALLERY_STORE_DIM ||
+        h->record_size != sizeof(gallery_record_t) || h->crc != store_crc32(0, h, GALLERY_STORE_HEADER_CRC_LEN)) {
+        return 0;
+    }
+    return h->generation;
+}
+
+
+static bool store_write(gallery_store_t *store, size_t offset, const void *data, size_t len)
+{
+    if (!store->flash.write(store->flash.ctx, offset, data, len)) return false;
+    store->stats.bytes_written += len;
+    return true;
+}
+
+
+static bool store_write_header(gallery_store_t *store, int half, uint32_t generation)
+{
+    gallery_store_header_t h;
+    memset(&h, 0xFF, sizeof(h));
+    memcpy(h.magic, GALLERY_STORE_MAGIC, 4);
+    h.version = GALLERY_STORE_VERSION;
+    h.dim = GALLERY_STORE_DIM;
+    h.generation = generation;
+    h.record_size = sizeof(gallery_record_t);
+    h.crc = store_crc32(0, &h, GALLERY_STORE_HEADER_CRC_LEN);
+    return store_write(store, store_half_offset(store, half), &h, sizeof(h));
+}
+
+
+static bool store_erase_half(gallery_store_t *store, int half)
+{
+    if (!store->flash.erase(store->flash.ctx, store_half_offset(store, half), store->half)) return false;
+    store->stats.erases += store->half / GALLERY_STORE_SECTOR;
+    return true;
+}
+
+
+/* valid templates of person among the first n records of a half that no tombstone hides yet:
+   a second delete of the same person only hides what was enrolled after the first */
+static uint32_t store_count_person(const gallery_store_t *store, int half, uint32_t n, uint16_t person)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const gallery_record_t *rec = store_map_record(store, half, i);
+        if (rec->person != person || rec->magic != GALLERY_STORE_RECORD_MAGIC || rec->crc != store_record_crc(rec)) continue;
+        if (rec->type == GALLERY_RECORD_TOMBSTONE) {
+            count = 0;
+        } else if (rec->type == GALLERY_RECORD_ENROLL) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+/* find the end of the active log and count what a compaction would drop */
+static void store_scan(gallery_store_t *store)
+{
+    store->stats.records = 0;
+    store->stats.dead = 0;
+    for (uint32_t i = 0; i < store->stats.capacity; i++) {
+        const gallery_record_t *rec = store_map_record(store, store->active, i);
+        if (rec->magic == 0xFFFF) break;
+        store->stats.records++;
+        if (rec->magic != GALLERY_STORE_RECORD_MAGIC || rec->crc != store_record_crc(rec)) {
+            store->stats.dead++;
+            store->stats.corrupt++;
+        } else if (rec->type == GALLERY_RECORD_TOMBSTONE) {
+            store->stats.dead += 1 + store_count_person(store, store->active, i, rec->person);
+        }
+    }
+}
+
+
+bool gallery_store_open(gallery_store_t *store, const gallery_store_flash_t *flash, bool *formatted)
+{
+    memset(store, 0, sizeof(*store));
+    store->flash = *flash;
+    store->half = (flash->size / 2) & ~(size_t)(GALLERY_STORE_SECTOR - 1);
+    *formatted = false;
+    if (store->half < GALLERY_STORE_SECTOR) return false;
+    store->stats.capacity = (store->half - sizeof(gallery_store_header_t)) / sizeof(gallery_record_t);
+    uint32_t g0 = store_header_generation(store, 0), g1 = store_header_generation(store, 1);
+    if (!g0 && !g1) {
+        store->active = 0;
+        if (!store_erase_half(store, 0) || !store_write_header(store, 0, 1)) return false;
+        store->stats.generation = 1;
+        *formatted = true;
+        return true;
+    }
+    store->active = (g1 > g0) ? 1 : 0;
+    store->stats.generation = store->active ? g1 : g0;
+    store_scan(store);
+    return true;
+}
+
+
+const gallery_record_t *gallery_store_record(gallery_store_t *store, uint32_t index)
+{
+    if (index >= store->stats.records) return NULL;
+    const gallery_record_t *rec = store_map_record(store, store->active, index);
+    if (rec->magic != GALLERY_STORE_RECORD_MAGIC || rec->crc != store_record_crc(rec)) return NULL;
+    return rec;
+}
+
+
+const gallery_record_t *gallery_store_append(gallery_store_t *store, const gallery_record_t *record)
+{
+    static gallery_record_t rec;
+    uint32_t index = store->stats.records;
+    if (index >= store->stats.capacity) return NULL;
+    memcpy(&rec, record, store_record_len(record));
+    rec.magic = GALLERY_STORE_RECORD_MAGIC;
+    rec.crc = store_record_crc(&rec);
+    if (!store_write(store, store_record_offset(store, store->active, index), &rec, store_record_len(&rec))) return NULL;
+    store->stats.records++;
+    store->stats.appends++;
+    if (rec.type == GALLERY_RECORD_TOMBSTONE) {
+        store->stats.dead += 1 + store_count_person(store, store->active, index, rec.person);
+    }
+    return store_map_record(store, store->active, index);
+}
+
+
+bool gallery_store_compact_start(gallery_store_t *store)
+{
+    store->compact_read = 0;
+    store->compact_written = 0;
+    return store_erase_half(store, !store->active);
+}
+
+
+bool gallery_store_compact_copy(gallery_store_t *store, uint32_t upto)
+{
+    static gallery_record_t rec;     // flash writes need the source outside the mapping
+    int target = !store->active;
+    if (upto > store->stats.records) upto = store->stats.records;
+    for (; store->compact_read < upto; store->compact_read++) {
+        const gallery_record_t *src = gallery_store_record(store, store->compact_read);
+        if (!src) continue;
+        if (src->type == GALLERY_RECORD_ENROLL) {
+            // hidden by a tombstone that has been written by now
+            bool deleted = false;
+            for (uint32_t j = store->compact_read + 1; j < upto && !deleted; j++) {
+                const gallery_record_t *later = gallery_store_record(store, j);
+                deleted = later && later->type == GALLERY_RECORD_TOMBSTONE && later->person == src->person;
+            }
+            if (deleted) continue;
+        } else if (!store_count_person(store, target, store->compact_written, src->person)) {
+            continue;                  // nothing left in the new half for this tombstone to hide
+        }
+        if (store->compact_written >= store->stats.capacity) return false;
+        memcpy(&rec, src, store_record_len(src));
+        if (!store_write(store, store_record_offset(store, target, store->compact_written), &rec, store_record_len(&rec))) {
+            return false;
+        }
+        store->compact_written++;
+    }
+    return true;
+}
+
+
+bool gallery_store_compact_finish(gallery_store_t *store)
+{
+    int target = !store->active;
+    if (!gallery_store_compact_copy(store, store->stats.records) ||
+        !store_write_header(store, target, store->stats.generation + 1)) {
+        return false;
+    }
+    store->active = target;
+    store->stats.generation++;
+    store->stats.compactions++;
+    store_scan(store);
+    return true;
+}
+
+
+bool gallery_store_wants_compaction(const gallery_store_t *store)
+{
+    const gallery_store_stats_t *s = &store->stats;
+    if (!s->dead) return false;
+    return s->records + GALLERY_STORE_RESERVE >= s->capacity || (s->dead >= GALLERY_STORE_MIN_DEAD && s->dead * 2 >= s->records);
+}
+
+
+void gallery_store_get_stats(const gallery_store_t *store, gallery_store_stats_t *out)
+{
+    *out = store->stats;
+}
@@ -0,0 +1,88 @@
+#ifndef GALLERY_STORE_H
+#define GALLERY_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// embedding length and norm slices of a stored template
+#define GALLERY_STORE_DIM 512
+#define GALLERY_STORE_CHUNKS 4
+
+#define GALLERY_STORE_VERSION 2
+#define GALLERY_STORE_SECTOR 4096
+
+typedef enum {
+    GALLERY_RECORD_ENROLL = 1,     // one template of a person
+    GALLERY_RECORD_TOMBSTONE = 2   // person deleted, hides every earlier template of it
+} gallery_record_type_t;
+
+// fixed-size log record; the header is 32 bytes so emb stays 16 byte aligned in the mapping
+typedef struct {
+    uint16_t magic;                // GALLERY_STORE_RECORD_MAGIC, 0xFFFF where the log ends
+    uint8_t type;                  // gallery_record_type_t
+    uint8_t reserved;
+    uint16_t person;
+    uint16_t reserved2;
+    float norm;                    // of emb, so loading does not touch the payload
+    float chunk_norm[GALLERY_STORE_CHUNKS];
+    uint32_t crc;                  // CRC-32 of the record with crc = 0, header only for tombstones
+    int8_t emb[GALLERY_STORE_DIM];
+} gallery_record_t;
+
+/* Flash the store runs on: the partition on the device, a file on a Linux host
+   (map = mmap(2) of the file, write = pwrite, erase = fill with 0xFF). Reads only go through map. */
+typedef struct {
+    void *ctx;
+    size_t size;                   // multiple of 2 * GALLERY_STORE_SECTOR
+    const uint8_t *map;
+    bool (*write)(void *ctx, size_t offset, const void *data, size_t len);
+    bool (*erase)(void *ctx, size_t offset, size_t len);
+} gallery_store_flash_t;
+
+typedef struct {
+    uint32_t generation;           // of the active half, bumped by every compaction
+    uint32_t records;              // written in the active half, including dead ones
+    uint32_t capacity;             // records one half can hold
+    uint32_t dead;                 // tombstones, deleted templates and records with a bad CRC
+    uint32_t corrupt;              // records with a bad CRC found since open
+    uint32_t appends;
+    uint32_t bytes_written;        // since open, appends and compactions
+    uint32_t erases;               // sectors erased since open
+    uint32_t compactions;
+} gallery_store_stats_t;
+
+typedef struct {
+    gallery_store_flash_t flash;
+    size_t half;                   // bytes per half
+    int active;                    // 0 or 1
+    uint32_t compact_read;         // next record of the active half to copy
+    uint32_t compact_written;      // records written to the inactive half
+    gallery_store_stats_t stats;
+} gallery_store_t;
+
+/* Use the half with the newest valid header, or format the first one if neither has one.
+   Walks the record headers once to find the end of the log; the payloads stay in flash.
+   *formatted is set when the store was empty. False if the flash is too small. */
+bool gallery_store_open(gallery_store_t *store, const gallery_store_flash_t *flash, bool *formatted);
+
+/* Record at index in the active half (mapped), NULL past the end or when its CRC is bad */
+const gallery_record_t *gallery_store_record(gallery_store_t *store, uint32_t index);
+
+/* Append a record; magic and crc are filled in. Returns the mapped copy, NULL when the half is full. */
+const gallery_record_t *gallery_store_append(gallery_store_t *store, const gallery_record_t *record);
+
+/* Compaction copies the live records into the erased other half, then switches to it by writing
+   its header (newer generation) last, so power loss at any step leaves one complete half.
+   start erases the other half; copy moves records up to index (exclusive) and may run without the
+   caller's lock for records that already exist; finish copies nothing and switches. */
+bool gallery_store_compact_start(gallery_store_t *store);
+bool gallery_store_compact_copy(gallery_store_t *store, uint32_t upto);
+bool gallery_store_compact_finish(gallery_store_t *store);
+
+/* True when dead records fill most of the half or it is almost full */
+bool gallery_store_wants_compaction(const gallery_store_t *store);
+
+void gallery_store_get_stats(const gallery_store_t *store, gallery_store_stats_t *stats);
+
+#endif
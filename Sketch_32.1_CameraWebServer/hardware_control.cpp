@@ -9,10 +9,14 @@ Also sends messages on WhatsApp using Callmebot
 #include <Arduino.h>
 #include "esp_log.h"
 #include <WiFi.h>
-#include <HTTPClient.h>
 #include "face_state.h"
-#include <WiFiClientSecure.h>
 #include "hardware_control.h"
+#include "telemetry.h"
+#include "db_client.h"
+#include "alert_client.h"
+#include "outbox.h"
+#include "trace.h"
+#include "session.h"
 
 #define TAG "hardware: "
 
@@ -62,13 +66,12 @@ volatile bool pir_active = false;
 int64_t pir_active_until_ms = 0;
 
 // text message variables
-static volatile unsigned long lastAlertTime = 0;
+static unsigned long lastAlertTime = 0;
+static portMUX_TYPE alert_mux = portMUX_INITIALIZER_UNLOCKED;
 #define ALERT_INTERVAL_MS 60000
 
-const char* serverName = "https://api.callmebot.com/whatsapp.php";
-static WiFiClientSecure alertClient;
-static HTTPClient alertHttp;
-static bool alertClientInitialized = false;
+// CallMeBot endpoint, host and TLS connection live in alert_client.cpp
+const char* serverPath = "/whatsapp.php";
 
 // Current set to Judy's phone. 
 // *** To register a new phone and get an API key, text +34 644 33 66 63 'I allow callmebot to send me messages'. 
@@ -135,41 +138,66 @@ bool hardware_led_is_on(hw_led_t *led) {
 }
 
 
-/* send text message */
-void sendIntruderAlert() {
-  if (lastAlertTime != 0 && (millis() - lastAlertTime) < ALERT_INTERVAL_MS) return;
+/* send text message over the warm CallMeBot connection, detected_ms = when the intruder was seen.
+   Returns true once CallMeBot accepted the message (2xx); a failed send is parked in the outbox if
+   park_in_outbox. */
+bool sendIntruderAlert(uint32_t detected_ms, bool park_in_outbox) {
+  if (session_replaying()) {
+    session_note("\"event\":\"alert\"");
+    return false;
+  }
+  // intruder_task and the outbox replay on the telemetry task both get here: claim the slot atomically
+  unsigned long now = millis();
+  taskENTER_CRITICAL(&alert_mux);
+  bool limited = lastAlertTime != 0 && (now - lastAlertTime) < ALERT_INTERVAL_MS;
+  if (!limited) lastAlertTime = now;
+  taskEXIT_CRITICAL(&alert_mux);
+  if (limited) return false;
+  static char query[160] = "";
+  if (query[0] == '\0') {
+    snprintf(query, sizeof(query), "%s?phone=%s&text=%s&apikey=%s", serverPath, phoneNumber, "intruder+alert", apiKey);
+  }
+  // an error page (bad API key, CallMeBot throttling) is no more a delivered alert than a dead link
+  bool delivered = false;
   if (WiFi.status() == WL_CONNECTED) {
-    WiFiClientSecure client;
-    client.setInsecure(); // skip certificate check
-    HTTPClient http;
-    String message = "intruder+alert";
-    String fullURL = String(serverName) +
-                      "?phone=" + phoneNumber +
-                      "&text=" + message +
-                      "&apikey=" + apiKey;
-      http.begin(client, fullURL);
-    int httpResponseCode = http.GET();
+    int httpResponseCode = alert_client_get(query, detected_ms);
     Serial.print("HTTP Response code: ");
     Serial.println(httpResponseCode);
-    if (httpResponseCode > 0) {
-      String payload = http.getString();
-      Serial.println(payload);
-    } else {
-      Serial.printf("GET failed: %s\n", http.errorToString(httpResponseCode).c_str());
-    }
-    http.end(); 
-    }
-    else {
-      Serial.println("WiFi Disconnected");
+    delivered = httpResponseCode >= 200 && httpResponseCode < 300;
+    if (!delivered) {
+      Serial.println("GET failed");
     }
-  lastAlertTime = millis();
-  // Serial.println("Sending text message (in theory)");
+  }
+  else {
+    Serial.println("WiFi Disconnected");
+  }
+  if (!delivered && park_in_outbox) {
+    // not lost: the outbox sends one late alert after reconnecting
+    outbox_append(OUTBOX_ALERT, true, -1, 0, (int64_t)detected_ms * 1000);
+  }
+  return delivered;
 }
 
 
 /* pir interrupt handler, toggle flag */
 void IRAM_ATTR pir_isr() {
   pir_triggered = true;
+  trace_instant(TRACE_PIR_ISR, 0);
+}
+
+
+/* PIR trigger: enable detection + recognition for the detection window */
+void hardware_pir_event(void) {
+  session_record_pir();
+  hardware_led_pulse(&pir_led, PIR_DETECTION_WINDOW_MS);
+  pir_active = true;
+  pir_active_until_ms = (session_clock_us() / 1000) + PIR_DETECTION_WINDOW_MS;
+  // Set PIR source flags 
+  detection_via_pir = true;
+  recognition_via_pir = true;
+  // recompute state
+  recompute_face_state();
+  Serial.println("PIR detection: face detection + recognition enabled (via PIR)");
 }
 
 
@@ -178,18 +206,11 @@ void hardware_control(void) {
   if (pir_triggered) {
     pir_triggered = false;
     Serial.println("pir_triggered true");
-    hardware_led_pulse(&pir_led, PIR_DETECTION_WINDOW_MS);
-    pir_active = true;
-    pir_active_until_ms = (esp_timer_get_time() / 1000) + PIR_DETECTION_WINDOW_MS;
-    // Set PIR source flags 
-    detection_via_pir = true;
-    recognition_via_pir = true;
-    // recompute state
-    recompute_face_state();
-    Serial.println("PIR detection: face detection + recognition enabled (via PIR)");
+    // a replay brings its own PIR edges
+    if (!session_replaying()) hardware_pir_event();
   }
   if (pir_active) {
-    int64_t now_ms = esp_timer_get_time() / 1000;
+    int64_t now_ms = session_clock_us() / 1000;
     if (now_ms > pir_active_until_ms) {
       pir_active = false;
       detection_via_pir = false;
@@ -230,27 +251,27 @@ void hardware_buzz(void) {
 }
 
 
-/* log data (face recognizer metrics) to database */
+/* log data (face recognizer metrics) to database - queued, telemetry_task does the POST */
 void send_to_database(bool intruder_status, int face_id, float confidence) {
-  WiFiClient client;    
-  HTTPClient http;
-  const char* serverURL = "http://54.167.124.79:5000/create";
-  http.begin(client, serverURL);
-  http.addHeader("Content-Type", "application/json");
-  String jsonBody = String("{") + String("\"intruder_status\":") + String(intruder_status ? "true" : "false") + String(",") + String("\"face_id\":") + String(face_id) + String(",") + String("\"confidence\":") + String(confidence) + String("}");
-  int httpCode = http.POST(jsonBody);
+  if (session_replaying()) {
+    session_note("\"event\":\"identity\",\"intruder\":%d,\"id\":%d,\"similarity\":%.3f", intruder_status, face_id, confidence);
+    return;
+  }
+  if (!telemetry_push(intruder_status, face_id, confidence)) {
+    ESP_LOGW(TAG, "telemetry ring full, event dropped");
+  }
 }
 
 
-/* send status of ESP32-S3 */
+/* send status of ESP32-S3 over the shared keep-alive connection */
 void send_heartbeat() {
-  WiFiClient client;    
-  HTTPClient http;
-  const char* serverURL = "http://54.167.124.79:5000/status_create";
-  http.begin(client, serverURL);
-  http.addHeader("Content-Type", "application/json");
-  String jsonBody = String("{") + String("\"status\":") + String("true") + String("}");
-  int httpCode = http.POST(jsonBody);
+  static const char body[] = "{\"status\":true}";
+  int httpCode = db_client_post(DB_ENDPOINT_STATUS, body, sizeof(body) - 1);
+  if (httpCode < 200 || httpCode >= 300) {
+    ESP_LOGW(TAG, "heartbeat failed: %d", httpCode);
+    // replayed with its original time once the server is reachable
+    outbox_append(OUTBOX_HEARTBEAT, false, 0, 0, esp_timer_get_time());
+  }
 }
 
 
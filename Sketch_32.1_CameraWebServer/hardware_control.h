@@ -53,16 +53,20 @@ bool hardware_led_is_on(hw_led_t *led);
 /* Poll for PIR events and handles corresponding action (not in ISR) */
 void hardware_control(void);
 
+/* Act on one PIR trigger: LED and a PIR detection window (live from hardware_control, or a session replay) */
+void hardware_pir_event(void);
+
 /* Turns on buzzer for a second */
 void hardware_buzz(void);
 
-/* Sends intruder status, face id and confidence to EC2 database */
+/* Queues intruder status, face id and confidence for the EC2 database (telemetry.cpp uploads it) */
 void send_to_database(bool intruder_status, int face_id, float confidence);
 
 /* Sends heartbeat that device is active and connected to wifi */
 void send_heartbeat();
 
-/* Sends whatsapp message through chat me bot to notify owner*/
-void sendIntruderAlert(void);
+/* Sends whatsapp message through chat me bot to notify owner, detected_ms = esp_timer ms of the detection.
+   At most one per minute; returns whether a message went out. A failed send is parked in the outbox if park_in_outbox. */
+bool sendIntruderAlert(uint32_t detected_ms, bool park_in_outbox);
 
 #endif
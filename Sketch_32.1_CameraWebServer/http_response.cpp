@@ -0,0 +1,92 @@
+/*
+http_response.cpp
+minimal HTTP/1.x response reader for the keep-alive clients (db_client, alert_client).
+Only the status code matters to us; the body is read and thrown away.
+*/
+
+#include "http_response.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#define HTTP_LINE_LEN 128
+
+// ----- FUNCTIONS --------------------------------
+
+/* one header/chunk-size line without the CRLF, -1 when the connection went away */
+static int http_read_line(Client &client, char *line, size_t len)
+{
+    size_t n = client.readBytesUntil('\n', line, len - 1);
+    if (n == 0 && !client.connected()) return -1;
+    if (n > 0 && line[n - 1] == '\r') n--;
+    line[n] = '\0';
+    return (int)n;
+}
+
+
+/* read and discard len body bytes */
+static bool http_skip(Client &client, long len)
+{
+    char buf[HTTP_LINE_LEN];
+    while (len > 0) {
+        size_t want = (len < (long)sizeof(buf)) ? len : sizeof(buf);
+        size_t got = client.readBytes(buf, want);
+        if (got == 0) return false;
+        len -= got;
+    }
+    return true;
+}
+
+
+/* chunk-size line, chunk, CRLF ... until the zero chunk and the trailer */
+static bool http_skip_chunked(Client &client)
+{
+    char line[HTTP_LINE_LEN];
+    while (true) {
+        if (http_read_line(client, line, sizeof(line)) <= 0) return false;
+        long size = strtol(line, NULL, 16);
+        if (size == 0) break;
+        if (!http_skip(client, size) || http_read_line(client, line, sizeof(line)) < 0) return false;
+    }
+    // trailer headers end with an empty line
+    int n;
+    while ((n = http_read_line(client, line, sizeof(line))) > 0) {
+    }
+    return n == 0;
+}
+
+
+int http_read_response(Client &client)
+{
+    char line[HTTP_LINE_LEN];
+    if (http_read_line(client, line, sizeof(line)) <= 0) return -1;
+    int major = 0, minor = 0, code = -1;
+    if (sscanf(line, "HTTP/%d.%d %d", &major, &minor, &code) != 3) return -1;
+    bool close = (major == 1 && minor == 0);
+    bool chunked = false;
+    long content_length = -1;
+    while (true) {
+        int n = http_read_line(client, line, sizeof(line));
+        if (n < 0) return -1;
+        if (n == 0) break;
+        if (!strncasecmp(line, "Content-Length:", 15)) {
+            content_length = atol(line + 15);
+        } else if (!strncasecmp(line, "Connection:", 11)) {
+            if (strcasestr(line + 11, "close")) close = true;
+            else if (strcasestr(line + 11, "keep-alive")) close = false;
+        } else if (!strncasecmp(line, "Transfer-Encoding:", 18) && strcasestr(line + 18, "chunked")) {
+            chunked = true;
+        }
+    }
+    bool drained;
+    if (chunked) {
+        drained = http_skip_chunked(client);
+    } else if (content_length >= 0) {
+        drained = http_skip(client, content_length);
+    } else {
+        drained = false;              // body runs until the server closes
+    }
+    if (close || !drained) client.stop();
+    return code;
+}
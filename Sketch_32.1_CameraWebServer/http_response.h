@@ -0,0 +1,11 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <Client.h>
+
+/* Read one HTTP/1.x response from a kept-alive connection: status line, headers, and the body
+   (Content-Length or chunked) drained so the next request can follow on the same socket.
+   Returns the status code, -1 on a broken response. Stops the client when the server asked to close. */
+int http_read_response(Client &client);
+
+#endif
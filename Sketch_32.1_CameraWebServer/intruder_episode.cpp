@@ -0,0 +1,89 @@
+/*
+intruder_episode.cpp
+turns per-frame intruder verdicts into episodes. The vision task reports every frame whose
+front face is an intruder; frames closer than EPISODE_END_GAP_MS belong to the same episode,
+no matter how often the track was lost in between. intruder_task only hears about the start
+(buzzer, LED, CallMeBot) and the end (summary) of each episode, so its queue, the peripherals
+and the network see O(1) work per intruder instead of one message per frame.
+*/
+
+#include "intruder_episode.h"
+#include "intruder_task.h"
+#include "session.h"
+#include "esp_log.h"
+#define TAG "episode: "
+
+static intruder_episode_t current;
+static bool active = false;
+static float similarity_sum = 0;
+static intruder_episode_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+/* hand a transition to intruder_task, never blocks the frame loop */
+static void episode_send(episode_transition_t transition)
+{
+    current.transition = transition;
+    session_note("\"event\":\"episode_%s\",\"episode\":%u,\"frames\":%u,\"max_similarity\":%.3f",
+                 transition == EPISODE_START ? "start" : "end", current.id, current.frames, current.max_similarity);
+    if (intruder_queue_send(&current)) {
+        stats.messages++;
+    } else {
+        stats.queue_drops++;
+    }
+}
+
+
+const intruder_episode_t *intruder_episode_observe(uint32_t frame_index, float similarity, float score)
+{
+    uint32_t now_ms = (uint32_t)(session_clock_us() / 1000);
+    stats.frames++;
+    if (!active) {
+        active = true;
+        stats.active = true;
+        stats.episodes++;
+        current.id = stats.episodes;
+        current.start_ms = now_ms;
+        current.end_ms = now_ms;
+        current.frames = 1;
+        current.max_similarity = similarity;
+        current.mean_similarity = similarity;
+        current.best_frame = frame_index;
+        current.best_score = score;
+        similarity_sum = similarity;
+        episode_send(EPISODE_START);
+        return &current;
+    }
+    current.end_ms = now_ms;
+    current.frames++;
+    similarity_sum += similarity;
+    current.mean_similarity = similarity_sum / current.frames;
+    if (similarity > current.max_similarity) current.max_similarity = similarity;
+    if (score > current.best_score) {
+        current.best_frame = frame_index;
+        current.best_score = score;
+        return &current;
+    }
+    return NULL;
+}
+
+
+void intruder_episode_tick(void)
+{
+    if (!active) return;
+    uint32_t now_ms = (uint32_t)(session_clock_us() / 1000);
+    if (now_ms - current.end_ms < EPISODE_END_GAP_MS) return;
+    active = false;
+    stats.active = false;
+    stats.last_frames = current.frames;
+    stats.last_duration_ms = current.end_ms - current.start_ms;
+    stats.avg_frames_per_episode = (stats.episodes == 1) ? current.frames :
+        stats.avg_frames_per_episode + ((float)current.frames - stats.avg_frames_per_episode) * 0.2f;
+    episode_send(EPISODE_END);
+}
+
+
+void intruder_episode_get_stats(intruder_episode_stats_t *out)
+{
+    *out = stats;
+}
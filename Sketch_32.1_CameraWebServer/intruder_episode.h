@@ -0,0 +1,51 @@
+#ifndef INTRUDER_EPISODE_H
+#define INTRUDER_EPISODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// an episode ends once no intruder frame was seen for this long
+#ifndef EPISODE_END_GAP_MS
+#define EPISODE_END_GAP_MS 3000
+#endif
+
+typedef enum {
+    EPISODE_START = 1,             // first intruder frame: buzzer, LED and alert
+    EPISODE_END                    // gap elapsed: summary only
+} episode_transition_t;
+
+// message to intruder_task, sent on transitions only
+typedef struct intruder_episode {
+    uint8_t transition;            // episode_transition_t
+    uint32_t id;                   // episode number since boot
+    uint32_t start_ms;             // esp_timer time of the first intruder frame
+    uint32_t end_ms;               // last intruder frame, = start_ms on EPISODE_START
+    uint32_t frames;               // intruder frames in the episode
+    float max_similarity;          // closest match to an enrolled face
+    float mean_similarity;
+    uint32_t best_frame;           // vision frame index with the clearest face
+    float best_score;              // its detection score
+} intruder_episode_t;
+
+typedef struct {
+    uint32_t episodes;
+    uint32_t frames;               // intruder frames observed
+    uint32_t messages;             // sent to intruder_task
+    uint32_t queue_drops;
+    bool active;
+    uint32_t last_frames;          // frames in the last closed episode
+    uint32_t last_duration_ms;
+    float avg_frames_per_episode;
+} intruder_episode_stats_t;
+
+/* One frame whose front face is an intruder. Call from the vision task only.
+   Returns the current episode when this frame is its best one so far, NULL otherwise. */
+const intruder_episode_t *intruder_episode_observe(uint32_t frame_index, float similarity, float score);
+
+/* Close the current episode once EPISODE_END_GAP_MS passed without an intruder frame.
+   Call once per vision loop, analysing or not. */
+void intruder_episode_tick(void);
+
+void intruder_episode_get_stats(intruder_episode_stats_t *stats);
+
+#endif
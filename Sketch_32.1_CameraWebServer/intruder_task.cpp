@@ -1,35 +1,52 @@
 /*
 intruder_task.cpp
 simple FreeRTOS queue for managing intruder detection without blocking the CPU: 
-sound the buzzer, pulse the red led, and send an alert on WhatsApp
+on the start of an intruder episode sound the buzzer, pulse the red led, and send an alert on WhatsApp;
+on its end release the episode snapshot for upload and cut the episode clip
 */ 
 #include "intruder_task.h"
 #include "hardware_control.h"
+#include "snapshot.h"
+#include "clip_recorder.h"
+#include "trace.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_log.h"
+#define TAG "intruder: "
 
 
 static QueueHandle_t intruderQueue = NULL;
 
 static void intruder_task(void *arg) {
-    uint32_t msg;
+    intruder_episode_t msg;
     while (true) {
         if (xQueueReceive(intruderQueue, &msg, portMAX_DELAY)) {
-            hardware_buzz();           
-            hardware_led_pulse(&intruder_led, 5000); 
-            sendIntruderAlert();          
+            if (msg.transition == EPISODE_START) {
+                trace_begin(TRACE_ALERT);
+                hardware_buzz();
+                hardware_led_pulse(&intruder_led, 5000);
+                sendIntruderAlert(msg.start_ms, true);
+                trace_end(TRACE_ALERT);
+            } else {
+                ESP_LOGI(TAG, "episode %u: %u frames in %u ms, similarity max %.2f mean %.2f, best frame %u (%.2f)",
+                         msg.id, msg.frames, msg.end_ms - msg.start_ms, msg.max_similarity, msg.mean_similarity,
+                         msg.best_frame, msg.best_score);
+                snapshot_episode_closed(&msg);
+                clip_recorder_episode_closed(&msg);
+            }
         }
     }
 }
 
 void intruder_task_init(void) {
     if (intruderQueue) return;
-    intruderQueue = xQueueCreate(4, sizeof(uint32_t));
+    intruderQueue = xQueueCreate(4, sizeof(intruder_episode_t));
     xTaskCreatePinnedToCore(intruder_task, "intruder_task", 8192, NULL, 4, NULL, 1);
 }
 
-bool intruder_queue_send(uint32_t msg) {
+bool intruder_queue_send(const intruder_episode_t *msg) {
     if (!intruderQueue) return false;
-    return xQueueSend(intruderQueue, &msg, 0) == pdTRUE;
+    trace_instant(TRACE_QUEUE_SEND, msg->transition);
+    return xQueueSend(intruderQueue, msg, 0) == pdTRUE;
 }
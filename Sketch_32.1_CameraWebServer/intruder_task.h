@@ -2,8 +2,10 @@
 #define INTRUDER_TASK_H
 
 #include <stdint.h>
+#include "intruder_episode.h"
 
 void intruder_task_init(void);
 
-bool intruder_queue_send(uint32_t msg);
+/* episode start / end from intruder_episode.cpp, copied into the queue */
+bool intruder_queue_send(const intruder_episode_t *msg);
 #endif
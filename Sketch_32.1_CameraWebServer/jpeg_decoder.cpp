@@ -0,0 +1,54 @@
+/*
+jpeg_decoder.cpp
+one JPEG decoder for the whole sketch. esp_jpg_decode, and fmt2rgb888 on top of it, decode
+through a static work buffer, while the pipeline decodes on both cores at once: the capture
+stage converts frames and feeds the motion gate on core 0, recognition decodes face crops on
+core 1, and /bench and the capture profile decode from their own tasks. Every caller takes this
+lock first; how often and how long they wait for each other shows in /stats.
+*/
+
+#include "jpeg_decoder.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stddef.h>
+
+static SemaphoreHandle_t decoder_lock = NULL;
+static jpeg_decoder_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+void jpeg_decoder_init(void)
+{
+    if (decoder_lock) return;
+    decoder_lock = xSemaphoreCreateMutex();
+}
+
+
+void jpeg_decoder_take(void)
+{
+    if (xSemaphoreTake(decoder_lock, 0) == pdTRUE) {
+        stats.decodes++;
+        return;
+    }
+    int64_t t0 = esp_timer_get_time();
+    xSemaphoreTake(decoder_lock, portMAX_DELAY);
+    // counted while holding the lock, so the stats need no lock of their own
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.decodes++;
+    stats.contended++;
+    if (us > stats.max_wait_us) stats.max_wait_us = us;
+    stats.avg_wait_us = (stats.contended == 1) ? us : stats.avg_wait_us + ((float)us - stats.avg_wait_us) * 0.05f;
+}
+
+
+void jpeg_decoder_give(void)
+{
+    xSemaphoreGive(decoder_lock);
+}
+
+
+void jpeg_decoder_get_stats(jpeg_decoder_stats_t *out)
+{
+    *out = stats;
+}
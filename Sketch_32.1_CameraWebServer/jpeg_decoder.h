@@ -0,0 +1,23 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t decodes;              // times the decoder was taken
+    uint32_t contended;            // takes that waited for a decode on the other core
+    uint32_t max_wait_us;
+    float avg_wait_us;             // moving average over the contended takes
+} jpeg_decoder_stats_t;
+
+/* Create the decoder lock; before any task decodes */
+void jpeg_decoder_init(void);
+
+/* esp_jpg_decode keeps its work area in a static buffer, so decodes must never overlap. Hold the
+   decoder around every esp_jpg_decode call and every fmt2rgb888 / jpg2rgb565 of a JPEG. */
+void jpeg_decoder_take(void);
+void jpeg_decoder_give(void);
+
+void jpeg_decoder_get_stats(jpeg_decoder_stats_t *stats);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+metrics.cpp
+per-stage latency histograms and pipeline counters for /metrics (Prometheus text format).
+Histograms are log-linear (HDR style): exact below 16us, then 8 sub-buckets per power of two,
+so every quantile is within 12.5% of the true value over 1us..60s in 200 buckets. The encode
+stage of the vision pipeline is the only writer of a histogram; it brackets each update with a
+sequence counter and the /metrics reader retries on a torn read, so neither side ever takes a lock.
+*/
+
+#include "metrics.h"
+#include "stream_broadcast.h"
+#include "telemetry.h"
+#include "intruder_episode.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define METRICS_SUB_BITS 3                                  // 8 sub-buckets per octave
+#define METRICS_EXACT 16                                    // values below are their own bucket
+#define METRICS_MAX_EXP 26                                  // ~67s, larger values land in the last bucket
+#define METRICS_BUCKETS (METRICS_EXACT + (METRICS_MAX_EXP - 3) * (1 << METRICS_SUB_BITS))
+
+typedef struct {
+    std::atomic<uint32_t> seq;     // odd while the writer is updating
+    uint32_t counts[METRICS_BUCKETS];
+    uint32_t count;
+    uint64_t sum_us;
+    uint32_t max_us;
+} metrics_histogram_t;
+
+static metrics_histogram_t histograms[METRIC_STAGE_COUNT];
+static std::atomic<uint32_t> counters[METRIC_COUNTER_COUNT];
+
+static const char *stage_names[METRIC_STAGE_COUNT] = { "ready", "detect", "recognize", "encode", "process", "frame" };
+static const float quantiles[] = { 0.5f, 0.95f, 0.99f };
+
+// ----- FUNCTIONS --------------------------------
+
+/* bucket of a latency value */
+static int metrics_bucket(uint32_t us)
+{
+    if (us < METRICS_EXACT) return us;
+    int exp = 31 - __builtin_clz(us);
+    if (exp > METRICS_MAX_EXP) return METRICS_BUCKETS - 1;
+    int sub = (us >> (exp - METRICS_SUB_BITS)) & ((1 << METRICS_SUB_BITS) - 1);
+    return METRICS_EXACT + (exp - 4) * (1 << METRICS_SUB_BITS) + sub;
+}
+
+
+/* largest value that falls into a bucket */
+static uint32_t metrics_bucket_upper(int bucket)
+{
+    if (bucket < METRICS_EXACT) return bucket;
+    int exp = (bucket - METRICS_EXACT) / (1 << METRICS_SUB_BITS) + 4;
+    int sub = (bucket - METRICS_EXACT) % (1 << METRICS_SUB_BITS);
+    uint32_t step = 1u << (exp - METRICS_SUB_BITS);
+    return (((1u << METRICS_SUB_BITS) + sub) << (exp - METRICS_SUB_BITS)) + step - 1;
+}
+
+
+void metrics_record(metrics_stage_t stage, uint32_t us)
+{
+    metrics_histogram_t *h = &histograms[stage];
+    uint32_t seq = h->seq.load(std::memory_order_relaxed);
+    h->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    h->counts[metrics_bucket(us)]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+    h->seq.store(seq + 2, std::memory_order_release);
+}
+
+
+void metrics_count(metrics_counter_t counter)
+{
+    counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/* consistent copy of one histogram */
+static void metrics_snapshot(metrics_histogram_t *h, uint32_t *counts, uint32_t *count, uint64_t *sum_us, uint32_t *max_us)
+{
+    while (true) {
+        uint32_t before = h->seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            vTaskDelay(1);             // writer preempted mid-update, let it finish
+            continue;
+        }
+        memcpy(counts, h->counts, sizeof(h->counts));
+        *count = h->count;
+        *sum_us = h->sum_us;
+        *max_us = h->max_us;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h->seq.load(std::memory_order_relaxed) == before) return;
+    }
+}
+
+
+static void metrics_append(char *buf, size_t cap, size_t *len, const char *fmt, ...)
+{
+    if (*len + 1 >= cap) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *len, cap - *len, fmt, args);
+    va_end(args);
+    if (n > 0) {
+        *len += ((size_t)n < cap - *len) ? (size_t)n : cap - *len - 1;
+    }
+}
+
+
+size_t metrics_render(char *buf, size_t cap)
+{
+    static uint32_t counts[METRICS_BUCKETS];
+    size_t len = 0;
+    buf[0] = '\0';
+    metrics_append(buf, cap, &len,
+                   "# HELP vision_stage_seconds Per-frame latency of each vision pipeline stage.\n"
+                   "# TYPE vision_stage_seconds summary\n");
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+        uint32_t count, max_us;
+        uint64_t sum_us;
+        metrics_snapshot(&histograms[s], counts, &count, &sum_us, &max_us);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            uint32_t rank = (uint32_t)(quantiles[q] * count + 0.5f);
+            if (rank == 0) rank = 1;
+            uint32_t seen = 0, value = 0;
+            for (int b = 0; b < METRICS_BUCKETS && count; b++) {
+                seen += counts[b];
+                if (seen >= rank) {
+                    value = metrics_bucket_upper(b);
+                    break;
+                }
+            }
+            if (value > max_us) value = max_us;
+            metrics_append(buf, cap, &len, "vision_stage_seconds{stage=\"%s\",quantile=\"%g\"} %.6f\n",
+                           stage_names[s], quantiles[q], value / 1e6);
+        }
+        metrics_append(buf, cap, &len, "vision_stage_seconds_sum{stage=\"%s\"} %.6f\n", stage_names[s], sum_us / 1e6);
+        metrics_append(buf, cap, &len, "vision_stage_seconds_count{stage=\"%s\"} %u\n", stage_names[s], count);
+    }
+    metrics_append(buf, cap, &len, "# HELP vision_stage_max_seconds Slowest sample of each stage since boot.\n"
+                                   "# TYPE vision_stage_max_seconds gauge\n");
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+        metrics_append(buf, cap, &len, "vision_stage_max_seconds{stage=\"%s\"} %.6f\n",
+                       stage_names[s], histograms[s].max_us / 1e6);
+    }
+
+    stream_producer_stats_t producer;
+    stream_client_stats_t clients[STREAM_MAX_CLIENTS];
+    stream_broadcast_get_stats(&producer, clients);
+    uint32_t viewer_drops = 0;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        viewer_drops += clients[i].frames_dropped;
+    }
+    telemetry_stats_t telemetry;
+    telemetry_get_stats(&telemetry);
+    intruder_episode_stats_t episode;
+    intruder_episode_get_stats(&episode);
+    struct {
+        const char *name;
+        const char *help;
+        uint32_t value;
+    } totals[] = {
+        { "vision_frames_total", "Frames captured.", counters[METRIC_FRAMES].load() },
+        { "vision_detections_total", "Frames with at least one face.", counters[METRIC_DETECTIONS].load() },
+        { "vision_recognitions_total", "Recognizer passes.", counters[METRIC_RECOGNITIONS].load() },
+        { "vision_intruder_frames_total", "Frames whose front face is an intruder.", counters[METRIC_INTRUDER_FRAMES].load() },
+        { "vision_intruder_episodes_total", "Intruder episodes.", episode.episodes },
+        { "vision_capture_failures_total", "Camera captures that returned no frame.", counters[METRIC_CAPTURE_FAILURES].load() },
+        { "vision_pipeline_drops_total", "Frames dropped for lack of a pooled buffer.", counters[METRIC_PIPELINE_DROPS].load() },
+        { "stream_publish_failures_total", "Encoded frames dropped for lack of a frame slot.", producer.publish_failed },
+        { "stream_viewer_drops_total", "Frames skipped by slow viewers (connected viewers only).", viewer_drops },
+        { "telemetry_dropped_total", "Recognizer events lost to a full upload ring.", telemetry.dropped },
+        { "intruder_queue_drops_total", "Episode messages intruder_task could not take.", episode.queue_drops },
+    };
+    for (size_t i = 0; i < sizeof(totals) / sizeof(totals[0]); i++) {
+        metrics_append(buf, cap, &len, "# HELP %s %s\n# TYPE %s counter\n%s %u\n",
+                       totals[i].name, totals[i].help, totals[i].name, totals[i].name, totals[i].value);
+    }
+    return len;
+}
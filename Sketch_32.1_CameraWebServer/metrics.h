@@ -0,0 +1,38 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// per-frame pipeline stages, latency histograms in microseconds
+typedef enum {
+    METRIC_STAGE_READY = 0,        // capture -> pixels ready (decode / convert)
+    METRIC_STAGE_DETECT,           // detection or tracker prediction
+    METRIC_STAGE_RECOGNIZE,        // recognizer pass, only when it ran
+    METRIC_STAGE_ENCODE,           // JPEG encode
+    METRIC_STAGE_PROCESS,          // capture -> encoded
+    METRIC_STAGE_FRAME,            // frame to frame interval
+    METRIC_STAGE_COUNT
+} metrics_stage_t;
+
+typedef enum {
+    METRIC_FRAMES = 0,
+    METRIC_DETECTIONS,             // frames with at least one face
+    METRIC_RECOGNITIONS,           // recognizer passes
+    METRIC_INTRUDER_FRAMES,
+    METRIC_CAPTURE_FAILURES,       // esp_camera_fb_get returned nothing
+    METRIC_PIPELINE_DROPS,         // frames dropped by the vision pipeline for lack of a pooled buffer
+    METRIC_COUNTER_COUNT
+} metrics_counter_t;
+
+/* Add one latency sample. Single writer per stage (the vision pipeline's encode stage), never blocks. */
+void metrics_record(metrics_stage_t stage, uint32_t us);
+
+/* Bump a counter, any task */
+void metrics_count(metrics_counter_t counter);
+
+/* Prometheus text exposition of the histograms, the counters and the pipeline drop counters.
+   Returns the length written (truncated at cap). */
+size_t metrics_render(char *buf, size_t cap);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+motion_gate.cpp
+cheap motion gate in front of the face detector. Every analysed frame is reduced to a
+40x30 luma thumbnail, compared block by block against a slowly adapting background and the
+detector only runs when enough blocks changed (or faces are already being tracked). The
+bounding box of the moving blocks is handed back so detection can be limited to it.
+*/
+
+#include "motion_gate.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_jpg_decode.h"
+#include "jpeg_decoder.h"
+#include <string.h>
+#define TAG "motion: "
+
+#define MOTION_THUMB_PIXELS (MOTION_THUMB_WIDTH * MOTION_THUMB_HEIGHT)
+#define MOTION_BLOCKS_X (MOTION_THUMB_WIDTH / MOTION_BLOCK_SIZE)
+#define MOTION_BLOCKS_Y (MOTION_THUMB_HEIGHT / MOTION_BLOCK_SIZE)
+#define MOTION_BG_SHIFT 3                // background follows the scene at 1/8 per frame
+#define MOTION_ROI_MAX_PCT 60            // larger regions are not worth the copy, search the whole frame
+
+// JPEG thumbnail accumulator, filled from the 1/8 scaled decode
+typedef struct {
+    const uint8_t *src;
+    int scaled_width;
+    int scaled_height;
+    uint16_t sum[MOTION_THUMB_PIXELS];
+    uint8_t count[MOTION_THUMB_PIXELS];
+} motion_decoder_t;
+
+static uint8_t thumb[MOTION_THUMB_PIXELS];
+static uint16_t background[MOTION_THUMB_PIXELS];   // luma << 4
+static bool background_valid = false;
+static int background_width = 0;
+static int background_height = 0;
+static int64_t last_motion_us = 0;
+static volatile int threshold_pct = MOTION_THRESHOLD_PCT;
+static motion_gate_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+static inline uint8_t motion_luma(int r, int g, int b)
+{
+    return (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+
+/* RGB565 in camera byte order, 2x2 samples per thumbnail pixel */
+static bool motion_thumb_rgb565(const uint8_t *src, size_t src_len, int fw, int fh)
+{
+    if (src_len < (size_t)fw * fh * 2) return false;
+    int cw = fw / MOTION_THUMB_WIDTH, ch = fh / MOTION_THUMB_HEIGHT;
+    for (int ty = 0; ty < MOTION_THUMB_HEIGHT; ty++) {
+        for (int tx = 0; tx < MOTION_THUMB_WIDTH; tx++) {
+            int acc = 0;
+            for (int sy = 0; sy < 2; sy++) {
+                for (int sx = 0; sx < 2; sx++) {
+                    int x = tx * cw + (cw * (1 + 2 * sx)) / 4;
+                    int y = ty * ch + (ch * (1 + 2 * sy)) / 4;
+                    const uint8_t *p = src + ((size_t)y * fw + x) * 2;
+                    uint8_t hb = p[0], lb = p[1];
+                    acc += motion_luma(hb & 0xF8, (hb & 0x07) << 5 | (lb & 0xE0) >> 3, (lb & 0x1F) << 3);
+                }
+            }
+            thumb[ty * MOTION_THUMB_WIDTH + tx] = acc >> 2;
+        }
+    }
+    return true;
+}
+
+
+/* BGR888 as produced by fmt2rgb888 */
+static bool motion_thumb_rgb888(const uint8_t *src, size_t src_len, int fw, int fh)
+{
+    if (src_len < (size_t)fw * fh * 3) return false;
+    int cw = fw / MOTION_THUMB_WIDTH, ch = fh / MOTION_THUMB_HEIGHT;
+    for (int ty = 0; ty < MOTION_THUMB_HEIGHT; ty++) {
+        for (int tx = 0; tx < MOTION_THUMB_WIDTH; tx++) {
+            int acc = 0;
+            for (int sy = 0; sy < 2; sy++) {
+                for (int sx = 0; sx < 2; sx++) {
+                    int x = tx * cw + (cw * (1 + 2 * sx)) / 4;
+                    int y = ty * ch + (ch * (1 + 2 * sy)) / 4;
+                    const uint8_t *p = src + ((size_t)y * fw + x) * 3;
+                    acc += motion_luma(p[2], p[1], p[0]);
+                }
+            }
+            thumb[ty * MOTION_THUMB_WIDTH + tx] = acc >> 2;
+        }
+    }
+    return true;
+}
+
+
+static size_t motion_jpg_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    motion_decoder_t *d = (motion_decoder_t *)arg;
+    if (buf) {
+        memcpy(buf, d->src + index, len);
+    }
+    return len;
+}
+
+
+/* jpg_writer_cb: fold every 1/8 scaled RGB pixel into its thumbnail cell */
+static bool motion_jpg_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    motion_decoder_t *d = (motion_decoder_t *)arg;
+    if (!data) {
+        if (x == 0 && y == 0) {
+            d->scaled_width = w;
+            d->scaled_height = h;
+        }
+        return true;
+    }
+    if (d->scaled_width <= 0 || d->scaled_height <= 0) return false;
+    for (int yy = 0; yy < h; yy++) {
+        int ty = (y + yy) * MOTION_THUMB_HEIGHT / d->scaled_height;
+        if (ty >= MOTION_THUMB_HEIGHT) break;
+        const uint8_t *p = data + yy * w * 3;
+        for (int xx = 0; xx < w; xx++, p += 3) {
+            int tx = (x + xx) * MOTION_THUMB_WIDTH / d->scaled_width;
+            if (tx >= MOTION_THUMB_WIDTH) break;
+            int i = ty * MOTION_THUMB_WIDTH + tx;
+            d->sum[i] += motion_luma(p[0], p[1], p[2]);
+            d->count[i]++;
+        }
+    }
+    return true;
+}
+
+
+/* JPEG: DCT-scaled 1/8 decode, no full-size RGB888 buffer needed */
+static bool motion_thumb_jpeg(const uint8_t *src, size_t src_len)
+{
+    static motion_decoder_t d;
+    memset(&d, 0, sizeof(d));
+    d.src = src;
+    jpeg_decoder_take();
+    esp_err_t err = esp_jpg_decode(src_len, JPG_SCALE_8X, motion_jpg_read, motion_jpg_write, &d);
+    jpeg_decoder_give();
+    if (err != ESP_OK) {
+        return false;
+    }
+    for (int i = 0; i < MOTION_THUMB_PIXELS; i++) {
+        thumb[i] = d.count[i] ? d.sum[i] / d.count[i] : 0;
+    }
+    return true;
+}
+
+
+/* moving block bounding box -> padded frame region, whole frame when it is too big to bother */
+static void motion_region(int bx0, int by0, int bx1, int by1, int fw, int fh, motion_region_t *r)
+{
+    int block_w = fw / MOTION_BLOCKS_X, block_h = fh / MOTION_BLOCKS_Y;
+    // one block of padding on every side, faces straddle block edges
+    int x0 = (bx0 - 1) * block_w, y0 = (by0 - 1) * block_h;
+    int x1 = (bx1 + 2) * block_w, y1 = (by1 + 2) * block_h;
+    if (x1 - x0 < MOTION_ROI_MIN_SIDE) {
+        int grow = (MOTION_ROI_MIN_SIDE - (x1 - x0) + 1) / 2;
+        x0 -= grow;
+        x1 += grow;
+    }
+    if (y1 - y0 < MOTION_ROI_MIN_SIDE) {
+        int grow = (MOTION_ROI_MIN_SIDE - (y1 - y0) + 1) / 2;
+        y0 -= grow;
+        y1 += grow;
+    }
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > fw) x1 = fw;
+    if (y1 > fh) y1 = fh;
+    x0 &= ~3;                         // keep rows word aligned for the copy
+    r->x = x0;
+    r->y = y0;
+    r->width = (x1 - x0) & ~3;
+    r->height = y1 - y0;
+    if ((int64_t)r->width * r->height * 100 > (int64_t)fw * fh * MOTION_ROI_MAX_PCT) {
+        r->x = 0;
+        r->y = 0;
+        r->width = fw;
+        r->height = fh;
+    }
+}
+
+
+bool motion_gate_check(const uint8_t *src, size_t src_len, pixformat_t format, int frame_width, int frame_height,
+                       bool keep_open, motion_region_t *region)
+{
+    int64_t t0 = esp_timer_get_time();
+    region->x = 0;
+    region->y = 0;
+    region->width = frame_width;
+    region->height = frame_height;
+    bool ok = false;
+    if (frame_width >= MOTION_THUMB_WIDTH * 2 && frame_height >= MOTION_THUMB_HEIGHT * 2) {
+        if (format == PIXFORMAT_RGB565) {
+            ok = motion_thumb_rgb565(src, src_len, frame_width, frame_height);
+        } else if (format == PIXFORMAT_RGB888) {
+            ok = motion_thumb_rgb888(src, src_len, frame_width, frame_height);
+        } else if (format == PIXFORMAT_JPEG) {
+            ok = motion_thumb_jpeg(src, src_len);
+        }
+    }
+    if (!ok) {
+        return true;                  // cannot judge this frame, let the detector decide
+    }
+    stats.frames++;
+    if (!background_valid || background_width != frame_width || background_height != frame_height) {
+        for (int i = 0; i < MOTION_THUMB_PIXELS; i++) background[i] = thumb[i] << 4;
+        background_valid = true;
+        background_width = frame_width;
+        background_height = frame_height;
+        last_motion_us = t0;
+        return true;                  // no reference yet, detect once
+    }
+    int moving = 0;
+    int bx0 = MOTION_BLOCKS_X, by0 = MOTION_BLOCKS_Y, bx1 = -1, by1 = -1;
+    for (int by = 0; by < MOTION_BLOCKS_Y; by++) {
+        for (int bx = 0; bx < MOTION_BLOCKS_X; bx++) {
+            int diff = 0;
+            for (int y = by * MOTION_BLOCK_SIZE; y < (by + 1) * MOTION_BLOCK_SIZE; y++) {
+                for (int x = bx * MOTION_BLOCK_SIZE; x < (bx + 1) * MOTION_BLOCK_SIZE; x++) {
+                    int i = y * MOTION_THUMB_WIDTH + x;
+                    int d = thumb[i] - (background[i] >> 4);
+                    diff += (d < 0) ? -d : d;
+                    background[i] += ((thumb[i] << 4) - background[i]) >> MOTION_BG_SHIFT;
+                }
+            }
+            if (diff > MOTION_BLOCK_DELTA * MOTION_BLOCK_SIZE * MOTION_BLOCK_SIZE) {
+                moving++;
+                if (bx < bx0) bx0 = bx;
+                if (bx > bx1) bx1 = bx;
+                if (by < by0) by0 = by;
+                if (by > by1) by1 = by;
+            }
+        }
+    }
+    float pct = moving * 100.0f / (MOTION_BLOCKS_X * MOTION_BLOCKS_Y);
+    bool motion = moving > 0 && pct >= threshold_pct;
+    if (motion) {
+        last_motion_us = t0;
+        stats.motion_frames++;
+    }
+    bool open = motion || keep_open || t0 - last_motion_us < (int64_t)MOTION_HOLD_MS * 1000;
+#if MOTION_DETECT_ROI
+    // tracked faces may sit outside the moving blocks, only narrow the search on fresh motion
+    if (motion && !keep_open) {
+        motion_region(bx0, by0, bx1, by1, frame_width, frame_height, region);
+        if (region->width < frame_width || region->height < frame_height) {
+            stats.roi_frames++;
+            float roi_pct = (float)region->width * region->height * 100.0f / ((float)frame_width * frame_height);
+            stats.avg_roi_pct = (stats.roi_frames == 1) ? roi_pct : stats.avg_roi_pct + (roi_pct - stats.avg_roi_pct) * 0.1f;
+        }
+    }
+#endif
+    if (!open) {
+        stats.skipped++;
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.last_motion_pct = pct;
+    stats.avg_motion_pct += (pct - stats.avg_motion_pct) * 0.05f;
+    stats.avg_gate_us = (stats.frames == 1) ? us : stats.avg_gate_us + ((float)us - stats.avg_gate_us) * 0.05f;
+    return open;
+}
+
+
+void motion_gate_reset(void)
+{
+    background_valid = false;
+}
+
+
+void motion_gate_set_threshold(int pct)
+{
+    if (pct < 0) pct = 0;
+    if (pct > 100) pct = 100;
+    threshold_pct = pct;
+    ESP_LOGI(TAG, "motion threshold %d%%", pct);
+}
+
+
+void motion_gate_get_stats(motion_gate_stats_t *out)
+{
+    *out = stats;
+    out->threshold_pct = threshold_pct;
+}
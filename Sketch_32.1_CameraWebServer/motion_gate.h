@@ -0,0 +1,78 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_camera.h"
+
+// luma thumbnail every frame is reduced to
+#ifndef MOTION_THUMB_WIDTH
+#define MOTION_THUMB_WIDTH 40
+#endif
+#ifndef MOTION_THUMB_HEIGHT
+#define MOTION_THUMB_HEIGHT 30
+#endif
+
+// thumbnail pixels per difference block side (40x30 -> 8x6 blocks)
+#ifndef MOTION_BLOCK_SIZE
+#define MOTION_BLOCK_SIZE 5
+#endif
+
+// mean absolute luma difference that marks a block as moving
+#ifndef MOTION_BLOCK_DELTA
+#define MOTION_BLOCK_DELTA 12
+#endif
+
+// default share of moving blocks (percent) needed to run the detector, runtime value via /control?var=motion_threshold
+#ifndef MOTION_THRESHOLD_PCT
+#define MOTION_THRESHOLD_PCT 3
+#endif
+
+// keep the detector running this long after the last motion
+#ifndef MOTION_HOLD_MS
+#define MOTION_HOLD_MS 2000
+#endif
+
+// run the detector only on the motion bounding region when it is small enough
+#ifndef MOTION_DETECT_ROI
+#define MOTION_DETECT_ROI 1
+#endif
+
+// smallest region side handed to the detector, MSR01 needs some context around a face
+#ifndef MOTION_ROI_MIN_SIDE
+#define MOTION_ROI_MIN_SIDE 96
+#endif
+
+// region of the frame the detector should look at, in frame pixels
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} motion_region_t;
+
+typedef struct {
+    uint32_t frames;               // frames seen by the gate
+    uint32_t motion_frames;        // frames with motion above the threshold
+    uint32_t skipped;              // inferences skipped because the scene was still
+    uint32_t roi_frames;           // detections restricted to the motion region
+    float last_motion_pct;         // moving blocks in the last frame
+    float avg_motion_pct;
+    float avg_roi_pct;             // region area vs. frame area for ROI detections
+    float avg_gate_us;             // thumbnail + difference time
+    int threshold_pct;
+} motion_gate_stats_t;
+
+/* Build the luma thumbnail of this frame, diff it against the background and decide whether to detect.
+   keep_open: faces are being tracked, detect regardless of motion. region gets the area to search. */
+bool motion_gate_check(const uint8_t *src, size_t src_len, pixformat_t format, int frame_width, int frame_height,
+                       bool keep_open, motion_region_t *region);
+
+/* Drop the background, e.g. after the frame size changed */
+void motion_gate_reset(void);
+
+void motion_gate_set_threshold(int pct);
+
+void motion_gate_get_stats(motion_gate_stats_t *stats);
+
+#endif
@@ -0,0 +1,320 @@
+/*
+outbox.cpp
+store-and-forward log for everything that could not be delivered while Wi-Fi or the server
+was down: recognizer events, heartbeats and intruder alerts. Records are fixed size, CRC
+checked and numbered; they are staged in RAM and appended to /spiffs/outbox.log in batches
+to keep flash wear down. Once the server is reachable again they are replayed (with their
+sequence number and original time), acknowledged by sequence number in /spiffs/outbox.ack
+and the log is compacted. The log is capped at OUTBOX_MAX_BYTES; beyond that the oldest
+records go. The file format lives in outbox_store.cpp; this file adds SPIFFS, the staging
+and the replay to the server.
+*/
+
+#include "outbox.h"
+#include "outbox_store.h"
+#include "db_client.h"
+#include "event_codec.h"
+#include "hardware_control.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "FS.h"
+#include "SPIFFS.h"
+#include <time.h>
+#define TAG "outbox: "
+
+#define OUTBOX_CLOCK_VALID 1600000000    // time() above this means SNTP has set the clock
+
+static const char *outbox_paths[OUTBOX_FILE_COUNT] = { "/outbox.log", "/outbox.tmp", "/outbox.ack" };
+
+static SemaphoreHandle_t outbox_lock = NULL;
+static outbox_store_t store;
+static outbox_record_t staged[OUTBOX_WRITE_BATCH];
+static int staged_count = 0;
+static int64_t staged_since_us = 0;
+static uint16_t boot_id = 0;
+static int alert_failures = 0;         // failed sends of the alert run at the head of the log
+static outbox_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+static long outbox_fs_size(void *ctx, outbox_file_t file)
+{
+    if (!SPIFFS.exists(outbox_paths[file])) return -1;
+    File f = SPIFFS.open(outbox_paths[file], FILE_READ);
+    if (!f) return -1;
+    long size = f.size();
+    f.close();
+    return size;
+}
+
+
+static size_t outbox_fs_read(void *ctx, outbox_file_t file, uint32_t offset, void *buf, size_t len)
+{
+    File f = SPIFFS.open(outbox_paths[file], FILE_READ);
+    if (!f) return 0;
+    size_t n = f.seek(offset) ? f.read((uint8_t *)buf, len) : 0;
+    f.close();
+    return n;
+}
+
+
+static size_t outbox_fs_append(void *ctx, outbox_file_t file, const void *data, size_t len)
+{
+    File f = SPIFFS.open(outbox_paths[file], FILE_APPEND);
+    if (!f) {
+        ESP_LOGE(TAG, "cannot append to %s", outbox_paths[file]);
+        return 0;
+    }
+    size_t n = f.write((const uint8_t *)data, len);
+    f.close();
+    return n;
+}
+
+
+static bool outbox_fs_replace(void *ctx, outbox_file_t file, const void *data, size_t len)
+{
+    File f = SPIFFS.open(outbox_paths[file], FILE_WRITE);
+    if (!f) return false;
+    size_t n = f.write((const uint8_t *)data, len);
+    f.close();
+    return n == len;
+}
+
+
+static bool outbox_fs_remove(void *ctx, outbox_file_t file)
+{
+    return SPIFFS.remove(outbox_paths[file]);
+}
+
+
+static bool outbox_fs_rename(void *ctx, outbox_file_t from, outbox_file_t to)
+{
+    return SPIFFS.rename(outbox_paths[from], outbox_paths[to]);
+}
+
+
+/* append the staged records in one write. Call with outbox_lock held. */
+static void outbox_flush(void)
+{
+    if (staged_count == 0) return;
+    outbox_store_append(&store, staged, staged_count);
+    stats.flushes++;
+    staged_count = 0;
+}
+
+
+void outbox_init(void)
+{
+    static const outbox_store_fs_t fs = {
+        NULL, outbox_fs_size, outbox_fs_read, outbox_fs_append, outbox_fs_replace, outbox_fs_remove, outbox_fs_rename
+    };
+    if (outbox_lock) return;
+    outbox_lock = xSemaphoreCreateMutex();
+    boot_id = (uint16_t)esp_random();
+    stats.mounted = SPIFFS.begin(true, "/spiffs", 5, OUTBOX_PARTITION);
+    if (!stats.mounted) {
+        ESP_LOGE(TAG, "SPIFFS partition '%s' not mounted, outbox disabled", OUTBOX_PARTITION);
+        return;
+    }
+    if (!outbox_store_open(&store, &fs, OUTBOX_MAX_BYTES)) {
+        ESP_LOGE(TAG, "cannot recover %s, outbox disabled", outbox_paths[OUTBOX_FILE_LOG]);
+        stats.mounted = false;
+        return;
+    }
+    outbox_store_stats_t st;
+    outbox_store_get_stats(&store, &st);
+    if (st.recovered) ESP_LOGW(TAG, "finished a compaction interrupted by a power cut");
+    if (st.torn_bytes) ESP_LOGW(TAG, "cut %u bytes of a torn record off the log", st.torn_bytes);
+    ESP_LOGI(TAG, "%u records pending after seq %u, next seq %u", st.pending, st.acked_seq, st.next_seq);
+}
+
+
+bool outbox_append(outbox_type_t type, bool intruder, int face_id, float confidence, int64_t at_us)
+{
+    if (!stats.mounted) return false;
+    int64_t now = esp_timer_get_time();
+    time_t wall = time(NULL);
+    outbox_record_t r;
+    r.epoch_s = (wall > OUTBOX_CLOCK_VALID) ? (uint32_t)(wall - (now - at_us) / 1000000) : 0;
+    r.uptime_ms = (uint32_t)(at_us / 1000);
+    r.boot_id = boot_id;
+    r.type = (uint8_t)type;
+    r.intruder = intruder ? 1 : 0;
+    r.face_id = (int16_t)face_id;
+    float c = confidence * 10000.0f;
+    r.confidence_e4 = (c != c) ? 0 : (int16_t)((c > 32767.0f) ? 32767.0f : (c < -32768.0f) ? -32768.0f : c);
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    outbox_store_seal(&store, &r);
+    if (staged_count == 0) staged_since_us = now;
+    staged[staged_count++] = r;
+    stats.appended++;
+    if (staged_count == OUTBOX_WRITE_BATCH) outbox_flush();
+    xSemaphoreGive(outbox_lock);
+    return true;
+}
+
+
+void outbox_tick(void)
+{
+    if (!stats.mounted) return;
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    if (staged_count && esp_timer_get_time() - staged_since_us >= (int64_t)OUTBOX_FLUSH_MS * 1000) {
+        outbox_flush();
+    }
+    xSemaphoreGive(outbox_lock);
+}
+
+
+uint32_t outbox_pending(void)
+{
+    return outbox_store_pending(&store) + staged_count;
+}
+
+
+/* original time of a record for the server: wall clock if known, age within this boot, otherwise nothing */
+static int outbox_time_json(char *out, size_t len, const outbox_record_t *r)
+{
+    if (r->epoch_s) {
+        return snprintf(out, len, ",\"ts\":%u", r->epoch_s);
+    }
+    if (r->boot_id == boot_id) {
+        return snprintf(out, len, ",\"age_ms\":%u", (uint32_t)(esp_timer_get_time() / 1000) - r->uptime_ms);
+    }
+    return snprintf(out, len, "%s", "");
+}
+
+
+/* same time for a binary event record, as the flag it sets */
+static uint8_t outbox_time_record(const outbox_record_t *r, uint32_t *time)
+{
+    if (r->epoch_s) {
+        *time = r->epoch_s;
+        return EVENT_FLAG_TS;
+    }
+    if (r->boot_id == boot_id) {
+        *time = (uint32_t)(esp_timer_get_time() / 1000) - r->uptime_ms;
+        return EVENT_FLAG_AGE;
+    }
+    *time = 0;
+    return 0;
+}
+
+
+int outbox_replay(int max_batches)
+{
+    static outbox_record_t batch[OUTBOX_REPLAY_BATCH];
+    static uint8_t events[EVENT_CODEC_HEADER_LEN + OUTBOX_REPLAY_BATCH * EVENT_CODEC_RECORD_LEN];
+    static char status[OUTBOX_REPLAY_BATCH * 48 + 4];
+    if (!stats.mounted || outbox_pending() == 0) return 0;
+    int acked = 0;
+    int64_t t0 = esp_timer_get_time();
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    outbox_flush();
+    xSemaphoreGive(outbox_lock);
+    for (int b = 0; b < max_batches; b++) {
+        // read the next batch, post it without holding the lock
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        int n = outbox_store_read(&store, batch, OUTBOX_REPLAY_BATCH);
+        xSemaphoreGive(outbox_lock);
+        if (n == 0) break;
+        size_t st_len = 0;
+        int st_count = 0, alerts = 0;
+        uint32_t last_seq = 0, before_alerts = 0;
+        event_encoder_t enc;
+        event_codec_begin(&enc, events, sizeof(events));
+        status[st_len++] = '[';
+        for (int i = 0; i < n; i++) {
+            const outbox_record_t *r = &batch[i];
+            if (!outbox_store_valid(r)) {
+                stats.crc_errors++;
+                continue;
+            }
+            // the batch ends behind the first run of alerts, so an alert that cannot go out yet
+            // only holds back what was already posted before it
+            if (alerts && r->type != OUTBOX_ALERT) break;
+            if (r->type == OUTBOX_ALERT && alerts == 0) before_alerts = last_seq;
+            last_seq = r->seq;
+            if (r->type == OUTBOX_EVENT) {
+                event_record_t e = { EVENT_TYPE_RECOGNITION, EVENT_FLAG_SEQ, r->face_id,
+                                     r->confidence_e4 / 10000.0f, r->seq, 0 };
+                e.flags |= outbox_time_record(r, &e.time);
+                if (r->intruder) e.flags |= EVENT_FLAG_INTRUDER;
+                event_codec_put(&enc, &e);
+            } else if (r->type == OUTBOX_HEARTBEAT) {
+                char when[32];
+                outbox_time_json(when, sizeof(when), r);
+                st_len += snprintf(status + st_len, sizeof(status) - st_len, "%s{\"status\":true,\"seq\":%u%s}",
+                                   st_count++ ? "," : "", r->seq, when);
+            } else if (r->type == OUTBOX_ALERT) {
+                alerts++;
+            }
+        }
+        size_t ev_len = event_codec_finish(&enc);
+        status[st_len++] = ']';
+        bool ok = true;
+        if (enc.count) {
+            int code = db_client_post_format(DB_ENDPOINT_CREATE, DB_FORMAT_BINARY, events, ev_len);
+            ok = code >= 200 && code < 300;
+        }
+        if (ok && st_count) {
+            int code = db_client_post(DB_ENDPOINT_STATUS, status, st_len);
+            ok = code >= 200 && code < 300;
+        }
+        if (!ok) {
+            stats.replay_failures++;
+            break;
+        }
+        // by sequence number: the size cap may have dropped records meanwhile; a corrupt batch
+        // (last_seq 0) is passed over up to the next valid record. What was posted ahead of the
+        // alerts is acknowledged whatever becomes of them.
+        if (alerts) {
+            xSemaphoreTake(outbox_lock, portMAX_DELAY);
+            acked += outbox_store_ack(&store, before_alerts);
+            xSemaphoreGive(outbox_lock);
+        }
+        // one late message for however many alerts were missed; acknowledged once it went out, a
+        // rate-limited or failed one is retried on a later replay up to OUTBOX_ALERT_RETRIES times
+        bool alert_held = false;
+        if (alerts && sendIntruderAlert((uint32_t)(esp_timer_get_time() / 1000), false)) {
+            ESP_LOGW(TAG, "%d intruder alerts missed while offline", alerts);
+            alert_failures = 0;
+        } else if (alerts && ++alert_failures >= OUTBOX_ALERT_RETRIES) {
+            ESP_LOGE(TAG, "late alert failed %d times, dropping %d alerts", alert_failures, alerts);
+            stats.alerts_dropped += alerts;
+            alert_failures = 0;
+        } else if (alerts) {
+            alert_held = true;
+        }
+        if (alert_held) break;
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        acked += outbox_store_ack(&store, last_seq);
+        xSemaphoreGive(outbox_lock);
+    }
+    if (acked) {
+        stats.replayed += acked;
+        float rate = acked * 1000000.0f / (float)(esp_timer_get_time() - t0);
+        stats.replay_rate = (stats.replay_rate == 0) ? rate : stats.replay_rate + (rate - stats.replay_rate) * 0.2f;
+        ESP_LOGI(TAG, "replayed %d records, %u left", acked, outbox_pending());
+    }
+    return acked;
+}
+
+
+void outbox_get_stats(outbox_stats_t *out)
+{
+    outbox_store_stats_t st;
+    outbox_store_get_stats(&store, &st);
+    *out = stats;
+    out->staged = staged_count;
+    out->pending = st.pending;
+    out->log_bytes = st.log_bytes;
+    out->record_bytes = st.record_bytes;
+    out->flash_bytes = st.flash_bytes;
+    out->compactions = st.compactions;
+    out->dropped = st.dropped;
+    out->acked_seq = st.acked_seq;
+    out->next_seq = st.next_seq;
+}
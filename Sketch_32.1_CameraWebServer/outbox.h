@@ -0,0 +1,81 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// SPIFFS partition label (partitions.csv)
+#ifndef OUTBOX_PARTITION
+#define OUTBOX_PARTITION "spiffs"
+#endif
+
+// log size cap, the oldest unacknowledged records are dropped beyond it
+#ifndef OUTBOX_MAX_BYTES
+#define OUTBOX_MAX_BYTES (64 * 1024)
+#endif
+
+// records staged in RAM before one flash append
+#ifndef OUTBOX_WRITE_BATCH
+#define OUTBOX_WRITE_BATCH 16
+#endif
+
+// staged records are written out at least this often
+#ifndef OUTBOX_FLUSH_MS
+#define OUTBOX_FLUSH_MS 30000
+#endif
+
+// records per replay POST
+#ifndef OUTBOX_REPLAY_BATCH
+#define OUTBOX_REPLAY_BATCH 16
+#endif
+
+// replays a held back alert run may fail before it is given up, so it cannot stall the records behind it
+#ifndef OUTBOX_ALERT_RETRIES
+#define OUTBOX_ALERT_RETRIES 5
+#endif
+
+typedef enum {
+    OUTBOX_EVENT = 1,              // recognizer verdict -> /create
+    OUTBOX_HEARTBEAT,              // missed heartbeat -> /status_create
+    OUTBOX_ALERT                   // missed intruder alert -> one late CallMeBot message
+} outbox_type_t;
+
+typedef struct {
+    bool mounted;
+    uint32_t appended;             // records accepted
+    uint32_t staged;               // in RAM, not on flash yet
+    uint32_t pending;              // on flash, not acknowledged
+    uint32_t log_bytes;            // current log file size
+    uint32_t record_bytes;         // record bytes appended
+    uint32_t flash_bytes;          // bytes written to flash (records, ack file, compaction)
+    uint32_t flushes;
+    uint32_t compactions;
+    uint32_t replayed;             // records acknowledged by the server
+    uint32_t replay_failures;
+    uint32_t alerts_dropped;       // late alerts given up after OUTBOX_ALERT_RETRIES failed sends
+    float replay_rate;             // records per second while replaying
+    uint32_t crc_errors;
+    uint32_t dropped;              // lost to the size cap
+    uint32_t acked_seq;            // highest sequence number the server acknowledged
+    uint32_t next_seq;
+} outbox_stats_t;
+
+/* Mount SPIFFS, finish an interrupted compaction and recover the acknowledged and next sequence number */
+void outbox_init(void);
+
+/* Park an event that could not be delivered. at_us is the esp_timer time it happened. Thread safe. */
+bool outbox_append(outbox_type_t type, bool intruder, int face_id, float confidence, int64_t at_us);
+
+/* Write staged records out once OUTBOX_FLUSH_MS passed */
+void outbox_tick(void);
+
+/* Records waiting for replay (staged + on flash) */
+uint32_t outbox_pending(void);
+
+/* Replay up to max_batches batches to the server, acknowledging and compacting as they land.
+   Returns the number of records acknowledged. */
+int outbox_replay(int max_batches);
+
+void outbox_get_stats(outbox_stats_t *stats);
+
+#endif
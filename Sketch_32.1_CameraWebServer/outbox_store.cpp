@@ -0,0 +1,248 @@
+/*
+outbox_store.cpp
+on-flash format of the outbox: an append-only log of fixed-size, CRC checked, numbered records
+and a small ack file holding the highest sequence number the server acknowledged. Boot skips
+every record up to that number, so the log and the ack file never have to agree on a byte
+offset. Compaction copies the unacknowledged tail into a temporary file and renames it over the
+log; the ack file is always written before, so a power cut anywhere in between leaves either
+log valid. Only plain C and the file callbacks are used here, so the format runs unchanged
+against a directory on a Linux host.
+*/
+
+#include "outbox_store.h"
+#include <string.h>
+
+#define OUTBOX_STORE_ACK_MAGIC 0x3258424fu     // "OBX2"
+#define OUTBOX_STORE_CHUNK 16                   // records per read while scanning or copying
+
+// acknowledged sequence number, rewritten after every replayed batch
+typedef struct {
+    uint32_t magic;
+    uint32_t acked_seq;
+    uint32_t next_seq;
+    uint32_t crc;
+} outbox_store_ack_t;
+
+static uint32_t crc_table[256];
+
+// ----- FUNCTIONS --------------------------------
+
+/* CRC-32 as zlib and esp_rom_crc32_le compute it */
+static uint32_t store_crc32(uint32_t crc, const void *data, size_t len)
+{
+    if (!crc_table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+static uint32_t store_record_crc(const outbox_record_t *r)
+{
+    return store_crc32(0, r, offsetof(outbox_record_t, crc));
+}
+
+
+bool outbox_store_valid(const outbox_record_t *record)
+{
+    return record->crc == store_record_crc(record);
+}
+
+
+static bool store_write_ack(outbox_store_t *store)
+{
+    outbox_store_ack_t ack = { OUTBOX_STORE_ACK_MAGIC, store->acked_seq, store->next_seq, 0 };
+    ack.crc = store_crc32(0, &ack, offsetof(outbox_store_ack_t, crc));
+    if (!store->fs.replace(store->fs.ctx, OUTBOX_FILE_ACK, &ack, sizeof(ack))) return false;
+    store->stats.flash_bytes += sizeof(ack);
+    return true;
+}
+
+
+/* move the acknowledged position over at most max_records records, stopping at the first valid
+   one numbered above through_seq. Corrupt records are passed over. Returns the records passed. */
+static uint32_t store_advance(outbox_store_t *store, uint32_t through_seq, uint32_t max_records)
+{
+    outbox_record_t buf[OUTBOX_STORE_CHUNK];
+    uint32_t passed = 0;
+    while (passed < max_records && store->acked_offset < store->log_size) {
+        uint32_t want = (store->log_size - store->acked_offset) / OUTBOX_RECORD_LEN;
+        if (want > OUTBOX_STORE_CHUNK) want = OUTBOX_STORE_CHUNK;
+        if (want > max_records - passed) want = max_records - passed;
+        size_t got = store->fs.read(store->fs.ctx, OUTBOX_FILE_LOG, store->acked_offset, buf,
+                                    want * OUTBOX_RECORD_LEN) / OUTBOX_RECORD_LEN;
+        if (got == 0) break;
+        for (size_t i = 0; i < got; i++) {
+            if (outbox_store_valid(&buf[i])) {
+                if (buf[i].seq > through_seq) return passed;
+                if (buf[i].seq > store->acked_seq) store->acked_seq = buf[i].seq;
+            }
+            store->acked_offset += OUTBOX_RECORD_LEN;
+            passed++;
+        }
+    }
+    return passed;
+}
+
+
+/* drop the acknowledged head of the log: delete it when everything is acked, otherwise copy the
+   tail into the temporary file and rename it over the log. The ack file must be current. */
+static bool store_compact(outbox_store_t *store)
+{
+    const outbox_store_fs_t *fs = &store->fs;
+    uint32_t copied = 0;
+    if (store->acked_offset >= store->log_size) {
+        fs->remove(fs->ctx, OUTBOX_FILE_LOG);
+    } else {
+        outbox_record_t buf[OUTBOX_STORE_CHUNK];
+        fs->remove(fs->ctx, OUTBOX_FILE_TMP);
+        for (uint32_t off = store->acked_offset; off < store->log_size; off += sizeof(buf)) {
+            size_t len = store->log_size - off;
+            if (len > sizeof(buf)) len = sizeof(buf);
+            if (fs->read(fs->ctx, OUTBOX_FILE_LOG, off, buf, len) != len ||
+                fs->append(fs->ctx, OUTBOX_FILE_TMP, buf, len) != len) {
+                // the log is untouched, a partial copy is discarded
+                fs->remove(fs->ctx, OUTBOX_FILE_TMP);
+                return false;
+            }
+            copied += len;
+        }
+        // from here on outbox_store_open finishes the job after a power cut
+        if (!fs->remove(fs->ctx, OUTBOX_FILE_LOG) || !fs->rename(fs->ctx, OUTBOX_FILE_TMP, OUTBOX_FILE_LOG)) return false;
+        store->stats.flash_bytes += copied;
+    }
+    store->log_size = copied;
+    store->acked_offset = 0;
+    store->stats.compactions++;
+    return true;
+}
+
+
+bool outbox_store_open(outbox_store_t *store, const outbox_store_fs_t *fs, uint32_t max_bytes)
+{
+    memset(store, 0, sizeof(*store));
+    store->fs = *fs;
+    store->max_bytes = max_bytes;
+    store->next_seq = 1;
+    // a temporary file left next to the log is a copy that did not finish; without the log
+    // the copy was complete and only the rename is missing
+    if (fs->size(fs->ctx, OUTBOX_FILE_TMP) >= 0) {
+        if (fs->size(fs->ctx, OUTBOX_FILE_LOG) < 0) {
+            if (!fs->rename(fs->ctx, OUTBOX_FILE_TMP, OUTBOX_FILE_LOG)) return false;
+            store->stats.recovered = true;
+        } else {
+            fs->remove(fs->ctx, OUTBOX_FILE_TMP);
+        }
+    }
+    outbox_store_ack_t ack;
+    if (fs->read(fs->ctx, OUTBOX_FILE_ACK, 0, &ack, sizeof(ack)) == sizeof(ack) && ack.magic == OUTBOX_STORE_ACK_MAGIC &&
+        ack.crc == store_crc32(0, &ack, offsetof(outbox_store_ack_t, crc))) {
+        store->acked_seq = ack.acked_seq;
+        store->next_seq = ack.next_seq;
+    }
+    long size = fs->size(fs->ctx, OUTBOX_FILE_LOG);
+    if (size <= 0) return true;
+    store->log_size = (uint32_t)size / OUTBOX_RECORD_LEN * OUTBOX_RECORD_LEN;
+    store->stats.torn_bytes = (uint32_t)size - store->log_size;
+    // the first record numbered above acked_seq is where replay resumes; the last one numbers the next
+    outbox_record_t buf[OUTBOX_STORE_CHUNK];
+    bool found = false;
+    for (uint32_t off = 0; off < store->log_size; off += sizeof(buf)) {
+        size_t got = fs->read(fs->ctx, OUTBOX_FILE_LOG, off, buf, sizeof(buf)) / OUTBOX_RECORD_LEN;
+        if (got == 0) break;
+        for (size_t i = 0; i < got; i++) {
+            if (!outbox_store_valid(&buf[i])) continue;
+            if (buf[i].seq >= store->next_seq) store->next_seq = buf[i].seq + 1;
+            if (!found && buf[i].seq > store->acked_seq) {
+                store->acked_offset = off + i * OUTBOX_RECORD_LEN;
+                found = true;
+            }
+        }
+    }
+    if (!found) store->acked_offset = store->log_size;
+    if (store->stats.torn_bytes) {
+        // a record torn by a power cut: rewrite the log so later appends stay aligned
+        store_compact(store);
+    }
+    return true;
+}
+
+
+void outbox_store_seal(outbox_store_t *store, outbox_record_t *record)
+{
+    record->seq = store->next_seq++;
+    record->crc = store_record_crc(record);
+}
+
+
+bool outbox_store_append(outbox_store_t *store, const outbox_record_t *records, int count)
+{
+    uint32_t need = count * OUTBOX_RECORD_LEN;
+    if (store->log_size + need > store->max_bytes) {
+        // the acknowledged head goes first, then the oldest pending records make way
+        uint32_t over = store->log_size + need - store->max_bytes;
+        if (over > store->acked_offset) {
+            uint32_t drop = (over - store->acked_offset + OUTBOX_RECORD_LEN - 1) / OUTBOX_RECORD_LEN;
+            store->stats.dropped += store_advance(store, UINT32_MAX, drop);
+            store_write_ack(store);
+        }
+        if (store->acked_offset) store_compact(store);
+    }
+    size_t written = store->fs.append(store->fs.ctx, OUTBOX_FILE_LOG, records, need);
+    uint32_t whole = written - written % OUTBOX_RECORD_LEN;
+    store->log_size += whole;
+    store->stats.record_bytes += whole;
+    store->stats.flash_bytes += written;
+    if (written != need) {
+        // cut the partial record off again before anything is appended behind it
+        store->stats.torn_bytes += written - whole;
+        store_compact(store);
+        return false;
+    }
+    return true;
+}
+
+
+int outbox_store_read(outbox_store_t *store, outbox_record_t *out, int max)
+{
+    uint32_t avail = outbox_store_pending(store);
+    if ((uint32_t)max > avail) max = avail;
+    if (max <= 0) return 0;
+    size_t got = store->fs.read(store->fs.ctx, OUTBOX_FILE_LOG, store->acked_offset, out, max * OUTBOX_RECORD_LEN);
+    return got / OUTBOX_RECORD_LEN;
+}
+
+
+int outbox_store_ack(outbox_store_t *store, uint32_t last_seq)
+{
+    int passed = store_advance(store, last_seq, UINT32_MAX);
+    if (passed == 0) return 0;
+    store_write_ack(store);
+    if (store->acked_offset >= store->log_size || store->acked_offset >= store->max_bytes / 2) {
+        store_compact(store);
+    }
+    return passed;
+}
+
+
+uint32_t outbox_store_pending(const outbox_store_t *store)
+{
+    return (store->log_size - store->acked_offset) / OUTBOX_RECORD_LEN;
+}
+
+
+void outbox_store_get_stats(const outbox_store_t *store, outbox_store_stats_t *out)
+{
+    *out = store->stats;
+    out->log_bytes = store->log_size;
+    out->pending = outbox_store_pending(store);
+    out->acked_seq = store->acked_seq;
+    out->next_seq = store->next_seq;
+}
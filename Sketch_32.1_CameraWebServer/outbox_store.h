@@ -0,0 +1,91 @@
+#ifndef OUTBOX_STORE_H
+#define OUTBOX_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// one record on flash, 24 bytes
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t epoch_s;              // wall clock when it happened, 0 if the clock was not set
+    uint32_t uptime_ms;
+    uint16_t boot_id;              // uptime_ms only means something within the same boot
+    uint8_t type;                  // outbox_type_t
+    uint8_t intruder;
+    int16_t face_id;
+    int16_t confidence_e4;         // similarity * 10000
+    uint32_t crc;                  // CRC-32 of the fields above
+} outbox_record_t;
+
+#define OUTBOX_RECORD_LEN sizeof(outbox_record_t)
+
+typedef enum {
+    OUTBOX_FILE_LOG = 0,           // the records, oldest first
+    OUTBOX_FILE_TMP,               // compaction target, renamed over the log when complete
+    OUTBOX_FILE_ACK,               // last acknowledged sequence number
+    OUTBOX_FILE_COUNT
+} outbox_file_t;
+
+/* Files the store runs on: SPIFFS on the device, a directory on a Linux host.
+   size is -1 for a missing file; append creates it; replace writes the whole file. */
+typedef struct {
+    void *ctx;
+    long (*size)(void *ctx, outbox_file_t file);
+    size_t (*read)(void *ctx, outbox_file_t file, uint32_t offset, void *buf, size_t len);
+    size_t (*append)(void *ctx, outbox_file_t file, const void *data, size_t len);
+    bool (*replace)(void *ctx, outbox_file_t file, const void *data, size_t len);
+    bool (*remove)(void *ctx, outbox_file_t file);
+    bool (*rename)(void *ctx, outbox_file_t from, outbox_file_t to);
+} outbox_store_fs_t;
+
+typedef struct {
+    uint32_t log_bytes;            // current log file size
+    uint32_t pending;              // records in the log after the acknowledged ones
+    uint32_t record_bytes;         // record bytes appended
+    uint32_t flash_bytes;          // bytes written (records, ack file, compaction)
+    uint32_t compactions;
+    uint32_t dropped;              // lost to the size cap
+    uint32_t torn_bytes;           // partial record cut off the end of the log at open
+    bool recovered;                // a complete compaction was found in the temporary file at open
+    uint32_t acked_seq;
+    uint32_t next_seq;
+} outbox_store_stats_t;
+
+typedef struct {
+    outbox_store_fs_t fs;
+    uint32_t max_bytes;            // log size cap
+    uint32_t log_size;             // whole records only
+    uint32_t acked_offset;         // first record after acked_seq
+    uint32_t acked_seq;            // every record up to this one was delivered
+    uint32_t next_seq;
+    outbox_store_stats_t stats;
+} outbox_store_t;
+
+/* Finish or discard a compaction a power cut interrupted, read the acknowledged sequence number
+   and find the first record after it. A torn record at the end of the log is cut off. */
+bool outbox_store_open(outbox_store_t *store, const outbox_store_fs_t *fs, uint32_t max_bytes);
+
+/* Number the record and fill in its CRC */
+void outbox_store_seal(outbox_store_t *store, outbox_record_t *record);
+
+/* CRC check of a record read back */
+bool outbox_store_valid(const outbox_record_t *record);
+
+/* Append sealed records in one write. Beyond max_bytes the oldest pending records are dropped
+   (acknowledged without delivery) to make room. */
+bool outbox_store_append(outbox_store_t *store, const outbox_record_t *records, int count);
+
+/* Up to max pending records, oldest first. Records with a bad CRC are returned as read. */
+int outbox_store_read(outbox_store_t *store, outbox_record_t *out, int max);
+
+/* Every record up to last_seq was delivered: persist it, compact once the log is fully
+   acknowledged or half of the cap is. Returns the records passed over, corrupt ones included. */
+int outbox_store_ack(outbox_store_t *store, uint32_t last_seq);
+
+/* Records on flash not acknowledged yet */
+uint32_t outbox_store_pending(const outbox_store_t *store);
+
+void outbox_store_get_stats(const outbox_store_t *store, outbox_store_stats_t *stats);
+
+#endif
@@ -0,0 +1,512 @@
+/*
+session.cpp
+deterministic record/replay of field sessions. Recording writes the camera frames as JPEG
+(sensor JPEGs copied, raw frames encoded once), the PIR edges and the /control commands with
+their offsets into one file on SPIFFS; a low priority task on core 0 does the flash writes so
+the frame loop only pays the copy or encode. Replay feeds that file back through the vision
+task in place of esp_camera_fb_get, dispatching the PIR and /control records between frames,
+at recorded pace or as fast as the pipeline goes. Episode, tracker and PIR windows run on the
+recorded clock (session_clock_us), so both paces produce the same decisions. Database events
+and alerts are written to a JSON lines results log with the per-frame stage timings instead of
+leaving the device, which makes two firmware builds comparable on identical input.
+*/
+
+#include "session.h"
+#include "frame_pool.h"
+#include "face_state.h"
+#include "face_tracker.h"
+#include "motion_gate.h"
+#include "hardware_control.h"
+#include "outbox.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "FS.h"
+#include "SPIFFS.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#define TAG "session: "
+
+#define SESSION_TASK_STACK 4096
+#define SESSION_TASK_PRIORITY 1
+#define SESSION_TASK_CORE 0
+#define SESSION_MAGIC "SES1"
+#define SESSION_TEXT_LEN 48
+#define SESSION_PACE_STEP_MS 50          // longest wait between stop checks in a realtime replay
+#define SESSION_JPEG_QUALITY 90
+
+typedef enum {
+    SESSION_REC_STATE = 0,         // face state flags at the start of the recording
+    SESSION_REC_FRAME,             // JPEG payload
+    SESSION_REC_PIR,
+    SESSION_REC_CONTROL,           // "variable=value"
+    SESSION_REC_CLOSE              // queue only: end of recording
+} session_rec_type_t;
+
+// one record header in the file, payload follows
+typedef struct __attribute__((packed)) {
+    uint32_t t_us;                 // since the recording started
+    uint32_t len;
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t width;
+    uint16_t height;
+    uint16_t reserved2;
+} session_rec_t;
+
+typedef struct {
+    session_rec_t rec;
+    pool_buf_t *jpg;
+    char text[SESSION_TEXT_LEN];
+} session_item_t;
+
+static volatile session_state_t state = SESSION_IDLE;
+static SemaphoreHandle_t session_lock = NULL;      // recording file open/close, replay file reads
+static SemaphoreHandle_t results_lock = NULL;
+static QueueHandle_t write_queue = NULL;
+static File record_file;
+static File replay_file;
+static int64_t record_start_us = 0;
+static session_stats_t stats;
+
+// replay
+static session_pace_t replay_pace;
+static bool replay_fresh = false;  // vision task has not taken a replay frame yet
+static bool pending = false;       // header read, waiting for its time
+static session_rec_t pending_rec;
+static int64_t replay_base_us = 0; // session clock at replay start
+static int64_t replay_wall_us = 0; // esp_timer at replay start
+static volatile int64_t replay_clock_us = 0;
+static volatile int64_t clock_skew_us = 0;
+static uint8_t *replay_buf = NULL;
+static camera_fb_t replay_fb;
+static char *results = NULL;
+static size_t results_len = 0;
+
+// ----- FUNCTIONS --------------------------------
+
+session_state_t session_state(void)
+{
+    return state;
+}
+
+
+int64_t session_clock_us(void)
+{
+    if (state == SESSION_REPLAYING && !replay_fresh) return replay_clock_us;
+    return esp_timer_get_time() + clock_skew_us;
+}
+
+
+/* queue an item for the writer, frames give up at once, events wait a little */
+static bool session_enqueue(session_item_t *item, TickType_t wait)
+{
+    if (!write_queue || xQueueSend(write_queue, item, wait) != pdTRUE) {
+        if (item->jpg) frame_pool_put(item->jpg);
+        stats.record_drops++;
+        return false;
+    }
+    return true;
+}
+
+
+static void session_item_init(session_item_t *item, session_rec_type_t type, int64_t at_us)
+{
+    memset(item, 0, sizeof(*item));
+    item->rec.type = type;
+    item->rec.t_us = (uint32_t)(at_us - record_start_us);
+}
+
+
+void session_record_frame(const camera_fb_t *fb, int64_t captured_us)
+{
+    if (state != SESSION_RECORDING) return;
+    int64_t t0 = esp_timer_get_time();
+    pool_buf_t *jpg = frame_pool_get(FRAME_POOL_JPEG);
+    if (!jpg) {
+        stats.record_drops++;
+        return;
+    }
+    bool ok;
+    if (fb->format == PIXFORMAT_JPEG) {
+        ok = fb->len <= jpg->cap;
+        if (ok) {
+            memcpy(jpg->data, fb->buf, fb->len);
+            jpg->len = fb->len;
+        }
+    } else {
+        ok = frame_pool_encode_jpeg(fb->buf, fb->len, fb->width, fb->height, fb->format, SESSION_JPEG_QUALITY, jpg);
+    }
+    if (!ok) {
+        frame_pool_put(jpg);
+        stats.record_drops++;
+        return;
+    }
+    session_item_t item;
+    session_item_init(&item, SESSION_REC_FRAME, captured_us);
+    item.rec.len = jpg->len;
+    item.rec.width = fb->width;
+    item.rec.height = fb->height;
+    item.jpg = jpg;
+    if (session_enqueue(&item, 0)) {
+        uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+        stats.avg_record_us = (stats.recorded_frames == 0) ? us : stats.avg_record_us + ((float)us - stats.avg_record_us) * 0.2f;
+        stats.recorded_frames++;
+    }
+}
+
+
+void session_record_pir(void)
+{
+    if (state != SESSION_RECORDING) return;
+    session_item_t item;
+    session_item_init(&item, SESSION_REC_PIR, esp_timer_get_time());
+    if (session_enqueue(&item, pdMS_TO_TICKS(10))) stats.recorded_events++;
+}
+
+
+void session_record_control(const char *variable, const char *value)
+{
+    if (state != SESSION_RECORDING) return;
+    session_item_t item;
+    session_item_init(&item, SESSION_REC_CONTROL, esp_timer_get_time());
+    item.rec.len = snprintf(item.text, sizeof(item.text), "%s=%s", variable, value);
+    if (item.rec.len >= sizeof(item.text)) item.rec.len = sizeof(item.text) - 1;
+    if (session_enqueue(&item, pdMS_TO_TICKS(10))) stats.recorded_events++;
+}
+
+
+/* flash writes happen here, never on the frame loop */
+static void session_task(void *arg)
+{
+    session_item_t item;
+    while (true) {
+        if (!xQueueReceive(write_queue, &item, portMAX_DELAY)) continue;
+        xSemaphoreTake(session_lock, portMAX_DELAY);
+        if (item.rec.type == SESSION_REC_CLOSE) {
+            if (record_file) record_file.close();
+            ESP_LOGI(TAG, "recording closed: %u frames, %u events, %u bytes", stats.recorded_frames,
+                     stats.recorded_events, stats.bytes);
+        } else if (record_file && stats.bytes + sizeof(item.rec) + item.rec.len > SESSION_MAX_BYTES) {
+            // full: keep what we have, later items are dropped
+            record_file.close();
+            state = SESSION_IDLE;
+            stats.record_drops++;
+            ESP_LOGW(TAG, "recording full at %u bytes", stats.bytes);
+        } else if (record_file) {
+            const uint8_t *payload = item.jpg ? item.jpg->data : (const uint8_t *)item.text;
+            size_t written = record_file.write((const uint8_t *)&item.rec, sizeof(item.rec));
+            written += record_file.write(payload, item.rec.len);
+            stats.bytes += written;
+        } else {
+            stats.record_drops++;
+        }
+        xSemaphoreGive(session_lock);
+        if (item.jpg) frame_pool_put(item.jpg);
+    }
+}
+
+
+bool session_record_start(void)
+{
+    if (!session_lock) return false;
+    outbox_stats_t outbox;
+    outbox_get_stats(&outbox);
+    if (!outbox.mounted) return false;
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    bool ok = state == SESSION_IDLE && !record_file;
+    if (ok) {
+        record_file = SPIFFS.open(SESSION_PATH, FILE_WRITE);
+        ok = (bool)record_file;
+    }
+    if (ok) {
+        record_start_us = esp_timer_get_time();
+        uint8_t flags[5] = { detection_via_gui, recognition_via_gui, detection_via_pir, recognition_via_pir,
+                             (uint8_t)is_enrolling };
+        session_rec_t rec = { 0, sizeof(flags), SESSION_REC_STATE, 0, 0, 0, 0 };
+        record_file.write((const uint8_t *)SESSION_MAGIC, 4);
+        record_file.write((const uint8_t *)&rec, sizeof(rec));
+        record_file.write(flags, sizeof(flags));
+        stats.bytes = 4 + sizeof(rec) + sizeof(flags);
+        stats.recorded_frames = 0;
+        stats.recorded_events = 0;
+        stats.record_drops = 0;
+        stats.avg_record_us = 0;
+        state = SESSION_RECORDING;
+        ESP_LOGI(TAG, "recording to %s", SESSION_PATH);
+    }
+    xSemaphoreGive(session_lock);
+    return ok;
+}
+
+
+static void session_results_reset(void)
+{
+    xSemaphoreTake(results_lock, portMAX_DELAY);
+    results_len = 0;
+    stats.results_bytes = 0;
+    stats.results_truncated = 0;
+    xSemaphoreGive(results_lock);
+}
+
+
+static void session_results_append(const char *line, size_t len)
+{
+    xSemaphoreTake(results_lock, portMAX_DELAY);
+    if (results && results_len + len <= SESSION_RESULTS_BYTES) {
+        memcpy(results + results_len, line, len);
+        results_len += len;
+        stats.results_bytes = results_len;
+    } else {
+        stats.results_truncated++;
+    }
+    xSemaphoreGive(results_lock);
+}
+
+
+void session_note(const char *format, ...)
+{
+    if (state != SESSION_REPLAYING) return;
+    char line[160];
+    int n = snprintf(line, sizeof(line), "{\"t_ms\":%u,", (uint32_t)((session_clock_us() - replay_base_us) / 1000));
+    va_list arg;
+    va_start(arg, format);
+    n += vsnprintf(line + n, sizeof(line) - n, format, arg);
+    va_end(arg);
+    if (n > (int)sizeof(line) - 3) n = sizeof(line) - 3;
+    line[n++] = '}';
+    line[n++] = '\n';
+    session_results_append(line, n);
+}
+
+
+void session_note_frame(bool detected, int face_id, uint32_t ready_us, uint32_t detect_us,
+                        uint32_t recognize_us, uint32_t encode_us, uint32_t process_us)
+{
+    if (state != SESSION_REPLAYING) return;
+    session_note("\"frame\":%u,\"detected\":%d,\"id\":%d,\"ready_us\":%u,\"detect_us\":%u,\"recognize_us\":%u,"
+                 "\"encode_us\":%u,\"process_us\":%u",
+                 stats.replayed_frames, detected, face_id, ready_us, detect_us, recognize_us, encode_us, process_us);
+}
+
+
+bool session_replay_start(session_pace_t pace)
+{
+    if (!session_lock) return false;
+    if (!replay_buf) replay_buf = (uint8_t *)heap_caps_malloc(SESSION_FRAME_MAX_BYTES, MALLOC_CAP_SPIRAM);
+    if (!results) results = (char *)heap_caps_malloc(SESSION_RESULTS_BYTES, MALLOC_CAP_SPIRAM);
+    if (!replay_buf || !results) return false;
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    bool ok = state == SESSION_IDLE && !record_file;
+    if (ok) {
+        replay_file = SPIFFS.open(SESSION_PATH, FILE_READ);
+        char magic[4];
+        ok = replay_file && replay_file.read((uint8_t *)magic, 4) == 4 && !memcmp(magic, SESSION_MAGIC, 4);
+        if (!ok && replay_file) replay_file.close();
+    }
+    if (ok) {
+        session_results_reset();
+        replay_pace = pace;
+        replay_fresh = true;
+        pending = false;
+        stats.replayed_frames = 0;
+        stats.replayed_events = 0;
+        stats.replay_skipped = 0;
+        stats.replay_wall_ms = 0;
+        stats.replay_fps = 0;
+        state = SESSION_REPLAYING;
+        ESP_LOGI(TAG, "replaying %s at %s pace", SESSION_PATH, pace == SESSION_PACE_MAX ? "max" : "recorded");
+    }
+    xSemaphoreGive(session_lock);
+    return ok;
+}
+
+
+/* under session_lock: close the replay, keep the session clock from going backwards */
+static void session_replay_finish(const char *reason)
+{
+    session_note("\"event\":\"replay_end\",\"reason\":\"%s\",\"frames\":%u,\"events\":%u,\"wall_ms\":%u,\"fps\":%.2f",
+                 reason, stats.replayed_frames, stats.replayed_events, stats.replay_wall_ms, stats.replay_fps);
+    replay_file.close();
+    int64_t ahead = replay_clock_us - esp_timer_get_time();
+    if (!replay_fresh && ahead > clock_skew_us) clock_skew_us = ahead;
+    state = SESSION_IDLE;
+    ESP_LOGI(TAG, "replay %s: %u frames, %u events in %u ms", reason, stats.replayed_frames, stats.replayed_events,
+             stats.replay_wall_ms);
+}
+
+
+void session_stop(void)
+{
+    if (!session_lock) return;
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    session_state_t was = state;
+    if (was == SESSION_RECORDING) state = SESSION_IDLE;
+    if (was == SESSION_REPLAYING) session_replay_finish("stopped");
+    xSemaphoreGive(session_lock);
+    if (was == SESSION_RECORDING) {
+        session_item_t item;
+        memset(&item, 0, sizeof(item));
+        item.rec.type = SESSION_REC_CLOSE;
+        xQueueSend(write_queue, &item, portMAX_DELAY);
+    }
+}
+
+
+/* under session_lock: apply one PIR / control / state record at its time */
+static void session_dispatch(const session_rec_t *rec, char *payload)
+{
+    stats.replayed_events++;
+    if (rec->type == SESSION_REC_STATE && rec->len >= 5) {
+        detection_via_gui = payload[0];
+        recognition_via_gui = payload[1];
+        detection_via_pir = payload[2];
+        recognition_via_pir = payload[3];
+        is_enrolling = payload[4];
+        recompute_face_state();
+        session_note("\"event\":\"state\",\"detect\":%d,\"recognize\":%d,\"enroll\":%d", detection_enabled,
+                     recognition_enabled, is_enrolling);
+    } else if (rec->type == SESSION_REC_PIR) {
+        session_note("\"event\":\"pir\"");
+        hardware_pir_event();
+    } else if (rec->type == SESSION_REC_CONTROL) {
+        char *value = strchr(payload, '=');
+        if (value) *value++ = '\0';
+        session_note("\"event\":\"control\",\"var\":\"%s\",\"val\":\"%s\"", payload, value ? value : "");
+        control_apply(payload, value ? value : "");
+    }
+}
+
+
+/* under session_lock: next recorded frame, dispatching the events before it; NULL at the end */
+static camera_fb_t *session_replay_next(void)
+{
+    while (state == SESSION_REPLAYING) {
+        if (!pending) {
+            if (replay_file.read((uint8_t *)&pending_rec, sizeof(pending_rec)) != sizeof(pending_rec)) {
+                session_replay_finish("end");
+                return NULL;
+            }
+            pending = true;
+        }
+        if (replay_fresh) {
+            // first record: start both clocks here, drop what the live pipeline was tracking
+            replay_fresh = false;
+            replay_base_us = esp_timer_get_time() + clock_skew_us;
+            replay_wall_us = esp_timer_get_time();
+            face_tracker_reset();
+            motion_gate_reset();
+        }
+        if (replay_pace == SESSION_PACE_REALTIME) {
+            int64_t wait_us = replay_wall_us + pending_rec.t_us - esp_timer_get_time();
+            if (wait_us > 0) {
+                // wait without the lock so /session?action=stop gets through
+                xSemaphoreGive(session_lock);
+                vTaskDelay(pdMS_TO_TICKS(wait_us / 1000 < SESSION_PACE_STEP_MS ? wait_us / 1000 + 1 : SESSION_PACE_STEP_MS));
+                xSemaphoreTake(session_lock, portMAX_DELAY);
+                continue;
+            }
+        }
+        pending = false;
+        replay_clock_us = replay_base_us + pending_rec.t_us;
+        stats.replay_wall_ms = (uint32_t)((esp_timer_get_time() - replay_wall_us) / 1000);
+        if (pending_rec.type != SESSION_REC_FRAME) {
+            char payload[SESSION_TEXT_LEN];
+            size_t n = pending_rec.len < sizeof(payload) - 1 ? pending_rec.len : sizeof(payload) - 1;
+            if (replay_file.read((uint8_t *)payload, n) != n) continue;
+            if (n < pending_rec.len) replay_file.seek(pending_rec.len - n, SeekCur);
+            payload[n] = '\0';
+            session_dispatch(&pending_rec, payload);
+            continue;
+        }
+        if (pending_rec.len > SESSION_FRAME_MAX_BYTES) {
+            replay_file.seek(pending_rec.len, SeekCur);
+            stats.replay_skipped++;
+            continue;
+        }
+        if (replay_file.read(replay_buf, pending_rec.len) != pending_rec.len) continue;
+        stats.replayed_frames++;
+        stats.replay_fps = stats.replay_wall_ms ? stats.replayed_frames * 1000.0f / stats.replay_wall_ms : 0;
+        replay_fb.buf = replay_buf;
+        replay_fb.len = pending_rec.len;
+        replay_fb.width = pending_rec.width;
+        replay_fb.height = pending_rec.height;
+        replay_fb.format = PIXFORMAT_JPEG;
+        replay_fb.timestamp.tv_sec = replay_clock_us / 1000000;
+        replay_fb.timestamp.tv_usec = replay_clock_us % 1000000;
+        return &replay_fb;
+    }
+    return NULL;
+}
+
+
+camera_fb_t *session_fb_get(void)
+{
+    if (state != SESSION_REPLAYING) return esp_camera_fb_get();
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    camera_fb_t *fb = session_replay_next();
+    xSemaphoreGive(session_lock);
+    // replay over: back to the camera
+    return fb ? fb : esp_camera_fb_get();
+}
+
+
+void session_fb_return(camera_fb_t *fb)
+{
+    if (fb != &replay_fb) esp_camera_fb_return(fb);
+}
+
+
+bool session_file_acquire(void)
+{
+    if (!session_lock) return false;
+    xSemaphoreTake(session_lock, portMAX_DELAY);
+    if (state == SESSION_IDLE && !record_file) return true;
+    xSemaphoreGive(session_lock);
+    return false;
+}
+
+
+void session_file_release(void)
+{
+    xSemaphoreGive(session_lock);
+}
+
+
+char *session_results_copy(size_t *len)
+{
+    if (!results_lock) return NULL;
+    char *copy = NULL;
+    xSemaphoreTake(results_lock, portMAX_DELAY);
+    if (results && results_len) {
+        copy = (char *)malloc(results_len);
+        if (copy) {
+            memcpy(copy, results, results_len);
+            *len = results_len;
+        }
+    }
+    xSemaphoreGive(results_lock);
+    return copy;
+}
+
+
+void session_init(void)
+{
+    if (session_lock) return;
+    session_lock = xSemaphoreCreateMutex();
+    results_lock = xSemaphoreCreateMutex();
+    write_queue = xQueueCreate(SESSION_QUEUE_LEN, sizeof(session_item_t));
+    xTaskCreatePinnedToCore(session_task, "session", SESSION_TASK_STACK, NULL, SESSION_TASK_PRIORITY, NULL, SESSION_TASK_CORE);
+}
+
+
+void session_get_stats(session_stats_t *out)
+{
+    *out = stats;
+    out->state = state;
+}
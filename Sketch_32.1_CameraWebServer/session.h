@@ -0,0 +1,100 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_camera.h"
+
+// recording on the outbox SPIFFS partition, leave room for the outbox log
+#define SESSION_PATH "/session.bin"
+#ifndef SESSION_MAX_BYTES
+#define SESSION_MAX_BYTES (512 * 1024)
+#endif
+
+// recorded frames waiting for the writer task, each pins one pooled JPEG buffer
+#ifndef SESSION_QUEUE_LEN
+#define SESSION_QUEUE_LEN 2
+#endif
+
+// replay limits: largest recorded JPEG, and the JSON lines kept from one replay (PSRAM)
+#ifndef SESSION_FRAME_MAX_BYTES
+#define SESSION_FRAME_MAX_BYTES (96 * 1024)
+#endif
+#ifndef SESSION_RESULTS_BYTES
+#define SESSION_RESULTS_BYTES (128 * 1024)
+#endif
+
+typedef enum {
+    SESSION_IDLE = 0,
+    SESSION_RECORDING,
+    SESSION_REPLAYING
+} session_state_t;
+
+typedef enum {
+    SESSION_PACE_REALTIME = 0,     // frames and events at their recorded offsets
+    SESSION_PACE_MAX               // as fast as the pipeline takes them
+} session_pace_t;
+
+typedef struct {
+    session_state_t state;
+    uint32_t recorded_frames;
+    uint32_t recorded_events;      // PIR edges and /control commands
+    uint32_t record_drops;         // frames lost to a busy writer or an empty pool
+    uint32_t bytes;                // size of the recording
+    float avg_record_us;           // cost on the frame loop (copy or encode)
+    uint32_t replayed_frames;
+    uint32_t replayed_events;
+    uint32_t replay_skipped;       // frames larger than SESSION_FRAME_MAX_BYTES
+    uint32_t replay_wall_ms;       // last or running replay
+    float replay_fps;
+    uint32_t results_bytes;
+    uint32_t results_truncated;    // lines that did not fit SESSION_RESULTS_BYTES
+} session_stats_t;
+
+/* Start the writer task, call once after outbox_init (SPIFFS is mounted there) */
+void session_init(void);
+
+/* Record camera frames, PIR edges and /control commands from now on, replacing the last recording.
+   Starts with the current face state so a replay begins where the recording did. */
+bool session_record_start(void);
+
+/* Replay the recording through the vision pipeline instead of the camera.
+   External effects (database events, WhatsApp alerts) go to the results log instead. */
+bool session_replay_start(session_pace_t pace);
+
+/* End recording or replay */
+void session_stop(void);
+
+session_state_t session_state(void);
+static inline bool session_replaying(void) { return session_state() == SESSION_REPLAYING; }
+
+/* Time base for episode, tracker and PIR windows: esp_timer when live, recorded time in a replay.
+   Never goes backwards, a replay at max pace leaves it ahead of esp_timer. */
+int64_t session_clock_us(void);
+
+/* Frame source for the vision task: the camera, or the next recorded frame while replaying.
+   Every frame goes back through session_fb_return. */
+camera_fb_t *session_fb_get(void);
+void session_fb_return(camera_fb_t *fb);
+
+/* Recording hooks, no-ops unless recording */
+void session_record_frame(const camera_fb_t *fb, int64_t captured_us);
+void session_record_pir(void);
+void session_record_control(const char *variable, const char *value);
+
+/* Replay hooks, no-ops unless replaying: one JSON line per frame (numbered from 1 in file order)
+   and one per external event ("\"event\":...", the time is prepended) */
+void session_note_frame(bool detected, int face_id, uint32_t ready_us, uint32_t detect_us,
+                        uint32_t recognize_us, uint32_t encode_us, uint32_t process_us);
+void session_note(const char *format, ...);
+
+/* Exclusive use of SESSION_PATH for a download or an upload; false while recording or replaying */
+bool session_file_acquire(void);
+void session_file_release(void);
+
+/* JSON lines of the last replay, malloc'd copy the caller frees; NULL if there is none */
+char *session_results_copy(size_t *len);
+
+void session_get_stats(session_stats_t *stats);
+
+#endif
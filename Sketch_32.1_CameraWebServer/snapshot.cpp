@@ -0,0 +1,208 @@
+/*
+snapshot.cpp
+evidence for each intruder episode: the best frame, kept as the very JPEG buffer the vision
+task already encoded for /stream. Holding it only takes a reference on the pooled buffer
+(frame_pool.h), so the frame loop pays no copy and no second encode. Once the episode ends a
+low priority task on core 0 uploads the held JPEG to /snapshot over the shared keep-alive
+connection (db_client.cpp); the server links it to the episode's intruder row.
+*/
+
+#include "snapshot.h"
+#include "frame_pool.h"
+#include "intruder_episode.h"
+#include "event_codec.h"
+#include "db_client.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <time.h>
+#define TAG "snapshot: "
+
+#define SNAPSHOT_TASK_STACK 4096
+#define SNAPSHOT_TASK_PRIORITY 2
+#define SNAPSHOT_TASK_CORE 0
+#define SNAPSHOT_CLOCK_VALID 1600000000  // time() above this means SNTP has set the clock
+
+typedef enum {
+    SNAP_FREE = 0,
+    SNAP_HOLDING,                  // episode still running, a better frame may replace it
+    SNAP_READY,                    // episode over, waiting for the uploader
+    SNAP_UPLOADING                 // owned by the uploader
+} snapshot_state_t;
+
+typedef struct {
+    snapshot_state_t state;
+    pool_buf_t *jpg;
+    uint32_t episode;
+    uint32_t start_ms;
+    uint32_t best_frame;
+    float similarity;
+    int attempts;
+    int64_t retry_at_us;
+} snapshot_slot_t;
+
+// slot states and buffers are guarded by snap_mux
+static snapshot_slot_t slots[SNAPSHOT_SLOTS];
+static portMUX_TYPE snap_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t snapshot_task_handle = NULL;
+static snapshot_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+bool snapshot_hold(pool_buf_t *jpg, const intruder_episode_t *episode)
+{
+    int64_t t0 = esp_timer_get_time();
+    snapshot_slot_t *slot = NULL;
+    pool_buf_t *dead = NULL;
+    bool closed = false;
+    frame_pool_ref(jpg);
+    taskENTER_CRITICAL(&snap_mux);
+    for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+        if (slots[i].state != SNAP_HOLDING) continue;
+        if (slots[i].episode == episode->id) {
+            slot = &slots[i];
+        } else {
+            // a newer episode started, so this one ended even if its end message was lost
+            slots[i].state = SNAP_READY;
+            closed = true;
+        }
+    }
+    for (int i = 0; !slot && i < SNAPSHOT_SLOTS; i++) {
+        if (slots[i].state == SNAP_FREE) slot = &slots[i];
+    }
+    if (slot) {
+        dead = slot->jpg;
+        slot->state = SNAP_HOLDING;
+        slot->jpg = jpg;
+        slot->episode = episode->id;
+        slot->start_ms = episode->start_ms;
+        slot->best_frame = episode->best_frame;
+        slot->similarity = episode->max_similarity;
+        slot->attempts = 0;
+        slot->retry_at_us = 0;
+    }
+    taskEXIT_CRITICAL(&snap_mux);
+    if (slot) {
+        stats.held++;
+        if (dead) stats.replaced++;
+        frame_pool_put(dead);
+    } else {
+        stats.no_slot++;
+        frame_pool_put(jpg);
+    }
+    if (closed && snapshot_task_handle) xTaskNotifyGive(snapshot_task_handle);
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.last_hold_us = us;
+    stats.avg_hold_us = (stats.held <= 1) ? us : stats.avg_hold_us + ((float)us - stats.avg_hold_us) * 0.2f;
+    return slot != NULL;
+}
+
+
+void snapshot_episode_closed(const intruder_episode_t *episode)
+{
+    bool ready = false;
+    taskENTER_CRITICAL(&snap_mux);
+    for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+        if (slots[i].state == SNAP_HOLDING && slots[i].episode == episode->id) {
+            slots[i].state = SNAP_READY;
+            slots[i].similarity = episode->max_similarity;
+            ready = true;
+        }
+    }
+    taskEXIT_CRITICAL(&snap_mux);
+    if (ready && snapshot_task_handle) xTaskNotifyGive(snapshot_task_handle);
+}
+
+
+void snapshot_note_extra_encode(void)
+{
+    stats.extra_encodes++;
+}
+
+
+/* one POST: an event_codec record describing the episode, then the JPEG straight from the pool buffer */
+static bool snapshot_upload(const snapshot_slot_t *s)
+{
+    uint8_t head[EVENT_CODEC_HEADER_LEN + EVENT_CODEC_RECORD_LEN];
+    uint32_t age_ms = (uint32_t)(esp_timer_get_time() / 1000) - s->start_ms;
+    event_record_t r = { EVENT_TYPE_SNAPSHOT, EVENT_FLAG_INTRUDER | EVENT_FLAG_SEQ, -1, s->similarity, s->episode, age_ms };
+    time_t now = time(NULL);
+    if (now > SNAPSHOT_CLOCK_VALID) {
+        r.flags |= EVENT_FLAG_TS;
+        r.time = (uint32_t)now - age_ms / 1000;
+    } else {
+        r.flags |= EVENT_FLAG_AGE;
+    }
+    event_encoder_t enc;
+    event_codec_begin(&enc, head, sizeof(head));
+    event_codec_put(&enc, &r);
+    size_t head_len = event_codec_finish(&enc);
+    int64_t t0 = esp_timer_get_time();
+    int code = db_client_post_parts(DB_ENDPOINT_SNAPSHOT, DB_FORMAT_SNAPSHOT, head, head_len, s->jpg->data, s->jpg->len);
+    if (code < 200 || code >= 300) {
+        stats.upload_failures++;
+        ESP_LOGW(TAG, "episode %u upload failed (%d)", s->episode, code);
+        return false;
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.uploaded++;
+    stats.bytes += s->jpg->len;
+    stats.avg_upload_us = (stats.uploaded == 1) ? us : stats.avg_upload_us + ((float)us - stats.avg_upload_us) * 0.2f;
+    ESP_LOGI(TAG, "episode %u: frame %u, %u bytes in %ums", s->episode, s->best_frame, (uint32_t)s->jpg->len, us / 1000);
+    return true;
+}
+
+
+/* give the slot and its buffer back */
+static void snapshot_release(snapshot_slot_t *s)
+{
+    taskENTER_CRITICAL(&snap_mux);
+    pool_buf_t *dead = s->jpg;
+    s->jpg = NULL;
+    s->state = SNAP_FREE;
+    taskEXIT_CRITICAL(&snap_mux);
+    frame_pool_put(dead);
+}
+
+
+static void snapshot_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SNAPSHOT_RETRY_MS));
+        for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+            snapshot_slot_t *s = &slots[i];
+            int64_t now = esp_timer_get_time();
+            taskENTER_CRITICAL(&snap_mux);
+            bool take = s->state == SNAP_READY && now >= s->retry_at_us;
+            if (take) s->state = SNAP_UPLOADING;
+            taskEXIT_CRITICAL(&snap_mux);
+            if (!take) continue;
+            if (snapshot_upload(s)) {
+                snapshot_release(s);
+            } else if (++s->attempts >= SNAPSHOT_MAX_ATTEMPTS) {
+                stats.given_up++;
+                snapshot_release(s);
+            } else {
+                taskENTER_CRITICAL(&snap_mux);
+                s->retry_at_us = esp_timer_get_time() + (int64_t)SNAPSHOT_RETRY_MS * 1000;
+                s->state = SNAP_READY;
+                taskEXIT_CRITICAL(&snap_mux);
+            }
+        }
+    }
+}
+
+
+void snapshot_init(void)
+{
+    if (snapshot_task_handle) return;
+    xTaskCreatePinnedToCore(snapshot_task, "snapshot", SNAPSHOT_TASK_STACK, NULL, SNAPSHOT_TASK_PRIORITY,
+                            &snapshot_task_handle, SNAPSHOT_TASK_CORE);
+}
+
+
+void snapshot_get_stats(snapshot_stats_t *out)
+{
+    *out = stats;
+}
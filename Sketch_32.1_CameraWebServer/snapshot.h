@@ -0,0 +1,53 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct pool_buf;            // frame_pool.h
+struct intruder_episode;    // intruder_episode.h
+
+// intruder episodes whose best frame can be held at once, each pins one pooled JPEG buffer
+#ifndef SNAPSHOT_SLOTS
+#define SNAPSHOT_SLOTS 2
+#endif
+
+// upload attempts per snapshot before it is given up
+#ifndef SNAPSHOT_MAX_ATTEMPTS
+#define SNAPSHOT_MAX_ATTEMPTS 3
+#endif
+
+#ifndef SNAPSHOT_RETRY_MS
+#define SNAPSHOT_RETRY_MS 10000
+#endif
+
+typedef struct {
+    uint32_t held;                 // frames pinned (first or better frame of an episode)
+    uint32_t replaced;             // held frame swapped for a better one
+    uint32_t no_slot;              // every slot busy uploading
+    uint32_t extra_encodes;        // frames encoded only for a snapshot, nobody was streaming
+    uint32_t uploaded;
+    uint32_t upload_failures;
+    uint32_t given_up;
+    uint32_t bytes;                // JPEG bytes uploaded
+    uint32_t last_hold_us;
+    float avg_hold_us;             // cost on the frame loop
+    float avg_upload_us;
+} snapshot_stats_t;
+
+/* Start the uploader task, call once after db_client_init */
+void snapshot_init(void);
+
+/* Keep an encoded frame as the best one of its episode so far. Takes its own reference on
+   jpg, nothing is copied. Called from the vision task. */
+bool snapshot_hold(struct pool_buf *jpg, const struct intruder_episode *episode);
+
+/* The episode is over, its held frame can be uploaded. Called from intruder_task. */
+void snapshot_episode_closed(const struct intruder_episode *episode);
+
+/* vision task bookkeeping: a frame was encoded only because a snapshot wanted it */
+void snapshot_note_extra_encode(void);
+
+void snapshot_get_stats(snapshot_stats_t *stats);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+spsc_queue.cpp
+bounded single-producer/single-consumer pointer queue connecting the vision pipeline stages.
+Head and tail are only ever advanced by their own side, so push and pop need no lock; the
+release store of one side pairs with the acquire load of the other. A side that finds the queue
+full (or empty) sleeps on its FreeRTOS task notification and re-checks after every wake-up, so
+notifications meant for another queue of the same task only cost a spurious loop.
+*/
+
+#include "spsc_queue.h"
+#include <string.h>
+
+// ----- FUNCTIONS --------------------------------
+
+void spsc_queue_init(spsc_queue_t *q, uint32_t capacity)
+{
+    memset(q->slot, 0, sizeof(q->slot));
+    q->capacity = (capacity < 1) ? 1 : (capacity > SPSC_QUEUE_MAX ? SPSC_QUEUE_MAX : capacity);
+    q->head.store(0);
+    q->tail.store(0);
+    q->producer.store(NULL);
+    q->consumer.store(NULL);
+    q->high_water = 0;
+    q->full_waits = 0;
+}
+
+
+bool spsc_queue_push(spsc_queue_t *q, void *item, TickType_t wait)
+{
+    q->producer.store(xTaskGetCurrentTaskHandle());
+    uint32_t head = q->head.load(std::memory_order_relaxed);
+    bool waited = false;
+    while (head - q->tail.load(std::memory_order_acquire) >= q->capacity) {
+        if (!waited) q->full_waits++;
+        waited = true;
+        if (!ulTaskNotifyTake(pdTRUE, wait)) return false;
+    }
+    q->slot[head % q->capacity] = item;
+    q->head.store(head + 1, std::memory_order_release);
+    uint32_t depth = head + 1 - q->tail.load(std::memory_order_relaxed);
+    if (depth > q->high_water) q->high_water = depth;
+    TaskHandle_t consumer = q->consumer.load();
+    if (consumer) xTaskNotifyGive(consumer);
+    return true;
+}
+
+
+void *spsc_queue_pop(spsc_queue_t *q, TickType_t wait)
+{
+    q->consumer.store(xTaskGetCurrentTaskHandle());
+    uint32_t tail = q->tail.load(std::memory_order_relaxed);
+    while (q->head.load(std::memory_order_acquire) == tail) {
+        if (!ulTaskNotifyTake(pdTRUE, wait)) return NULL;
+    }
+    void *item = q->slot[tail % q->capacity];
+    q->tail.store(tail + 1, std::memory_order_release);
+    TaskHandle_t producer = q->producer.load();
+    if (producer) xTaskNotifyGive(producer);
+    return item;
+}
+
+
+uint32_t spsc_queue_depth(const spsc_queue_t *q)
+{
+    return q->head.load(std::memory_order_acquire) - q->tail.load(std::memory_order_acquire);
+}
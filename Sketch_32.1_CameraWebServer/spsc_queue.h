@@ -0,0 +1,38 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// slots of the largest queue
+#define SPSC_QUEUE_MAX 8
+
+/* Bounded queue of pointers between exactly one producer task and one consumer task.
+   Lock free; a blocked side sleeps on its task notification and the other side wakes it. */
+typedef struct {
+    void *slot[SPSC_QUEUE_MAX];
+    uint32_t capacity;
+    std::atomic<uint32_t> head;            // written by the producer only
+    std::atomic<uint32_t> tail;            // written by the consumer only
+    std::atomic<TaskHandle_t> producer;    // last task that pushed, woken when a slot frees up
+    std::atomic<TaskHandle_t> consumer;    // last task that popped, woken on a push
+    uint32_t high_water;
+    uint32_t full_waits;                   // pushes that had to wait (backpressure)
+} spsc_queue_t;
+
+/* Empty queue of capacity slots (at most SPSC_QUEUE_MAX) */
+void spsc_queue_init(spsc_queue_t *q, uint32_t capacity);
+
+/* Append item, waiting up to wait ticks for a free slot; false on timeout */
+bool spsc_queue_push(spsc_queue_t *q, void *item, TickType_t wait);
+
+/* Oldest item, waiting up to wait ticks for one; NULL on timeout */
+void *spsc_queue_pop(spsc_queue_t *q, TickType_t wait);
+
+/* Items queued right now */
+uint32_t spsc_queue_depth(const spsc_queue_t *q);
+
+#endif
@@ -0,0 +1,283 @@
+/*
+stream_broadcast.cpp
+MJPEG fan-out for /stream. The vision task encodes each frame once into a reference-counted
+shared frame; every viewer is detached from the httpd task and served by its own small sender
+task that always picks up the newest frame. A slow viewer just skips frames, it never holds up
+the producer or the other viewers.
+*/
+
+#include "stream_broadcast.h"
+#include "frame_pool.h"
+#include "trace.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+#define TAG "stream: "
+
+// Enables live streaming over HTTP by mix of JPEG to MJPEG though mixed
+#define PART_BOUNDARY "123456789000000000000987654321"
+static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
+static const char *_STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
+static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
+
+// sender tasks
+#define STREAM_CLIENT_STACK 4096
+#define STREAM_CLIENT_PRIORITY 4
+#define STREAM_CLIENT_CORE 0
+#define STREAM_FRAME_TIMEOUT_MS 5000     // viewer gives up when the producer stalls this long
+
+// one slot per viewer in flight, one for the latest frame, one being published
+#define STREAM_FRAME_SLOTS (STREAM_MAX_CLIENTS + 2)
+
+typedef struct {
+    pool_buf_t *buf;
+    struct timeval timestamp;
+    uint32_t seq;
+    int refs;
+} shared_frame_t;
+
+typedef struct {
+    httpd_req_t *req;
+    TaskHandle_t task;
+    stream_client_stats_t stats;
+} stream_client_t;
+
+// shared frames, refcounts and latest pointer are guarded by frame_mux
+static shared_frame_t frames[STREAM_FRAME_SLOTS];
+static shared_frame_t *latest = NULL;
+static uint32_t publish_seq = 0;
+static portMUX_TYPE frame_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// viewer table, guarded by clients_lock
+static stream_client_t clients[STREAM_MAX_CLIENTS];
+static SemaphoreHandle_t clients_lock = NULL;
+static uint32_t next_client_id = 1;
+static volatile int client_count = 0;
+
+static stream_producer_stats_t producer_stats;
+
+// ----- FUNCTIONS --------------------------------
+
+/* take a reference on the newest frame if it is newer than after_seq */
+static shared_frame_t *stream_frame_acquire(uint32_t after_seq)
+{
+    shared_frame_t *f = NULL;
+    taskENTER_CRITICAL(&frame_mux);
+    if (latest && latest->seq != after_seq) {
+        latest->refs++;
+        f = latest;
+    }
+    taskEXIT_CRITICAL(&frame_mux);
+    return f;
+}
+
+
+/* drop a reference, the last one returns the JPEG buffer to the pool */
+static void stream_frame_release(shared_frame_t *f)
+{
+    pool_buf_t *dead = NULL;
+    taskENTER_CRITICAL(&frame_mux);
+    if (--f->refs == 0) {
+        dead = f->buf;
+        f->buf = NULL;
+    }
+    taskEXIT_CRITICAL(&frame_mux);
+    frame_pool_put(dead);
+}
+
+
+/* wake every sender task */
+static void stream_notify_clients(void)
+{
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (clients[i].task) {
+            xTaskNotifyGive(clients[i].task);
+        }
+    }
+    xSemaphoreGive(clients_lock);
+}
+
+
+void stream_broadcast_init(void)
+{
+    if (clients_lock) return;
+    clients_lock = xSemaphoreCreateMutex();
+    memset(frames, 0, sizeof(frames));
+    memset(clients, 0, sizeof(clients));
+    memset(&producer_stats, 0, sizeof(producer_stats));
+}
+
+
+int stream_broadcast_clients(void)
+{
+    return client_count;
+}
+
+
+bool stream_broadcast_publish_owned(pool_buf_t *jpg, const struct timeval *timestamp, uint32_t encode_us)
+{
+    shared_frame_t *slot = NULL;
+    pool_buf_t *dead = NULL;
+    taskENTER_CRITICAL(&frame_mux);
+    for (int i = 0; i < STREAM_FRAME_SLOTS; i++) {
+        if (frames[i].refs == 0) {
+            slot = &frames[i];
+            break;
+        }
+    }
+    if (slot) {
+        slot->buf = jpg;
+        slot->timestamp = *timestamp;
+        slot->seq = ++publish_seq;
+        slot->refs = 1;             // held by "latest"
+        shared_frame_t *prev = latest;
+        latest = slot;
+        if (prev && --prev->refs == 0) {
+            dead = prev->buf;
+            prev->buf = NULL;
+        }
+    }
+    taskEXIT_CRITICAL(&frame_mux);
+    if (!slot) {
+        frame_pool_put(jpg);
+        producer_stats.publish_failed++;
+        return false;
+    }
+    frame_pool_put(dead);
+    producer_stats.frames_published++;
+    producer_stats.last_encode_us = encode_us;
+    producer_stats.avg_encode_us += ((float)encode_us - producer_stats.avg_encode_us) * 0.05f;
+    stream_notify_clients();
+    return true;
+}
+
+
+/* send one multipart chunk (boundary, part header, jpeg) */
+static esp_err_t stream_send_frame(httpd_req_t *req, const shared_frame_t *f)
+{
+    char part_buf[128];
+    esp_err_t res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+    if (res == ESP_OK) {
+        size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, f->buf->len, f->timestamp.tv_sec, f->timestamp.tv_usec);
+        res = httpd_resp_send_chunk(req, part_buf, hlen);
+    }
+    if (res == ESP_OK) {
+        res = httpd_resp_send_chunk(req, (const char *)f->buf->data, f->buf->len);
+    }
+    return res;
+}
+
+
+/* per viewer sender: wait for a newer frame, send it, repeat until the socket fails */
+static void stream_client_task(void *arg)
+{
+    stream_client_t *c = (stream_client_t *)arg;
+    httpd_req_t *req = c->req;
+    uint32_t last_seq = 0;
+    uint32_t window_frames = 0;
+    int64_t window_start = esp_timer_get_time();
+    esp_err_t res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
+    if (res == ESP_OK) {
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_set_hdr(req, "X-Framerate", "60");
+    }
+    while (res == ESP_OK) {
+        shared_frame_t *f = stream_frame_acquire(last_seq);
+        if (!f) {
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_FRAME_TIMEOUT_MS)) == 0 &&
+                (f = stream_frame_acquire(last_seq)) == NULL) {
+                ESP_LOGE(TAG, "client %u: no frame from vision task", c->stats.id);
+                break;
+            }
+            if (!f) continue;
+        }
+        if (last_seq != 0 && f->seq > last_seq + 1) {
+            c->stats.frames_dropped += f->seq - last_seq - 1;
+        }
+        last_seq = f->seq;
+        trace_begin(TRACE_STREAM_SEND);
+        res = stream_send_frame(req, f);
+        trace_end(TRACE_STREAM_SEND);
+        if (res == ESP_OK) {
+            c->stats.frames_sent++;
+            c->stats.bytes_sent += f->buf->len;
+            window_frames++;
+        }
+        stream_frame_release(f);
+        int64_t now = esp_timer_get_time();
+        if (now - window_start >= 1000000) {
+            c->stats.fps = window_frames * 1000000.0f / (float)(now - window_start);
+            window_frames = 0;
+            window_start = now;
+        }
+    }
+    ESP_LOGI(TAG, "client %u left: %u sent, %u dropped", c->stats.id, c->stats.frames_sent, c->stats.frames_dropped);
+    httpd_req_async_handler_complete(req);
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    c->task = NULL;
+    c->req = NULL;
+    c->stats.active = false;
+    client_count--;
+    xSemaphoreGive(clients_lock);
+    vTaskDelete(NULL);
+}
+
+
+esp_err_t stream_broadcast_add_client(httpd_req_t *req)
+{
+    httpd_req_t *async_req = NULL;
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    stream_client_t *c = NULL;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (!clients[i].stats.active) {
+            c = &clients[i];
+            break;
+        }
+    }
+    if (!c) {
+        xSemaphoreGive(clients_lock);
+        ESP_LOGW(TAG, "viewer rejected, %d already attached", STREAM_MAX_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "too many viewers", HTTPD_RESP_USE_STRLEN);
+    }
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        xSemaphoreGive(clients_lock);
+        ESP_LOGE(TAG, "async handler begin failed");
+        return ESP_FAIL;
+    }
+    memset(c, 0, sizeof(*c));
+    c->req = async_req;
+    c->stats.active = true;
+    c->stats.id = next_client_id++;
+    c->stats.connected_us = esp_timer_get_time();
+    if (xTaskCreatePinnedToCore(stream_client_task, "stream_client", STREAM_CLIENT_STACK, c,
+                                STREAM_CLIENT_PRIORITY, &c->task, STREAM_CLIENT_CORE) != pdPASS) {
+        c->stats.active = false;
+        c->req = NULL;
+        xSemaphoreGive(clients_lock);
+        httpd_req_async_handler_complete(async_req);
+        ESP_LOGE(TAG, "stream_client task create failed");
+        return ESP_FAIL;
+    }
+    client_count++;
+    xSemaphoreGive(clients_lock);
+    ESP_LOGI(TAG, "client %u attached (%d viewers)", c->stats.id, client_count);
+    return ESP_OK;
+}
+
+
+void stream_broadcast_get_stats(stream_producer_stats_t *producer, stream_client_stats_t *out)
+{
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    *producer = producer_stats;
+    producer->clients = client_count;
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        out[i] = clients[i].stats;
+    }
+    xSemaphoreGive(clients_lock);
+}
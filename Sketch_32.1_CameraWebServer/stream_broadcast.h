@@ -0,0 +1,51 @@
+#ifndef STREAM_BROADCAST_H
+#define STREAM_BROADCAST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "esp_http_server.h"
+
+struct pool_buf;   // frame_pool.h
+
+// max simultaneous /stream viewers
+#ifndef STREAM_MAX_CLIENTS
+#define STREAM_MAX_CLIENTS 4
+#endif
+
+// per-viewer statistics
+typedef struct {
+    bool active;
+    uint32_t id;
+    uint32_t frames_sent;
+    uint32_t frames_dropped;     // published frames skipped because the viewer was still sending
+    uint64_t bytes_sent;
+    float fps;
+    int64_t connected_us;
+} stream_client_stats_t;
+
+// producer side statistics
+typedef struct {
+    uint32_t frames_published;
+    uint32_t publish_failed;     // no free frame slot
+    uint32_t last_encode_us;
+    float avg_encode_us;         // moving average of encode cost per published frame
+    int clients;
+} stream_producer_stats_t;
+
+/* Set up the shared frame slots, call once before the vision task starts publishing */
+void stream_broadcast_init(void);
+
+/* Number of viewers currently attached, the producer only encodes while this is > 0 */
+int stream_broadcast_clients(void);
+
+/* Publish a pooled JPEG buffer; ownership moves to the broadcaster, which returns it to the pool when the last viewer is done */
+bool stream_broadcast_publish_owned(struct pool_buf *jpg, const struct timeval *timestamp, uint32_t encode_us);
+
+/* Detach a /stream request from the httpd task and serve it from its own sender task */
+esp_err_t stream_broadcast_add_client(httpd_req_t *req);
+
+/* Snapshot statistics, clients must hold STREAM_MAX_CLIENTS entries */
+void stream_broadcast_get_stats(stream_producer_stats_t *producer, stream_client_stats_t *clients);
+
+#endif
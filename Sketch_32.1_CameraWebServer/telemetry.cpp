@@ -0,0 +1,208 @@
+/*
+telemetry.cpp
+recognizer events for the EC2 database, uploaded off the frame loop. The vision task drops
+events into a lock-free single-producer/single-consumer ring; a low priority uploader task on
+core 0 drains it and POSTs batches to /create (db_client.cpp), as event_codec records or JSON
+arrays, once a batch fills up or the flush interval passes. Network stalls only ever delay the
+uploader, never capture.
+*/
+
+#include "telemetry.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "db_client.h"
+#include "outbox.h"
+#include "event_codec.h"
+#include "trace.h"
+#include <atomic>
+#define TAG "telemetry: "
+
+#define TELEMETRY_TASK_STACK 6144
+#define TELEMETRY_TASK_PRIORITY 2
+#define TELEMETRY_TASK_CORE 0
+#define TELEMETRY_EVENT_JSON_LEN 80      // one {"intruder_status":..} object, generous
+#define TELEMETRY_REPLAY_BATCHES 4       // outbox batches replayed per wake
+#define TELEMETRY_CODEC_SAMPLE 8         // batches between JSON vs binary encode comparisons
+
+static telemetry_event_t ring[TELEMETRY_RING_SIZE];
+static std::atomic<uint32_t> ring_head(0);   // written by the producer only
+static std::atomic<uint32_t> ring_tail(0);   // written by the uploader only
+static TaskHandle_t telemetry_task_handle = NULL;
+static telemetry_stats_t stats;
+
+// ----- FUNCTIONS --------------------------------
+
+bool telemetry_push(bool intruder, int face_id, float confidence)
+{
+    uint32_t head = ring_head.load(std::memory_order_relaxed);
+    uint32_t tail = ring_tail.load(std::memory_order_acquire);
+    if (head - tail >= TELEMETRY_RING_SIZE) {
+        stats.dropped++;
+        return false;
+    }
+    telemetry_event_t *e = &ring[head & (TELEMETRY_RING_SIZE - 1)];
+    e->timestamp_us = esp_timer_get_time();
+    e->intruder = intruder;
+    e->face_id = face_id;
+    e->confidence = confidence;
+    ring_head.store(head + 1, std::memory_order_release);
+    stats.queued++;
+    uint32_t depth = head + 1 - tail;
+    if (depth > stats.max_depth) stats.max_depth = depth;
+    // a full batch does not wait for the flush timer
+    if (depth >= TELEMETRY_BATCH_MAX && telemetry_task_handle) {
+        xTaskNotifyGive(telemetry_task_handle);
+    }
+    return true;
+}
+
+
+/* serialise up to TELEMETRY_BATCH_MAX events from the tail without consuming them, as a JSON array */
+static int telemetry_build_json(char *json, size_t json_len, size_t *out_len, int64_t *mean_queued_us)
+{
+    uint32_t tail = ring_tail.load(std::memory_order_relaxed);
+    uint32_t head = ring_head.load(std::memory_order_acquire);
+    int count = 0;
+    size_t len = 0;
+    json[len++] = '[';
+    int64_t queued_sum = 0;
+    while (tail + count != head && count < TELEMETRY_BATCH_MAX) {
+        const telemetry_event_t *e = &ring[(tail + count) & (TELEMETRY_RING_SIZE - 1)];
+        int n = snprintf(json + len, json_len - len, "%s{\"intruder_status\":%s,\"face_id\":%d,\"confidence\":%.2f}",
+                         count ? "," : "", e->intruder ? "true" : "false", e->face_id, e->confidence);
+        if (n < 0 || (size_t)n >= json_len - len - 1) break;
+        len += n;
+        queued_sum += e->timestamp_us;
+        count++;
+    }
+    json[len++] = ']';
+    json[len] = '\0';
+    *out_len = len;
+    *mean_queued_us = count ? queued_sum / count : 0;
+    return count;
+}
+
+
+/* same batch as event_codec records, each carrying its age so the server can stamp the real time */
+static int telemetry_build_binary(uint8_t *buf, size_t cap, size_t *out_len, int64_t *mean_queued_us)
+{
+    uint32_t tail = ring_tail.load(std::memory_order_relaxed);
+    uint32_t head = ring_head.load(std::memory_order_acquire);
+    int64_t now = esp_timer_get_time();
+    int64_t queued_sum = 0;
+    event_encoder_t enc;
+    event_codec_begin(&enc, buf, cap);
+    while (tail + enc.count != head && enc.count < TELEMETRY_BATCH_MAX) {
+        const telemetry_event_t *e = &ring[(tail + enc.count) & (TELEMETRY_RING_SIZE - 1)];
+        event_record_t r = { EVENT_TYPE_RECOGNITION, EVENT_FLAG_AGE, (int16_t)e->face_id, e->confidence, 0,
+                             (uint32_t)((now - e->timestamp_us) / 1000) };
+        if (e->intruder) r.flags |= EVENT_FLAG_INTRUDER;
+        if (!event_codec_put(&enc, &r)) break;
+        queued_sum += e->timestamp_us;
+    }
+    *out_len = event_codec_finish(&enc);
+    *mean_queued_us = enc.count ? queued_sum / enc.count : 0;
+    return enc.count;
+}
+
+
+/* encode the batch in the given format, timing it for the JSON vs binary comparison in /stats */
+static int telemetry_build_batch(db_format_t format, uint8_t *buf, size_t cap, size_t *out_len, int64_t *mean_queued_us)
+{
+    int64_t t0 = esp_timer_get_time();
+    int count = (format == DB_FORMAT_BINARY) ? telemetry_build_binary(buf, cap, out_len, mean_queued_us)
+                                             : telemetry_build_json((char *)buf, cap, out_len, mean_queued_us);
+    if (count == 0) return 0;
+    float us = (float)(esp_timer_get_time() - t0) / count;
+    float bytes = (float)*out_len / count;
+    float *avg_us = (format == DB_FORMAT_BINARY) ? &stats.binary_encode_us : &stats.json_encode_us;
+    float *avg_bytes = (format == DB_FORMAT_BINARY) ? &stats.binary_bytes_per_event : &stats.json_bytes_per_event;
+    *avg_us = (*avg_us == 0) ? us : *avg_us + (us - *avg_us) * 0.2f;
+    *avg_bytes = (*avg_bytes == 0) ? bytes : *avg_bytes + (bytes - *avg_bytes) * 0.2f;
+    return count;
+}
+
+
+/* move the batch at the tail of the ring into the flash outbox */
+static bool telemetry_spill(int count)
+{
+    uint32_t tail = ring_tail.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        const telemetry_event_t *e = &ring[(tail + i) & (TELEMETRY_RING_SIZE - 1)];
+        if (!outbox_append(OUTBOX_EVENT, e->intruder, e->face_id, e->confidence, e->timestamp_us)) {
+            ring_tail.fetch_add(i, std::memory_order_release);
+            stats.spilled += i;
+            return false;
+        }
+    }
+    ring_tail.fetch_add(count, std::memory_order_release);
+    stats.spilled += count;
+    return true;
+}
+
+
+static void telemetry_task(void *arg)
+{
+    static uint8_t body[TELEMETRY_BATCH_MAX * TELEMETRY_EVENT_JSON_LEN + 4];
+    db_format_t format = TELEMETRY_BINARY ? DB_FORMAT_BINARY : DB_FORMAT_JSON;
+    db_format_t other = TELEMETRY_BINARY ? DB_FORMAT_JSON : DB_FORMAT_BINARY;
+    uint32_t attempts = 0;         // batches built, failed posts and retries included
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TELEMETRY_FLUSH_MS));
+        trace_sync();              // cycle anchor for core 0
+        while (true) {
+            size_t len = 0;
+            int64_t mean_queued_us = 0;
+            // every few batches also encode the other format, only to keep the comparison current;
+            // counted per attempt, so a batch retried while offline is not re-encoded every time
+            if (attempts++ % TELEMETRY_CODEC_SAMPLE == 0) {
+                telemetry_build_batch(other, body, sizeof(body), &len, &mean_queued_us);
+            }
+            int count = telemetry_build_batch(format, body, sizeof(body), &len, &mean_queued_us);
+            if (count == 0) break;
+            int64_t t0 = esp_timer_get_time();
+            int code = db_client_post_format(DB_ENDPOINT_CREATE, format, body, len);
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+            stats.last_upload_us = us;
+            stats.avg_upload_us = (stats.batches == 0) ? us : stats.avg_upload_us + ((float)us - stats.avg_upload_us) * 0.2f;
+            if (code < 200 || code >= 300) {
+                stats.failures++;
+                ESP_LOGW(TAG, "POST of %d events failed: %d", count, code);
+                // offline: park the batch in the flash outbox, it is replayed on reconnect
+                if (telemetry_spill(count)) break;
+                // no outbox: keep the batch queued, new events are dropped at the producer if this lasts
+                vTaskDelay(pdMS_TO_TICKS(TELEMETRY_RETRY_MS));
+                break;
+            }
+            ring_tail.fetch_add(count, std::memory_order_release);
+            stats.batches++;
+            stats.sent += count;
+            stats.bytes_sent += len;
+            float age_ms = (esp_timer_get_time() - mean_queued_us) / 1000.0f;
+            stats.avg_event_age_ms = (stats.batches == 1) ? age_ms : stats.avg_event_age_ms + (age_ms - stats.avg_event_age_ms) * 0.2f;
+            if (count < TELEMETRY_BATCH_MAX) break;
+        }
+        outbox_tick();
+        // live events first, then whatever piled up while offline
+        if (ring_head.load(std::memory_order_acquire) == ring_tail.load(std::memory_order_relaxed)) {
+            outbox_replay(TELEMETRY_REPLAY_BATCHES);
+        }
+    }
+}
+
+
+void telemetry_init(void)
+{
+    if (telemetry_task_handle) return;
+    xTaskCreatePinnedToCore(telemetry_task, "telemetry_task", TELEMETRY_TASK_STACK, NULL,
+                            TELEMETRY_TASK_PRIORITY, &telemetry_task_handle, TELEMETRY_TASK_CORE);
+}
+
+
+void telemetry_get_stats(telemetry_stats_t *out)
+{
+    *out = stats;
+    out->depth = ring_head.load(std::memory_order_acquire) - ring_tail.load(std::memory_order_acquire);
+}
@@ -0,0 +1,67 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// pending events, power of two
+#ifndef TELEMETRY_RING_SIZE
+#define TELEMETRY_RING_SIZE 64
+#endif
+
+// events per POST
+#ifndef TELEMETRY_BATCH_MAX
+#define TELEMETRY_BATCH_MAX 16
+#endif
+
+// post whatever is queued at least this often
+#ifndef TELEMETRY_FLUSH_MS
+#define TELEMETRY_FLUSH_MS 2000
+#endif
+
+// back off this long after a failed POST when the outbox cannot take the batch
+#ifndef TELEMETRY_RETRY_MS
+#define TELEMETRY_RETRY_MS 5000
+#endif
+
+// post event_codec binary batches instead of JSON arrays (the Flask server accepts both)
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 1
+#endif
+
+// one recognizer verdict, same fields the /create endpoint stores
+typedef struct {
+    int64_t timestamp_us;
+    int face_id;
+    float confidence;
+    bool intruder;
+} telemetry_event_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t dropped;              // ring was full
+    uint32_t sent;                 // events acknowledged by the server
+    uint32_t batches;
+    uint32_t failures;             // POSTs that failed
+    uint32_t spilled;              // events parked in the flash outbox after a failed POST
+    uint32_t depth;                // events waiting right now
+    uint32_t max_depth;
+    uint32_t last_upload_us;       // POST round trip
+    float avg_upload_us;
+    float avg_event_age_ms;        // queue-to-ack delay
+    uint32_t bytes_sent;           // request bodies acknowledged by the server
+    float json_bytes_per_event;
+    float json_encode_us;          // per event
+    float binary_bytes_per_event;
+    float binary_encode_us;        // per event
+} telemetry_stats_t;
+
+/* Start the uploader task */
+void telemetry_init(void);
+
+/* Queue one event without blocking. Single producer (the vision task); false when the ring is full */
+bool telemetry_push(bool intruder, int face_id, float confidence);
+
+void telemetry_get_stats(telemetry_stats_t *stats);
+
+#endif
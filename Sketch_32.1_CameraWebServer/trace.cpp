@@ -0,0 +1,140 @@
+/*
+trace.cpp
+low overhead begin/end trace of the pipeline, for the timing questions ESP_LOGI cannot answer
+without disturbing what it measures. Every event is 12 bytes with a raw cycle counter stamp,
+written lock free into a fixed ring of the core it ran on (internal RAM, so the PIR ISR can
+record while flash is busy). Cycle counters are per core and wrap every few seconds, so each
+core also drops a cycle/esp_timer anchor once a second; trace_to_chrome.py uses those to put
+both cores on one timeline and turns a /trace download into Chrome trace_event JSON.
+*/
+
+#include "trace.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <string.h>
+
+#define TRACE_CORES 2
+#define TRACE_MAX_TASKS 24
+#define TRACE_TASK_NAME_LEN 16
+#define TRACE_TASK_ISR 0xFF
+#define TRACE_SYNC_US 1000000
+#define TRACE_DUMP_HEADER_LEN 16
+
+// one event, the dump carries them as is (little endian)
+typedef struct __attribute__((packed)) {
+    uint32_t cycles;
+    uint32_t arg;
+    uint8_t point;                 // trace_point_t
+    uint8_t phase;                 // trace_phase_t
+    uint8_t task;                  // slot in the task table, TRACE_TASK_ISR from interrupts
+    uint8_t reserved;
+} trace_event_t;
+
+static DRAM_ATTR trace_event_t rings[TRACE_CORES][TRACE_EVENTS_PER_CORE];
+static std::atomic<uint32_t> heads[TRACE_CORES];
+static volatile bool recording = true;
+static int64_t last_sync_us[TRACE_CORES];
+
+// task handle -> slot, appended under task_mux, read without it
+static TaskHandle_t tasks[TRACE_MAX_TASKS];
+static std::atomic<int> task_count(0);
+static portMUX_TYPE task_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// ----- FUNCTIONS --------------------------------
+
+/* small stable number for the calling task */
+static IRAM_ATTR uint8_t trace_task_slot(void)
+{
+    if (xPortInIsrContext()) return TRACE_TASK_ISR;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    int n = task_count.load(std::memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        if (tasks[i] == self) return i;
+    }
+    int slot = TRACE_TASK_ISR;
+    taskENTER_CRITICAL(&task_mux);
+    n = task_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < n && slot == TRACE_TASK_ISR; i++) {
+        if (tasks[i] == self) slot = i;
+    }
+    if (slot == TRACE_TASK_ISR && n < TRACE_MAX_TASKS) {
+        tasks[n] = self;
+        task_count.store(n + 1, std::memory_order_release);
+        slot = n;
+    }
+    taskEXIT_CRITICAL(&task_mux);
+    return slot;
+}
+
+
+void IRAM_ATTR trace_record(trace_point_t point, trace_phase_t phase, uint32_t arg)
+{
+    if (!recording) return;
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    int core = xPortGetCoreID();
+    uint32_t i = heads[core].fetch_add(1, std::memory_order_relaxed);
+    trace_event_t *e = &rings[core][i % TRACE_EVENTS_PER_CORE];
+    e->cycles = cycles;
+    e->arg = arg;
+    e->point = point;
+    e->phase = phase;
+    e->task = trace_task_slot();
+    e->reserved = 0;
+}
+
+
+void trace_sync(void)
+{
+    int core = xPortGetCoreID();
+    int64_t now = esp_timer_get_time();
+    if (now - last_sync_us[core] < TRACE_SYNC_US) return;
+    last_sync_us[core] = now;
+    trace_record(TRACE_SYNC, TRACE_INSTANT, (uint32_t)now);
+}
+
+
+size_t trace_dump_size(void)
+{
+    return TRACE_DUMP_HEADER_LEN + TRACE_MAX_TASKS * TRACE_TASK_NAME_LEN +
+           TRACE_CORES * (4 + sizeof(rings[0]));
+}
+
+
+/*
+dump layout, little endian:
+  'T' 'R' 'C' '1'  cpu_hz(u32)  cores(u16)  events_per_core(u16)  tasks(u16)  event_size(u16)
+  tasks x 16 byte zero padded task names
+  per core: events written since boot (u32), then the ring as stored (slot = seq % events_per_core)
+*/
+size_t trace_dump(uint8_t *buf, size_t cap)
+{
+    if (cap < trace_dump_size()) return 0;
+    recording = false;
+    vTaskDelay(1);                 // let writers that already passed the check finish
+    int n = task_count.load(std::memory_order_acquire);
+    uint32_t cpu_hz = esp_rom_get_cpu_ticks_per_us() * 1000000u;
+    uint16_t header[4] = { TRACE_CORES, TRACE_EVENTS_PER_CORE, (uint16_t)n, sizeof(trace_event_t) };
+    uint8_t *p = buf;
+    memcpy(p, "TRC1", 4);
+    memcpy(p + 4, &cpu_hz, 4);
+    memcpy(p + 8, header, sizeof(header));
+    p += TRACE_DUMP_HEADER_LEN;
+    for (int i = 0; i < n; i++) {
+        memset(p, 0, TRACE_TASK_NAME_LEN);
+        strncpy((char *)p, pcTaskGetName(tasks[i]), TRACE_TASK_NAME_LEN - 1);
+        p += TRACE_TASK_NAME_LEN;
+    }
+    for (int c = 0; c < TRACE_CORES; c++) {
+        uint32_t head = heads[c].load(std::memory_order_relaxed);
+        memcpy(p, &head, 4);
+        memcpy(p + 4, rings[c], sizeof(rings[c]));
+        p += 4 + sizeof(rings[c]);
+    }
+    recording = true;
+    return p - buf;
+}
@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// events kept per core, oldest overwritten (internal RAM, 12 bytes each)
+#ifndef TRACE_EVENTS_PER_CORE
+#define TRACE_EVENTS_PER_CORE 512
+#endif
+
+// trace points; trace_to_chrome.py keeps the same order
+typedef enum {
+    TRACE_SYNC = 0,                // cycle counter <-> esp_timer anchor, arg = esp_timer us
+    TRACE_CAPTURE,                 // esp_camera_fb_get
+    TRACE_CONVERT,                 // JPEG -> RGB888 decode
+    TRACE_DETECT,                  // detection / tracker prediction
+    TRACE_RECOGNIZE,
+    TRACE_ENCODE,                  // JPEG encode
+    TRACE_STREAM_SEND,             // one MJPEG part to one viewer
+    TRACE_DB_POST,                 // request on the database connection
+    TRACE_PIR_ISR,
+    TRACE_QUEUE_SEND,              // intruder_task queue, arg = episode transition
+    TRACE_ALERT,                   // intruder_task: buzzer, LED and CallMeBot alert
+    TRACE_FACE_STATE,              // recompute_face_state, arg = detect | recognize << 1
+    TRACE_POINT_COUNT
+} trace_point_t;
+
+typedef enum {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_INSTANT = 'i'
+} trace_phase_t;
+
+/* Record one event on the calling core's ring. Lock free, callable from ISRs. */
+void trace_record(trace_point_t point, trace_phase_t phase, uint32_t arg);
+
+static inline void trace_begin(trace_point_t point) { trace_record(point, TRACE_BEGIN, 0); }
+static inline void trace_end(trace_point_t point) { trace_record(point, TRACE_END, 0); }
+static inline void trace_instant(trace_point_t point, uint32_t arg) { trace_record(point, TRACE_INSTANT, arg); }
+
+/* Drop a cycle counter anchor for this core once a second; call from a task that runs regularly */
+void trace_sync(void);
+
+/* Size of the dump, for the response buffer */
+size_t trace_dump_size(void);
+
+/* Binary dump of both rings plus the task name table, recording paused meanwhile.
+   Returns the length written, 0 if cap is too small. Format: see trace_to_chrome.py. */
+size_t trace_dump(uint8_t *buf, size_t cap);
+
+#endif
@@ -0,0 +1,761 @@
+/*
+vision_task.cpp
+always-on frame pipeline that owns the camera. Runs face detection and recognition whenever
+it is enabled (GUI, PIR or enrolling) and publishes the latest annotated JPEG frame to the
+stream broadcaster, whether or not a browser is watching. Three stages connected by
+single-producer/single-consumer queues: capture + convert and encode + publish on core 0,
+detection + recognition (vision_task) on core 1, so a frame is encoded while the next one is
+being analysed and steady-state fps follows the slowest stage instead of the sum of them.
+Frames wider than VISION_MAX_DETECT_WIDTH run as a resolution cascade: the detectors see a
+1/2..1/8 DCT-scaled decode of the sensor JPEG, boxes and keypoints are scaled back up, and the
+recognizer gets its face crop decoded from the full-resolution JPEG. Both cores decode JPEG,
+so they take turns on the one decoder (jpeg_decoder.cpp).
+*/
+
+#include "vision_task.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "img_converters.h"
+#include "frame_annotate.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "hardware_control.h"
+#include "intruder_episode.h"
+#include "snapshot.h"
+#include "clip_recorder.h"
+#include "metrics.h"
+#include "trace.h"
+#include "session.h"
+#include "face_state.h"
+#include "stream_broadcast.h"
+#include "frame_pool.h"
+#include "capture_profile.h"
+#include "face_crop.h"
+#include "jpeg_decoder.h"
+#include "face_tracker.h"
+#include "motion_gate.h"
+#include "spsc_queue.h"
+#include <Arduino.h>
+#define TAG "vision: "
+
+/* all part of face detection and recogition */
+#include "face_models.h"
+#include "gallery.h"
+#include <vector>
+#include <list>
+#include <cstdarg>
+
+#define ENROLL_INTERVAL_MS 5000          // 5 seconds between enroll captures (tune if you like)
+
+// stage placement - intruder_task also lives on core 1 but only wakes per intruder episode
+#define VISION_TASK_STACK 16384
+#define VISION_TASK_PRIORITY 5
+#define VISION_TASK_CORE 1
+#define VISION_CAPTURE_STACK 16384       // session recording may JPEG-encode on this stage
+#define VISION_CAPTURE_PRIORITY 4
+#define VISION_CAPTURE_CORE 0
+#define VISION_ENCODE_STACK 16384
+#define VISION_ENCODE_PRIORITY 4
+#define VISION_ENCODE_CORE 0
+#define VISION_IDLE_POLL_MS 50           // poll interval while nothing needs frames
+#define VISION_MAX_DETECT_WIDTH 400      // widest image the detectors are run on
+
+// encoded JPEG frames in the pool: one per viewer in flight, the latest frame, one being encoded,
+// sensor JPEGs in the pipeline queues, the held snapshots and recorded session frames waiting for flash
+#ifndef VISION_JPEG_BUFS
+#define VISION_JPEG_BUFS (STREAM_MAX_CLIENTS + 5 + SNAPSHOT_SLOTS + SESSION_QUEUE_LEN)
+#endif
+
+// detect on wider JPEG frames through a scaled decode; 0 streams them without detection
+#ifndef VISION_CASCADE
+#define VISION_CASCADE 1
+#endif
+
+// per-frame timing line on the serial console, /metrics has the same numbers as histograms
+#ifndef VISION_FRAME_LOG
+#define VISION_FRAME_LOG 0
+#endif
+
+// Delay showing the enrollment messages on screen
+static bool show_enroll_msg = false;
+static char enroll_msg_text[64];
+static int64_t enroll_msg_until_us = 0;
+#define ENROLL_MSG_DURATION_MS 3000
+
+// one frame on its way through the stages, with the pooled buffers it holds
+typedef struct {
+    pool_buf_t *pixels;                  // RGB565 copy, RGB888 decode or raw frame to encode
+    pool_buf_t *jpg;                     // sensor JPEG copy, or the encoded frame
+    pixformat_t format;                  // of pixels
+    int width;
+    int height;
+    int scale;                           // pixels are width / scale x height / scale (cascade)
+    uint32_t frame_index;
+    struct timeval timestamp;
+    bool analyse;
+    bool restart;                        // first analysed frame after a pause: tracks are stale
+    bool publish;
+    bool record;
+    bool gate;                           // motion: run the detector
+    motion_region_t region;
+    bool detected;
+    bool recognized;
+    int face_id;
+    bool snapshot;                       // best frame of an intruder episode so far
+    intruder_episode_t episode;
+    int64_t t_start, t_ready, t_infer, t_face, t_recognize, t_encode;
+} vision_frame_t;
+
+// busy time of a stage over the current one second window
+typedef struct {
+    vision_stage_stats_t stats;
+    int64_t window_start;
+    int64_t window_busy;
+} vision_stage_clock_t;
+
+// free slots go capture -> infer -> encode -> back to capture
+static vision_frame_t frames[VISION_PIPELINE_FRAMES];
+static spsc_queue_t free_frames;
+static spsc_queue_t infer_queue;
+static spsc_queue_t encode_queue;
+static vision_stage_clock_t stages[VISION_STAGE_COUNT];
+static vision_pipeline_stats_t pipeline;
+
+static TaskHandle_t vision_task_handle = NULL;
+static TaskHandle_t capture_task_handle = NULL;
+static TaskHandle_t encode_task_handle = NULL;
+
+// ----- FUNCTIONS --------------------------------
+
+/* recognized owner — single green line, intruder — single red message */
+static void draw_identity(fb_data_t *fb, const track_identity_t *identity)
+{
+    if (identity->id >= 0) {
+        rgb_printf(fb, FACE_COLOR_GREEN, "ID[%u]: %.2f", identity->id, identity->similarity);
+    } else {
+        rgb_print(fb, FACE_COLOR_RED, "Intruder Alert!");
+    }
+}
+
+
+/* log data for a new identity episode, the alarm is raised by intruder_episode.cpp */
+static void report_identity(const track_identity_t *identity)
+{
+    if (identity->id >= 0) {
+        send_to_database(false, identity->id, identity->similarity);
+    } else {
+        send_to_database(true, -1, identity->similarity);
+    }
+}
+
+
+/*
+    Runs facial recognition
+    Takes the face image tensor (full frame or crop) and matching keypoints, text goes onto fb.
+    One embedding per call: enrolling adds it to the gallery as a template of the person being
+    enrolled, otherwise it is matched against every template.
+*/
+static int run_face_recognition(fb_data_t *fb, Tensor<uint8_t> &tensor, std::vector<int> &landmarks)
+{
+    // person of the running enroll session and the templates it has so far
+    static int enroll_person = -1;
+    static int enroll_templates = 0;
+    static int64_t last_enroll_time_us = 0;
+    if (!is_enrolling) {
+        enroll_person = -1;
+        enroll_templates = 0;
+    }
+    Tensor<float> &embedding = face_models_recognizer().get_face_emb(tensor, landmarks);
+    if (embedding.get_size() != GALLERY_DIM) {
+        ESP_LOGE(TAG, "unexpected embedding size %d", embedding.get_size());
+        return -1;
+    }
+    if (is_enrolling) {
+        // GALLERY_TEMPLATES_PER_ID captures ENROLL_INTERVAL_MS apart, then the session is complete
+        int64_t now_us = esp_timer_get_time();
+        if (enroll_templates < GALLERY_TEMPLATES_PER_ID && now_us - last_enroll_time_us >= (int64_t)ENROLL_INTERVAL_MS * 1000) {
+            int id = gallery_enroll(embedding.get_element_ptr(), enroll_person);
+            last_enroll_time_us = now_us;
+            if (id < 0) {
+                snprintf(enroll_msg_text, sizeof(enroll_msg_text), "Gallery full");
+            } else {
+                enroll_person = id;
+                enroll_templates++;
+                ESP_LOGI(TAG, "Enrolled ID: %d (template %d/%d)", id, enroll_templates, GALLERY_TEMPLATES_PER_ID);
+                snprintf(enroll_msg_text, sizeof(enroll_msg_text), "ID[%d] enrolled %d/%d", id, enroll_templates, GALLERY_TEMPLATES_PER_ID);
+            }
+            // delay a little to slow down enrolling and verify that identity has been enrolled
+            show_enroll_msg = true;
+            enroll_msg_until_us = esp_timer_get_time() + (int64_t)ENROLL_MSG_DURATION_MS * 1000;
+            rgb_print(fb, FACE_COLOR_CYAN, enroll_msg_text);
+            return id;
+        }
+        return enroll_person;
+    }
+
+    gallery_match_t match;
+    gallery_match(embedding.get_element_ptr(), &match);
+    track_identity_t identity = { match.id, match.similarity };
+    // log / alert once per tracked person, not once per frame
+    if (face_tracker_set_front_identity(&identity)) {
+        report_identity(&identity);
+    }
+    draw_identity(fb, &identity);
+    return match.id;
+}
+
+
+/* recognition on a full BGR888 frame */
+static int run_face_recognition_frame(fb_data_t *fb, std::list<dl::detect::result_t> *results)
+{
+    std::vector<int> landmarks = results->front().keypoint;
+    // Turns framebuffer into a Tensor object to put into the NN
+    Tensor<uint8_t> tensor;
+    tensor.set_element((uint8_t *)fb->data).set_shape({fb->height, fb->width, 3}).set_auto_free(false);
+    return run_face_recognition(fb, tensor, landmarks);
+}
+
+
+/* recognition on just the padded face box, taken from the RGB565 frame before anything is drawn
+   on it or from the full-resolution JPEG of a cascade frame */
+static int run_face_recognition_crop(fb_data_t *fb, const uint8_t *src, size_t len, pixformat_t format,
+                                     int width, int height, std::list<dl::detect::result_t> *results)
+{
+    dl::detect::result_t &face = results->front();
+    face_crop_t crop;
+    if (!face_crop_region(face.box, width, height, &crop)) return 0;
+    pool_buf_t *buf = frame_pool_get(FRAME_POOL_CROP);
+    if (!buf || (size_t)crop.out_width * crop.out_height * 3 > buf->cap ||
+        !face_crop_extract(src, len, format, width, height, &crop, buf->data)) {
+        frame_pool_put(buf);
+        return 0;
+    }
+    std::vector<int> landmarks = face_crop_landmarks(face.keypoint, &crop);
+    Tensor<uint8_t> tensor;
+    tensor.set_element(buf->data).set_shape({crop.out_height, crop.out_width, 3}).set_auto_free(false);
+    int id = run_face_recognition(fb, tensor, landmarks);
+    frame_pool_put(buf);
+    return id;
+}
+
+
+/* copy the motion region rows into a contiguous buffer the detector can take */
+static bool copy_region(const uint8_t *src, int frame_width, size_t bytes_per_pixel, const motion_region_t *region, pool_buf_t *dst)
+{
+    size_t row = (size_t)region->width * bytes_per_pixel;
+    if (!dst || row * region->height > dst->cap) return false;
+    const uint8_t *p = src + ((size_t)region->y * frame_width + region->x) * bytes_per_pixel;
+    for (int y = 0; y < region->height; y++, p += (size_t)frame_width * bytes_per_pixel) {
+        memcpy(dst->data + y * row, p, row);
+    }
+    dst->len = row * region->height;
+    return true;
+}
+
+
+/* two-stage detection on detection frames (feeds the tracker), predicted tracks otherwise.
+   pixels hold the frame at 1/scale; results and tracks are always in full-frame coordinates.
+   With a motion region smaller than the frame only that region is searched. */
+template <typename T>
+static std::list<dl::detect::result_t> *detect_or_track(HumanFaceDetectMSR01 &s1, HumanFaceDetectMNP01 &s2,
+                                                        T *pixels, int width, int height, int scale, bool full,
+                                                        const motion_region_t *region)
+{
+    if (!full) {
+        return &face_tracker_predict(width, height);
+    }
+    int64_t t0 = esp_timer_get_time();
+    T *input = pixels;
+    int in_width = width / scale, in_height = height / scale;
+    motion_region_t scaled = { region->x / scale, region->y / scale, region->width / scale, region->height / scale };
+    int x0 = 0, y0 = 0;
+    pool_buf_t *roi = NULL;
+    if (scaled.width > 0 && scaled.height > 0 && (scaled.width < in_width || scaled.height < in_height)) {
+        roi = frame_pool_get(FRAME_POOL_RGB);
+        size_t bytes_per_pixel = (sizeof(T) == 2) ? 2 : 3;
+        if (copy_region((const uint8_t *)pixels, in_width, bytes_per_pixel, &scaled, roi)) {
+            input = (T *)roi->data;
+            in_width = scaled.width;
+            in_height = scaled.height;
+            x0 = scaled.x;
+            y0 = scaled.y;
+        }
+    }
+    std::list<dl::detect::result_t> &candidates = s1.infer(input, {in_height, in_width, 3});
+    std::list<dl::detect::result_t> &results = s2.infer(input, {in_height, in_width, 3}, candidates);
+    frame_pool_put(roi);
+    if (x0 || y0 || scale > 1) {
+        // back to full-frame coordinates
+        for (std::list<dl::detect::result_t>::iterator r = results.begin(); r != results.end(); r++) {
+            for (size_t i = 0; i + 1 < r->box.size(); i += 2) {
+                r->box[i] = (r->box[i] + x0) * scale;
+                r->box[i + 1] = (r->box[i + 1] + y0) * scale;
+            }
+            for (size_t i = 0; i + 1 < r->keypoint.size(); i += 2) {
+                r->keypoint[i] = (r->keypoint[i] + x0) * scale;
+                r->keypoint[i + 1] = (r->keypoint[i + 1] + y0) * scale;
+            }
+        }
+    }
+    face_tracker_update(results, (uint32_t)(esp_timer_get_time() - t0), width, height);
+    return &results;
+}
+
+
+/* label from the identity cache of the tracked face, no recognizer pass */
+static int show_cached_identity(fb_data_t *fb)
+{
+    track_identity_t identity;
+    if (is_enrolling) {
+        return face_tracker_front_label();
+    }
+    if (!recognition_enabled || !face_tracker_front_identity(&identity)) {
+        return 0;
+    }
+    draw_identity(fb, &identity);
+    return identity.id;
+}
+
+
+/* feed the episode aggregator when the front face is an intruder, cached or freshly recognized.
+   Returns the episode when this frame should become its snapshot. */
+static const intruder_episode_t *observe_intruder(uint32_t frame_index, std::list<dl::detect::result_t> *results)
+{
+    track_identity_t identity;
+    if (is_enrolling || !recognition_enabled || !face_tracker_front_identity(&identity) || identity.id >= 0) {
+        return NULL;
+    }
+    metrics_count(METRIC_INTRUDER_FRAMES);
+    return intruder_episode_observe(frame_index, identity.similarity, results->front().score);
+}
+
+
+/* Keep enrollment message on screen for N ms */
+static void draw_enroll_msg(fb_data_t *fb)
+{
+    if (show_enroll_msg) {
+        if (esp_timer_get_time() < enroll_msg_until_us) {
+            // redisplay enrolled message
+            rgb_print(fb, FACE_COLOR_CYAN, enroll_msg_text);
+        } else {
+            show_enroll_msg = false; // stop displaying
+        }
+    }
+}
+
+
+/* one frame of work done by a stage, occupancy refreshed once a second */
+static void stage_done(vision_stage_t stage, int64_t t0, int64_t t1)
+{
+    vision_stage_clock_t *c = &stages[stage];
+    uint32_t us = (uint32_t)(t1 - t0);
+    c->stats.frames++;
+    c->stats.avg_us = (c->stats.frames == 1) ? us : c->stats.avg_us + ((float)us - c->stats.avg_us) * 0.2f;
+    c->window_busy += us;
+    if (!c->window_start) c->window_start = t0;
+    if (t1 - c->window_start >= 1000000) {
+        c->stats.occupancy = (float)c->window_busy / (t1 - c->window_start);
+        c->window_start = t1;
+        c->window_busy = 0;
+    }
+}
+
+
+/* time a stage spent starved (in) or held back by the next one (out) */
+static void stage_waited(vision_stage_t stage, bool out, int64_t t0, int64_t t1)
+{
+    uint64_t *total = out ? &stages[stage].stats.wait_out_us : &stages[stage].stats.wait_in_us;
+    *total += t1 - t0;
+}
+
+
+/* cascade frame: the smallest 1/2, 1/4 or 1/8 decode that fits the detector width, plus the
+   sensor JPEG for the full-resolution face crop and the stream */
+static bool capture_cascade(vision_frame_t *f, camera_fb_t *fb)
+{
+    int scale = 2;
+    while (fb->width / scale > VISION_MAX_DETECT_WIDTH && scale < 8) {
+        scale *= 2;
+    }
+    size_t out_len = (size_t)(fb->width / scale) * (fb->height / scale) * 3;
+    f->jpg = frame_pool_get(FRAME_POOL_JPEG);
+    if (!f->pixels || !f->jpg || out_len > f->pixels->cap || fb->len > f->jpg->cap) {
+        return false;
+    }
+    memcpy(f->jpg->data, fb->buf, fb->len);
+    f->jpg->len = fb->len;
+    int64_t t0 = esp_timer_get_time();
+    trace_begin(TRACE_CONVERT);
+    bool s = face_crop_decode_scaled(fb->buf, fb->len, fb->width, fb->height, scale, f->pixels->data);
+    trace_end(TRACE_CONVERT);
+    if (!s) {
+        ESP_LOGE(TAG, "1/%d decode failed", scale);
+        return false;
+    }
+    f->pixels->len = out_len;
+    f->format = PIXFORMAT_RGB888;
+    f->scale = scale;
+    capture_profile_note_scaled(scale, (uint32_t)(esp_timer_get_time() - t0));
+    return true;
+}
+
+
+/* pixels for the next stages, all in pooled buffers so the camera frame goes back right away.
+   False when a needed buffer is missing: the frame is dropped, a stage never waits for the pool. */
+static bool capture_convert(vision_frame_t *f, camera_fb_t *fb)
+{
+    if (f->gate) {
+        f->pixels = frame_pool_get(FRAME_POOL_RGB);
+        if (fb->format == PIXFORMAT_RGB565) {
+            // raw RGB565 from the analysis profile: detect on it directly, recognize on a face crop
+            if (!f->pixels || fb->len > f->pixels->cap) return false;
+            memcpy(f->pixels->data, fb->buf, fb->len);
+            f->pixels->len = fb->len;
+            f->format = PIXFORMAT_RGB565;
+            capture_profile_note_skipped();
+            return true;
+        }
+        if (fb->format == PIXFORMAT_JPEG && fb->width > VISION_MAX_DETECT_WIDTH) {
+            return capture_cascade(f, fb);
+        }
+        // JPEG frame - full decode needed for detection
+        size_t out_len = (size_t)fb->width * fb->height * 3;
+        if (!f->pixels || out_len > f->pixels->cap) {
+            ESP_LOGE(TAG, "no pooled rgb buffer for %ux%u", (uint32_t)fb->width, (uint32_t)fb->height);
+            return false;
+        }
+        int64_t t0 = esp_timer_get_time();
+        trace_begin(TRACE_CONVERT);
+        jpeg_decoder_take();
+        bool s = fmt2rgb888(fb->buf, fb->len, fb->format, f->pixels->data);
+        jpeg_decoder_give();
+        trace_end(TRACE_CONVERT);
+        if (!s) {
+            ESP_LOGE(TAG, "to rgb888 failed");
+            return false;
+        }
+        f->pixels->len = out_len;
+        f->format = PIXFORMAT_RGB888;
+        capture_profile_note_convert(fb->format, (uint32_t)(esp_timer_get_time() - t0));
+        return true;
+    }
+    // no detection on this frame, faster camera stream
+    if (!f->publish && !f->record) return true;
+    frame_pool_kind_t kind = (fb->format == PIXFORMAT_JPEG) ? FRAME_POOL_JPEG : FRAME_POOL_RGB;
+    pool_buf_t *buf = frame_pool_get(kind);
+    if (!buf || fb->len > buf->cap) {
+        frame_pool_put(buf);
+        return false;
+    }
+    memcpy(buf->data, fb->buf, fb->len);
+    buf->len = fb->len;
+    if (kind == FRAME_POOL_JPEG) {
+        f->jpg = buf;                    // sensor JPEG, streamed as is
+    } else {
+        f->pixels = buf;
+        f->format = fb->format;
+    }
+    return true;
+}
+
+
+/* stage 1, core 0: camera (or session replay) -> motion gate -> pixels for the detector */
+static void capture_task(void *arg)
+{
+    vision_frame_t *f = NULL;
+    bool analysing = false;
+    uint32_t frame_index = 0;
+    while (true)
+    {
+        bool analyse = detection_enabled || is_enrolling;
+        bool publish = stream_broadcast_clients() > 0;
+        // intruder clips need the frames leading up to an episode, so encode while analysing
+        bool record = analyse && clip_recorder_enabled();
+        if (!analyse) {
+            motion_gate_reset();
+        }
+        // nobody needs frames: leave the camera alone
+        if (!analyse && !publish)
+        {
+            analysing = false;
+            vTaskDelay(pdMS_TO_TICKS(VISION_IDLE_POLL_MS));
+            continue;
+        }
+        // a free frame slot before reading the camera: a slow stage holds the camera back
+        // instead of queueing stale frames, and a replay at max pace loses nothing
+        if (!f) {
+            int64_t t_wait = esp_timer_get_time();
+            f = (vision_frame_t *)spsc_queue_pop(&free_frames, pdMS_TO_TICKS(VISION_IDLE_POLL_MS));
+            stage_waited(VISION_STAGE_CAPTURE, false, t_wait, esp_timer_get_time());
+            if (!f) continue;
+        }
+        // raw pixels while analysing, sensor JPEG for plain streaming
+        capture_profile_update(analyse);
+        trace_begin(TRACE_CAPTURE);
+        camera_fb_t *fb = session_fb_get();     // the camera, or a recorded session being replayed
+        trace_end(TRACE_CAPTURE);
+        if (!fb)
+        {
+            ESP_LOGE(TAG, "Camera capture failed");
+            metrics_count(METRIC_CAPTURE_FAILURES);
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        int64_t t0 = esp_timer_get_time();
+        memset(f, 0, sizeof(*f));
+        f->frame_index = ++frame_index;
+        f->timestamp.tv_sec = fb->timestamp.tv_sec;
+        f->timestamp.tv_usec = fb->timestamp.tv_usec;
+        f->width = fb->width;
+        f->height = fb->height;
+        f->scale = 1;
+        f->analyse = analyse;
+        f->restart = analyse && !analysing;
+        analysing = analyse;
+        f->publish = publish;
+        f->record = record;
+        f->t_start = t0;
+        session_record_frame(fb, t0);
+        // still scene: skip the detector and stream the frame as is
+        f->region = { 0, 0, (int)fb->width, (int)fb->height };
+        bool detectable = fb->width <= VISION_MAX_DETECT_WIDTH || (VISION_CASCADE && fb->format == PIXFORMAT_JPEG);
+        if (analyse && detectable)
+        {
+            f->gate = is_enrolling || motion_gate_check(fb->buf, fb->len, fb->format, fb->width, fb->height,
+                                                        face_tracker_active_tracks() > 0, &f->region);
+        }
+        bool ok = capture_convert(f, fb);
+        session_fb_return(fb);
+        f->t_ready = esp_timer_get_time();
+        stage_done(VISION_STAGE_CAPTURE, t0, f->t_ready);
+        if (!ok) {
+            frame_pool_put(f->pixels);
+            frame_pool_put(f->jpg);
+            pipeline.drops++;
+            metrics_count(METRIC_PIPELINE_DROPS);
+            continue;                    // keep the slot for the next frame
+        }
+        spsc_queue_push(&infer_queue, f, portMAX_DELAY);
+        stage_waited(VISION_STAGE_CAPTURE, true, f->t_ready, esp_timer_get_time());
+        f = NULL;
+    }
+}
+
+
+/* detect (or track), recognize and annotate one frame in place.
+   Cascade frames stream the sensor JPEG, so nothing is drawn on their scaled pixels. */
+static void infer_frame(vision_frame_t *f, HumanFaceDetectMSR01 &s1, HumanFaceDetectMNP01 &s2)
+{
+    bool rgb565 = f->format == PIXFORMAT_RGB565;
+    bool cascade = f->scale > 1;
+    fb_data_t rfb;
+    rfb.width = f->width / f->scale;
+    rfb.height = f->height / f->scale;
+    rfb.data = f->pixels->data;
+    rfb.bytes_per_pixel = rgb565 ? 2 : 3;
+    rfb.format = rgb565 ? FB_RGB565 : FB_BGR888;
+    // full detection every N frames, tracked boxes in between
+    bool full = face_tracker_should_detect();
+    trace_begin(TRACE_DETECT);
+    std::list<dl::detect::result_t> *results = rgb565
+        ? detect_or_track(s1, s2, (uint16_t *)f->pixels->data, f->width, f->height, 1, full, &f->region)
+        : detect_or_track(s1, s2, (uint8_t *)f->pixels->data, f->width, f->height, f->scale, full, &f->region);
+    trace_end(TRACE_DETECT);
+    f->t_face = esp_timer_get_time();
+    f->t_recognize = f->t_face;
+    if (results->size() > 0) {
+        f->detected = true;
+        // recognizer only on detection frames whose track has no trusted identity yet
+        if (full && (is_enrolling || (recognition_enabled && face_tracker_front_needs_recognition()))) {
+            trace_begin(TRACE_RECOGNIZE);
+            if (cascade) {
+                f->face_id = run_face_recognition_crop(&rfb, f->jpg->data, f->jpg->len, PIXFORMAT_JPEG, f->width, f->height, results);
+            } else if (rgb565) {
+                f->face_id = run_face_recognition_crop(&rfb, rfb.data, (size_t)f->width * f->height * 2, PIXFORMAT_RGB565,
+                                                       f->width, f->height, results);
+            } else {
+                f->face_id = run_face_recognition_frame(&rfb, results);
+            }
+            trace_end(TRACE_RECOGNIZE);
+            f->t_recognize = esp_timer_get_time();
+            f->recognized = true;
+        } else {
+            f->face_id = show_cached_identity(&rfb);
+        }
+        const intruder_episode_t *best = observe_intruder(f->frame_index, results);
+        if (best) {
+            f->snapshot = true;
+            f->episode = *best;
+        }
+        if (!cascade && (f->publish || f->record || f->snapshot)) {
+            draw_face_boxes(&rfb, results, f->face_id);
+        }
+    }
+    if (!cascade) draw_enroll_msg(&rfb);
+}
+
+
+/* stage 2, core 1: detection, tracking, recognition and episodes; the only user of the models */
+static void vision_task(void *arg)
+{
+    // long-lived, already warmed-up detectors (face_models.cpp)
+    HumanFaceDetectMSR01 &s1 = face_models_msr01();
+    HumanFaceDetectMNP01 &s2 = face_models_mnp01();
+    while (true)
+    {
+        intruder_episode_tick();
+        trace_sync();
+        int64_t t_wait = esp_timer_get_time();
+        vision_frame_t *f = (vision_frame_t *)spsc_queue_pop(&infer_queue, pdMS_TO_TICKS(VISION_IDLE_POLL_MS));
+        int64_t t0 = esp_timer_get_time();
+        stage_waited(VISION_STAGE_INFER, false, t_wait, t0);
+        if (!f) {
+            if (!detection_enabled && !is_enrolling) face_tracker_reset();
+            continue;
+        }
+        if (!f->analyse || f->restart) {
+            face_tracker_reset();
+        }
+        f->t_infer = t0;
+        if (f->gate) {
+            infer_frame(f, s1, s2);
+        }
+        int64_t t1 = esp_timer_get_time();
+        stage_done(VISION_STAGE_INFER, t0, t1);
+        spsc_queue_push(&encode_queue, f, portMAX_DELAY);
+        stage_waited(VISION_STAGE_INFER, true, t1, esp_timer_get_time());
+    }
+}
+
+
+/* stage 3, core 0: JPEG encode, then hand the frame to viewers, clip ring and snapshot */
+static void encode_task(void *arg)
+{
+    int64_t last_frame = esp_timer_get_time();
+    while (true)
+    {
+        int64_t t_wait = esp_timer_get_time();
+        vision_frame_t *f = (vision_frame_t *)spsc_queue_pop(&encode_queue, portMAX_DELAY);
+        int64_t t0 = esp_timer_get_time();
+        stage_waited(VISION_STAGE_ENCODE, false, t_wait, t0);
+        if (!f) continue;
+        // the stream's JPEG doubles as clip frame and snapshot, encoded without viewers only for those
+        bool encoded = false;
+        if (!f->jpg && f->pixels && (f->publish || f->record || f->snapshot)) {
+            if (!f->publish && !f->record) snapshot_note_extra_encode();
+            uint8_t quality = (f->format == PIXFORMAT_RGB888) ? 90 : 80;
+            f->jpg = frame_pool_get(FRAME_POOL_JPEG);
+            if (f->jpg && !frame_pool_encode_jpeg(f->pixels->data, f->pixels->len, f->width, f->height, f->format, quality, f->jpg)) {
+                ESP_LOGE(TAG, "fmt2jpg failed");
+                frame_pool_put(f->jpg);
+                f->jpg = NULL;
+            }
+            encoded = f->jpg != NULL;
+        }
+        frame_pool_put(f->pixels);
+        f->pixels = NULL;
+        f->t_encode = esp_timer_get_time();
+        uint32_t encode_us = (uint32_t)(f->t_encode - t0);
+        size_t jpg_len = 0;
+        // hand the encoded frame to the viewers, encoded once no matter how many are attached
+        if (f->jpg)
+        {
+            jpg_len = f->jpg->len;
+            if (f->record) {
+                clip_recorder_push(f->jpg->data, f->jpg->len, f->width, f->height, f->t_start);
+            }
+            if (f->snapshot) {
+                snapshot_hold(f->jpg, &f->episode);   // its own reference, no copy
+            }
+            if (f->publish) {
+                stream_broadcast_publish_owned(f->jpg, &f->timestamp, encode_us);
+            } else {
+                frame_pool_put(f->jpg);
+            }
+            f->jpg = NULL;
+        }
+        int64_t fr_end = esp_timer_get_time();
+        stage_done(VISION_STAGE_ENCODE, t0, fr_end);
+        uint32_t ready_us = f->gate ? (uint32_t)(f->t_ready - f->t_start) : 0;
+        uint32_t detect_us = f->gate ? (uint32_t)(f->t_face - f->t_infer) : 0;
+        uint32_t recognize_us = f->recognized ? (uint32_t)(f->t_recognize - f->t_face) : 0;
+        uint32_t process_us = (uint32_t)(f->t_encode - f->t_start);
+        metrics_count(METRIC_FRAMES);
+        if (f->detected) metrics_count(METRIC_DETECTIONS);
+        if (f->gate) {
+            metrics_record(METRIC_STAGE_READY, ready_us);
+            metrics_record(METRIC_STAGE_DETECT, detect_us);
+        }
+        if (f->recognized) {
+            metrics_count(METRIC_RECOGNITIONS);
+            metrics_record(METRIC_STAGE_RECOGNIZE, recognize_us);
+        }
+        if (encoded) metrics_record(METRIC_STAGE_ENCODE, encode_us);
+        metrics_record(METRIC_STAGE_PROCESS, process_us);
+        metrics_record(METRIC_STAGE_FRAME, (uint32_t)(fr_end - last_frame));
+        session_note_frame(f->detected, f->face_id, ready_us, detect_us, recognize_us, encoded ? encode_us : 0, process_us);
+        pipeline.frames++;
+        float fps = (fr_end > last_frame) ? 1000000.0f / (fr_end - last_frame) : 0;
+        pipeline.fps = (pipeline.frames == 1) ? fps : pipeline.fps + (fps - pipeline.fps) * 0.1f;
+#if VISION_FRAME_LOG
+        int64_t frame_time = (fr_end - last_frame) / 1000;
+        if (frame_time < 1) frame_time = 1;
+        ESP_LOGI(TAG, "MJPG: %uB %ums (%.1ffps)"
+                      ", %u+%u+%u+%u=%u %s%d", (uint32_t)jpg_len,
+                 (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time,
+                 ready_us / 1000, detect_us / 1000, recognize_us / 1000, encode_us / 1000, process_us / 1000,
+                 (f->detected) ? "DETECTED " : "", f->face_id);
+#else
+        (void)jpg_len;
+#endif
+        last_frame = fr_end;
+        spsc_queue_push(&free_frames, f, portMAX_DELAY);
+    }
+}
+
+
+/* size the frame pools and the clip ring, build and warm up the models at the configured frame size, then start the pipeline stages */
+void vision_task_init(void)
+{
+    if (vision_task_handle) return;
+    jpeg_decoder_init();
+    stream_broadcast_init();
+    sensor_t *sensor = esp_camera_sensor_get();
+    framesize_t framesize = sensor ? sensor->status.framesize : FRAMESIZE_QVGA;
+    frame_pool_init(VISION_JPEG_BUFS, resolution[framesize].width, resolution[framesize].height);
+    clip_recorder_init();
+    face_models_init(resolution[framesize].width, resolution[framesize].height);
+    spsc_queue_init(&free_frames, VISION_PIPELINE_FRAMES);
+    spsc_queue_init(&infer_queue, VISION_PIPELINE_FRAMES);
+    spsc_queue_init(&encode_queue, VISION_PIPELINE_FRAMES);
+    for (int i = 0; i < VISION_PIPELINE_FRAMES; i++) {
+        spsc_queue_push(&free_frames, &frames[i], 0);
+    }
+    free_frames.producer = NULL;       // filled from here, the encode stage pushes from now on
+    stages[VISION_STAGE_CAPTURE].stats.core = VISION_CAPTURE_CORE;
+    stages[VISION_STAGE_INFER].stats.core = VISION_TASK_CORE;
+    stages[VISION_STAGE_ENCODE].stats.core = VISION_ENCODE_CORE;
+    xTaskCreatePinnedToCore(encode_task, "vision_encode", VISION_ENCODE_STACK, NULL, VISION_ENCODE_PRIORITY, &encode_task_handle, VISION_ENCODE_CORE);
+    xTaskCreatePinnedToCore(vision_task, "vision_task", VISION_TASK_STACK, NULL, VISION_TASK_PRIORITY, &vision_task_handle, VISION_TASK_CORE);
+    xTaskCreatePinnedToCore(capture_task, "vision_capture", VISION_CAPTURE_STACK, NULL, VISION_CAPTURE_PRIORITY, &capture_task_handle, VISION_CAPTURE_CORE);
+}
+
+
+/* enrolled face count, used by recompute_face_state */
+int vision_enrolled_count(void)
+{
+    return gallery_person_count();
+}
+
+
+void vision_get_pipeline_stats(vision_pipeline_stats_t *out)
+{
+    *out = pipeline;
+    for (int i = 0; i < VISION_STAGE_COUNT; i++) {
+        out->stage[i] = stages[i].stats;
+    }
+    out->infer_queue_high_water = infer_queue.high_water;
+    out->encode_queue_high_water = encode_queue.high_water;
+    out->backpressure_waits = free_frames.full_waits + infer_queue.full_waits + encode_queue.full_waits;
+}
@@ -0,0 +1,46 @@
+#ifndef VISION_TASK_H
+#define VISION_TASK_H
+
+#include <stdint.h>
+
+// frames in flight, one per stage; the capture stage waits for a free one before reading the camera
+#ifndef VISION_PIPELINE_FRAMES
+#define VISION_PIPELINE_FRAMES 3
+#endif
+
+typedef enum {
+    VISION_STAGE_CAPTURE = 0,      // capture, motion gate, decode / copy into a pooled buffer (core 0)
+    VISION_STAGE_INFER,            // detection, tracking, recognition, annotation (core 1)
+    VISION_STAGE_ENCODE,           // JPEG encode, publish, clip ring, snapshot (core 0)
+    VISION_STAGE_COUNT
+} vision_stage_t;
+
+typedef struct {
+    int core;
+    uint32_t frames;
+    float avg_us;                  // work per frame
+    float occupancy;               // busy share of the last second
+    uint64_t wait_in_us;           // starved: waiting for a frame (capture: for a free slot)
+    uint64_t wait_out_us;          // blocked on a full queue downstream
+} vision_stage_stats_t;
+
+typedef struct {
+    vision_stage_stats_t stage[VISION_STAGE_COUNT];
+    uint32_t frames;               // through all three stages
+    uint32_t drops;                // no pooled buffer at capture, the frame never entered the pipeline
+    float fps;
+    uint32_t infer_queue_high_water;
+    uint32_t encode_queue_high_water;
+    uint32_t backpressure_waits;   // pushes that found the next queue full
+} vision_pipeline_stats_t;
+
+/* Build and warm up the face models, then start the always-on capture, inference and encode stages */
+void vision_task_init(void);
+
+/* Number of persons currently enrolled in the gallery */
+int vision_enrolled_count(void);
+
+/* Per-stage occupancy and queue depth of the pipeline */
+void vision_get_pipeline_stats(vision_pipeline_stats_t *stats);
+
+#endif
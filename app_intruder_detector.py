@@ -1,144 +1,256 @@
-from flask import Flask, request, jsonify
-import psycopg2
-from datetime import datetime, timedelta, timezone
-from flask_cors import CORS
-
-app = Flask(__name__)
-CORS(app)
-
-def get_db_connection():
-    return psycopg2.connect(
-        database="intruder_detection",
-        user="postgres",
-        # hiding the password for now 
-        password="************",
-        host="127.0.0.1",
-        port="5432"
-    )
-
-# posting all of the data on intruder status, confidence, and face_id info to intruder_data table
-@app.route('/create', methods=['POST'])
-def create():
-    conn = get_db_connection()
-    cur = conn.cursor()
-    data = request.get_json()
-
-    if not data:
-        return jsonify({"error": "No JSON received"}), 400
-
-
-    if isinstance(data, dict):
-        data = [data]
-
-    for row in data:
-        # all data sent to the server must be in JSON format 
-        # endpoint is http://54.167.124.79:5000/create - I am running this from an EC2 instance
-        intruder_status = row.get("intruder_status")
-        face_id = row.get("face_id")
-        confidence = row.get("confidence")
-        if intruder_status is None:
-            continue  
-
-        cur.execute(
-            "INSERT INTO intruder_data (intruder_status, face_id, confidence) VALUES (%s, %s, %s)",
-            (intruder_status, face_id, confidence)
-        )
-
-    conn.commit()
-    cur.close()
-    conn.close()
-
-    return jsonify({"message": f"row inserted successfully"}), 201
-
-# getting all of the data inserted in the last give minutes, so the data can be plotted in plotly 
-@app.route('/recent', methods=['GET'])
-def get_recent():
-    """
-    Get all rows inserted in the last 5 minutes - we only want the most recent data 
-    """
-    conn = get_db_connection()
-    cur = conn.cursor()
-
-    five_min_ago = datetime.now(timezone.utc) - timedelta(minutes=5)
-
-    cur.execute(
-        "SELECT intruder_status, face_id, confidence, timestamp FROM intruder_data WHERE timestamp >= %s ORDER BY timestamp ASC",
-        (five_min_ago,)
-    )
-
-    rows = cur.fetchall()
-    cur.close()
-    conn.close()
-
-    # formatting the JSON GET request
-
-    data = [
-        {
-            "intruder_status": r[0],
-            "face_id": r[1],
-            "confidence": r[2],
-            "timestamp": r[3].isoformat()
-        } for r in rows
-    ]
-
-    return jsonify(data), 200
-# getting the device heartbeat
-@app.route('/status', methods=['GET'])
-def get_status():
-    """
-    Get the device's current status every minute - if it's on and connected to wifi
-    """
-    conn = get_db_connection()
-    cur = conn.cursor()
-
-    one_min_ago = datetime.now(timezone.utc) - timedelta(minutes=1)
-    cur.execute(
-        "SELECT created_at, status FROM device_status WHERE created_at >= %s ORDER BY created_at ASC",
-        (one_min_ago,)
-    )
-
-    rows = cur.fetchall()
-    cur.close()
-    conn.close()
-    data = [
-        {
-            "created_at": r[0].isoformat(),
-            "status": r[1]
-        } for r in rows
-    ]
-
-    return jsonify(data), 200
-# posting the device heartbeat
-@app.route('/status_create', methods=['POST'])
-def create_status():
-    conn = get_db_connection()
-    cur = conn.cursor()
-    data = request.get_json()
-
-    if not data:
-        return jsonify({"error": "No JSON received"}), 400
-
-
-    if isinstance(data, dict):
-        data = [data]
-
-    for row in data:
-        # all data sent to the server must be in JSON format 
-        # endpoint is http://54.167.124.79:5000/status_create 
-        status_value = row.get("status")
-        if status_value is None:
-            continue  
-
-        cur.execute(
-            "INSERT INTO device_status (status) VALUES (%s)",
-            (status_value,)
-        )
-
-    conn.commit()
-    cur.close()
-    conn.close()
-
-    return jsonify({"message": f"row inserted successfully"}), 201
-
-if __name__ == '__main__':
-    app.run(host='0.0.0.0', port=5000)
+from flask import Flask, request, jsonify, Response
+import psycopg2
+import struct
+from datetime import datetime, timedelta, timezone
+from flask_cors import CORS
+from werkzeug.serving import WSGIRequestHandler
+
+app = Flask(__name__)
+CORS(app)
+
+def get_db_connection():
+    return psycopg2.connect(
+        database="intruder_detection",
+        user="postgres",
+        # hiding the password for now 
+        password="************",
+        host="127.0.0.1",
+        port="5432"
+    )
+
+# rows replayed from the ESP32 outbox carry their original time: "ts" (epoch seconds) or "age_ms"
+def row_time(row):
+    if row.get("ts"):
+        return datetime.fromtimestamp(row["ts"], timezone.utc)
+    if row.get("age_ms") is not None:
+        return datetime.now(timezone.utc) - timedelta(milliseconds=row["age_ms"])
+    return None
+
+# binary batches from the ESP32 (event_codec.h): 4 byte header 'EV' version count, then 14 byte records
+EVENT_CONTENT_TYPE = "application/x-intruder-events"
+SNAPSHOT_CONTENT_TYPE = "application/x-intruder-snapshot"
+EVENT_HEADER = struct.Struct("<2sBB")
+EVENT_RECORD = struct.Struct("<BBhhII")
+EVENT_FLAG_INTRUDER, EVENT_FLAG_TS, EVENT_FLAG_AGE, EVENT_FLAG_SEQ = 0x01, 0x02, 0x04, 0x08
+
+def decode_events(data):
+    magic, version, count = EVENT_HEADER.unpack_from(data, 0)
+    if magic != b"EV" or version != 1 or len(data) < EVENT_HEADER.size + count * EVENT_RECORD.size:
+        raise ValueError("bad event batch")
+    rows = []
+    for i in range(count):
+        kind, flags, face_id, confidence_e4, seq, time = EVENT_RECORD.unpack_from(data, EVENT_HEADER.size + i * EVENT_RECORD.size)
+        row = {"type": kind, "face_id": face_id, "confidence": confidence_e4 / 10000.0}
+        if kind == 1:
+            row["intruder_status"] = bool(flags & EVENT_FLAG_INTRUDER)
+        else:
+            row["status"] = True
+        if flags & EVENT_FLAG_SEQ:
+            row["seq"] = seq
+        if flags & EVENT_FLAG_TS:
+            row["ts"] = time
+        elif flags & EVENT_FLAG_AGE:
+            row["age_ms"] = time
+        rows.append(row)
+    return rows
+
+# JSON object / array, or a binary event batch
+def request_rows():
+    if request.content_type == EVENT_CONTENT_TYPE:
+        try:
+            return decode_events(request.get_data())
+        except (ValueError, struct.error):
+            return None
+    return request.get_json()
+
+# posting all of the data on intruder status, confidence, and face_id info to intruder_data table
+@app.route('/create', methods=['POST'])
+def create():
+    conn = get_db_connection()
+    cur = conn.cursor()
+    data = request_rows()
+
+    if not data:
+        return jsonify({"error": "No data received"}), 400
+
+
+    if isinstance(data, dict):
+        data = [data]
+
+    for row in data:
+        # data sent to the server is JSON or an event_codec binary batch
+        # endpoint is http://54.167.124.79:5000/create - I am running this from an EC2 instance
+        intruder_status = row.get("intruder_status")
+        face_id = row.get("face_id")
+        confidence = row.get("confidence")
+        if intruder_status is None:
+            continue  
+
+        when = row_time(row)
+        if when is None:
+            cur.execute(
+                "INSERT INTO intruder_data (intruder_status, face_id, confidence) VALUES (%s, %s, %s)",
+                (intruder_status, face_id, confidence)
+            )
+        else:
+            cur.execute(
+                "INSERT INTO intruder_data (intruder_status, face_id, confidence, timestamp) VALUES (%s, %s, %s, %s)",
+                (intruder_status, face_id, confidence, when)
+            )
+
+    conn.commit()
+    cur.close()
+    conn.close()
+
+    return jsonify({"message": f"row inserted successfully"}), 201
+
+# getting all of the data inserted in the last give minutes, so the data can be plotted in plotly 
+@app.route('/recent', methods=['GET'])
+def get_recent():
+    """
+    Get all rows inserted in the last 5 minutes - we only want the most recent data 
+    """
+    conn = get_db_connection()
+    cur = conn.cursor()
+
+    five_min_ago = datetime.now(timezone.utc) - timedelta(minutes=5)
+
+    cur.execute(
+        "SELECT intruder_status, face_id, confidence, timestamp, snapshot_id FROM intruder_data WHERE timestamp >= %s ORDER BY timestamp ASC",
+        (five_min_ago,)
+    )
+
+    rows = cur.fetchall()
+    cur.close()
+    conn.close()
+
+    # formatting the JSON GET request
+
+    data = [
+        {
+            "intruder_status": r[0],
+            "face_id": r[1],
+            "confidence": r[2],
+            "timestamp": r[3].isoformat(),
+            "snapshot_id": r[4]
+        } for r in rows
+    ]
+
+    return jsonify(data), 200
+# getting the device heartbeat
+@app.route('/status', methods=['GET'])
+def get_status():
+    """
+    Get the device's current status every minute - if it's on and connected to wifi
+    """
+    conn = get_db_connection()
+    cur = conn.cursor()
+
+    one_min_ago = datetime.now(timezone.utc) - timedelta(minutes=1)
+    cur.execute(
+        "SELECT created_at, status FROM device_status WHERE created_at >= %s ORDER BY created_at ASC",
+        (one_min_ago,)
+    )
+
+    rows = cur.fetchall()
+    cur.close()
+    conn.close()
+    data = [
+        {
+            "created_at": r[0].isoformat(),
+            "status": r[1]
+        } for r in rows
+    ]
+
+    return jsonify(data), 200
+# posting the device heartbeat
+@app.route('/status_create', methods=['POST'])
+def create_status():
+    conn = get_db_connection()
+    cur = conn.cursor()
+    data = request_rows()
+
+    if not data:
+        return jsonify({"error": "No data received"}), 400
+
+
+    if isinstance(data, dict):
+        data = [data]
+
+    for row in data:
+        # all data sent to the server must be in JSON format 
+        # endpoint is http://54.167.124.79:5000/status_create 
+        status_value = row.get("status")
+        if status_value is None:
+            continue  
+
+        when = row_time(row)
+        if when is None:
+            cur.execute(
+                "INSERT INTO device_status (status) VALUES (%s)",
+                (status_value,)
+            )
+        else:
+            cur.execute(
+                "INSERT INTO device_status (status, created_at) VALUES (%s, %s)",
+                (status_value, when)
+            )
+
+    conn.commit()
+    cur.close()
+    conn.close()
+
+    return jsonify({"message": f"row inserted successfully"}), 201
+
+# intruder episode snapshot: one event record (seq = episode, time = episode start) followed by the JPEG
+# stored in intruder_snapshots and linked to the intruder row closest to the episode start
+SNAPSHOT_LINK_WINDOW = timedelta(seconds=5)
+
+@app.route('/snapshot', methods=['POST'])
+def create_snapshot():
+    data = request.get_data()
+    header_len = EVENT_HEADER.size + EVENT_RECORD.size
+    if request.content_type != SNAPSHOT_CONTENT_TYPE or len(data) <= header_len:
+        return jsonify({"error": "No snapshot received"}), 400
+    try:
+        row = decode_events(data[:header_len])[0]
+    except (ValueError, struct.error):
+        return jsonify({"error": "Bad snapshot header"}), 400
+    started = row_time(row) or datetime.now(timezone.utc)
+
+    conn = get_db_connection()
+    cur = conn.cursor()
+    cur.execute(
+        "INSERT INTO intruder_snapshots (episode, started_at, confidence, image) VALUES (%s, %s, %s, %s) RETURNING id",
+        (row.get("seq"), started, row["confidence"], psycopg2.Binary(data[header_len:]))
+    )
+    snapshot_id = cur.fetchone()[0]
+    cur.execute(
+        "UPDATE intruder_data SET snapshot_id = %s WHERE ctid = ("
+        " SELECT ctid FROM intruder_data WHERE intruder_status AND snapshot_id IS NULL"
+        " AND timestamp BETWEEN %s AND %s"
+        " ORDER BY abs(extract(epoch FROM timestamp - %s)) LIMIT 1)",
+        (snapshot_id, started - SNAPSHOT_LINK_WINDOW, started + SNAPSHOT_LINK_WINDOW, started)
+    )
+    conn.commit()
+    cur.close()
+    conn.close()
+
+    return jsonify({"snapshot_id": snapshot_id}), 201
+
+@app.route('/snapshot/<int:snapshot_id>', methods=['GET'])
+def get_snapshot(snapshot_id):
+    conn = get_db_connection()
+    cur = conn.cursor()
+    cur.execute("SELECT image FROM intruder_snapshots WHERE id = %s", (snapshot_id,))
+    row = cur.fetchone()
+    cur.close()
+    conn.close()
+    if row is None:
+        return jsonify({"error": "No such snapshot"}), 404
+    return Response(bytes(row[0]), mimetype="image/jpeg")
+
+if __name__ == '__main__':
+    # HTTP/1.1 so the ESP32 can keep one connection open between posts (keep-alive)
+    WSGIRequestHandler.protocol_version = "HTTP/1.1"
+    app.run(host='0.0.0.0', port=5000, threaded=True)
@@ -0,0 +1,339 @@
+/*
+bench_host.cpp
+the portable frame-processing kernels timed on a Linux host, same corpus and report layout as the
+on-device /bench (bench.cpp): face crop conversion from RGB565 and RGB888, face box and text
+annotation, recompute_face_state and the scalar gallery search at 7, 100 and 500 ids. /bench
+stays the place for the JPEG codec and the PIE dot product.
+  bench_host [--iterations N] [--format json|text] [--baseline report.json [--tolerance pct]]
+With a baseline every kernel slower than it by more than the tolerance (default 10 %) is listed
+and the exit code is 1; frame kernels compare their fastest pass, the gallery its mean.
+*/
+
+#include "frame_annotate.h"
+#include "face_crop.h"
+#include "jpeg_decoder.h"
+#include "face_state.h"
+#include "gallery_search.h"
+#include "vision_task.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#define BENCH_ITERATIONS 200
+#define BENCH_FACES 3
+#define BENCH_GALLERY_QUERIES 20       // gallery searches per iteration
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    bool noisy;
+    uint8_t *rgb565;
+    uint8_t *rgb888;
+    uint8_t *out;                  // conversion target
+    std::list<dl::detect::result_t> faces;
+} bench_frame_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(bench_frame_t *f);
+} bench_kernel_t;
+
+typedef struct {
+    std::string kernel;
+    std::string frame;
+    double ns;
+    double min_ns;
+    double bytes;
+    float pruned;                  // gallery rows only, < 0 otherwise
+} bench_row_t;
+
+static int iterations = BENCH_ITERATIONS;
+static std::vector<bench_row_t> rows;
+
+// ----- FUNCTIONS --------------------------------
+
+/* the vision task's enrolled count, so recompute_face_state keeps the PIR requests */
+int vision_enrolled_count(void)
+{
+    return 1;
+}
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* the whole frame as one crop, step 1 */
+static face_crop_t bench_full_frame(bench_frame_t *f)
+{
+    face_crop_t c = { 0, 0, f->width, f->height, 1, f->width, f->height };
+    return c;
+}
+
+
+static void kernel_rgb565_to_bgr888(bench_frame_t *f)
+{
+    face_crop_t c = bench_full_frame(f);
+    face_crop_extract(f->rgb565, f->width * f->height * 2, PIXFORMAT_RGB565, f->width, f->height, &c, f->rgb888);
+}
+
+
+static void kernel_rgb888_copy(bench_frame_t *f)
+{
+    face_crop_t c = bench_full_frame(f);
+    face_crop_extract(f->rgb888, f->width * f->height * 3, PIXFORMAT_RGB888, f->width, f->height, &c, f->out);
+}
+
+
+static void kernel_crop_rgb565(bench_frame_t *f)
+{
+    face_crop_t c;
+    if (!face_crop_region(f->faces.front().box, f->width, f->height, &c)) return;
+    face_crop_extract(f->rgb565, f->width * f->height * 2, PIXFORMAT_RGB565, f->width, f->height, &c, f->out);
+}
+
+
+static void bench_fb(bench_frame_t *f, fb_data_t *fb, bool rgb565)
+{
+    fb->width = f->width;
+    fb->height = f->height;
+    fb->data = rgb565 ? f->out : f->rgb888;
+    fb->bytes_per_pixel = rgb565 ? 2 : 3;
+    fb->format = rgb565 ? FB_RGB565 : FB_BGR888;
+}
+
+
+static void kernel_draw_face_boxes(bench_frame_t *f)
+{
+    fb_data_t fb;
+    bench_fb(f, &fb, false);
+    draw_face_boxes(&fb, &f->faces, -1);
+}
+
+
+static void kernel_draw_face_boxes_565(bench_frame_t *f)
+{
+    fb_data_t fb;
+    bench_fb(f, &fb, true);
+    draw_face_boxes(&fb, &f->faces, 2);
+}
+
+
+static void kernel_rgb_printf(bench_frame_t *f)
+{
+    fb_data_t fb;
+    bench_fb(f, &fb, false);
+    rgb_printf(&fb, FACE_COLOR_GREEN, "ID[%u]: %.2f", 3, 0.87f);
+}
+
+
+// run order matters: the RGB888 kernels work on what the conversion produced
+static const bench_kernel_t kernels[] = {
+    { "rgb565_to_bgr888", kernel_rgb565_to_bgr888 },
+    { "rgb888_copy", kernel_rgb888_copy },
+    { "crop_rgb565", kernel_crop_rgb565 },
+    { "draw_face_boxes", kernel_draw_face_boxes },
+    { "draw_face_boxes_565", kernel_draw_face_boxes_565 },
+    { "rgb_printf", kernel_rgb_printf },
+};
+
+
+/* same frames as bench.cpp: gradient or fixed-seed noise over a gradient, RGB565 big endian */
+static void bench_fill(bench_frame_t *f)
+{
+    uint32_t seed = 0x2545F491;
+    for (int y = 0; y < f->height; y++) {
+        for (int x = 0; x < f->width; x++) {
+            int r = x * 31 / f->width, g = y * 63 / f->height, b = ((x + y) >> 3) & 31;
+            if (f->noisy) {
+                seed = seed * 1664525u + 1013904223u;
+                r = (r + (seed >> 28)) & 31;
+                g = (g + ((seed >> 22) & 31)) & 63;
+                b = (b + ((seed >> 16) & 15)) & 31;
+            }
+            uint16_t px = (r << 11) | (g << 5) | b;
+            uint8_t *p = f->rgb565 + (y * f->width + x) * 2;
+            p[0] = px >> 8;
+            p[1] = px & 0xFF;
+        }
+    }
+    for (int i = 0; i < BENCH_FACES; i++) {
+        dl::detect::result_t r;
+        int w = f->width / 5, x = f->width / 10 + i * f->width * 3 / 10, y = f->height / 4;
+        r.category = 0;
+        r.score = 0.9f;
+        r.box = { x, y, x + w, y + w };
+        r.keypoint = { x + w / 3, y + w / 3, x + w / 3, y + w * 3 / 4, x + w / 2, y + w / 2,
+                       x + w * 2 / 3, y + w / 3, x + w * 2 / 3, y + w * 3 / 4 };
+        f->faces.push_back(r);
+    }
+}
+
+
+/* time one kernel, mean and fastest pass in ns, net heap change per pass */
+static void bench_measure(const char *kernel, const char *frame, void (*run)(bench_frame_t *), bench_frame_t *f)
+{
+    int64_t total = 0, fastest = INT64_MAX;
+    run(f);
+    size_t heap0 = mallinfo2().uordblks;
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = now_ns();
+        run(f);
+        int64_t ns = now_ns() - t0;
+        total += ns;
+        if (ns < fastest) fastest = ns;
+    }
+    double bytes = ((double)mallinfo2().uordblks - heap0) / iterations;
+    rows.push_back({ kernel, frame, (double)total / iterations, (double)fastest, bytes, -1 });
+}
+
+
+static void kernel_face_state(bench_frame_t *f)
+{
+    recompute_face_state();
+}
+
+
+static bool bench_gallery(int persons)
+{
+    gallery_record_t *records = (gallery_record_t *)aligned_alloc(16, persons * sizeof(gallery_record_t));
+    gallery_record_t *queries = (gallery_record_t *)aligned_alloc(16, GALLERY_BENCH_QUERIES * sizeof(gallery_record_t));
+    gallery_set_t set = { (const gallery_record_t **)malloc(persons * sizeof(set.tpl[0])), 0, persons };
+    bool ok = records && queries && set.tpl;
+    if (ok) {
+        gallery_bench_t result;
+        gallery_search_bench(&set, records, queries, iterations * BENCH_GALLERY_QUERIES, false, &result);
+        char frame[16];
+        snprintf(frame, sizeof(frame), "ids_%d", persons);
+        rows.push_back({ "gallery_match_scalar", frame, (double)result.search_ns, -1, -1, result.pruned });
+    }
+    free(records);
+    free(queries);
+    free(set.tpl);
+    return ok;
+}
+
+
+static void bench_print(bool json)
+{
+    if (json) {
+        printf("{\"iterations\":%d,\"cpu_mhz\":0,\"host\":true,\"results\":[", iterations);
+    } else {
+        printf("%d iterations on the host\n%-20s %-12s %12s %12s %10s\n", iterations, "kernel", "frame", "ns/frame", "min ns", "bytes");
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        const bench_row_t *r = &rows[i];
+        if (json && r->pruned >= 0) {
+            printf("%s{\"kernel\":\"%s\",\"frame\":\"%s\",\"ns_per_frame\":%.0f,\"pruned\":%.2f}",
+                   i ? "," : "", r->kernel.c_str(), r->frame.c_str(), r->ns, r->pruned);
+        } else if (json) {
+            printf("%s{\"kernel\":\"%s\",\"frame\":\"%s\",\"ns_per_frame\":%.0f,\"min_ns\":%.0f,\"bytes_per_frame\":%.0f}",
+                   i ? "," : "", r->kernel.c_str(), r->frame.c_str(), r->ns, r->min_ns, r->bytes);
+        } else if (r->pruned >= 0) {
+            printf("%-20s %-12s %12.0f %12s %10s pruned %.2f\n", r->kernel.c_str(), r->frame.c_str(), r->ns, "-", "-", r->pruned);
+        } else {
+            printf("%-20s %-12s %12.0f %12.0f %10.0f\n", r->kernel.c_str(), r->frame.c_str(), r->ns, r->min_ns, r->bytes);
+        }
+    }
+    printf(json ? "]}\n" : "");
+}
+
+
+/* time of kernel/frame in a JSON report, < 0 if it has no such row: the fastest pass where the
+   row has one (far steadier than the mean on a shared machine), ns_per_frame otherwise */
+static double baseline_ns(const std::string &report, const bench_row_t *r)
+{
+    std::string key = "\"kernel\":\"" + r->kernel + "\",\"frame\":\"" + r->frame + "\",";
+    size_t at = report.find(key);
+    if (at == std::string::npos) return -1;
+    size_t end = report.find('}', at);
+    const char *field = (r->min_ns >= 0) ? "\"min_ns\":" : "\"ns_per_frame\":";
+    size_t value = report.find(field, at);
+    return (value == std::string::npos || value > end) ? -1 : atof(report.c_str() + value + strlen(field));
+}
+
+
+/* kernels slower than the baseline by more than tolerance percent, listed on stderr */
+static int bench_compare(const char *path, double tolerance)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot read baseline %s\n", path);
+        return -1;
+    }
+    std::string report;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) report.append(chunk, n);
+    fclose(f);
+    int regressions = 0;
+    for (const bench_row_t &r : rows) {
+        double base = baseline_ns(report, &r);
+        if (base <= 0) continue;
+        double ns = (r.min_ns >= 0) ? r.min_ns : r.ns;
+        double change = (ns - base) * 100.0 / base;
+        if (change > tolerance) {
+            fprintf(stderr, "regression: %s %s %.0f ns, baseline %.0f ns (%+.1f %%)\n",
+                    r.kernel.c_str(), r.frame.c_str(), ns, base, change);
+            regressions++;
+        }
+    }
+    fprintf(stderr, "%d of %zu kernels slower than %s by more than %.0f %%\n", regressions, rows.size(), path, tolerance);
+    return regressions;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool json = true;
+    const char *baseline = NULL;
+    double tolerance = 10;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--iterations") == 0) iterations = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--format") == 0) json = strcmp(argv[i + 1], "text") != 0;
+        else if (strcmp(argv[i], "--baseline") == 0) baseline = argv[i + 1];
+        else if (strcmp(argv[i], "--tolerance") == 0) tolerance = atof(argv[i + 1]);
+    }
+    if (iterations < 1) iterations = 1;
+    jpeg_decoder_init();                 // face_crop takes it for JPEG sources, as on the device
+    static bench_frame_t frames[] = {
+        { "qvga_smooth", 320, 240, false, NULL, NULL, NULL, {} },
+        { "qvga_noisy", 320, 240, true, NULL, NULL, NULL, {} },
+        { "vga_smooth", 640, 480, false, NULL, NULL, NULL, {} },
+        { "vga_noisy", 640, 480, true, NULL, NULL, NULL, {} },
+    };
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        bench_frame_t *f = &frames[i];
+        f->rgb565 = (uint8_t *)malloc(f->width * f->height * 2);
+        f->rgb888 = (uint8_t *)malloc(f->width * f->height * 3);
+        f->out = (uint8_t *)malloc(f->width * f->height * 3);
+        if (!f->rgb565 || !f->rgb888 || !f->out) return 2;
+        bench_fill(f);
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            bench_measure(kernels[k].name, f->name, kernels[k].run, f);
+        }
+        free(f->rgb565);
+        free(f->rgb888);
+        free(f->out);
+        f->faces.clear();
+    }
+    detection_via_pir = true;
+    recognition_via_pir = true;
+    bench_measure("recompute_face_state", "none", kernel_face_state, NULL);
+    static const int gallery_sizes[] = { 7, 100, 500 };
+    for (size_t i = 0; i < sizeof(gallery_sizes) / sizeof(gallery_sizes[0]); i++) {
+        if (!bench_gallery(gallery_sizes[i])) return 2;
+    }
+    bench_print(json);
+    if (baseline) return bench_compare(baseline, tolerance) == 0 ? 0 : 1;
+    return 0;
+}
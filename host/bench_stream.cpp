@@ -0,0 +1,274 @@
+/*
+bench_stream.cpp
+producer cost of the /stream fan-out on a Linux host: stream_broadcast.cpp as is, each viewer
+served by its own sender task (a thread here) and main() in the vision task's place. For 1 to
+STREAM_MAX_CLIENTS viewers it publishes a series of JPEG-sized frames and times
+stream_broadcast_publish_owned, which is all the producer pays per frame however many viewers
+there are. A viewer's "socket" copies every chunk into a buffer of its own, as lwIP copies into
+its send buffers, so the senders compete for memory bandwidth the way they do on the device.
+  bench_stream [--frames N] [--frame-bytes N] [--interval-us N] [--format json|text]
+*/
+
+#include "stream_broadcast.h"
+#include "frame_pool.h"
+#include "freertos/task.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+
+#define BENCH_FRAMES 500
+#define BENCH_FRAME_BYTES (24 * 1024)  // a VGA JPEG at the sketch's default quality
+#define BENCH_INTERVAL_US 1000         // between frames, so the senders get to run
+#define BENCH_SOCKET_BYTES (64 * 1024)
+#define BENCH_LEAVE_MS 2000            // viewers must be gone this long after their socket fails
+
+// the JPEG pool: one buffer per viewer in flight, the latest, the one being published, spare
+#define BENCH_POOL_BUFS (STREAM_MAX_CLIENTS + 4)
+
+typedef struct {
+    httpd_req_t req;
+    uint8_t *socket;
+    size_t socket_len;
+    std::atomic<bool> closing;
+} bench_viewer_t;
+
+typedef struct {
+    int viewers;
+    double ns;
+    double min_ns;
+    uint32_t sent;                 // frames sent, all viewers
+    uint32_t dropped;              // frames a viewer skipped because it was still sending
+    uint32_t failed;               // publishes without a free frame slot
+} bench_row_t;
+
+static pool_buf_t pool_bufs[BENCH_POOL_BUFS];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t pool_misses = 0;
+static bench_viewer_t viewers[STREAM_MAX_CLIENTS];
+
+// ----- FUNCTIONS --------------------------------
+
+/* frame_pool.cpp stand-in: JPEG buffers only, heap instead of PSRAM */
+pool_buf_t *frame_pool_get(frame_pool_kind_t kind)
+{
+    pool_buf_t *buf = NULL;
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < BENCH_POOL_BUFS && !buf; i++) {
+        if (pool_bufs[i].refs == 0) buf = &pool_bufs[i];
+    }
+    if (buf) buf->refs = 1;
+    else pool_misses++;
+    pthread_mutex_unlock(&pool_lock);
+    return buf;
+}
+
+
+void frame_pool_ref(pool_buf_t *buf)
+{
+    pthread_mutex_lock(&pool_lock);
+    buf->refs++;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+
+void frame_pool_put(pool_buf_t *buf)
+{
+    if (!buf) return;
+    pthread_mutex_lock(&pool_lock);
+    buf->refs--;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+
+/* esp_http_server.h stand-ins: every request is one simulated viewer socket */
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    bench_viewer_t *v = (bench_viewer_t *)req->user_ctx;
+    if (v->closing) return ESP_FAIL;
+    while (len > 0) {
+        size_t n = BENCH_SOCKET_BYTES - v->socket_len;
+        if (n > (size_t)len) n = len;
+        memcpy(v->socket + v->socket_len, buf, n);
+        v->socket_len = (v->socket_len + n) % BENCH_SOCKET_BYTES;
+        buf += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *req, httpd_req_t **out)
+{
+    *out = req;
+    return ESP_OK;
+}
+
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *req)
+{
+    return ESP_OK;
+}
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* one publish as the vision task does it: borrow a pooled JPEG, hand it over */
+static int64_t bench_publish(size_t frame_bytes)
+{
+    pool_buf_t *jpg = frame_pool_get(FRAME_POOL_JPEG);
+    if (!jpg) return -1;
+    jpg->len = frame_bytes;
+    struct timeval timestamp;
+    gettimeofday(&timestamp, NULL);
+    int64_t t0 = now_ns();
+    stream_broadcast_publish_owned(jpg, &timestamp, 0);
+    return now_ns() - t0;
+}
+
+
+/* attach count viewers, publish frames, detach them again */
+static bool bench_run(int count, int frames, size_t frame_bytes, int interval_us, bench_row_t *row)
+{
+    stream_producer_stats_t producer;
+    stream_client_stats_t clients[STREAM_MAX_CLIENTS];
+    stream_broadcast_get_stats(&producer, clients);
+    uint32_t failed0 = producer.publish_failed;
+    for (int i = 0; i < count; i++) {
+        viewers[i].closing = false;
+        if (stream_broadcast_add_client(&viewers[i].req) != ESP_OK) return false;
+    }
+    int64_t total = 0, fastest = INT64_MAX;
+    int timed = 0;
+    for (int f = 0; f < frames; f++) {
+        int64_t ns = bench_publish(frame_bytes);
+        if (ns >= 0) {
+            total += ns;
+            if (ns < fastest) fastest = ns;
+            timed++;
+        }
+        usleep(interval_us);
+    }
+    stream_broadcast_get_stats(&producer, clients);
+    row->viewers = count;
+    row->ns = timed ? (double)total / timed : 0;
+    row->min_ns = timed ? (double)fastest : 0;
+    row->sent = 0;
+    row->dropped = 0;
+    row->failed = producer.publish_failed - failed0 + (frames - timed);
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        if (!clients[i].active) continue;
+        row->sent += clients[i].frames_sent;
+        row->dropped += clients[i].frames_dropped;
+    }
+    // the viewers' next send fails: one more frame wakes the ones waiting for it
+    for (int i = 0; i < count; i++) viewers[i].closing = true;
+    bench_publish(frame_bytes);
+    for (int waited = 0; stream_broadcast_clients() > 0; waited++) {
+        if (waited >= BENCH_LEAVE_MS) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+
+static void bench_print(const std::vector<bench_row_t> &rows, int frames, size_t frame_bytes, bool json)
+{
+    if (json) {
+        printf("{\"frames\":%d,\"frame_bytes\":%u,\"host\":true,\"results\":[", frames, (uint32_t)frame_bytes);
+    } else {
+        printf("%d frames of %u bytes on the host\n%-16s %-10s %10s %10s %8s %8s %8s\n", frames, (uint32_t)frame_bytes,
+               "kernel", "frame", "ns/frame", "min ns", "sent", "dropped", "failed");
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        const bench_row_t *r = &rows[i];
+        if (json) {
+            printf("%s{\"kernel\":\"stream_publish\",\"frame\":\"viewers_%d\",\"ns_per_frame\":%.0f,\"min_ns\":%.0f,"
+                   "\"sent\":%u,\"dropped\":%u,\"failed\":%u}",
+                   i ? "," : "", r->viewers, r->ns, r->min_ns, r->sent, r->dropped, r->failed);
+        } else {
+            char frame[16];
+            snprintf(frame, sizeof(frame), "viewers_%d", r->viewers);
+            printf("%-16s %-10s %10.0f %10.0f %8u %8u %8u\n", "stream_publish", frame, r->ns, r->min_ns,
+                   r->sent, r->dropped, r->failed);
+        }
+    }
+    printf(json ? "]}\n" : "");
+}
+
+
+int main(int argc, char **argv)
+{
+    bool json = true;
+    int frames = BENCH_FRAMES;
+    int interval_us = BENCH_INTERVAL_US;
+    size_t frame_bytes = BENCH_FRAME_BYTES;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--frames") == 0) frames = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--frame-bytes") == 0) frame_bytes = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--interval-us") == 0) interval_us = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--format") == 0) json = strcmp(argv[i + 1], "text") != 0;
+    }
+    if (frames < 1) frames = 1;
+    if (frame_bytes < 1) frame_bytes = 1;
+    for (int i = 0; i < BENCH_POOL_BUFS; i++) {
+        pool_bufs[i].data = (uint8_t *)malloc(frame_bytes);
+        pool_bufs[i].cap = frame_bytes;
+        pool_bufs[i].kind = FRAME_POOL_JPEG;
+        if (!pool_bufs[i].data) return 2;
+        memset(pool_bufs[i].data, 0x5A, frame_bytes);
+    }
+    for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+        viewers[i].req.user_ctx = &viewers[i];
+        viewers[i].socket = (uint8_t *)malloc(BENCH_SOCKET_BYTES);
+        if (!viewers[i].socket) return 2;
+    }
+    host_tasks_run(true);
+    stream_broadcast_init();
+    std::vector<bench_row_t> rows;
+    for (int count = 1; count <= STREAM_MAX_CLIENTS; count++) {
+        bench_row_t row;
+        if (!bench_run(count, frames, frame_bytes, interval_us, &row)) {
+            fprintf(stderr, "%d viewers: attach or detach failed\n", count);
+            return 1;
+        }
+        rows.push_back(row);
+    }
+    bench_print(rows, frames, frame_bytes, json);
+    if (pool_misses) fprintf(stderr, "%u publishes found the JPEG pool empty\n", pool_misses);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""
+Round trip of the binary event format from the C encoder into the server's decode_events():
+runs test_event_codec --emit, decodes batch.bin with decode_events() taken out of
+app_intruder_detector.py (without importing Flask or psycopg2) and compares every row with
+expected.json. Truncated and foreign batches must raise.
+
+  check_event_codec.py <test_event_codec binary> <app_intruder_detector.py>
+"""
+
+import ast
+import json
+import struct
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+def load_decoder(server_py):
+    # only the EVENT_* constants and decode_events() itself
+    tree = ast.parse(Path(server_py).read_text(), server_py)
+    keep = []
+    for node in tree.body:
+        if isinstance(node, ast.FunctionDef) and node.name == "decode_events":
+            keep.append(node)
+        elif isinstance(node, ast.Assign):
+            names = [n.id for t in node.targets for n in ast.walk(t) if isinstance(n, ast.Name)]
+            if names and all(n.startswith("EVENT_") for n in names):
+                keep.append(node)
+    scope = {"struct": struct}
+    exec(compile(ast.Module(body=keep, type_ignores=[]), server_py, "exec"), scope)
+    return scope["decode_events"]
+
+
+def main():
+    binary, server_py = sys.argv[1], sys.argv[2]
+    decode_events = load_decoder(server_py)
+    failures = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        subprocess.run([binary, "--emit", tmp], check=True)
+        data = (Path(tmp) / "batch.bin").read_bytes()
+        expected = json.loads((Path(tmp) / "expected.json").read_text())
+
+    rows = decode_events(data)
+    if len(rows) != len(expected):
+        print(f"{len(rows)} rows decoded, {len(expected)} expected")
+        failures += 1
+    for i, (row, want) in enumerate(zip(rows, expected)):
+        want = dict(want)
+        e4 = want.pop("confidence_e4")
+        got = dict(row)
+        confidence = got.pop("confidence")
+        if round(confidence * 10000) != e4 or got != want:
+            print(f"row {i}: decoded {row}, expected {want} with confidence_e4 {e4}")
+            failures += 1
+
+    for name, bad in (("truncated", data[:-1]), ("foreign magic", b"XX" + data[2:]),
+                      ("version", data[:2] + b"\x02" + data[3:]), ("header only", data[:3])):
+        try:
+            decode_events(bad)
+        except (ValueError, struct.error):
+            continue
+        print(f"{name} batch was accepted")
+        failures += 1
+
+    print(f"check_event_codec: {len(rows)} rows, {'FAILED' if failures else 'ok'}")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
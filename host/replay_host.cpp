@@ -0,0 +1,289 @@
+/*
+replay_host.cpp
+the decision half of a session replay on a Linux host: face_tracker.cpp, intruder_episode.cpp
+and event_codec.cpp as they are, driven frame by frame the way vision_task.cpp drives them,
+with the esp-dl detector and recognizer replaced by a script. Each scripted frame lists the
+faces the detector finds and the verdict the recognizer gives each of them; the tracker still
+decides which frames are detected and which are predicted, and when a face is recognized again.
+The results are the JSON lines of a device replay (frames, identity, episode and alert events),
+so session_tool.py diff compares a host run against a device replay of the same scene. Identity
+events are also encoded into the binary /create batches telemetry would upload.
+  replay_host [scenario.txt] [--detect-us N] [--expect-episodes N]
+Scenario lines, '#' starts a comment, faces in full-frame pixels of a REPLAY_WIDTH x REPLAY_HEIGHT
+frame, id -1 for a stranger:
+  t_ms [x0 y0 x1 y1 score id similarity]...
+Without a file a built-in scene runs: the owner walks through, then a stranger who steps out of
+view briefly (one episode) and comes back after a long gap (a second one).
+*/
+
+#include "face_tracker.h"
+#include "intruder_episode.h"
+#include "intruder_task.h"
+#include "session.h"
+#include "event_codec.h"
+#include "telemetry.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#define REPLAY_WIDTH 320
+#define REPLAY_HEIGHT 240
+#define REPLAY_DETECT_US 60000         // cost the scripted detector reports, sets the tracker's interval
+#define REPLAY_FRAME_MS 100            // built-in scene: 10 fps
+
+// one face the scripted detector finds, with the recognizer's verdict on it
+typedef struct {
+    int box[4];
+    float score;
+    int id;
+    float similarity;
+} replay_face_t;
+
+typedef struct {
+    uint32_t t_ms;
+    std::vector<replay_face_t> faces;
+} replay_frame_t;
+
+typedef struct {
+    uint32_t identities;
+    uint32_t episode_starts;
+    uint32_t episode_ends;
+    uint32_t alerts;
+    uint32_t batches;              // binary /create batches
+    uint32_t batch_bytes;
+} replay_counts_t;
+
+static int64_t clock_us = 0;
+static replay_counts_t counts;
+static uint8_t batch[EVENT_CODEC_HEADER_LEN + TELEMETRY_BATCH_MAX * EVENT_CODEC_RECORD_LEN];
+static event_encoder_t encoder;
+
+// ----- FUNCTIONS --------------------------------
+
+/* session.cpp stand-ins: the replay clock is the scripted frame time, results go to stdout */
+session_state_t session_state(void)
+{
+    return SESSION_REPLAYING;
+}
+
+
+int64_t session_clock_us(void)
+{
+    return clock_us;
+}
+
+
+void session_note(const char *format, ...)
+{
+    va_list arg;
+    va_start(arg, format);
+    printf("{\"t_ms\":%u,", (uint32_t)(clock_us / 1000));
+    vprintf(format, arg);
+    printf("}\n");
+    va_end(arg);
+}
+
+
+/* intruder_task.cpp stand-in: an episode start raises the alert, which a replay only notes */
+bool intruder_queue_send(const intruder_episode_t *msg)
+{
+    if (msg->transition == EPISODE_START) {
+        counts.episode_starts++;
+        counts.alerts++;
+        session_note("\"event\":\"alert\"");
+    } else {
+        counts.episode_ends++;
+    }
+    return true;
+}
+
+
+/* what went into the current /create batch is posted once it is full or the replay ends */
+static void replay_flush_batch(void)
+{
+    if (encoder.count == 0) return;
+    counts.batches++;
+    counts.batch_bytes += event_codec_finish(&encoder);
+    event_codec_begin(&encoder, batch, sizeof(batch));
+}
+
+
+/* send_to_database in a replay, plus the record telemetry would have queued for upload */
+static void replay_report_identity(const track_identity_t *identity)
+{
+    bool intruder = identity->id < 0;
+    counts.identities++;
+    session_note("\"event\":\"identity\",\"intruder\":%d,\"id\":%d,\"similarity\":%.3f", intruder,
+                 identity->id, identity->similarity);
+    event_record_t r = { EVENT_TYPE_RECOGNITION, EVENT_FLAG_AGE, (int16_t)identity->id, identity->similarity, 0, 0 };
+    if (intruder) r.flags |= EVENT_FLAG_INTRUDER;
+    if (!event_codec_put(&encoder, &r)) {
+        replay_flush_batch();
+        event_codec_put(&encoder, &r);
+    }
+    if (encoder.count == TELEMETRY_BATCH_MAX) replay_flush_batch();
+}
+
+
+static dl::detect::result_t replay_result(const replay_face_t *face)
+{
+    dl::detect::result_t r;
+    const int *b = face->box;
+    int w = b[2] - b[0], h = b[3] - b[1];
+    r.category = 0;
+    r.score = face->score;
+    r.box.assign(b, b + 4);
+    // eyes, nose and mouth corners where a frontal face has them
+    r.keypoint = { b[0] + w * 3 / 10, b[1] + h * 4 / 10, b[0] + w * 7 / 10, b[1] + h * 4 / 10,
+                   b[0] + w / 2, b[1] + h * 6 / 10, b[0] + w * 35 / 100, b[1] + h * 8 / 10,
+                   b[0] + w * 65 / 100, b[1] + h * 8 / 10 };
+    return r;
+}
+
+
+/* the scripted recognizer: the verdict of the scripted face under the front box */
+static track_identity_t replay_recognize(const replay_frame_t *frame, const dl::detect::result_t &front)
+{
+    track_identity_t identity = { -1, 0 };
+    int best = -1;
+    for (size_t i = 0; i < frame->faces.size(); i++) {
+        const int *b = frame->faces[i].box;
+        int iw = std::min(b[2], front.box[2]) - std::max(b[0], front.box[0]);
+        int ih = std::min(b[3], front.box[3]) - std::max(b[1], front.box[1]);
+        if (iw > 0 && ih > 0 && iw * ih > best) {
+            best = iw * ih;
+            identity.id = frame->faces[i].id;
+            identity.similarity = frame->faces[i].similarity;
+        }
+    }
+    return identity;
+}
+
+
+/* one frame through detect-or-track, recognition and the episode aggregator, as infer_frame does */
+static void replay_frame(const replay_frame_t *frame, uint32_t index, uint32_t detect_us)
+{
+    clock_us = (int64_t)frame->t_ms * 1000;
+    intruder_episode_tick();
+    static std::list<dl::detect::result_t> detected;
+    std::list<dl::detect::result_t> *results;
+    bool full = face_tracker_should_detect();
+    if (full) {
+        detected.clear();
+        for (size_t i = 0; i < frame->faces.size(); i++) detected.push_back(replay_result(&frame->faces[i]));
+        face_tracker_update(detected, detect_us, REPLAY_WIDTH, REPLAY_HEIGHT);
+        results = &detected;
+    } else {
+        results = &face_tracker_predict(REPLAY_WIDTH, REPLAY_HEIGHT);
+    }
+    int face_id = 0;
+    track_identity_t identity;
+    if (!results->empty()) {
+        if (full && face_tracker_front_needs_recognition()) {
+            identity = replay_recognize(frame, results->front());
+            if (face_tracker_set_front_identity(&identity)) replay_report_identity(&identity);
+            face_id = identity.id;
+        } else if (face_tracker_front_identity(&identity)) {
+            face_id = identity.id;
+        }
+        if (face_tracker_front_identity(&identity) && identity.id < 0) {
+            intruder_episode_observe(index, identity.similarity, results->front().score);
+        }
+    }
+    session_note("\"frame\":%u,\"detected\":%d,\"id\":%d,\"ready_us\":0,\"detect_us\":%u,\"recognize_us\":0,"
+                 "\"encode_us\":0,\"process_us\":0", index, !results->empty(), face_id, full ? detect_us : 0);
+}
+
+
+/* t_ms [x0 y0 x1 y1 score id similarity]... per line */
+static bool replay_load(const char *path, std::vector<replay_frame_t> *frames)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        char *p = strchr(line, '#');
+        if (p) *p = '\0';
+        char *end;
+        replay_frame_t frame;
+        frame.t_ms = (uint32_t)strtoul(line, &end, 10);
+        if (end == line) continue;
+        p = end;
+        while (true) {
+            replay_face_t face;
+            int n = 0;
+            if (sscanf(p, "%d %d %d %d %f %d %f%n", &face.box[0], &face.box[1], &face.box[2], &face.box[3],
+                       &face.score, &face.id, &face.similarity, &n) != 7) break;
+            frame.faces.push_back(face);
+            p += n;
+        }
+        frames->push_back(frame);
+    }
+    fclose(f);
+    return true;
+}
+
+
+/* the owner crosses the frame, a stranger is out of view for 1 s (same episode), then 6 s (a new one) */
+static void replay_builtin(std::vector<replay_frame_t> *frames)
+{
+    for (int i = 0; i < 200; i++) {
+        replay_frame_t frame;
+        frame.t_ms = i * REPLAY_FRAME_MS;
+        bool owner = i < 30;
+        bool stranger = (i >= 40 && i < 70) || (i >= 80 && i < 100) || (i >= 160 && i < 190);
+        if (owner || stranger) {
+            int x = 20 + (i % 40) * 4, y = 70;
+            replay_face_t face = { { x, y, x + 60, y + 72 }, 0.95f, owner ? 1 : -1, owner ? 0.82f : 0.21f };
+            frame.faces.push_back(face);
+        }
+        frames->push_back(frame);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    uint32_t detect_us = REPLAY_DETECT_US;
+    int expect_episodes = -1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--detect-us") == 0 && i + 1 < argc) detect_us = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--expect-episodes") == 0 && i + 1 < argc) expect_episodes = atoi(argv[++i]);
+        else path = argv[i];
+    }
+    std::vector<replay_frame_t> frames;
+    if (path && !replay_load(path, &frames)) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 2;
+    }
+    if (!path) replay_builtin(&frames);
+    event_codec_begin(&encoder, batch, sizeof(batch));
+    for (size_t i = 0; i < frames.size(); i++) {
+        replay_frame(&frames[i], i + 1, detect_us);
+    }
+    // the vision loop keeps ticking after the last frame, so an open episode still ends
+    clock_us += (int64_t)EPISODE_END_GAP_MS * 1000;
+    intruder_episode_tick();
+    replay_flush_batch();
+    session_note("\"event\":\"replay_end\",\"reason\":\"end\",\"frames\":%u,\"events\":0,\"wall_ms\":0,\"fps\":0.00",
+                 (uint32_t)frames.size());
+    face_tracker_stats_t tracker;
+    face_tracker_get_stats(&tracker);
+    fprintf(stderr, "%u frames (%u detected, %u tracked), %u identities, %u episodes, %u alerts, "
+            "%u /create batches of %u bytes\n", (uint32_t)frames.size(), tracker.detect_frames,
+            tracker.tracked_frames, counts.identities, counts.episode_starts, counts.alerts, counts.batches,
+            counts.batch_bytes);
+    if (counts.episode_ends != counts.episode_starts) {
+        fprintf(stderr, "%u episodes started but %u ended\n", counts.episode_starts, counts.episode_ends);
+        return 1;
+    }
+    if (expect_episodes >= 0 && counts.episode_starts != (uint32_t)expect_episodes) {
+        fprintf(stderr, "expected %d episodes\n", expect_episodes);
+        return 1;
+    }
+    return 0;
+}
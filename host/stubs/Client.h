@@ -0,0 +1,41 @@
+#ifndef HOST_CLIENT_H
+#define HOST_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// host stand-in for the Arduino Client/Stream API. read() returning -1 counts as the stream
+// timeout, so the blocking helpers return as soon as the data runs out.
+class Client {
+public:
+    virtual ~Client() {}
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+
+    size_t readBytes(char *buf, size_t len)
+    {
+        size_t n = 0;
+        while (n < len) {
+            int c = read();
+            if (c < 0) break;
+            buf[n++] = (char)c;
+        }
+        return n;
+    }
+
+    size_t readBytesUntil(char terminator, char *buf, size_t len)
+    {
+        size_t n = 0;
+        while (n < len) {
+            int c = read();
+            if (c < 0 || c == terminator) break;
+            buf[n++] = (char)c;
+        }
+        return n;
+    }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include "Client.h"
+
+// host stand-in for the Arduino WiFi library: one scripted server behind every WiFiClient
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class IPAddress {
+public:
+    IPAddress() : addr(0) {}
+    IPAddress(uint32_t a) : addr(a) {}
+    uint32_t addr;
+};
+
+// what the server side does, set up by the test
+struct host_net_t {
+    bool wifi_up = true;
+    int refuse_connects = 0;       // the next n connects fail
+    bool stale = false;            // server has dropped the open connection, the client has not noticed yet
+    std::deque<std::string> responses;   // one per request, served when the client starts reading
+    std::string sent;              // everything the clients wrote
+    int connects = 0;              // successful connects
+    int connect_attempts = 0;
+    int dns_lookups = 0;
+};
+
+extern host_net_t host_net;
+
+/* Back to a reachable server with nothing queued */
+void host_net_reset(void);
+
+class WiFiClass {
+public:
+    int status() { return host_net.wifi_up ? WL_CONNECTED : WL_DISCONNECTED; }
+    bool hostByName(const char *host, IPAddress &ip)
+    {
+        host_net.dns_lookups++;
+        if (!host_net.wifi_up) return false;
+        ip = IPAddress(0x0100007F);
+        return true;
+    }
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client {
+public:
+    int connect(const char *host, uint16_t port, int32_t timeout_ms) { return open_connection(); }
+    int connect(IPAddress ip, uint16_t port) { return open_connection(); }
+    void setNoDelay(bool on) {}
+    void setTimeout(uint32_t seconds) {}
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        if (!open_) return 0;
+        host_net.sent.append((const char *)buf, size);
+        return size;
+    }
+
+    int available() override { return (int)(rx_.size() - pos_); }
+
+    int read() override
+    {
+        if (pos_ == rx_.size()) {
+            rx_.clear();
+            pos_ = 0;
+            if (!open_) return -1;
+            if (host_net.stale || host_net.responses.empty()) {
+                open_ = false;         // reset by the server, or a read timeout
+                return -1;
+            }
+            rx_ = host_net.responses.front();
+            host_net.responses.pop_front();
+        }
+        return (uint8_t)rx_[pos_++];
+    }
+
+    uint8_t connected() override { return open_ || pos_ < rx_.size(); }
+
+    void stop() override
+    {
+        open_ = false;
+        rx_.clear();
+        pos_ = 0;
+    }
+
+protected:
+    int open_connection()
+    {
+        host_net.connect_attempts++;
+        if (!host_net.wifi_up || host_net.refuse_connects > 0) {
+            if (host_net.refuse_connects > 0) host_net.refuse_connects--;
+            return 0;
+        }
+        host_net.connects++;
+        host_net.stale = false;
+        open_ = true;
+        rx_.clear();
+        pos_ = 0;
+        return 1;
+    }
+
+    bool open_ = false;
+    std::string rx_;
+    size_t pos_ = 0;
+};
+
+#endif
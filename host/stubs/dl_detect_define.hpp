@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+
+// host stand-in for esp-dl's detection result
+
+namespace dl {
+namespace detect {
+typedef struct {
+    int category;
+    float score;
+    std::vector<int> box;          // x0, y0, x1, y1
+    std::vector<int> keypoint;     // 5 landmarks as x, y pairs
+} result_t;
+}
+}
@@ -0,0 +1,13 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+// host stand-in for esp_timer.h: monotonic microseconds, plus an offset tests can move forward
+
+int64_t esp_timer_get_time(void);
+
+/* Jump the clock ahead, for backoff and TTL tests */
+void host_clock_advance_ms(uint32_t ms);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+fb_gfx.cpp
+host stand-in for esp32-camera's fb_gfx: rectangles clipped to the frame and written pixel by
+pixel in the frame's byte order, text as 14 pixel wide cells of 2x2 blocks like the real font.
+*/
+
+#include "fb_gfx.h"
+
+#define FB_GFX_ADVANCE 14          // x advance of the real font
+
+// ----- FUNCTIONS --------------------------------
+
+void fb_gfx_fillRect(fb_data_t *fb, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+{
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > fb->width) w = fb->width - x;
+    if (y + h > fb->height) h = fb->height - y;
+    if (w <= 0 || h <= 0) return;
+    uint8_t c0 = color & 0xFF, c1 = (color >> 8) & 0xFF, c2 = (color >> 16) & 0xFF;
+    for (int32_t yy = y; yy < y + h; yy++) {
+        uint8_t *p = fb->data + ((int64_t)yy * fb->width + x) * fb->bytes_per_pixel;
+        for (int32_t xx = 0; xx < w; xx++) {
+            if (fb->bytes_per_pixel == 2) {
+                *p++ = c1;
+                *p++ = c0;
+            } else if (fb->bytes_per_pixel == 3) {
+                *p++ = c0;
+                *p++ = c1;
+                *p++ = c2;
+            } else {
+                *p++ = c0;
+            }
+        }
+    }
+}
+
+
+void fb_gfx_drawFastHLine(fb_data_t *fb, int32_t x, int32_t y, int32_t w, uint32_t color)
+{
+    fb_gfx_fillRect(fb, x, y, w, 1, color);
+}
+
+
+void fb_gfx_drawFastVLine(fb_data_t *fb, int32_t x, int32_t y, int32_t h, uint32_t color)
+{
+    fb_gfx_fillRect(fb, x, y, 1, h, color);
+}
+
+
+uint8_t fb_gfx_putc(fb_data_t *fb, int32_t x, int32_t y, uint32_t color, unsigned char c)
+{
+    uint32_t bits = c * 2654435761u;          // some 5x7 pattern per character
+    for (int row = 0; row < 7; row++) {
+        for (int col = 0; col < 5; col++) {
+            if ((bits >> ((row * 5 + col) % 32)) & 1) fb_gfx_fillRect(fb, x + col * 2, y + row * 2, 2, 2, color);
+        }
+    }
+    return FB_GFX_ADVANCE;
+}
+
+
+uint32_t fb_gfx_print(fb_data_t *fb, int32_t x, int32_t y, uint32_t color, const char *str)
+{
+    uint32_t l = 0;
+    for (; *str; str++, l++) {
+        x += fb_gfx_putc(fb, x, y, color, (unsigned char)*str);
+    }
+    return l;
+}
@@ -0,0 +1,24 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+
+// host stand-in: by default tasks are never started and host tests drive the module functions
+// directly; after host_tasks_run(true) every new task is a thread and notifications wake it
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+/* Start tasks created from now on as threads (host programs that need the module's own tasks) */
+void host_tasks_run(bool run);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+host_stubs.cpp
+implementations behind the host stand-in headers: clock, log, FreeRTOS mutexes, tasks as
+threads on request and the scripted network, plus no-op versions of the sketch modules the tested ones call into (trace) and a JPEG
+decoder that always fails.
+*/
+
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "WiFi.h"
+#include "trace.h"
+#include "esp_jpg_decode.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+struct host_semaphore {
+    pthread_mutex_t mutex;
+};
+
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify;
+};
+
+static int64_t clock_offset_us = 0;
+static pthread_mutex_t critical = PTHREAD_MUTEX_INITIALIZER;
+static bool tasks_run = false;
+static thread_local TaskHandle_t current_task = NULL;
+
+host_net_t host_net;
+WiFiClass WiFi;
+
+// ----- FUNCTIONS --------------------------------
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + clock_offset_us;
+}
+
+
+void host_clock_advance_ms(uint32_t ms)
+{
+    clock_offset_us += (int64_t)ms * 1000;
+}
+
+
+void host_log(char level, const char *tag, const char *format, ...)
+{
+    static const bool enabled = getenv("HOST_LOG") != NULL;
+    if (!enabled) return;
+    va_list arg;
+    va_start(arg, format);
+    fprintf(stderr, "%c %s", level, tag);
+    vfprintf(stderr, format, arg);
+    fputc('\n', stderr);
+    va_end(arg);
+}
+
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    return ESP_LOG_INFO;
+}
+
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+}
+
+
+void host_critical_enter(void)
+{
+    pthread_mutex_lock(&critical);
+}
+
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&critical);
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = (SemaphoreHandle_t)malloc(sizeof(*sem));
+    pthread_mutex_init(&sem->mutex, NULL);
+    return sem;
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    int err = ticks ? pthread_mutex_lock(&sem->mutex) : pthread_mutex_trylock(&sem->mutex);
+    return err == 0 ? pdTRUE : pdFALSE;
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return pthread_mutex_unlock(&sem->mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+
+void host_tasks_run(bool run)
+{
+    tasks_run = run;
+}
+
+
+static void *host_task_thread(void *arg)
+{
+    current_task = (TaskHandle_t)arg;
+    current_task->fn(current_task->arg);
+    return NULL;
+}
+
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    TaskHandle_t task = (TaskHandle_t)malloc(sizeof(*task));
+    task->fn = fn;
+    task->arg = arg;
+    task->notify = 0;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    if (handle) *handle = task;
+    if (tasks_run) {
+        if (pthread_create(&task->thread, NULL, host_task_thread, task) != 0) return pdFAIL;
+        pthread_detach(task->thread);
+    }
+    return pdPASS;
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current_task;
+}
+
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (current_task) usleep(ticks * 1000);
+}
+
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (current_task && (task == NULL || task == current_task)) pthread_exit(NULL);
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    if (!task) return pdFAIL;
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+
+/* outside a task thread there is nobody to wait for: returns 0 at once */
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    TaskHandle_t task = current_task;
+    if (!task) return 0;
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += ticks / 1000;
+    until.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0) {
+        int err = (ticks == portMAX_DELAY) ? pthread_cond_wait(&task->notified, &task->lock)
+                                           : pthread_cond_timedwait(&task->notified, &task->lock, &until);
+        if (err != 0) break;
+    }
+    uint32_t value = task->notify;
+    if (value) task->notify = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+
+void host_net_reset(void)
+{
+    host_net = host_net_t();
+}
+
+
+void trace_record(trace_point_t point, trace_phase_t phase, uint32_t arg)
+{
+}
+
+
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void *arg)
+{
+    return ESP_FAIL;
+}
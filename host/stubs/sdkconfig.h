@@ -0,0 +1,6 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// host stand-in: no IDF target, so target specific code paths (PIE kernels) stay off
+
+#endif
@@ -0,0 +1,113 @@
+/*
+test_alert_client.cpp
+alert_client against the scripted server in stubs/WiFi.h (a connect stands for the TLS
+handshake): alerts reuse the warm connection, a connection the server dropped is re-opened
+inside the alert, the resolved address is kept for ALERT_DNS_TTL_MS and an alert still
+handshakes while the background reconnect is backing off.
+*/
+
+#include "host_test.h"
+#include "alert_client.h"
+#include "esp_timer.h"
+#include "WiFi.h"
+
+static const char *SENT = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 7\r\n\r\nQueued!";
+
+// ----- FUNCTIONS --------------------------------
+
+static int alert(void)
+{
+    return alert_client_get("/whatsapp.php?phone=0&text=intruder+alert&apikey=0", (uint32_t)(esp_timer_get_time() / 1000));
+}
+
+
+static void test_cold_then_warm(void)
+{
+    alert_client_stats_t st;
+    host_net.responses.push_back(SENT);
+    host_net.responses.push_back(SENT);
+    CHECK_EQ(alert(), 200);
+    CHECK_EQ(alert(), 200);
+    alert_client_get_stats(&st);
+    CHECK_EQ(st.alerts, 2);
+    CHECK_EQ(st.cold_sends, 1);
+    CHECK_EQ(st.warm_sends, 1);
+    CHECK_EQ(st.handshakes, 1);
+    CHECK_EQ(st.dns_lookups, 1);
+    CHECK(st.connected);
+    CHECK(host_net.sent.find("GET /whatsapp.php?phone=0&text=intruder+alert&apikey=0 HTTP/1.1\r\nHost: api.callmebot.com\r\n") == 0);
+}
+
+
+static void test_dropped_connection(void)
+{
+    alert_client_stats_t before, st;
+    alert_client_get_stats(&before);
+    host_net.stale = true;                       // server closed the idle TLS session
+    host_net.responses.push_back(SENT);
+    CHECK_EQ(alert(), 200);
+    alert_client_get_stats(&st);
+    CHECK_EQ(st.handshakes - before.handshakes, 1);
+    CHECK_EQ(st.cold_sends - before.cold_sends, 1);
+    CHECK_EQ(st.failures, before.failures);
+    CHECK_EQ(st.dns_lookups, before.dns_lookups);   // reconnect reuses the resolved address
+}
+
+
+static void test_handshake_failure(void)
+{
+    alert_client_stats_t before, st;
+    host_net.stale = true;
+    host_net.refuse_connects = 1;
+    alert_client_get_stats(&before);
+    CHECK_EQ(alert(), -1);
+    alert_client_get_stats(&st);
+    CHECK_EQ(st.failures - before.failures, 1);
+    CHECK_EQ(st.handshake_failures - before.handshake_failures, 1);
+    CHECK(!st.connected);
+    // the next alert does not wait for the backoff, and resolves again: the address may have moved
+    host_net.responses.push_back(SENT);
+    CHECK_EQ(alert(), 200);
+    alert_client_get_stats(&st);
+    CHECK_EQ(st.handshakes - before.handshakes, 1);
+    CHECK_EQ(st.dns_lookups - before.dns_lookups, 1);
+}
+
+
+static void test_dns_ttl(void)
+{
+    alert_client_stats_t before, st;
+    alert_client_get_stats(&before);
+    host_clock_advance_ms(ALERT_DNS_TTL_MS);
+    host_net.stale = true;
+    host_net.responses.push_back(SENT);
+    CHECK_EQ(alert(), 200);
+    alert_client_get_stats(&st);
+    CHECK_EQ(st.dns_lookups - before.dns_lookups, 1);
+}
+
+
+static void test_wifi_down(void)
+{
+    alert_client_stats_t before, st;
+    alert_client_get_stats(&before);
+    host_net.stale = true;
+    host_net.wifi_up = false;
+    CHECK_EQ(alert(), -1);
+    alert_client_get_stats(&st);
+    CHECK_EQ(st.failures - before.failures, 1);
+    CHECK_EQ(st.handshakes, before.handshakes);
+    host_net.wifi_up = true;
+}
+
+
+int main(void)
+{
+    alert_client_init();
+    test_cold_then_warm();
+    test_dropped_connection();
+    test_handshake_failure();
+    test_dns_ttl();
+    test_wifi_down();
+    return HOST_TEST_DONE("alert_client");
+}
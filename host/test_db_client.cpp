@@ -0,0 +1,141 @@
+/*
+test_db_client.cpp
+db_client against the scripted server in stubs/WiFi.h: requests share one keep-alive
+connection, a connection the server dropped is re-opened once per request, and failed
+connects back off exponentially up to DB_CLIENT_BACKOFF_MAX_MS.
+*/
+
+#include "host_test.h"
+#include "db_client.h"
+#include "esp_timer.h"
+#include "WiFi.h"
+#include <string.h>
+
+static const char *CREATED = "HTTP/1.1 201 CREATED\r\nContent-Length: 2\r\n\r\n{}";
+static const char *CLOSED = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n{}";
+
+// ----- FUNCTIONS --------------------------------
+
+static int post(void)
+{
+    static const char body[] = "{\"status\":true}";
+    return db_client_post(DB_ENDPOINT_STATUS, body, strlen(body));
+}
+
+
+static size_t count(const std::string &s, const char *needle)
+{
+    size_t n = 0;
+    for (size_t at = s.find(needle); at != std::string::npos; at = s.find(needle, at + 1)) n++;
+    return n;
+}
+
+
+static void test_keep_alive(void)
+{
+    db_client_stats_t st;
+    host_net_reset();
+    for (int i = 0; i < 3; i++) host_net.responses.push_back(CREATED);
+    CHECK_EQ(post(), 201);
+    CHECK_EQ(post(), 201);
+    static const uint8_t events[] = { 'E', 'V', 1, 0 };
+    CHECK_EQ(db_client_post_format(DB_ENDPOINT_CREATE, DB_FORMAT_BINARY, events, sizeof(events)), 201);
+    db_client_get_stats(&st);
+    CHECK_EQ(host_net.connects, 1);
+    CHECK_EQ(st.connects, 1);
+    CHECK_EQ(st.reuses, 2);
+    CHECK_EQ(st.binary_requests, 1);
+    CHECK_EQ(count(host_net.sent, "POST /status_create HTTP/1.1\r\n"), 2);
+    CHECK_EQ(count(host_net.sent, "Content-Type: application/x-intruder-events\r\n"), 1);
+    CHECK_EQ(count(host_net.sent, "Content-Length: 15\r\n\r\n{\"status\":true}"), 2);
+}
+
+
+static void test_stale_connection(void)
+{
+    db_client_stats_t before, st;
+    db_client_get_stats(&before);
+    host_net.stale = true;                       // idle timeout on the server side
+    host_net.responses.push_back(CREATED);
+    CHECK_EQ(post(), 201);
+    db_client_get_stats(&st);
+    CHECK_EQ(st.stale_retries - before.stale_retries, 1);
+    CHECK_EQ(st.connects - before.connects, 1);
+    CHECK_EQ(st.failures, before.failures);
+}
+
+
+static void test_server_close(void)
+{
+    db_client_stats_t before, st;
+    db_client_get_stats(&before);
+    host_net.responses.push_back(CLOSED);
+    host_net.responses.push_back(CREATED);
+    CHECK_EQ(post(), 200);
+    CHECK_EQ(post(), 201);                       // fresh connection, not a stale retry
+    db_client_get_stats(&st);
+    CHECK_EQ(st.connects - before.connects, 1);
+    CHECK_EQ(st.stale_retries, before.stale_retries);
+}
+
+
+static void test_backoff(void)
+{
+    db_client_stats_t st;
+    host_net.responses.push_back(CLOSED);
+    CHECK_EQ(post(), 200);
+    host_net.refuse_connects = 3;
+    int attempts = host_net.connect_attempts;
+    CHECK_EQ(post(), -1);
+    db_client_get_stats(&st);
+    CHECK_EQ(st.backoff_ms, DB_CLIENT_BACKOFF_MIN_MS);
+    CHECK_EQ(post(), -1);                        // inside the backoff: no connect attempt
+    db_client_get_stats(&st);
+    CHECK_EQ(st.backoff_skips, 1);
+    CHECK_EQ(host_net.connect_attempts - attempts, 1);
+    host_clock_advance_ms(DB_CLIENT_BACKOFF_MIN_MS);
+    CHECK_EQ(post(), -1);
+    db_client_get_stats(&st);
+    CHECK_EQ(st.backoff_ms, 2 * DB_CLIENT_BACKOFF_MIN_MS);
+    host_clock_advance_ms(2 * DB_CLIENT_BACKOFF_MIN_MS);
+    CHECK_EQ(post(), -1);
+    db_client_get_stats(&st);
+    CHECK_EQ(st.backoff_ms, 4 * DB_CLIENT_BACKOFF_MIN_MS);
+    CHECK_EQ(st.connect_failures, 3);
+    host_clock_advance_ms(4 * DB_CLIENT_BACKOFF_MIN_MS);
+    host_net.responses.push_back(CREATED);
+    CHECK_EQ(post(), 201);
+    db_client_get_stats(&st);
+    CHECK_EQ(st.backoff_ms, 0);
+    CHECK_EQ(host_net.connect_attempts - attempts, 4);
+}
+
+
+static void test_backoff_cap(void)
+{
+    db_client_stats_t st;
+    host_net.responses.push_back(CLOSED);
+    CHECK_EQ(post(), 200);
+    host_net.wifi_up = false;
+    for (int i = 0; i < 12; i++) {
+        post();
+        host_clock_advance_ms(DB_CLIENT_BACKOFF_MAX_MS);
+    }
+    db_client_get_stats(&st);
+    CHECK_EQ(st.backoff_ms, DB_CLIENT_BACKOFF_MAX_MS);
+    host_net.wifi_up = true;
+    host_net.responses.push_back(CREATED);
+    CHECK_EQ(post(), 201);
+}
+
+
+int main(void)
+{
+    db_client_init();
+    test_keep_alive();
+    test_stale_connection();
+    test_server_close();
+    test_backoff();
+    test_backoff_cap();
+    return HOST_TEST_DONE("db_client");
+}
@@ -0,0 +1,178 @@
+/*
+test_event_codec.cpp
+event_codec against a reference decoder of the wire format: every flag combination for each
+record type, face ids and sequence numbers at the integer limits, confidence saturation (and
+NaN), TS taking precedence over AGE, and the buffer and count limits.
+  test_event_codec --emit <dir>   also writes batch.bin and the rows decode_events() must return
+                                  as expected.json, for check_event_codec.py
+*/
+
+#include "host_test.h"
+#include "event_codec.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define BATCH_MAX 160
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    int16_t face_id;
+    int16_t confidence_e4;
+    uint32_t seq;
+    uint32_t time;
+} decoded_t;
+
+static const int16_t face_ids[] = { -1, 0, 7, INT16_MIN, INT16_MAX };
+static const float confidences[] = { 0.875f, -0.0625f, 4.0f, -4.0f, NAN, INFINITY, 0.0f };
+static const int16_t confidences_e4[] = { 8750, -625, 32767, -32768, 0, 32767, 0 };
+static const uint32_t values[] = { 0, 1, 1700000000u, UINT32_MAX };
+
+// ----- FUNCTIONS --------------------------------
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+/* the wire format as event_codec.h documents it; count or -1 for a bad header */
+static int reference_decode(const uint8_t *buf, size_t len, decoded_t *out, int max)
+{
+    if (len < EVENT_CODEC_HEADER_LEN || buf[0] != 'E' || buf[1] != 'V' || buf[2] != EVENT_CODEC_VERSION) return -1;
+    int count = buf[3];
+    if (count > max || len != EVENT_CODEC_HEADER_LEN + (size_t)count * EVENT_CODEC_RECORD_LEN) return -1;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *p = buf + EVENT_CODEC_HEADER_LEN + i * EVENT_CODEC_RECORD_LEN;
+        out[i].type = p[0];
+        out[i].flags = p[1];
+        out[i].face_id = (int16_t)get_u16(p + 2);
+        out[i].confidence_e4 = (int16_t)get_u16(p + 4);
+        out[i].seq = get_u32(p + 6);
+        out[i].time = get_u32(p + 10);
+    }
+    return count;
+}
+
+
+/* the batch under test: both record types with all 16 flag combinations, cycling through the edge values */
+static int build_batch(event_record_t *records, int16_t *expected_e4)
+{
+    int n = 0;
+    for (int type = EVENT_TYPE_RECOGNITION; type <= EVENT_TYPE_HEARTBEAT; type++) {
+        for (int flags = 0; flags < 16; flags++) {
+            for (int v = 0; v < 4; v++, n++) {
+                int c = n % (sizeof(confidences) / sizeof(confidences[0]));
+                records[n].type = (uint8_t)type;
+                records[n].flags = (uint8_t)flags;
+                records[n].face_id = face_ids[n % (sizeof(face_ids) / sizeof(face_ids[0]))];
+                records[n].confidence = confidences[c];
+                records[n].seq = values[v];
+                records[n].time = values[3 - v];
+                expected_e4[n] = confidences_e4[c];
+            }
+        }
+    }
+    return n;
+}
+
+
+static void test_round_trip(const event_record_t *records, const int16_t *expected_e4, int n,
+                            uint8_t *buf, size_t cap, size_t *len)
+{
+    event_encoder_t enc;
+    CHECK(event_codec_begin(&enc, buf, cap));
+    for (int i = 0; i < n; i++) CHECK(event_codec_put(&enc, &records[i]));
+    *len = event_codec_finish(&enc);
+    CHECK_EQ(*len, EVENT_CODEC_HEADER_LEN + n * EVENT_CODEC_RECORD_LEN);
+    decoded_t out[BATCH_MAX];
+    CHECK_EQ(reference_decode(buf, *len, out, BATCH_MAX), n);
+    for (int i = 0; i < n; i++) {
+        CHECK_EQ(out[i].type, records[i].type);
+        CHECK_EQ(out[i].flags, records[i].flags);
+        CHECK_EQ(out[i].face_id, records[i].face_id);
+        CHECK_EQ(out[i].confidence_e4, expected_e4[i]);
+        CHECK_EQ(out[i].seq, records[i].seq);
+        CHECK_EQ(out[i].time, records[i].time);
+    }
+}
+
+
+static void test_limits(void)
+{
+    uint8_t buf[EVENT_CODEC_HEADER_LEN + 2 * EVENT_CODEC_RECORD_LEN];
+    event_encoder_t enc;
+    event_record_t r = { EVENT_TYPE_RECOGNITION, 0, 0, 0.5f, 1, 0 };
+    CHECK(!event_codec_begin(&enc, buf, EVENT_CODEC_HEADER_LEN - 1));
+    CHECK(!event_codec_put(&enc, &r));
+    CHECK(event_codec_begin(&enc, buf, sizeof(buf)));
+    CHECK(event_codec_put(&enc, &r));
+    CHECK(event_codec_put(&enc, &r));
+    CHECK(!event_codec_put(&enc, &r));           // buffer full
+    CHECK_EQ(event_codec_finish(&enc), sizeof(buf));
+    CHECK_EQ(buf[3], 2);
+    // the count is one byte
+    static uint8_t big[EVENT_CODEC_HEADER_LEN + 256 * EVENT_CODEC_RECORD_LEN];
+    CHECK(event_codec_begin(&enc, big, sizeof(big)));
+    for (int i = 0; i < EVENT_CODEC_MAX_COUNT; i++) CHECK(event_codec_put(&enc, &r));
+    CHECK(!event_codec_put(&enc, &r));
+    CHECK_EQ(event_codec_finish(&enc), EVENT_CODEC_HEADER_LEN + EVENT_CODEC_MAX_COUNT * EVENT_CODEC_RECORD_LEN);
+    CHECK_EQ(big[3], EVENT_CODEC_MAX_COUNT);
+}
+
+
+/* the rows decode_events() builds: intruder_status for recognitions, status otherwise, seq with
+   EVENT_FLAG_SEQ, ts with EVENT_FLAG_TS, age_ms with EVENT_FLAG_AGE unless TS is set too */
+static bool emit(const char *dir, const uint8_t *buf, size_t len, const event_record_t *records,
+                 const int16_t *expected_e4, int n)
+{
+    std::string path = std::string(dir) + "/batch.bin";
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f || fwrite(buf, 1, len, f) != len) return false;
+    fclose(f);
+    path = std::string(dir) + "/expected.json";
+    f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "[\n");
+    for (int i = 0; i < n; i++) {
+        const event_record_t *r = &records[i];
+        fprintf(f, "{\"type\":%u,\"face_id\":%d,\"confidence_e4\":%d", r->type, r->face_id, expected_e4[i]);
+        if (r->type == EVENT_TYPE_RECOGNITION) {
+            fprintf(f, ",\"intruder_status\":%s", (r->flags & EVENT_FLAG_INTRUDER) ? "true" : "false");
+        } else {
+            fprintf(f, ",\"status\":true");
+        }
+        if (r->flags & EVENT_FLAG_SEQ) fprintf(f, ",\"seq\":%u", r->seq);
+        if (r->flags & EVENT_FLAG_TS) {
+            fprintf(f, ",\"ts\":%u", r->time);
+        } else if (r->flags & EVENT_FLAG_AGE) {
+            fprintf(f, ",\"age_ms\":%u", r->time);
+        }
+        fprintf(f, "}%s\n", (i + 1 < n) ? "," : "");
+    }
+    fprintf(f, "]\n");
+    fclose(f);
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    static event_record_t records[BATCH_MAX];
+    static int16_t expected_e4[BATCH_MAX];
+    static uint8_t buf[EVENT_CODEC_HEADER_LEN + BATCH_MAX * EVENT_CODEC_RECORD_LEN];
+    size_t len = 0;
+    int n = build_batch(records, expected_e4);
+    test_round_trip(records, expected_e4, n, buf, sizeof(buf), &len);
+    test_limits();
+    if (argc == 3 && strcmp(argv[1], "--emit") == 0) CHECK(emit(argv[2], buf, len, records, expected_e4, n));
+    return HOST_TEST_DONE("event_codec");
+}
@@ -0,0 +1,69 @@
+/*
+test_face_crop.cpp
+face_crop_region on boxes at and past the frame border, as the tracker predicts them: the
+padded crop stays inside the frame, and a box with nothing left inside gives no crop.
+*/
+
+#include "host_test.h"
+#include "face_crop.h"
+
+#define W 320
+#define H 240
+
+// ----- FUNCTIONS --------------------------------
+
+/* every sampled pixel of the crop is inside the frame */
+static void check_inside(const face_crop_t *c)
+{
+    CHECK(c->out_width >= 1 && c->out_height >= 1);
+    CHECK(c->x >= 0 && c->y >= 0);
+    CHECK(c->x + (c->out_width - 1) * c->step < W);
+    CHECK(c->y + (c->out_height - 1) * c->step < H);
+}
+
+
+static void test_inside(void)
+{
+    face_crop_t c;
+    CHECK(face_crop_region({100, 80, 149, 139}, W, H, &c));
+    check_inside(&c);
+    CHECK_EQ(c.step, 1);
+    CHECK_EQ(c.x, 100 - 50 * FACE_CROP_PAD_PCT / 100);
+    CHECK_EQ(c.out_width, 50 + 2 * (50 * FACE_CROP_PAD_PCT / 100));
+}
+
+
+static void test_border(void)
+{
+    face_crop_t c;
+    CHECK(face_crop_region({-20, -10, 30, 40}, W, H, &c));
+    check_inside(&c);
+    CHECK_EQ(c.x, 0);
+    CHECK_EQ(c.y, 0);
+    CHECK(face_crop_region({W - 30, H - 30, W + 40, H + 40}, W, H, &c));
+    check_inside(&c);
+    // a box wider than the frame comes out as the whole frame, decimated
+    CHECK(face_crop_region({-100, -100, W + 100, H + 100}, W, H, &c));
+    check_inside(&c);
+    CHECK(c.out_width <= FACE_CROP_MAX_SIDE && c.out_height <= FACE_CROP_MAX_SIDE);
+}
+
+
+static void test_outside(void)
+{
+    face_crop_t c;
+    CHECK(!face_crop_region({W + 50, 10, W + 80, 40}, W, H, &c));
+    CHECK(!face_crop_region({10, H + 50, 40, H + 80}, W, H, &c));
+    CHECK(!face_crop_region({-90, 10, -60, 40}, W, H, &c));
+    CHECK(!face_crop_region({10, -90, 40, -60}, W, H, &c));
+    CHECK(!face_crop_region({10, 10}, W, H, &c));
+}
+
+
+int main(void)
+{
+    test_inside();
+    test_border();
+    test_outside();
+    return HOST_TEST_DONE("face_crop");
+}
@@ -0,0 +1,310 @@
+/*
+test_gallery_store.cpp
+gallery_store against a file mapped the way the partition is on the device (mmap for reads,
+pwrite for writes, erase = fill with 0xFF): appends across reopens, tombstones hiding earlier
+templates (and a second tombstone of the same person not counting them twice), incremental
+compaction with appends between copy and finish, a power cut before every write of a
+compaction (torn header included) and right after its header, and a record with a bad CRC.
+*/
+
+#include "host_test.h"
+#include "gallery_store.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+#define FLASH_SIZE (16 * GALLERY_STORE_SECTOR)    // two halves of 60 records
+
+// the partition file; cut_at counts writes and erases until the power goes
+typedef struct {
+    int fd;
+    uint8_t *map;
+    int ops;
+    int cut_at;                    // -1: never
+    bool cut;
+} host_flash_t;
+
+// what the gallery should see: (person, serial) of every live template in log order
+typedef std::vector<std::pair<int, int>> live_t;
+
+static host_flash_t host;
+static int next_serial = 1;
+
+// ----- FUNCTIONS --------------------------------
+
+/* false once the power is gone: the operation that hits the cut and everything after it */
+static bool host_power(void)
+{
+    if (host.cut || host.cut_at < 0) return !host.cut;
+    if (host.ops++ < host.cut_at) return true;
+    host.cut = true;
+    return false;
+}
+
+
+/* a cut in the middle of a write or an erase gets the first half of it done */
+static bool host_write(void *ctx, size_t offset, const void *data, size_t len)
+{
+    if (host.cut) return false;
+    bool power = host_power();
+    size_t n = power ? len : len / 2;
+    return pwrite(host.fd, data, n, offset) == (ssize_t)n && power;
+}
+
+
+static bool host_erase(void *ctx, size_t offset, size_t len)
+{
+    static uint8_t ones[GALLERY_STORE_SECTOR];
+    memset(ones, 0xFF, sizeof(ones));
+    if (host.cut) return false;
+    bool power = host_power();
+    size_t end = offset + (power ? len : len / 2);
+    for (size_t at = offset; at < end; at += sizeof(ones)) {
+        size_t n = (end - at < sizeof(ones)) ? end - at : sizeof(ones);
+        if (pwrite(host.fd, ones, n, at) != (ssize_t)n) return false;
+    }
+    return power;
+}
+
+
+/* power back on and boot */
+static bool reopen(gallery_store_t *store, bool *formatted)
+{
+    host.ops = 0;
+    host.cut_at = -1;
+    host.cut = false;
+    gallery_store_flash_t flash = { &host, FLASH_SIZE, host.map, host_write, host_erase };
+    return gallery_store_open(store, &flash, formatted);
+}
+
+
+/* blank flash, as shipped */
+static void host_blank(void)
+{
+    memset(host.map, 0xFF, FLASH_SIZE);
+    msync(host.map, FLASH_SIZE, MS_SYNC);
+}
+
+
+static void enroll(gallery_store_t *store, live_t *live, int person)
+{
+    gallery_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = GALLERY_RECORD_ENROLL;
+    rec.person = (uint16_t)person;
+    rec.norm = 1;
+    int serial = next_serial++;
+    for (int i = 0; i < GALLERY_STORE_DIM; i++) rec.emb[i] = (int8_t)(serial * 7 + i);
+    memcpy(rec.emb, &serial, sizeof(serial));
+    const gallery_record_t *stored = gallery_store_append(store, &rec);
+    CHECK(stored != NULL);
+    if (stored) CHECK(memcmp(stored->emb, rec.emb, GALLERY_STORE_DIM) == 0);
+    live->push_back(std::make_pair(person, serial));
+}
+
+
+static void tombstone(gallery_store_t *store, live_t *live, int person)
+{
+    gallery_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = GALLERY_RECORD_TOMBSTONE;
+    rec.person = (uint16_t)person;
+    CHECK(gallery_store_append(store, &rec) != NULL);
+    for (size_t i = live->size(); i-- > 0;) {
+        if ((*live)[i].first == person) live->erase(live->begin() + i);
+    }
+}
+
+
+/* the templates gallery.cpp would index: a tombstone removes what its person had so far */
+static live_t visible(gallery_store_t *store)
+{
+    live_t out;
+    for (uint32_t i = 0; i < store->stats.records; i++) {
+        const gallery_record_t *rec = gallery_store_record(store, i);
+        if (!rec) continue;
+        if (rec->type == GALLERY_RECORD_TOMBSTONE) {
+            for (size_t j = out.size(); j-- > 0;) {
+                if (out[j].first == rec->person) out.erase(out.begin() + j);
+            }
+        } else {
+            int serial;
+            memcpy(&serial, rec->emb, sizeof(serial));
+            out.push_back(std::make_pair((int)rec->person, serial));
+        }
+    }
+    return out;
+}
+
+
+static void test_append(gallery_store_t *store, live_t *live)
+{
+    bool formatted = false;
+    host_blank();
+    CHECK(reopen(store, &formatted));
+    CHECK(formatted);
+    CHECK_EQ(store->stats.generation, 1);
+    CHECK_EQ(store->stats.capacity, (FLASH_SIZE / 2 - 32) / sizeof(gallery_record_t));
+    for (int person = 1; person <= 3; person++) {
+        enroll(store, live, person);
+        enroll(store, live, person);
+    }
+    CHECK_EQ(store->stats.records, 6);
+    CHECK_EQ(store->stats.dead, 0);
+    CHECK(gallery_store_record(store, 6) == NULL);
+    CHECK(reopen(store, &formatted));
+    CHECK(!formatted);
+    CHECK_EQ(store->stats.records, 6);
+    CHECK_EQ(store->stats.dead, 0);
+    CHECK(visible(store) == *live);
+}
+
+
+static void test_tombstone(gallery_store_t *store, live_t *live)
+{
+    bool formatted;
+    tombstone(store, live, 2);
+    CHECK_EQ(store->stats.dead, 3);               // the tombstone and both templates
+    tombstone(store, live, 2);
+    CHECK_EQ(store->stats.dead, 4);               // nothing left for the second one to hide
+    enroll(store, live, 2);
+    tombstone(store, live, 2);
+    CHECK_EQ(store->stats.dead, 6);               // only the template enrolled in between
+    enroll(store, live, 4);
+    CHECK(visible(store) == *live);
+    gallery_store_stats_t before = store->stats;
+    CHECK(reopen(store, &formatted));
+    CHECK_EQ(store->stats.records, before.records);
+    CHECK_EQ(store->stats.dead, before.dead);     // the boot scan agrees with the appends
+    CHECK(visible(store) == *live);
+}
+
+
+/* copy person 1, keep appending (a tombstone for person 1 among it), finish */
+static void test_compaction(gallery_store_t *store, live_t *live)
+{
+    bool formatted;
+    uint32_t generation = store->stats.generation;
+    int active = store->active;
+    CHECK(gallery_store_compact_start(store));
+    CHECK(gallery_store_compact_copy(store, 2));
+    enroll(store, live, 5);
+    tombstone(store, live, 1);
+    enroll(store, live, 3);
+    CHECK(gallery_store_compact_finish(store));
+    CHECK_EQ(store->stats.generation, generation + 1);
+    CHECK(store->active != active);
+    CHECK(visible(store) == *live);
+    // the copied templates of person 1 and the tombstone hiding them; the other deletes are gone
+    CHECK_EQ(store->stats.dead, 3);
+    CHECK_EQ(store->stats.records, live->size() + 3);
+    CHECK(reopen(store, &formatted));
+    CHECK_EQ(store->stats.generation, generation + 1);
+    CHECK(visible(store) == *live);
+    // a second round drops them as well
+    CHECK(gallery_store_compact_start(store));
+    CHECK(gallery_store_compact_finish(store));
+    CHECK_EQ(store->stats.dead, 0);
+    CHECK_EQ(store->stats.records, live->size());
+    CHECK(visible(store) == *live);
+}
+
+
+/* power cut before each erase and write of a compaction: the old half until its header is
+   complete, the new one from then on, and a compaction after the reboot still works */
+static void test_power_loss(gallery_store_t *store, live_t *live)
+{
+    bool formatted;
+    tombstone(store, live, 3);
+    enroll(store, live, 6);
+    uint32_t generation = store->stats.generation;
+    int ops = 0;
+    for (int cut_at = 0;; cut_at++) {
+        CHECK(reopen(store, &formatted));
+        host.cut_at = cut_at;
+        bool done = gallery_store_compact_start(store) && gallery_store_compact_finish(store);
+        int run_ops = host.ops;
+        CHECK(reopen(store, &formatted));
+        CHECK(!formatted);
+        CHECK(visible(store) == *live);
+        if (done) {
+            ops = run_ops;
+            break;
+        }
+        CHECK_EQ(store->stats.generation, generation);    // the cut header (last op) is torn, not newer
+    }
+    CHECK(ops >= 3);                                       // erase, records, header
+    CHECK_EQ(store->stats.generation, generation + 1);
+    CHECK_EQ(store->stats.dead, 0);
+    // cut right after the header: the next append is torn, the switch stays
+    host.cut_at = 0;
+    gallery_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = GALLERY_RECORD_ENROLL;
+    rec.person = 7;
+    CHECK(gallery_store_append(store, &rec) == NULL);
+    CHECK(reopen(store, &formatted));
+    CHECK_EQ(store->stats.generation, generation + 1);
+    CHECK_EQ(store->stats.corrupt, 1);
+    CHECK(visible(store) == *live);
+    CHECK(gallery_store_compact_start(store));
+    CHECK(gallery_store_compact_finish(store));
+    CHECK_EQ(store->stats.dead, 0);
+    CHECK_EQ(store->stats.records, live->size());
+}
+
+
+/* a flipped payload byte: the record reads as missing, counts as dead and compaction drops it */
+static void test_corrupt(gallery_store_t *store, live_t *live)
+{
+    bool formatted;
+    enroll(store, live, 8);
+    uint32_t index = store->stats.records - 1;
+    const gallery_record_t *rec = gallery_store_record(store, index);
+    CHECK(rec != NULL);
+    size_t offset = (const uint8_t *)rec - host.map + offsetof(gallery_record_t, emb) + 100;
+    uint8_t flipped = host.map[offset] ^ 0x40;
+    CHECK(pwrite(host.fd, &flipped, 1, offset) == 1);
+    live->pop_back();
+    CHECK(reopen(store, &formatted));
+    CHECK_EQ(store->stats.corrupt, 1);
+    CHECK_EQ(store->stats.dead, 1);
+    CHECK(gallery_store_record(store, index) == NULL);
+    CHECK(visible(store) == *live);
+    enroll(store, live, 9);                               // the log goes on after it
+    CHECK(visible(store) == *live);
+    CHECK(gallery_store_wants_compaction(store) == false);
+    CHECK(gallery_store_compact_start(store));
+    CHECK(gallery_store_compact_finish(store));
+    CHECK_EQ(store->stats.dead, 0);
+    CHECK_EQ(store->stats.records, live->size());
+    CHECK(reopen(store, &formatted));
+    CHECK_EQ(store->stats.corrupt, 0);
+    CHECK(visible(store) == *live);
+}
+
+
+int main(void)
+{
+    char path[] = "/tmp/gallery_storeXXXXXX";
+    host.fd = mkstemp(path);
+    if (host.fd < 0 || ftruncate(host.fd, FLASH_SIZE) != 0) return 1;
+    unlink(path);
+    host.map = (uint8_t *)mmap(NULL, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, host.fd, 0);
+    if (host.map == MAP_FAILED) return 1;
+    gallery_store_t store;
+    live_t live;
+    test_append(&store, &live);
+    test_tombstone(&store, &live);
+    test_compaction(&store, &live);
+    test_power_loss(&store, &live);
+    test_corrupt(&store, &live);
+    munmap(host.map, FLASH_SIZE);
+    close(host.fd);
+    return HOST_TEST_DONE("gallery_store");
+}
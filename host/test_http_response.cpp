@@ -0,0 +1,131 @@
+/*
+test_http_response.cpp
+http_read_response against canned responses: Content-Length and chunked bodies are drained so
+the next response on the same connection parses, broken or closing responses stop the client.
+*/
+
+#include "host_test.h"
+#include "http_response.h"
+#include <string>
+#include <string.h>
+
+// one connection whose server side has already sent `data`, and closed it unless server_open
+class MemClient : public Client {
+public:
+    explicit MemClient(const std::string &data, bool server_open = true) : data_(data), server_open_(server_open) {}
+    size_t write(const uint8_t *buf, size_t size) override { return size; }
+    int available() override { return (int)(data_.size() - pos_); }
+    int read() override { return (!stopped && pos_ < data_.size()) ? (uint8_t)data_[pos_++] : -1; }
+    uint8_t connected() override { return !stopped && (server_open_ || pos_ < data_.size()); }
+    void stop() override { stopped = true; }
+    size_t left() const { return data_.size() - pos_; }
+    bool stopped = false;
+
+private:
+    std::string data_;
+    bool server_open_;
+    size_t pos_ = 0;
+};
+
+static const char *OK_LENGTH = "HTTP/1.1 201 CREATED\r\nContent-Type: application/json\r\nContent-Length: 34\r\n\r\n"
+                               "{\"message\":\"row inserted success\"}";
+static const char *OK_CHUNKED = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                "5\r\nhello\r\n1a;ext=1\r\n abcdefghijklmnopqrstuvwxy\r\n0\r\nX-Trailer: 1\r\n\r\n";
+
+// ----- FUNCTIONS --------------------------------
+
+static void test_content_length(void)
+{
+    MemClient c(std::string(OK_LENGTH) + OK_LENGTH);
+    CHECK_EQ(http_read_response(c), 201);
+    CHECK(!c.stopped);
+    CHECK_EQ(c.left(), strlen(OK_LENGTH));
+    CHECK_EQ(http_read_response(c), 201);       // second response on the same connection
+    CHECK(!c.stopped);
+    CHECK_EQ(c.left(), 0);
+}
+
+
+static void test_chunked(void)
+{
+    MemClient c(std::string(OK_CHUNKED) + OK_LENGTH);
+    CHECK_EQ(http_read_response(c), 200);
+    CHECK(!c.stopped);
+    CHECK_EQ(c.left(), strlen(OK_LENGTH));
+    CHECK_EQ(http_read_response(c), 201);
+    CHECK_EQ(c.left(), 0);
+}
+
+
+static void test_header_case(void)
+{
+    MemClient c("HTTP/1.1 204 No Content\r\ncontent-length: 0\r\nCONNECTION: Keep-Alive\r\n\r\n");
+    CHECK_EQ(http_read_response(c), 204);
+    CHECK(!c.stopped);
+}
+
+
+static void test_truncated_length(void)
+{
+    MemClient c("HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\nonly twenty bytes...");
+    CHECK_EQ(http_read_response(c), 200);        // status is known, the connection is not reusable
+    CHECK(c.stopped);
+}
+
+
+static void test_truncated_chunked(void)
+{
+    MemClient a("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n10\r\nshort");
+    CHECK_EQ(http_read_response(a), 200);
+    CHECK(a.stopped);
+    MemClient b("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n");   // no zero chunk
+    CHECK_EQ(http_read_response(b), 200);
+    CHECK(b.stopped);
+}
+
+
+static void test_truncated_headers(void)
+{
+    MemClient c("HTTP/1.1 200 OK\r\nContent-Len", false);
+    CHECK_EQ(http_read_response(c), -1);
+}
+
+
+static void test_close(void)
+{
+    MemClient a("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok");
+    CHECK_EQ(http_read_response(a), 200);
+    CHECK(a.stopped);
+    MemClient b("HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    CHECK_EQ(http_read_response(b), 200);
+    CHECK(b.stopped);
+    MemClient c("HTTP/1.0 200 OK\r\nConnection: keep-alive\r\nContent-Length: 2\r\n\r\nok");
+    CHECK_EQ(http_read_response(c), 200);
+    CHECK(!c.stopped);
+    MemClient d("HTTP/1.1 200 OK\r\n\r\nbody until the server closes");
+    CHECK_EQ(http_read_response(d), 200);
+    CHECK(d.stopped);
+}
+
+
+static void test_garbage(void)
+{
+    MemClient a("SSH-2.0-OpenSSH_9.6\r\n\r\n");
+    CHECK_EQ(http_read_response(a), -1);
+    MemClient b("");
+    CHECK_EQ(http_read_response(b), -1);
+}
+
+
+int main(void)
+{
+    test_content_length();
+    test_chunked();
+    test_header_case();
+    test_truncated_length();
+    test_truncated_chunked();
+    test_truncated_headers();
+    test_close();
+    test_garbage();
+    return HOST_TEST_DONE("http_response");
+}
@@ -0,0 +1,377 @@
+/*
+test_outbox_store.cpp
+outbox_store against a directory of plain files: append and replay across reboots, the size cap,
+compaction, a torn last record, and a power cut injected before every single file operation of a
+compaction and of an append. Prints replay throughput, log size and write amplification.
+*/
+
+#include "host_test.h"
+#include "outbox_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// the outbox files in a temporary directory; cut_at counts the writing operations until the power goes
+typedef struct {
+    char dir[64];
+    int ops;
+    int cut_at;                    // -1: never
+    bool cut;
+} host_fs_t;
+
+static const char *host_names[OUTBOX_FILE_COUNT] = { "outbox.log", "outbox.tmp", "outbox.ack" };
+
+// ----- FUNCTIONS --------------------------------
+
+static const char *host_path(host_fs_t *h, outbox_file_t file)
+{
+    static char path[128];
+    snprintf(path, sizeof(path), "%s/%s", h->dir, host_names[file]);
+    return path;
+}
+
+
+/* false once the power is gone: the operation that hits the cut and everything after it */
+static bool host_power(host_fs_t *h)
+{
+    if (h->cut || h->cut_at < 0) return !h->cut;
+    if (h->ops++ < h->cut_at) return true;
+    h->cut = true;
+    return false;
+}
+
+
+static long host_size(void *ctx, outbox_file_t file)
+{
+    struct stat st;
+    return stat(host_path((host_fs_t *)ctx, file), &st) == 0 ? (long)st.st_size : -1;
+}
+
+
+static size_t host_read(void *ctx, outbox_file_t file, uint32_t offset, void *buf, size_t len)
+{
+    FILE *f = fopen(host_path((host_fs_t *)ctx, file), "rb");
+    if (!f) return 0;
+    size_t n = fseek(f, offset, SEEK_SET) == 0 ? fread(buf, 1, len, f) : 0;
+    fclose(f);
+    return n;
+}
+
+
+/* a cut in the middle of a write keeps the first half of it */
+static size_t host_write(host_fs_t *h, outbox_file_t file, const char *mode, const void *data, size_t len)
+{
+    bool power = host_power(h);
+    FILE *f = fopen(host_path(h, file), mode);
+    if (!f) return 0;
+    size_t n = fwrite(data, 1, power ? len : len / 2, f);
+    fclose(f);
+    return n;
+}
+
+
+static size_t host_append(void *ctx, outbox_file_t file, const void *data, size_t len)
+{
+    host_fs_t *h = (host_fs_t *)ctx;
+    if (h->cut) return 0;
+    return host_write(h, file, "ab", data, len);
+}
+
+
+static bool host_replace(void *ctx, outbox_file_t file, const void *data, size_t len)
+{
+    host_fs_t *h = (host_fs_t *)ctx;
+    if (h->cut) return false;
+    return host_write(h, file, "wb", data, len) == len;
+}
+
+
+static bool host_remove(void *ctx, outbox_file_t file)
+{
+    host_fs_t *h = (host_fs_t *)ctx;
+    return host_power(h) && remove(host_path(h, file)) == 0;
+}
+
+
+static bool host_rename(void *ctx, outbox_file_t from, outbox_file_t to)
+{
+    host_fs_t *h = (host_fs_t *)ctx;
+    if (!host_power(h)) return false;
+    char src[128];
+    snprintf(src, sizeof(src), "%s", host_path(h, from));
+    return rename(src, host_path(h, to)) == 0;
+}
+
+
+static host_fs_t host;
+static const outbox_store_fs_t host_fs = { &host, host_size, host_read, host_append, host_replace, host_remove, host_rename };
+
+
+/* empty directory, power on */
+static void host_reset(void)
+{
+    for (int f = 0; f < OUTBOX_FILE_COUNT; f++) remove(host_path(&host, (outbox_file_t)f));
+    host.ops = 0;
+    host.cut_at = -1;
+    host.cut = false;
+}
+
+
+/* power back on and boot */
+static void reboot(outbox_store_t *store, uint32_t max_bytes)
+{
+    host.cut = false;
+    host.cut_at = -1;
+    CHECK(outbox_store_open(store, &host_fs, max_bytes));
+}
+
+
+static void append(outbox_store_t *store, int count)
+{
+    outbox_record_t recs[16];
+    while (count > 0) {
+        int n = (count < 16) ? count : 16;
+        for (int i = 0; i < n; i++) {
+            memset(&recs[i], 0, sizeof(recs[i]));
+            recs[i].type = 1;
+            recs[i].face_id = (int16_t)(i - 1);
+            outbox_store_seal(store, &recs[i]);
+        }
+        outbox_store_append(store, recs, n);
+        count -= n;
+    }
+}
+
+
+/* sequence numbers of every pending record, all of them valid */
+static int pending_seqs(outbox_store_t *store, uint32_t *seqs, int max)
+{
+    outbox_record_t recs[64];
+    int n = outbox_store_read(store, recs, (max < 64) ? max : 64);
+    for (int i = 0; i < n; i++) {
+        CHECK(outbox_store_valid(&recs[i]));
+        seqs[i] = recs[i].seq;
+    }
+    return n;
+}
+
+
+/* pending records are first..last without gaps */
+static void check_pending(outbox_store_t *store, uint32_t first, uint32_t last)
+{
+    uint32_t seqs[64];
+    int n = pending_seqs(store, seqs, 64);
+    CHECK_EQ(n, last - first + 1);
+    for (int i = 0; i < n; i++) CHECK_EQ(seqs[i], first + i);
+}
+
+
+static void test_append_replay(void)
+{
+    outbox_store_t store;
+    host_reset();
+    reboot(&store, 64 * 1024);
+    append(&store, 40);
+    CHECK_EQ(outbox_store_pending(&store), 40);
+    check_pending(&store, 1, 40);
+    CHECK_EQ(outbox_store_ack(&store, 16), 16);
+    check_pending(&store, 17, 40);
+    // power cycle: the ack survives, numbering continues
+    reboot(&store, 64 * 1024);
+    check_pending(&store, 17, 40);
+    append(&store, 2);
+    check_pending(&store, 17, 42);
+    CHECK_EQ(outbox_store_ack(&store, 42), 26);
+    CHECK_EQ(outbox_store_pending(&store), 0);
+    reboot(&store, 64 * 1024);
+    outbox_store_stats_t st;
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(st.pending, 0);
+    CHECK_EQ(st.log_bytes, 0);
+    CHECK_EQ(st.acked_seq, 42);
+    CHECK_EQ(st.next_seq, 43);
+}
+
+
+static void test_size_cap(void)
+{
+    outbox_store_t store;
+    outbox_store_stats_t st;
+    host_reset();
+    reboot(&store, 10 * OUTBOX_RECORD_LEN);
+    append(&store, 8);
+    append(&store, 5);                           // 3 of the oldest make way
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(st.dropped, 3);
+    CHECK_EQ(st.log_bytes, 10 * OUTBOX_RECORD_LEN);
+    check_pending(&store, 4, 13);
+    // acknowledged records go before pending ones
+    CHECK_EQ(outbox_store_ack(&store, 5), 2);
+    append(&store, 2);
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(st.dropped, 3);
+    check_pending(&store, 6, 15);
+    reboot(&store, 10 * OUTBOX_RECORD_LEN);
+    check_pending(&store, 6, 15);
+}
+
+
+static void test_compaction(void)
+{
+    outbox_store_t store;
+    outbox_store_stats_t st;
+    host_reset();
+    reboot(&store, 40 * OUTBOX_RECORD_LEN);
+    append(&store, 30);
+    CHECK_EQ(outbox_store_ack(&store, 10), 10);  // below half of the cap: only the ack file
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(st.compactions, 0);
+    CHECK_EQ(st.log_bytes, 30 * OUTBOX_RECORD_LEN);
+    CHECK_EQ(outbox_store_ack(&store, 20), 10);
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(st.compactions, 1);
+    CHECK_EQ(st.log_bytes, 10 * OUTBOX_RECORD_LEN);
+    CHECK_EQ(host_size(&host, OUTBOX_FILE_LOG), 10 * OUTBOX_RECORD_LEN);
+    CHECK_EQ(host_size(&host, OUTBOX_FILE_TMP), -1);
+    check_pending(&store, 21, 30);
+    CHECK_EQ(outbox_store_ack(&store, 30), 10);  // all acknowledged: the log goes
+    CHECK_EQ(host_size(&host, OUTBOX_FILE_LOG), -1);
+    reboot(&store, 40 * OUTBOX_RECORD_LEN);
+    CHECK_EQ(outbox_store_pending(&store), 0);
+    append(&store, 1);
+    check_pending(&store, 31, 31);
+}
+
+
+static void test_torn_tail(void)
+{
+    outbox_store_t store;
+    outbox_store_stats_t st;
+    host_reset();
+    reboot(&store, 64 * 1024);
+    append(&store, 5);
+    FILE *f = fopen(host_path(&host, OUTBOX_FILE_LOG), "ab");
+    fwrite("0123456789", 1, 10, f);              // a record the power cut tore
+    fclose(f);
+    reboot(&store, 64 * 1024);
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(st.torn_bytes, 10);
+    CHECK_EQ(host_size(&host, OUTBOX_FILE_LOG), 5 * OUTBOX_RECORD_LEN);
+    append(&store, 3);                           // aligned behind the cut
+    check_pending(&store, 1, 8);
+    reboot(&store, 64 * 1024);
+    check_pending(&store, 1, 8);
+}
+
+
+/* a power cut before every file operation of an acknowledgement with compaction: after the
+   reboot no unacknowledged record is missing, and once the ack file is written no acknowledged
+   one comes back */
+static void test_power_cut_compaction(void)
+{
+    outbox_store_t store;
+    bool recovered = false, finished = false;
+    for (int cut = 0; !finished; cut++) {
+        host_reset();
+        reboot(&store, 40 * OUTBOX_RECORD_LEN);
+        append(&store, 30);
+        host.ops = 0;
+        host.cut_at = cut;
+        outbox_store_ack(&store, 25);
+        finished = !host.cut;
+        reboot(&store, 40 * OUTBOX_RECORD_LEN);
+        outbox_store_stats_t st;
+        outbox_store_get_stats(&store, &st);
+        recovered |= st.recovered;
+        CHECK_EQ(host_size(&host, OUTBOX_FILE_TMP), -1);
+        uint32_t first = (cut == 0) ? 1 : 26;    // the ack file is the first write
+        check_pending(&store, first, 30);
+        append(&store, 1);
+        check_pending(&store, first, 31);
+    }
+    CHECK(recovered);
+}
+
+
+/* the same for the append that makes room under the cap */
+static void test_power_cut_append(void)
+{
+    outbox_store_t store;
+    bool finished = false;
+    for (int cut = 0; !finished; cut++) {
+        host_reset();
+        reboot(&store, 10 * OUTBOX_RECORD_LEN);
+        append(&store, 8);
+        host.ops = 0;
+        host.cut_at = cut;
+        append(&store, 4);                       // drops 2, writes the ack, compacts, appends
+        finished = !host.cut;
+        reboot(&store, 10 * OUTBOX_RECORD_LEN);
+        uint32_t seqs[64] = { 0 };
+        int n = pending_seqs(&store, seqs, 64);
+        // the old records survive up to the two dropped ones; new ones land in whole records up to the cut
+        CHECK(n >= 6);
+        CHECK(seqs[0] == 1 || seqs[0] == 3);
+        for (int i = 1; i < n; i++) CHECK_EQ(seqs[i], seqs[i - 1] + 1);
+        CHECK(seqs[n - 1] >= 8 && seqs[n - 1] <= 12);
+        append(&store, 1);
+        uint32_t next[64] = { 0 };
+        int m = pending_seqs(&store, next, 64);
+        CHECK(next[m - 1] > seqs[n - 1]);
+    }
+}
+
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* a long outage and the catch-up: replay throughput, log size and write amplification */
+static void measure(void)
+{
+    outbox_store_t store;
+    outbox_store_stats_t st;
+    host_reset();
+    reboot(&store, 64 * 1024);
+    append(&store, 2000);                        // 16 per flush, like OUTBOX_WRITE_BATCH
+    outbox_store_get_stats(&store, &st);
+    uint32_t log_bytes = st.log_bytes;
+    outbox_record_t batch[16];
+    int replayed = 0, n;
+    double t0 = now_s();
+    while ((n = outbox_store_read(&store, batch, 16)) > 0) {
+        replayed += outbox_store_ack(&store, batch[n - 1].seq);
+    }
+    double dt = now_s() - t0;
+    outbox_store_get_stats(&store, &st);
+    CHECK_EQ(replayed, 2000);
+    CHECK_EQ(st.pending, 0);
+    printf("outbox_store: %d records replayed in %.1f ms (%.0f records/s), log %u bytes, "
+           "%u compactions, write amplification %.2f\n",
+           replayed, dt * 1000, replayed / dt, log_bytes, st.compactions,
+           (double)st.flash_bytes / st.record_bytes);
+}
+
+
+int main(void)
+{
+    snprintf(host.dir, sizeof(host.dir), "/tmp/outbox_store_XXXXXX");
+    if (!mkdtemp(host.dir)) return 1;
+    test_append_replay();
+    test_size_cap();
+    test_compaction();
+    test_torn_tail();
+    test_power_cut_compaction();
+    test_power_cut_append();
+    measure();
+    host_reset();
+    rmdir(host.dir);
+    return HOST_TEST_DONE("outbox_store");
+}
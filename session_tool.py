@@ -0,0 +1,92 @@
+# inspects ESP32 session recordings (session.cpp) and compares replay results across firmware builds
+#   curl -o session.bin "http://<esp32>:81/session?action=download"
+#   python3 session_tool.py info session.bin
+#   python3 session_tool.py frames session.bin out_dir
+#   curl -o a.ndjson "http://<esp32>:81/session?action=results"    (once per firmware build)
+#   python3 session_tool.py diff a.ndjson b.ndjson
+import json
+import os
+import struct
+import sys
+
+MAGIC = b"SES1"
+RECORD = struct.Struct("<IIBBHHH")
+TYPES = ["state", "frame", "pir", "control"]
+STAGES = ["ready_us", "detect_us", "recognize_us", "encode_us", "process_us"]
+
+def records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != MAGIC:
+        raise ValueError("not a session recording")
+    pos = 4
+    while pos + RECORD.size <= len(data):
+        t_us, length, kind, _, width, height, _ = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        yield t_us, TYPES[kind] if kind < len(TYPES) else str(kind), width, height, data[pos:pos + length]
+        pos += length
+
+def info(path):
+    frames = 0
+    jpeg_bytes = 0
+    last = 0
+    for t_us, kind, width, height, payload in records(path):
+        last = t_us
+        if kind == "frame":
+            frames += 1
+            jpeg_bytes += len(payload)
+        elif kind == "state":
+            print("%9.3fs state detect_gui=%d recognize_gui=%d detect_pir=%d recognize_pir=%d enroll=%d" % ((t_us / 1e6,) + tuple(payload[:5])))
+        else:
+            print("%9.3fs %s %s" % (t_us / 1e6, kind, payload.decode(errors="replace")))
+    seconds = last / 1e6
+    print("%d frames over %.1fs (%.1f fps), %.1f KB of JPEG" % (frames, seconds, frames / seconds if seconds else 0, jpeg_bytes / 1024))
+
+def frames(path, out_dir):
+    os.makedirs(out_dir, exist_ok=True)
+    n = 0
+    for t_us, kind, _, _, payload in records(path):
+        if kind == "frame":
+            n += 1
+            with open(os.path.join(out_dir, "%05d_%010d.jpg" % (n, t_us)), "wb") as f:
+                f.write(payload)
+    print("%d frames written to %s" % (n, out_dir))
+
+def load(path):
+    with open(path) as f:
+        return [json.loads(line) for line in f if line.strip()]
+
+def summary(rows):
+    events = [(r["event"], r.get("episode", r.get("id", ""))) for r in rows if "event" in r and r["event"] != "replay_end"]
+    timing = {}
+    for stage in STAGES:
+        values = [r[stage] for r in rows if "frame" in r and r.get(stage)]
+        timing[stage] = sum(values) / len(values) if values else 0
+    return events, timing, sum(1 for r in rows if "frame" in r)
+
+def diff(path_a, path_b):
+    events_a, timing_a, frames_a = summary(load(path_a))
+    events_b, timing_b, frames_b = summary(load(path_b))
+    print("frames: %d vs %d" % (frames_a, frames_b))
+    print("%-14s %12s %12s %8s" % ("stage", "mean a us", "mean b us", "change"))
+    for stage in STAGES:
+        a, b = timing_a[stage], timing_b[stage]
+        print("%-14s %12.0f %12.0f %7.1f%%" % (stage, a, b, (b - a) * 100 / a if a else 0))
+    if events_a == events_b:
+        print("event streams identical (%d events)" % len(events_a))
+        return 0
+    for i, (a, b) in enumerate(zip(events_a + [None] * len(events_b), events_b + [None] * len(events_a))):
+        if a != b:
+            print("event streams differ at #%d: %s vs %s" % (i, a, b))
+            break
+    return 1
+
+if __name__ == "__main__":
+    if len(sys.argv) >= 3 and sys.argv[1] == "info":
+        info(sys.argv[2])
+    elif len(sys.argv) >= 4 and sys.argv[1] == "frames":
+        frames(sys.argv[2], sys.argv[3])
+    elif len(sys.argv) >= 4 and sys.argv[1] == "diff":
+        sys.exit(diff(sys.argv[2], sys.argv[3]))
+    else:
+        sys.exit("usage: session_tool.py info <session.bin> | frames <session.bin> <dir> | diff <a.ndjson> <b.ndjson>")
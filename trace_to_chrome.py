@@ -0,0 +1,99 @@
+# converts a /trace download from the ESP32 (trace.cpp) into Chrome trace_event JSON,
+# open the result in chrome://tracing or https://ui.perfetto.dev
+#   curl -o trace.bin http://<esp32>/trace
+#   python3 trace_to_chrome.py trace.bin trace.json
+import json
+import struct
+import sys
+
+# same order as trace_point_t in trace.h
+POINTS = ["sync", "capture", "convert", "detect", "recognize", "encode", "stream_send",
+          "db_post", "pir_isr", "queue_send", "alert", "face_state"]
+TRACE_SYNC = 0
+TASK_ISR = 0xFF
+NAME_LEN = 16
+EVENT = struct.Struct("<IIBBBB")
+
+def parse(data):
+    if data[:4] != b"TRC1":
+        raise ValueError("not a trace dump")
+    cpu_hz, cores, per_core, ntasks, event_size = struct.unpack_from("<IHHHH", data, 4)
+    pos = 16
+    tasks = []
+    for _ in range(ntasks):
+        tasks.append(data[pos:pos + NAME_LEN].split(b"\0")[0].decode(errors="replace"))
+        pos += NAME_LEN
+    rings = []
+    for _ in range(cores):
+        head, = struct.unpack_from("<I", data, pos)
+        pos += 4
+        slots = [EVENT.unpack_from(data, pos + i * event_size) for i in range(per_core)]
+        pos += per_core * event_size
+        # oldest first: the ring only holds the last per_core events
+        if head <= per_core:
+            rings.append(slots[:head])
+        else:
+            start = head % per_core
+            rings.append(slots[start:] + slots[:start])
+    return cpu_hz, tasks, rings
+
+# cycle counters are per core and 32 bit: place every event relative to the nearest sync anchor
+def to_us(events, cpu_hz):
+    syncs = []
+    epoch = 0
+    last = None
+    for i, (cycles, arg, point, _, _, _) in enumerate(events):
+        if point != TRACE_SYNC:
+            continue
+        if last is not None and arg < last:
+            epoch += 1 << 32          # esp_timer microseconds truncated to 32 bit
+        last = arg
+        syncs.append((i, cycles, arg + epoch))
+    if not syncs:
+        return None
+    mhz = cpu_hz / 1e6
+    out = []
+    k = 0
+    for i, (cycles, *_rest) in enumerate(events):
+        while k + 1 < len(syncs) and syncs[k + 1][0] <= i:
+            k += 1
+        _, sync_cycles, sync_us = syncs[k]
+        if i >= syncs[k][0]:
+            out.append(sync_us + ((cycles - sync_cycles) & 0xFFFFFFFF) / mhz)
+        else:
+            out.append(sync_us - ((sync_cycles - cycles) & 0xFFFFFFFF) / mhz)
+    return out
+
+def convert(data):
+    cpu_hz, tasks, rings = parse(data)
+    trace = []
+    used = set()
+    for core, events in enumerate(rings):
+        stamps = to_us(events, cpu_hz)
+        if stamps is None:
+            if events:
+                print("core %d: no sync anchor in the ring, skipped" % core, file=sys.stderr)
+            continue
+        trace.append({"name": "process_name", "ph": "M", "pid": core, "args": {"name": "core %d" % core}})
+        for (cycles, arg, point, phase, task, _), ts in zip(events, stamps):
+            if point == TRACE_SYNC:
+                continue
+            name = POINTS[point] if point < len(POINTS) else "point_%d" % point
+            event = {"name": name, "ph": chr(phase), "ts": round(ts, 3), "pid": core, "tid": task}
+            if chr(phase) == "i":
+                event["s"] = "t"
+                event["args"] = {"arg": arg}
+            trace.append(event)
+            used.add((core, task))
+    for core, task in sorted(used):
+        name = "isr" if task == TASK_ISR else (tasks[task] if task < len(tasks) else "task %d" % task)
+        trace.append({"name": "thread_name", "ph": "M", "pid": core, "tid": task, "args": {"name": name}})
+    return {"traceEvents": trace, "displayTimeUnit": "ms"}
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: trace_to_chrome.py trace.bin [trace.json]")
+    with open(sys.argv[1], "rb") as f:
+        result = convert(f.read())
+    out = open(sys.argv[2], "w") if len(sys.argv) > 2 else sys.stdout
+    json.dump(result, out)